@@ -0,0 +1,526 @@
+/**
+ * @file
+ * @brief This file implements a load generator for the storage server.
+ *
+ * The benchmark runs a number of client threads, each with its own
+ * connection made through the client library, for a fixed time, or
+ * sharing a pool of connections checked out for every call, optionally
+ * with the client read cache on. Every
+ * thread issues a random mix of GET, SET and QUERY commands on keys drawn
+ * from a uniform or zipfian distribution, and times each call. At the end
+ * the operations per second and the latency percentiles of every command
+ * are printed.
+ *
+ * The table must have an int column; keys are "k0" to "k<keys - 1>" and
+ * the value of key "k<i>" is i until a SET changes it.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include "storage.h"
+
+#define BENCH_MAX_KEYS_PER_QUERY 10	///< Keys requested by every QUERY.
+
+/**
+ * @brief Operations issued by the benchmark.
+ */
+enum bench_op {
+	OP_GET,
+	OP_SET,
+	OP_QUERY,
+	NUM_OPS
+};
+
+static const char *opNames[NUM_OPS] = { "GET", "SET", "QUERY" };
+
+/**
+ * @brief Settings of a run, from the command line.
+ */
+typedef struct {
+	char host[MAX_HOST_LEN];
+	int port;
+	char username[MAX_USERNAME_LEN];
+	char password[MAX_ENC_PASSWORD_LEN];
+	char table[MAX_TABLE_LEN];
+	char column[MAX_COLNAME_LEN];
+	// Client threads, each with its own connection
+	int threads;
+	// Length of the measured run in seconds
+	int seconds;
+	// Number of distinct keys
+	long keys;
+	// Relative weights of GET, SET and QUERY
+	int ratio[NUM_OPS];
+	// Zipfian skew, 0 for uniform keys
+	double theta;
+	// True to SET every key before the run
+	bool load;
+	// Connections in a pool shared by the threads, 0 for one connection per thread
+	int poolSize;
+	// Records in the client read cache, 0 to leave it off
+	int cacheEntries;
+	// Milliseconds a cached record is used without revalidating it
+	int cacheTtl;
+} bench_config;
+
+/**
+ * @brief Latencies of one operation type, in nanoseconds.
+ */
+typedef struct {
+	uint64_t *ns;
+	size_t count;
+	size_t cap;
+	// Calls that returned an error
+	uint64_t errors;
+} latency_log;
+
+/**
+ * @brief State of one client thread.
+ */
+typedef struct {
+	int id;
+	pthread_t thread;
+	// Random number generator state
+	uint64_t rng;
+	latency_log log[NUM_OPS];
+	// False if the thread could not connect or authenticate
+	bool ok;
+} bench_thread;
+
+static bench_config config;
+
+// The shared pool if poolSize is set
+static void *pool = NULL;
+
+// Constants of the zipfian generator, shared by every thread
+static double zipfZetaN, zipfAlpha, zipfEta;
+
+// Set once all threads are connected, and when the run is over
+static volatile int started = 0;
+static volatile int stopped = 0;
+
+
+/**
+ * @brief Function to read the monotonic clock.
+ * @return Returns nanoseconds since an arbitrary start
+ */
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/**
+ * @brief Function to draw a random number, xorshift64*.
+ * @param state The generator state, never 0
+ * @return Returns 64 random bits
+ */
+static uint64_t next_random(uint64_t *state)
+{
+	uint64_t x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 2685821657736338717ULL;
+}
+
+
+/**
+ * @brief Function to draw a uniform random number in [0, 1).
+ */
+static double next_double(uint64_t *state)
+{
+	return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+/**
+ * @brief Function to precompute the zipfian constants for config.keys and config.theta.
+ *
+ * The generator is the one of Gray et al., "Quickly Generating
+ * Billion-Record Synthetic Databases", which needs zeta(n, theta) once.
+ */
+static void zipf_init()
+{
+	long i;
+	double zeta2 = 1.0 + pow(0.5, config.theta);
+	zipfZetaN = 0;
+	for (i = 1; i <= config.keys; i++)
+		zipfZetaN += 1.0 / pow((double)i, config.theta);
+	zipfAlpha = 1.0 / (1.0 - config.theta);
+	zipfEta = (1.0 - pow(2.0 / config.keys, 1.0 - config.theta)) / (1.0 - zeta2 / zipfZetaN);
+}
+
+
+/**
+ * @brief Function to draw a key index.
+ * @param state The generator state
+ * @return Returns an index in [0, config.keys), index 0 the most popular for zipfian keys
+ */
+static long next_key(uint64_t *state)
+{
+	if (config.theta == 0)
+		return (long)(next_random(state) % (uint64_t)config.keys);
+	double u = next_double(state);
+	double uz = u * zipfZetaN;
+	if (uz < 1.0)
+		return 0;
+	if (uz < 1.0 + pow(0.5, config.theta))
+		return 1;
+	long k = (long)(config.keys * pow(zipfEta * u - zipfEta + 1.0, zipfAlpha));
+	return (k < config.keys) ? k : config.keys - 1;
+}
+
+
+/**
+ * @brief Function to add a latency to a log.
+ * @param log The log
+ * @param ns The latency
+ * @return Returns void
+ */
+static void log_latency(latency_log *log, uint64_t ns)
+{
+	if (log->count == log->cap) {
+		size_t newCap = (log->cap == 0) ? 4096 : log->cap * 2;
+		uint64_t *grown = realloc(log->ns, newCap * sizeof(uint64_t));
+		if (grown == NULL) {
+			printf("Out of memory logging latencies.\n");
+			exit(EXIT_FAILURE);
+		}
+		log->ns = grown;
+		log->cap = newCap;
+	}
+	log->ns[log->count++] = ns;
+}
+
+
+/**
+ * @brief Function to open an authenticated connection.
+ * @return Returns the connection, or NULL after printing why it failed
+ */
+static void* bench_connect()
+{
+	void *conn = storage_connect(config.host, config.port);
+	if (conn == NULL) {
+		printf("Cannot connect to %s:%d. Error code: %d.\n", config.host, config.port, errno);
+		return NULL;
+	}
+	if (storage_auth(config.username, config.password, conn) != 0) {
+		printf("Cannot authenticate as %s. Error code: %d.\n", config.username, errno);
+		storage_disconnect(conn);
+		return NULL;
+	}
+	return conn;
+}
+
+
+/**
+ * @brief Function to run one client thread until the run is over.
+ * @param arg The bench_thread of the thread
+ * @return Returns NULL
+ */
+static void* bench_worker(void *arg)
+{
+	bench_thread *self = arg;
+	void *conn = (pool != NULL) ? NULL : bench_connect();
+	self->ok = (pool != NULL || conn != NULL);
+	if (!self->ok)
+		return NULL;
+
+	struct storage_record r;
+	char key[24];	// "k" and any long
+	char predicate[MAX_COLNAME_LEN + 32];
+	char keyBuf[BENCH_MAX_KEYS_PER_QUERY][MAX_KEY_LEN];
+	char *keys[BENCH_MAX_KEYS_PER_QUERY];
+	int i, total = config.ratio[OP_GET] + config.ratio[OP_SET] + config.ratio[OP_QUERY];
+	for (i = 0; i < BENCH_MAX_KEYS_PER_QUERY; i++)
+		keys[i] = keyBuf[i];
+
+	while (!started)
+		usleep(1000);
+
+	while (!stopped) {
+		int pick = (int)(next_random(&self->rng) % (uint64_t)total);
+		enum bench_op op = (pick < config.ratio[OP_GET]) ? OP_GET :
+			(pick < config.ratio[OP_GET] + config.ratio[OP_SET]) ? OP_SET : OP_QUERY;
+		long k = next_key(&self->rng);
+		int status;
+		uint64_t start = now_ns();
+		// Waiting for a pooled connection counts in the latency
+		if (pool != NULL && (conn = storage_pool_checkout(pool)) == NULL) {
+			self->log[op].errors++;
+			continue;
+		}
+		switch (op) {
+		case OP_GET:
+			snprintf(key, sizeof key, "k%ld", k);
+			status = storage_get(config.table, key, &r, conn);
+			break;
+		case OP_SET:
+			snprintf(key, sizeof key, "k%ld", k);
+			memset(&r, 0, sizeof r);
+			snprintf(r.value, sizeof r.value, "%s %ld", config.column,
+				(long)(next_random(&self->rng) % (uint64_t)config.keys));
+			status = storage_set(config.table, key, &r, conn);
+			break;
+		default:
+			// Values are key indexes, so an equality matches about one record
+			snprintf(predicate, sizeof predicate, "%s = %ld", config.column, k);
+			status = storage_query(config.table, predicate, keys, BENCH_MAX_KEYS_PER_QUERY, conn);
+			break;
+		}
+		uint64_t ns = now_ns() - start;
+		if (pool != NULL)
+			storage_pool_checkin(pool, conn);
+		if (stopped)
+			break;
+		log_latency(&self->log[op], ns);
+		// A GET of a key that is not loaded is a valid answer
+		if (status == -1 && !(op == OP_GET && errno == ERR_KEY_NOT_FOUND))
+			self->log[op].errors++;
+	}
+	if (pool == NULL)
+		storage_disconnect(conn);
+	return NULL;
+}
+
+
+/**
+ * @brief Function to SET every key of the run once.
+ * @return Returns 0 on success, -1 otherwise
+ */
+static int bench_load()
+{
+	void *conn = bench_connect();
+	if (conn == NULL)
+		return -1;
+	struct storage_record r;
+	char key[24];	// "k" and any long
+	long k;
+	for (k = 0; k < config.keys; k++) {
+		snprintf(key, sizeof key, "k%ld", k);
+		memset(&r, 0, sizeof r);
+		snprintf(r.value, sizeof r.value, "%s %ld", config.column, k);
+		if (storage_set(config.table, key, &r, conn) != 0) {
+			printf("Loading key %s failed. Error code: %d.\n", key, errno);
+			storage_disconnect(conn);
+			return -1;
+		}
+	}
+	storage_disconnect(conn);
+	return 0;
+}
+
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+
+/**
+ * @brief Function to find a percentile in sorted latencies.
+ */
+static uint64_t percentile(const uint64_t *sorted, size_t count, double q)
+{
+	if (count == 0)
+		return 0;
+	size_t rank = (size_t)ceil(q * count);
+	return sorted[(rank == 0) ? 0 : rank - 1];
+}
+
+
+/**
+ * @brief Function to parse a GET:SET:QUERY ratio like "80:15:5".
+ * @return Returns 0 on success, -1 otherwise
+ */
+static int parse_ratio(const char *s)
+{
+	if (sscanf(s, "%d:%d:%d", &config.ratio[OP_GET], &config.ratio[OP_SET], &config.ratio[OP_QUERY]) != 3)
+		return -1;
+	if (config.ratio[OP_GET] < 0 || config.ratio[OP_SET] < 0 || config.ratio[OP_QUERY] < 0)
+		return -1;
+	return (config.ratio[OP_GET] + config.ratio[OP_SET] + config.ratio[OP_QUERY] > 0) ? 0 : -1;
+}
+
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [options]\n"
+		"  -H host        server host, or the path of its Unix socket (localhost)\n"
+		"  -P port        server port (6499)\n"
+		"  -u user        username (admin)\n"
+		"  -w password    plain text password (dog4sale)\n"
+		"  -T table       table with an int column (inttbl)\n"
+		"  -C column      the int column (col)\n"
+		"  -t threads     client threads, one connection each (4)\n"
+		"  -o conns       share a pool of conns connections among the threads instead\n"
+		"  -c entries     turn the client read cache on with room for entries records\n"
+		"  -e ms          milliseconds a cached record is used before revalidating it (100)\n"
+		"  -d seconds     length of the run (10)\n"
+		"  -k keys        distinct keys (10000)\n"
+		"  -r g:s:q       GET:SET:QUERY ratio (80:15:5)\n"
+		"  -z theta       zipfian skew, 0 for uniform keys (0)\n"
+		"  -l             SET every key before the run\n", prog);
+}
+
+
+int main(int argc, char *argv[])
+{
+	snprintf(config.host, sizeof config.host, "localhost");
+	config.port = 6499;
+	snprintf(config.username, sizeof config.username, "admin");
+	snprintf(config.password, sizeof config.password, "dog4sale");
+	snprintf(config.table, sizeof config.table, "inttbl");
+	snprintf(config.column, sizeof config.column, "col");
+	config.threads = 4;
+	config.seconds = 10;
+	config.keys = 10000;
+	config.ratio[OP_GET] = 80;
+	config.ratio[OP_SET] = 15;
+	config.ratio[OP_QUERY] = 5;
+	config.theta = 0;
+	config.load = false;
+	config.poolSize = 0;
+	config.cacheEntries = 0;
+	config.cacheTtl = 100;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "H:P:u:w:T:C:t:o:c:e:d:k:r:z:l")) != -1) {
+		switch (opt) {
+		case 'H': snprintf(config.host, sizeof config.host, "%s", optarg); break;
+		case 'P': config.port = atoi(optarg); break;
+		case 'u': snprintf(config.username, sizeof config.username, "%s", optarg); break;
+		case 'w': snprintf(config.password, sizeof config.password, "%s", optarg); break;
+		case 'T': snprintf(config.table, sizeof config.table, "%s", optarg); break;
+		case 'C': snprintf(config.column, sizeof config.column, "%s", optarg); break;
+		case 't': config.threads = atoi(optarg); break;
+		case 'o': config.poolSize = atoi(optarg); break;
+		case 'c': config.cacheEntries = atoi(optarg); break;
+		case 'e': config.cacheTtl = atoi(optarg); break;
+		case 'd': config.seconds = atoi(optarg); break;
+		case 'k': config.keys = atol(optarg); break;
+		case 'r':
+			if (parse_ratio(optarg) != 0) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'z': config.theta = atof(optarg); break;
+		case 'l': config.load = true; break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	// theta 1 divides by zero in the generator
+	if (config.threads < 1 || config.seconds < 1 || config.keys < 2 || config.poolSize < 0 ||
+			config.cacheEntries < 0 || config.cacheTtl < 0 ||
+			config.theta < 0 || config.theta >= 1) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (config.theta > 0)
+		zipf_init();
+
+	if (config.load) {
+		printf("Loading %ld keys into %s...\n", config.keys, config.table);
+		if (bench_load() != 0)
+			return EXIT_FAILURE;
+	}
+
+	if (config.cacheEntries > 0 && storage_cache_config(config.cacheEntries, config.cacheTtl) != 0) {
+		printf("Cannot allocate a read cache of %d records.\n", config.cacheEntries);
+		return EXIT_FAILURE;
+	}
+
+	if (config.poolSize > 0) {
+		pool = storage_pool_create(config.host, config.port, config.username, config.password, config.poolSize);
+		if (pool == NULL) {
+			printf("Cannot create a pool of %d connections to %s:%d. Error code: %d.\n",
+				config.poolSize, config.host, config.port, errno);
+			return EXIT_FAILURE;
+		}
+	}
+
+	bench_thread *threads = calloc(config.threads, sizeof(bench_thread));
+	if (threads == NULL) {
+		printf("Out of memory starting threads.\n");
+		return EXIT_FAILURE;
+	}
+	int i, op;
+	for (i = 0; i < config.threads; i++) {
+		threads[i].id = i;
+		threads[i].rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+		if (pthread_create(&threads[i].thread, NULL, bench_worker, &threads[i]) != 0) {
+			printf("Error creating a client thread.\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	uint64_t start = now_ns();
+	started = 1;
+	sleep(config.seconds);
+	stopped = 1;
+	uint64_t elapsed = now_ns() - start;
+	for (i = 0; i < config.threads; i++)
+		pthread_join(threads[i].thread, NULL);
+
+	// Merge the logs of every thread
+	int connected = 0;
+	uint64_t totalOps = 0;
+	latency_log merged[NUM_OPS];
+	memset(merged, 0, sizeof merged);
+	for (i = 0; i < config.threads; i++) {
+		if (threads[i].ok)
+			connected++;
+		for (op = 0; op < NUM_OPS; op++) {
+			latency_log *log = &threads[i].log[op];
+			size_t j;
+			for (j = 0; j < log->count; j++)
+				log_latency(&merged[op], log->ns[j]);
+			merged[op].errors += log->errors;
+			free(log->ns);
+		}
+	}
+	free(threads);
+	if (pool != NULL)
+		storage_pool_destroy(pool);
+	if (connected == 0)
+		return EXIT_FAILURE;
+
+	if (config.poolSize > 0)
+		printf("pool %d, ", config.poolSize);
+	printf("threads %d, keys %ld (%s", connected, config.keys, (config.theta > 0) ? "zipfian" : "uniform");
+	if (config.theta > 0)
+		printf(" theta %.2f", config.theta);
+	printf("), GET:SET:QUERY %d:%d:%d, %.1f s\n", config.ratio[OP_GET], config.ratio[OP_SET],
+		config.ratio[OP_QUERY], elapsed / 1e9);
+	printf("%-6s %10s %12s %8s %10s %10s %10s %10s\n", "op", "count", "ops/sec", "errors",
+		"p50 us", "p99 us", "p999 us", "max us");
+	for (op = 0; op < NUM_OPS; op++) {
+		latency_log *log = &merged[op];
+		qsort(log->ns, log->count, sizeof(uint64_t), compare_u64);
+		totalOps += log->count;
+		printf("%-6s %10zu %12.0f %8llu %10.1f %10.1f %10.1f %10.1f\n", opNames[op], log->count,
+			log->count / (elapsed / 1e9), (unsigned long long)log->errors,
+			percentile(log->ns, log->count, 0.50) / 1e3, percentile(log->ns, log->count, 0.99) / 1e3,
+			percentile(log->ns, log->count, 0.999) / 1e3,
+			(log->count > 0) ? log->ns[log->count - 1] / 1e3 : 0.0);
+		free(log->ns);
+	}
+	printf("%-6s %10llu %12.0f\n", "total", (unsigned long long)totalOps, totalOps / (elapsed / 1e9));
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,201 @@
+/**
+ * @file
+ * @brief This file implements the command tokenizer declared in command.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "command.h"
+#include "utils.h"
+
+
+/**
+ * @brief Function to append a field to a line, growing the slots if they are full.
+ * @param line The line
+ * @param ptr Start of the field
+ * @param len Length of the field
+ * @return Returns void
+ */
+static void add_field(cmd_line *line, char *ptr, size_t len)
+{
+	if (line->numFields == line->fieldCap) {
+		int newCap = (line->fieldCap == 0) ? CMD_INIT_FIELDS : line->fieldCap * 2;
+		cmd_slice *grown = realloc(line->fields, newCap * sizeof(cmd_slice));
+		if (grown == NULL)
+			die("Out of memory parsing a command.", EXIT_FAILURE);
+		line->fields = grown;
+		line->fieldCap = newCap;
+	}
+	line->fields[line->numFields].ptr = ptr;
+	line->fields[line->numFields].len = len;
+	line->numFields++;
+}
+
+
+int cmd_parse(char *line, cmd_line *out)
+{
+	out->numFields = 0;
+	char *p = line;
+	for (;;) {
+		char *start = p;
+		while (*p != '\0' && *p != ',')
+			p++;
+		char *end = p;
+		int last = (*p == '\0');
+		while (start < end && isspace((unsigned char)*start))
+			start++;
+		while (end > start && isspace((unsigned char)end[-1]))
+			end--;
+		// A field of blanks only is skipped like an empty one
+		if (end > start) {
+			*end = '\0';
+			add_field(out, start, end - start);
+		}
+		if (last)
+			break;
+		p++;
+	}
+
+	if (out->numFields == 0) {
+		out->verb.ptr = line;
+		out->verb.len = 0;
+		return 0;
+	}
+	out->verb = out->fields[0];
+	char *space = memchr(out->verb.ptr, ' ', out->verb.len);
+	if (space != NULL)
+		out->verb.len = space - out->verb.ptr;
+	return out->numFields;
+}
+
+
+int cmd_equals(cmd_slice s, const char *str)
+{
+	return strncmp(s.ptr, str, s.len) == 0 && str[s.len] == '\0';
+}
+
+
+void cmd_split(cmd_slice field, cmd_slice *head, cmd_slice *tail)
+{
+	char *space = memchr(field.ptr, ' ', field.len);
+	if (space == NULL) {
+		*head = field;
+		tail->ptr = field.ptr + field.len;
+		tail->len = 0;
+		return;
+	}
+	*space = '\0';
+	head->ptr = field.ptr;
+	head->len = space - field.ptr;
+	char *rest = space + 1;
+	char *end = field.ptr + field.len;
+	while (rest < end && isspace((unsigned char)*rest))
+		rest++;
+	tail->ptr = rest;
+	tail->len = end - rest;
+}
+
+
+void cmd_free(cmd_line *line)
+{
+	free(line->fields);
+	line->fields = NULL;
+	line->numFields = line->fieldCap = 0;
+}
+
+
+/**
+ * @brief Function to find the newline ending the next line in the receive buffer.
+ * @param r The receive buffer
+ * @return Returns the newline, NULL if the line is not complete yet
+ */
+static char* find_newline(cmd_reader *r)
+{
+	if (r->end == r->start)
+		return NULL;
+	char *from = r->buf + r->start + r->scanned;
+	char *nl = memchr(from, '\n', r->end - r->start - r->scanned);
+	if (nl == NULL)
+		r->scanned = r->end - r->start;
+	return nl;
+}
+
+
+int cmd_reader_line(cmd_reader *r, char **line, size_t *len)
+{
+	char *nl = find_newline(r);
+	if (nl == NULL)
+		return 0;
+	*nl = '\0';
+	*line = r->buf + r->start;
+	*len = nl - *line;
+	r->start = nl + 1 - r->buf;
+	r->scanned = 0;
+	return 1;
+}
+
+
+int cmd_reader_ready(cmd_reader *r)
+{
+	return find_newline(r) != NULL;
+}
+
+
+char* cmd_reader_space(cmd_reader *r, size_t maxlen, size_t *room)
+{
+	size_t pending = r->end - r->start;
+	if (maxlen > 0 && pending >= maxlen)
+		return NULL;
+	// Keep the pending partial line, moved to the front
+	if (r->start > 0) {
+		memmove(r->buf, r->buf + r->start, pending);
+		r->start = 0;
+		r->end = pending;
+	}
+	if (r->end == r->cap) {
+		size_t newCap = (r->cap == 0) ? CMD_INIT_READ : r->cap * 2;
+		char *grown = realloc(r->buf, newCap);
+		if (grown == NULL)
+			return NULL;
+		r->buf = grown;
+		r->cap = newCap;
+	}
+	*room = r->cap - r->end;
+	return r->buf + r->end;
+}
+
+
+void cmd_reader_add(cmd_reader *r, size_t len)
+{
+	r->end += len;
+}
+
+
+int cmd_reader_fill(cmd_reader *r, int sock, size_t maxlen)
+{
+	size_t room;
+	char *space = cmd_reader_space(r, maxlen, &room);
+	if (space == NULL)
+		return -1;
+
+	ssize_t bytes;
+	do {
+		bytes = recv(sock, space, room, 0);
+	} while (bytes < 0 && errno == EINTR);
+	if (bytes <= 0)
+		return -1;
+	cmd_reader_add(r, bytes);
+	return 0;
+}
+
+
+void cmd_reader_free(cmd_reader *r)
+{
+	free(r->buf);
+	r->buf = NULL;
+	r->cap = r->start = r->end = r->scanned = 0;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file
+ * @brief This file declares the tokenizer of the command lines received by the server.
+ *
+ * A command line is split once, in place: every comma separated field is
+ * trimmed and NUL terminated inside the receive buffer, and the fields
+ * are returned as slices pointing into it.  Nothing is copied, so the
+ * slices stay valid until the next line is read into the buffer.
+ */
+
+#ifndef	COMMAND_H
+#define COMMAND_H
+
+#include <stddef.h>
+
+#define CMD_INIT_FIELDS 16	///< Initial field slots of a cmd_line, doubled when full.
+#define CMD_INIT_READ 8192	///< Initial size of a receive buffer, doubled for longer lines.
+
+/**
+ * @brief A piece of the receive buffer.
+ */
+typedef struct {
+	char *ptr;
+	size_t len;
+} cmd_slice;
+
+/**
+ * @brief A command line split into fields. Reused from one line to the next.
+ */
+typedef struct {
+	// The verb: the first field up to its first space, not NUL terminated if a space follows
+	cmd_slice verb;
+	// The fields, the one holding the verb first. Empty and blank fields are skipped like strtok() does.
+	cmd_slice *fields;
+	int numFields;
+	// Number of slots allocated in fields
+	int fieldCap;
+} cmd_line;
+
+/**
+ * @brief The receive buffer of a connection. Lines are read in bulk and handed out in place.
+ */
+typedef struct {
+	char *buf;
+	// Size of buf
+	size_t cap;
+	// Received bytes not handed out yet are buf[start] to buf[end - 1]
+	size_t start;
+	size_t end;
+	// Bytes after start already known not to hold a newline
+	size_t scanned;
+} cmd_reader;
+
+/**
+ * @brief Take the next complete line out of the receive buffer.
+ *
+ * @param r The receive buffer.
+ * @param line Set to the line, NUL terminated in place of its newline. Valid until the next cmd_reader_fill().
+ * @param len Set to the length of the line.
+ * @return Return 1 if a line was taken, 0 if the buffer holds no complete line.
+ */
+int cmd_reader_line(cmd_reader *r, char **line, size_t *len);
+
+/**
+ * @brief Tell whether a complete line is waiting in the receive buffer.
+ *
+ * @return Return 1 if cmd_reader_line() would take a line, 0 otherwise.
+ */
+int cmd_reader_ready(cmd_reader *r);
+
+/**
+ * @brief Receive more bytes, blocking until some arrive. Call when cmd_reader_line() returns 0.
+ *
+ * @param r The receive buffer.
+ * @param sock Where to receive from.
+ * @param maxlen The longest line accepted, or 0 for no limit.
+ * @return Return 0 on success, -1 if the connection closed or failed, or the pending line is longer than maxlen.
+ */
+int cmd_reader_fill(cmd_reader *r, int sock, size_t maxlen);
+
+/**
+ * @brief Make room after the received bytes, for a transport other than a socket. Follow with cmd_reader_add().
+ *
+ * @param r The receive buffer.
+ * @param maxlen The longest line accepted, or 0 for no limit.
+ * @param room Set to the number of bytes that fit.
+ * @return Return where to put the bytes, or NULL if the pending line is longer than maxlen or memory ran out.
+ */
+char* cmd_reader_space(cmd_reader *r, size_t maxlen, size_t *room);
+
+/**
+ * @brief Count len bytes put at the place returned by cmd_reader_space() as received.
+ */
+void cmd_reader_add(cmd_reader *r, size_t len);
+
+/**
+ * @brief Release the receive buffer.
+ */
+void cmd_reader_free(cmd_reader *r);
+
+/**
+ * @brief Split a command line into fields in place.
+ *
+ * @param line The NUL terminated line. Its commas and trailing blanks are overwritten.
+ * @param out Filled with the fields, each trimmed of blanks and never empty.
+ * @return Return the number of fields, 0 for a blank line.
+ */
+int cmd_parse(char *line, cmd_line *out);
+
+/**
+ * @brief Compare a slice with a string.
+ *
+ * @return Return 1 if they hold the same characters, 0 otherwise.
+ */
+int cmd_equals(cmd_slice s, const char *str);
+
+/**
+ * @brief Split a field in place at its first space.
+ *
+ * @param field The field. Its first space is overwritten with a NUL.
+ * @param head Set to the part before the space, or to the whole field.
+ * @param tail Set to the part after the space without its leading blanks, empty if there is no space.
+ */
+void cmd_split(cmd_slice field, cmd_slice *head, cmd_slice *tail);
+
+/**
+ * @brief Release the field slots of a line.
+ */
+void cmd_free(cmd_line *line);
+
+#endif
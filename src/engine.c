@@ -0,0 +1,1422 @@
+/**
+ * @file
+ * @brief This file implements the storage engine declared in engine.h.
+ *
+ * Records are multi-versioned. Writers lock single records and commit
+ * new versions under a global commit clock; QUERY reads a snapshot of
+ * the clock and never takes a lock, so it never blocks writers. Records
+ * unlinked from a table are freed through the epochs of epoch.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "utils.h"
+#include "engine.h"
+#include "epoch.h"
+#include "stats.h"
+
+table **tables;
+// Number of slots allocated in tables, doubled when full
+int tableCap;
+commit_hook commitHook = NULL;
+
+
+
+/**
+ * @brief Function to allocate a zeroed record image with room for the given number of columns.
+ * @param colNum Number of columns in the table
+ * @return Returns a pointer to the new record. The caller owns it and releases it with free().
+ */
+census* newRecord(int colNum) {
+    census *rp = calloc(1, sizeof(census) + (size_t)colNum * MAX_STRTYPE_SIZE);
+    if(rp == NULL)
+	die("Out of memory allocating a record.", EXIT_FAILURE);
+    return rp;
+}
+
+
+
+
+/**
+ * @brief Function to allocate an unpublished version with room for the given number of columns.
+ * @param colNum Number of columns in the table
+ * @return Returns a pointer to the new version.
+ */
+version* newVersion(int colNum) {
+    version *v = calloc(1, sizeof(version) + (size_t)colNum * MAX_STRTYPE_SIZE);
+    if(v == NULL)
+	die("Out of memory allocating a version.", EXIT_FAILURE);
+    return v;
+}
+
+
+
+
+/**
+ * @brief Function to free a chain of versions.
+ * @param v The newest version of the chain to free, may be NULL
+ * @return Returns void
+ */
+void freeVersions(version *v) {
+    while(v != NULL) {
+	version *older = v->older;
+	free(v);
+	v = older;
+    }
+}
+
+
+
+
+/*
+ * Snapshot readers.
+ *
+ * Every reading thread owns a slot in which it publishes the commit
+ * timestamp of its snapshot.  Writers look at the slots to decide whether
+ * to keep the image they overwrite and to find the oldest snapshot still
+ * in use before pruning old images.  Keeping records allocated is left to
+ * the epochs of epoch.h, so a GET, which needs no old images, only enters
+ * an epoch.
+ */
+
+/**
+ * @brief A reader slot, one per thread that has ever taken a snapshot.
+ */
+typedef struct snapshot_slot {
+	// Snapshot timestamp, SNAPSHOT_IDLE when the owner is not reading
+	uint64_t ts;
+	// True while a thread owns the slot
+	bool inUse;
+	// Next slot, slots are never freed
+	struct snapshot_slot *next;
+} snapshot_slot;
+
+// Commit timestamp of the newest commit, advanced before its records are written
+uint64_t commitClock = 0;
+// All reader slots
+snapshot_slot *snapshotSlots = NULL;
+// Slot owned by the current thread
+__thread snapshot_slot *mySlot = NULL;
+
+
+/**
+ * @brief Function to give the current thread a reader slot, reusing a released one if possible.
+ * @return Returns the slot of the current thread
+ */
+snapshot_slot* snapshot_slot_get() {
+	if(mySlot != NULL)
+		return mySlot;
+
+	snapshot_slot *s;
+	for(s = __atomic_load_n(&snapshotSlots, __ATOMIC_ACQUIRE); s != NULL; s = s->next) {
+		bool expected = false;
+		if(__atomic_compare_exchange_n(&s->inUse, &expected, true, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+			mySlot = s;
+			return s;
+		}
+	}
+
+	s = malloc(sizeof(snapshot_slot));
+	if(s == NULL)
+		die("Out of memory allocating a reader slot.", EXIT_FAILURE);
+	s->ts = SNAPSHOT_IDLE;
+	s->inUse = true;
+	s->next = __atomic_load_n(&snapshotSlots, __ATOMIC_RELAXED);
+	while(!__atomic_compare_exchange_n(&snapshotSlots, &s->next, s, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+	mySlot = s;
+	return s;
+}
+
+
+/**
+ * @brief Function to start a snapshot read. Versions committed after the snapshot stay invisible to it.
+ * @return Returns the snapshot timestamp
+ */
+uint64_t snapshot_begin() {
+	snapshot_slot *slot = snapshot_slot_get();
+	uint64_t ts = __atomic_load_n(&commitClock, __ATOMIC_SEQ_CST);
+	uint64_t now;
+
+	// Publish the snapshot, then make sure no writer could have missed it
+	__atomic_store_n(&slot->ts, ts, __ATOMIC_SEQ_CST);
+	while((now = __atomic_load_n(&commitClock, __ATOMIC_SEQ_CST)) != ts) {
+		ts = now;
+		__atomic_store_n(&slot->ts, ts, __ATOMIC_SEQ_CST);
+	}
+	return ts;
+}
+
+
+/**
+ * @brief Function to end the snapshot read of the current thread.
+ * @return Returns void
+ */
+void snapshot_end() {
+	__atomic_store_n(&mySlot->ts, SNAPSHOT_IDLE, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @brief Function to hand the reader slot of an exiting thread over to later threads.
+ * @return Returns void
+ */
+void snapshot_release_slot() {
+	if(mySlot == NULL)
+		return;
+	__atomic_store_n(&mySlot->inUse, false, __ATOMIC_RELEASE);
+	mySlot = NULL;
+}
+
+
+/**
+ * @brief Function to find the oldest snapshot that may still be read.
+ * @return Returns the oldest active snapshot, or the current commit clock if no snapshot is taken
+ */
+uint64_t oldestSnapshot() {
+	// Load the clock before the slots so a reader that is not seen yet gets a newer snapshot
+	uint64_t oldest = __atomic_load_n(&commitClock, __ATOMIC_SEQ_CST);
+	snapshot_slot *s;
+	for(s = __atomic_load_n(&snapshotSlots, __ATOMIC_ACQUIRE); s != NULL; s = s->next) {
+		uint64_t ts = __atomic_load_n(&s->ts, __ATOMIC_SEQ_CST);
+		if(ts < oldest)
+			oldest = ts;
+	}
+	return oldest;
+}
+
+
+
+
+/*
+ * Record locks.
+ *
+ * A writer owns a record while its sequence counter is odd, so taking the
+ * lock is also what makes lock-free readers retry.  Writers of different
+ * records never wait for each other.
+ */
+
+/**
+ * @brief Function to try to take the write lock of a record.
+ * @param r A pointer to the record
+ * @return Returns true if the lock was taken
+ */
+bool tryLockRecord(record *r) {
+	uint64_t seq = __atomic_load_n(&r->seq, __ATOMIC_RELAXED);
+	if(seq & 1)
+		return false;
+	return __atomic_compare_exchange_n(&r->seq, &seq, seq + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * @brief Function to take the write lock of a record, waiting for the current owner.
+ * @param r A pointer to the record
+ * @return Returns void
+ */
+void lockRecord(record *r) {
+	if(tryLockRecord(r))
+		return;
+	// Contended, so the wait is worth timing
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		sched_yield();
+	} while(!tryLockRecord(r));
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	stats_lock_wait((uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec);
+}
+
+
+/**
+ * @brief Function to release the write lock of a record.
+ * @param r A pointer to the record
+ * @return Returns void
+ */
+void unlockRecord(record *r) {
+	__atomic_store_n(&r->seq, __atomic_load_n(&r->seq, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @brief Function to queue a record for the garbage collector of its table.
+ * @param t A pointer to the table
+ * @param r A pointer to the record
+ * @return Returns void
+ */
+void pushGarbage(table *t, record *r) {
+	r->gcNext = __atomic_load_n(&t->gcList, __ATOMIC_RELAXED);
+	while(!__atomic_compare_exchange_n(&t->gcList, &r->gcNext, r, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+}
+
+
+/**
+ * @brief Function to map a chunk of memory whose pages are all placed on a NUMA node.
+ * @param node The node
+ * @return Returns the chunk, ARENA_CHUNK bytes, or NULL if it cannot be mapped or bound
+ */
+char* mapChunk(int node) {
+	char *p = mmap(NULL, ARENA_CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(p == MAP_FAILED)
+		return NULL;
+	// Untouched pages, so every page faults in on the node
+	unsigned long mask = 1UL << node;
+	if(syscall(SYS_mbind, p, ARENA_CHUNK, MPOL_BIND, &mask, sizeof mask * 8 + 1, 0) != 0) {
+		munmap(p, ARENA_CHUNK);
+		return NULL;
+	}
+	return p;
+}
+
+
+/**
+ * @brief Function to allocate a zeroed record for a table, from its arena if it has one.
+ * @param t A pointer to the table
+ * @return Returns the record, released with releaseRecord()
+ */
+record* allocRecord(table *t) {
+	record_arena *a = t->arena;
+	if(a == NULL) {
+		record *r = calloc(1, sizeof(record) + (size_t)t->numColumns * MAX_STRTYPE_SIZE);
+		if(r == NULL)
+			die("Out of memory allocating a record.", EXIT_FAILURE);
+		return r;
+	}
+	pthread_mutex_lock(&a->lock);
+	record *r = a->freeList;
+	if(r != NULL) {
+		a->freeList = r->gcNext;
+	} else {
+		if(a->next + a->recordSize > a->end) {
+			a->next = mapChunk(a->node);
+			if(a->next == NULL)
+				die("Out of memory allocating a record.", EXIT_FAILURE);
+			a->end = a->next + ARENA_CHUNK;
+			a->bytes += ARENA_CHUNK;
+		}
+		r = (record*)a->next;
+		a->next += a->recordSize;
+	}
+	pthread_mutex_unlock(&a->lock);
+	memset(r, 0, a->recordSize);
+	r->arena = a;
+	return r;
+}
+
+
+/**
+ * @brief Function to release a record allocated by allocRecord().
+ * @param r A pointer to the record
+ * @return Returns void
+ */
+void releaseRecord(record *r) {
+	record_arena *a = r->arena;
+	if(a == NULL) {
+		free(r);
+		return;
+	}
+	pthread_mutex_lock(&a->lock);
+	r->gcNext = a->freeList;
+	a->freeList = r;
+	pthread_mutex_unlock(&a->lock);
+}
+
+
+/**
+ * @brief Function to place the records of a table on a NUMA node. Called once its columns are added.
+ * @param t A pointer to the table, still empty
+ * @param node The node
+ * @return Returns 0 on success, -1 if memory cannot be bound to the node
+ */
+int bindTable(table *t, int node) {
+	if(node < 0 || node >= MAX_NUMA_NODES || t->arena != NULL)
+		return -1;
+	record_arena *a = calloc(1, sizeof(record_arena));
+	if(a == NULL)
+		die("Out of memory binding a table.", EXIT_FAILURE);
+	a->node = node;
+	// A cache line apart, so writers of neighbour records do not share one
+	a->recordSize = (sizeof(record) + (size_t)t->numColumns * MAX_STRTYPE_SIZE + 63) & ~(size_t)63;
+	pthread_mutex_init(&a->lock, NULL);
+	// The first chunk tells whether the node can be bound at all
+	a->next = mapChunk(node);
+	if(a->next == NULL) {
+		free(a);
+		return -1;
+	}
+	a->end = a->next + ARENA_CHUNK;
+	a->bytes = ARENA_CHUNK;
+	t->arena = a;
+	return 0;
+}
+
+
+/**
+ * @brief Function to free a retired record and its older images. Called by the epoch reclaimer.
+ * @param entry The reclamation entry of the record
+ * @return Returns void
+ */
+void freeRecord(epoch_entry *entry) {
+	record *r = (record*)((char*)entry - offsetof(record, reclaim));
+	freeVersions(r->older);
+	releaseRecord(r);
+}
+
+
+/**
+ * @brief Function to retire a record unlinked from the key index until no reader can hold it. Called by the hash map.
+ * @param node The index node of the record
+ * @param arg A pointer to the table
+ * @return Returns void
+ */
+void retireRecord(hm_node *node, void *arg) {
+	epoch_retire(&((record*)node)->reclaim, freeRecord);
+}
+
+
+
+
+/*
+ * Records and versions.
+ *
+ * A record holds its newest image in place, guarded by a sequence counter
+ * that is odd while a writer changes it.  Readers copy the image without a
+ * lock and retry if the counter moved.  The image being overwritten is
+ * kept on the older list only if a snapshot may still need it.
+ */
+
+// Images are copied in 8 byte words
+_Static_assert(MAX_STRTYPE_SIZE % 8 == 0, "MAX_STRTYPE_SIZE must be a multiple of 8");
+
+/**
+ * @brief Function to copy image words that a writer may change concurrently.
+ * @param dst Destination
+ * @param src Source, 8 byte aligned
+ * @param len Number of bytes, a multiple of 8
+ * @return Returns void
+ */
+void seqLoad(void *dst, const void *src, size_t len) {
+	const uint64_t *from = src;
+	size_t i;
+	for(i = 0; i < len / 8; i++) {
+		uint64_t w = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+		memcpy((char*)dst + i * 8, &w, 8);
+	}
+}
+
+
+/**
+ * @brief Function to write image words that readers may copy concurrently.
+ * @param dst Destination, 8 byte aligned
+ * @param src Source
+ * @param len Number of bytes, a multiple of 8
+ * @return Returns void
+ */
+void seqStore(void *dst, const void *src, size_t len) {
+	uint64_t *to = dst;
+	size_t i;
+	for(i = 0; i < len / 8; i++) {
+		uint64_t w;
+		memcpy(&w, (const char*)src + i * 8, 8);
+		__atomic_store_n(&to[i], w, __ATOMIC_RELAXED);
+	}
+}
+
+
+/**
+ * @brief Function to copy a consistent newest image of a record without taking a lock.
+ * @param r A pointer to the record. The caller is inside an epoch or holds the record lock.
+ * @param hdr Set to the commit timestamp, metadata, delete flag and older list of the image
+ * @param value Set to the column values, with room for colNum columns
+ * @param colNum Number of columns in the table
+ * @return Returns void
+ */
+void readImage(record *r, version *hdr, char (*value)[MAX_STRTYPE_SIZE], int colNum) {
+	for(;;) {
+		uint64_t seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+		if(seq & 1) {
+			// A writer is in the middle of the image
+			sched_yield();
+			continue;
+		}
+		hdr->ts = __atomic_load_n(&r->ts, __ATOMIC_RELAXED);
+		hdr->metadata = __atomic_load_n(&r->metadata, __ATOMIC_RELAXED);
+		hdr->deleted = __atomic_load_n(&r->deleted, __ATOMIC_RELAXED);
+		hdr->older = __atomic_load_n(&r->older, __ATOMIC_ACQUIRE);
+		seqLoad(value, r->value, (size_t)colNum * MAX_STRTYPE_SIZE);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&r->seq, __ATOMIC_RELAXED) == seq)
+			return;
+	}
+}
+
+
+/**
+ * @brief Function to find the image of a record that a snapshot sees.
+ * @param r A pointer to the record
+ * @param snapshot Snapshot timestamp
+ * @param scratch A version with room for colNum columns, used for the newest image
+ * @param colNum Number of columns in the table
+ * @return Returns scratch or an older version, or NULL if nothing was committed at or before the snapshot
+ */
+version* visibleVersion(record *r, uint64_t snapshot, version *scratch, int colNum) {
+	readImage(r, scratch, scratch->value, colNum);
+	if(scratch->ts != 0 && scratch->ts <= snapshot)
+		return scratch;
+	version *v = scratch->older;
+	while(v != NULL && v->ts > snapshot)
+		v = __atomic_load_n(&v->older, __ATOMIC_ACQUIRE);
+	return v;
+}
+
+
+/**
+ * @brief Function to describe the newest image of a record. The record must be locked.
+ * @param r A pointer to the record, may be NULL
+ * @param hdr Set to the commit timestamp, metadata and delete flag of the image
+ * @return Returns hdr, or NULL if the record was never written
+ */
+version* currentVersion(record *r, version *hdr) {
+	if(r == NULL || r->ts == 0)
+		return NULL;
+	hdr->ts = r->ts;
+	hdr->metadata = r->metadata;
+	hdr->deleted = r->deleted;
+	hdr->older = r->older;
+	return hdr;
+}
+
+
+/**
+ * @brief Function to write new images to several records under a single commit timestamp. The records must be locked.
+ * @param tabs The table of each record
+ * @param recs The records to update, each at most once
+ * @param vers The new images. They are consumed: kept as older images or freed.
+ * @param n Number of records
+ * @return Returns void
+ */
+void commitVersions(table **tabs, record **recs, version **vers, int n) {
+	int i;
+	// The records are locked, so readers see them as busy before the clock moves past them
+	uint64_t ts = __atomic_add_fetch(&commitClock, 1, __ATOMIC_SEQ_CST);
+
+	// A snapshot older than this commit reads the images being overwritten
+	bool keepOld = (oldestSnapshot() < ts);
+
+	for(i = 0; i < n; i++) {
+		record *r = recs[i];
+		version *v = vers[i];
+		size_t len = (size_t)tabs[i]->numColumns * MAX_STRTYPE_SIZE;
+		int metadata = v->metadata;
+		bool deleted = v->deleted;
+		if(keepOld && r->ts != 0) {
+			// Swap the images, so the new version buffer becomes the old image
+			size_t j;
+			for(j = 0; j < len / 8; j++) {
+				uint64_t w;
+				memcpy(&w, (char*)v->value + j * 8, 8);
+				memcpy((char*)v->value + j * 8, (char*)r->value + j * 8, 8);
+				__atomic_store_n((uint64_t*)r->value + j, w, __ATOMIC_RELAXED);
+			}
+			v->ts = r->ts;
+			v->metadata = r->metadata;
+			v->deleted = r->deleted;
+			v->older = r->older;
+			__atomic_store_n(&r->older, v, __ATOMIC_RELEASE);
+		} else {
+			seqStore(r->value, v->value, len);
+			free(v);
+		}
+		__atomic_store_n(&r->ts, ts, __ATOMIC_RELAXED);
+		__atomic_store_n(&r->metadata, metadata, __ATOMIC_RELAXED);
+		__atomic_store_n(&r->deleted, deleted, __ATOMIC_RELAXED);
+		// Still locked, so the hook sees the writes of a key in commit order
+		if(commitHook != NULL)
+			commitHook(tabs[i], r);
+	}
+	// The end of the commit, its records still locked
+	if(commitHook != NULL)
+		commitHook(NULL, NULL);
+}
+
+
+/**
+ * @brief Function to write a new image to a record. The record must be locked.
+ * @param t A pointer to the table
+ * @param r A pointer to the record
+ * @param v The new image, consumed by the commit
+ * @return Returns void
+ */
+void commitVersion(table *t, record *r, version *v) {
+	commitVersions(&t, &r, &v, 1);
+}
+
+
+/**
+ * @brief Function to drop the older images of a record that no snapshot can see any more. The record must be locked.
+ * @param r A pointer to the record
+ * @param oldest The oldest snapshot that may still be read
+ * @return Returns void
+ */
+void pruneVersions(record *r, uint64_t oldest) {
+	version *old;
+	if(r->ts <= oldest) {
+		// Every snapshot sees the newest image
+		old = r->older;
+		__atomic_store_n(&r->older, NULL, __ATOMIC_RELEASE);
+	} else {
+		// Readers stop at the first image at or before their snapshot, so nobody walks past v.
+		version *v = r->older;
+		while(v != NULL && v->ts > oldest)
+			v = v->older;
+		if(v == NULL)
+			return;
+		old = v->older;
+		__atomic_store_n(&v->older, NULL, __ATOMIC_RELEASE);
+	}
+	freeVersions(old);
+}
+
+
+/**
+ * @brief Function to prune a record after a write and queue it for garbage collection if needed. The record must be locked.
+ * @param t A pointer to the table
+ * @param r The record that was written
+ * @return Returns void
+ */
+void afterWrite(table *t, record *r) {
+	pruneVersions(r, oldestSnapshot());
+	if((r->older != NULL || r->deleted) && !r->onGcList) {
+		r->onGcList = true;
+		pushGarbage(t, r);
+	}
+}
+
+
+/**
+ * @brief Function to reclaim versions and deleted records that no snapshot needs any more.
+ * @param t A pointer to the table
+ * @return Returns void
+ *
+ * Only one thread collects a table at a time; others return at once.
+ */
+void collectGarbage(table *t) {
+	if(pthread_mutex_trylock( &t->gcLock ) != 0)
+		return;
+	uint64_t oldest = oldestSnapshot();
+	// Unlinking walks the key index, which other collectors may be shrinking
+	epoch_enter();
+
+	// Nothing new can be reclaimed from the garbage list until the oldest snapshot moves.
+	if(oldest != t->gcOldest) {
+		t->gcOldest = oldest;
+		record *r = __atomic_exchange_n(&t->gcList, NULL, __ATOMIC_ACQUIRE);
+		while(r != NULL) {
+			record *next = r->gcNext;
+			if(!tryLockRecord(r)) {
+				// A writer has it, look again next time
+				pushGarbage(t, r);
+			} else {
+				pruneVersions(r, oldest);
+				if(r->deleted && r->ts <= oldest) {
+					// Every snapshot sees the delete, so unlink the record. Readers may still hold it.
+					r->onGcList = false;
+					r->removed = true;
+					unlockRecord(r);
+					hm_remove(&t->map, &r->node);
+				} else {
+					if(r->older == NULL && !r->deleted)
+						r->onGcList = false;
+					else
+						pushGarbage(t, r);
+					unlockRecord(r);
+				}
+			}
+			r = next;
+		}
+	}
+
+	epoch_exit();
+	pthread_mutex_unlock( &t->gcLock );
+	// Free the records unlinked here and earlier once no reader can hold them
+	epoch_collect();
+}
+
+
+/**
+ * @brief Function to cut the string columns of a record image to the size declared for the table.
+ * @param t A pointer to the table
+ * @param rp A pointer to the record image
+ * @return Returns void
+ */
+void trimColumns(table *t, census *rp) {
+    int j=0;
+    for(j=0; j< t->numColumns; j++) {
+	if(t->columnType[j] > 0) {
+		int indexTrim = t->columnType[j];
+		if(indexTrim < MAX_STRTYPE_SIZE)
+			rp->value[j][indexTrim-1] = 0;
+		else
+			rp->value[j][MAX_STRTYPE_SIZE-1] = 0;
+	}
+    }
+}
+
+
+/**
+ * @brief Function to build the version a SET would commit on top of the current newest version.
+ * @param t A pointer to the table
+ * @param rp A pointer to the record image of the SET. String columns are trimmed to their size.
+ * @param del True if the SET deletes the key
+ * @param cur The current newest version, or NULL if the key was never written
+ * @return Returns the new unpublished version, or NULL if the metadata does not match or the key to delete does not exist
+ */
+version* buildVersion(table *t, census *rp, bool del, version *cur) {
+    bool exists = (cur != NULL && !cur->deleted);
+    version *v;
+    if(del) {
+	if(!exists)
+		return NULL;
+	v = newVersion(t->numColumns);
+	v->metadata = cur->metadata;
+	v->deleted = true;
+	return v;
+    }
+
+    int colNum = t->numColumns;
+    trimColumns(t, rp);
+    int metadata;
+    if(!exists) {
+		if(rp->metadata != 0)
+			return NULL;
+		metadata = 1;
+    }
+    else {
+		if(rp->metadata != cur->metadata && rp->metadata != 0)
+			return NULL;
+		metadata = cur->metadata + 1;
+    }
+
+    v = newVersion(colNum);
+    v->metadata = metadata;
+    memcpy(v->value, rp->value, (size_t)colNum * MAX_STRTYPE_SIZE);
+    return v;
+}
+
+
+/**
+ * @brief Function to find a record, adding an empty one if the key is not indexed. The caller is inside an epoch.
+ * @param t A pointer to the table
+ * @param keyname A string containing the key
+ * @return Returns a pointer to the record
+ */
+record* findOrAddRecord(table *t, char *keyname) {
+    record *tuple = findRecord(t, keyname);
+    if(tuple == NULL) {
+	// An empty record reads as deleted until its first commit.
+	tuple = allocRecord(t);
+	snprintf(tuple->key, sizeof tuple->key, "%s", keyname);
+	tuple->node.key = tuple->key;
+	tuple->deleted = true;
+	record *found = (record*)hm_insert(&t->map, &tuple->node);
+	if(found != tuple) {
+		// Another writer added the key first
+		releaseRecord(tuple);
+		tuple = found;
+	}
+    }
+    return tuple;
+}
+
+
+/**
+ * @brief Function to commit a SET of one key. Locks only the record of the key.
+ * @param t A pointer to the table
+ * @param rp A pointer to the new record image. It is copied, so the caller keeps ownership of it.
+ * @param del True if the SET deletes the key
+ * @param exact True to commit rp as it is, metadata included, without checking it against the stored version
+ * @return Returns 0 on success, -1 if the metadata does not match or the key to delete does not exist
+ */
+int writeRecord(table *t, census *rp, bool del, bool exact) {
+    version hdr;
+    int status = 0;
+    if(t->arena != NULL)
+	stats_placement(t->arena->node);
+    epoch_enter();
+    for(;;) {
+	record *tuple = del ? findRecord(t, rp->key) : findOrAddRecord(t, rp->key);
+	if(tuple == NULL) {
+		status = exact ? 0 : -1;
+		break;
+	}
+	lockRecord(tuple);
+	if(tuple->removed) {
+		// The collector unlinked it meanwhile, look the key up again
+		unlockRecord(tuple);
+		continue;
+	}
+	version *v;
+	if(!exact) {
+		v = buildVersion(t, rp, del, currentVersion(tuple, &hdr));
+	} else if(del && tuple->deleted) {
+		// Already gone
+		v = NULL;
+	} else {
+		v = newVersion(t->numColumns);
+		v->metadata = rp->metadata;
+		v->deleted = del;
+		if(!del)
+			memcpy(v->value, rp->value, (size_t)t->numColumns * MAX_STRTYPE_SIZE);
+	}
+	if(v == NULL)
+		status = exact ? 0 : -1;
+	else
+		commitVersion(t, tuple, v);
+	afterWrite(t, tuple);
+	unlockRecord(tuple);
+	break;
+    }
+    epoch_exit();
+    collectGarbage(t);
+    return status;
+}
+
+
+/**
+ * @brief Function to insert a record, or update it if the key exists. Locks only the record of the key.
+ * @param t A pointer to the table
+ * @param rp A pointer to the new record image. It is copied, so the caller keeps ownership of it.
+ * @return Returns 0 on success, -1 if the metadata does not match the stored version
+ */
+int insertRecord(table *t, census *rp) {
+    return writeRecord(t, rp, false, false);
+}
+
+
+
+
+/**
+ * @brief Function to find a record in a table, including one whose newest version is a delete
+ * @param t A pointer to the table. The caller is inside an epoch.
+ * @param keyname A string containing the key
+ * @return Returns a pointer to the found record. Returns NULL if nothing is found
+ */
+record* findRecord(table *t, char *keyname) {
+    return (record*)hm_find(&t->map, keyname);
+}
+
+
+/**
+ * @brief Function to delete a record by committing a delete version. Locks only the record of the key.
+ * @param t A pointer to the table
+ * @param rp A pointer to the census report
+ * @return Returns 0 on success, -1 if the key does not exist
+ */
+int deleteRecord(table *t, census *rp) {
+    return writeRecord(t, rp, true, false);
+}
+
+
+/**
+ * @brief Function to store a record image received from another server, as a replica does. Locks only the record of the key.
+ * @param t A pointer to the table
+ * @param rp A pointer to the record image, whose metadata is kept as is. It is copied, so the caller keeps ownership of it.
+ * @param del True to delete the key, which does nothing if it does not exist
+ * @return Returns void
+ */
+void applyRecord(table *t, census *rp, bool del) {
+    writeRecord(t, rp, del, true);
+}
+
+
+/**
+ * @brief Function to visit every record visible in a snapshot.
+ * @param t A pointer to the table
+ * @param snapshot A snapshot taken with snapshot_begin()
+ * @param visit Called with each key and its version, inside an epoch, so it must not block
+ * @param arg Passed to visit
+ * @return Returns void
+ */
+void scanSnapshot(table *t, uint64_t snapshot, void (*visit)(void *arg, const char *key, version *v), void *arg) {
+    version *scratch = newVersion(t->numColumns);
+    epoch_enter();
+    record *r;
+    for(r = (record*)hm_first(&t->map); r != NULL; r = (record*)hm_next(&r->node)) {
+	version *v = visibleVersion(r, snapshot, scratch, t->numColumns);
+	if(v != NULL && !v->deleted)
+		visit(arg, r->key, v);
+    }
+    epoch_exit();
+    free(scratch);
+}
+
+
+/**
+ * @brief Function to copy the newest image of a record. Takes no lock.
+ * @param t A pointer to the table
+ * @param keyname A string containing the key
+ * @param out A record image with room for every column of the table
+ * @param ts If not NULL, set to the commit timestamp of the version copied, or 0 if the key does not exist
+ * @return Returns 0 on success, -1 if the key does not exist
+ */
+int readRecord(table *t, char *keyname, census *out, uint64_t *ts) {
+    version hdr;
+    if(t->arena != NULL)
+	stats_placement(t->arena->node);
+    // The epoch keeps the record allocated while it is copied
+    epoch_enter();
+    record *tuple = findRecord(t, keyname);
+    if(tuple != NULL)
+	readImage(tuple, &hdr, out->value, t->numColumns);
+    epoch_exit();
+    bool exists = (tuple != NULL && hdr.ts != 0 && !hdr.deleted);
+    if(ts != NULL)
+	*ts = exists ? hdr.ts : 0;
+    if(!exists)
+	return -1;
+    strcpy(out->key, keyname);
+    out->metadata = hdr.metadata;
+    return 0;
+}
+
+
+/**
+ * @brief Function to display all records in the table, as of a fresh snapshot
+ * @param t A pointer to the table
+ * @return Returns void
+ */
+void displayAllRecords(table *t) {
+    version *scratch = newVersion(t->numColumns);
+    uint64_t snapshot = snapshot_begin();
+    epoch_enter();
+    record *r;
+    for(r = (record*)hm_first(&t->map); r != NULL; r = (record*)hm_next(&r->node)) {
+	version *v = visibleVersion(r, snapshot, scratch, t->numColumns);
+	if(v == NULL || v->deleted)
+		continue;
+        printf("%s:\n", r->key);
+	int j;
+	for(j=0; j < t->numColumns; j++) {
+		printf("\t::%s\n", v->value[j]);
+	} 
+    }
+    epoch_exit();
+    snapshot_end();
+    free(scratch);
+}
+
+
+
+/**
+ * @brief Function to test a version against the predicates of a query.
+ * @param v The version
+ * @param colPreds An array containing all predicates to query for
+ * @param numPreds Integer number of provided perdicates
+ * @return Returns true if the version satisfies every predicate
+ */
+static bool matchPredicates(version *v, predicate *colPreds, int numPreds) {
+    int i;
+    for(i=0; i < numPreds; i++) {
+	//Query each Predicate here
+	int columnNo = colPreds[i].colNum;
+	if(colPreds[i].type >= 0) {	/* Predicate is string type */
+		if(strcmp(colPreds[i].value, v->value[columnNo]) != 0)
+			return false;
+	} else { /* Predicate is integer type */
+		long value = strtol(v->value[columnNo], NULL, 10);
+		long operand = strtol(colPreds[i].value, NULL, 10);
+		switch(colPreds[i].cmp) {
+			case -1: /* lesser than */
+				 if(!(value < operand))
+					 return false;
+				 break;
+			case 0: /* equal to */
+				 if(!(value == operand))
+					 return false;
+				 break;
+			case 1: /* greater than */
+				 if(!(value > operand))
+					 return false;
+				 break;
+		}
+	}
+    }
+    return true;
+}
+
+
+/**
+ * @brief Function to query the records of one slice of a table visible in a snapshot. Writers are never blocked.
+ * @param t A pointer to the table
+ * @param snapshot A snapshot taken with snapshot_begin(), by this thread or one that waits for this one
+ * @param colPreds An array containing all predicates to query for
+ * @param numPreds Integer number of provided perdicates
+ * @param keys_arr An array of stings containing all keys found by the query function
+ * @param max_keys Integer maximum number of keys to be found by the query function provided by the client
+ * @param slice The slice of the key index, from 0 to 2^bits - 1
+ * @param bits Bits of the slice number, 0 for the whole table
+ * @return Returns Integer number of keys found with matching predicates
+ */
+int querySlice(table *t, uint64_t snapshot, predicate *colPreds, int numPreds, char **keys_arr, int max_keys,
+		unsigned slice, int bits) {
+    int keys_count = 0;
+    version *scratch = newVersion(t->numColumns);
+    if(t->arena != NULL)
+	stats_placement(t->arena->node);
+    epoch_enter();
+    record *r;
+    for(r = (record*)hm_slice_first(&t->map, slice, bits); r != NULL; r = (record*)hm_slice_next(&r->node, bits)) {
+	version *v = visibleVersion(r, snapshot, scratch, t->numColumns);
+	if(v == NULL || v->deleted || !matchPredicates(v, colPreds, numPreds))
+		continue;
+	/* Record satisfies all predicates */
+	if(keys_count < max_keys)
+		strcpy(keys_arr[keys_count], r->key);
+	keys_count++;
+    }
+    epoch_exit();
+    free(scratch);
+    return keys_count;
+}
+
+
+/**
+ * @brief Function to query all records visible in a fresh snapshot. Writers are never blocked.
+ * @param t A pointer to the table
+ * @param colPreds An array containing all predicates to query for
+ * @param numPreds Integer number of provided perdicates
+ * @param keys_arr An array of stings containing all keys found by the query function
+ * @param max_keys Integer maximum number of keys to be found by the query function provided by the client
+ * @return Returns Integer number of keys found with matching predicates 
+ */
+int queryAllRecords(table *t, predicate *colPreds, int numPreds, char **keys_arr, int max_keys) {
+    uint64_t snapshot = snapshot_begin();
+    int keys_count = querySlice(t, snapshot, colPreds, numPreds, keys_arr, max_keys, 0, 0);
+    snapshot_end();
+    return keys_count;
+}
+
+
+
+
+
+/**
+ * @brief Function to remember a key read inside a transaction, for validation at commit.
+ * @param txn A pointer to the transaction
+ * @param t A pointer to the table
+ * @param keyname A string containing the key
+ * @param ts Commit timestamp of the version read, 0 if the key did not exist
+ * @return Returns void
+ */
+void txnAddRead(transaction *txn, table *t, char *keyname, uint64_t ts) {
+	if(txn->numReads == txn->readCap) {
+		int newCap = (txn->readCap == 0) ? 8 : txn->readCap * 2;
+		txn_read *grown = realloc(txn->reads, newCap * sizeof(txn_read));
+		if(grown == NULL)
+			die("Out of memory growing a transaction.", EXIT_FAILURE);
+		txn->reads = grown;
+		txn->readCap = newCap;
+	}
+	txn_read *rd = &txn->reads[txn->numReads++];
+	rd->t = t;
+	snprintf(rd->key, sizeof rd->key, "%s", keyname);
+	rd->ts = ts;
+}
+
+
+/**
+ * @brief Function to buffer a SET inside a transaction until commit.
+ * @param txn A pointer to the transaction
+ * @param t A pointer to the table
+ * @param rp The record image of the SET. The transaction takes ownership of it.
+ * @param del True if the SET deletes the key
+ * @return Returns void
+ */
+void txnAddWrite(transaction *txn, table *t, census *rp, bool del) {
+	if(txn->numWrites == txn->writeCap) {
+		int newCap = (txn->writeCap == 0) ? 8 : txn->writeCap * 2;
+		txn_write *grown = realloc(txn->writes, newCap * sizeof(txn_write));
+		if(grown == NULL)
+			die("Out of memory growing a transaction.", EXIT_FAILURE);
+		txn->writes = grown;
+		txn->writeCap = newCap;
+	}
+	txn_write *wr = &txn->writes[txn->numWrites++];
+	wr->t = t;
+	wr->rp = rp;
+	wr->del = del;
+}
+
+
+/**
+ * @brief Function to find the last buffered write of a key before a given write.
+ * @param txn A pointer to the transaction
+ * @param t A pointer to the table
+ * @param keyname A string containing the key
+ * @param before Only writes with a lower index are considered
+ * @return Returns the index of the write, or -1 if the key was not written
+ */
+int txnFindWrite(transaction *txn, table *t, char *keyname, int before) {
+	int i;
+	for(i = before - 1; i >= 0; i--) {
+		if(txn->writes[i].t == t && strcmp(txn->writes[i].rp->key, keyname) == 0)
+			return i;
+	}
+	return -1;
+}
+
+
+/**
+ * @brief Function to free a transaction and the writes it buffered.
+ * @param txn A pointer to the transaction, may be NULL
+ * @return Returns void
+ */
+void txnFree(transaction *txn) {
+	if(txn == NULL)
+		return;
+	int i;
+	for(i = 0; i < txn->numWrites; i++)
+		free(txn->writes[i].rp);
+	free(txn->writes);
+	free(txn->reads);
+	free(txn);
+}
+
+
+/**
+ * @brief Comparator ordering locked records by address, the order in which commit takes record locks.
+ */
+int compareLocks(const void *a, const void *b) {
+	uintptr_t x = (uintptr_t)((const txn_lock*)a)->r;
+	uintptr_t y = (uintptr_t)((const txn_lock*)b)->r;
+	return (x > y) - (x < y);
+}
+
+
+/**
+ * @brief Function to lock records in the order of compareLocks(), each once. The caller is inside an epoch.
+ * @param locks The records to lock, sorted and rid of duplicates in place
+ * @param numLocks Number of entries in locks
+ * @return Returns the number of records locked, or -1 with none locked if the collector unlinked one of them meanwhile
+ */
+static int lockRecords(txn_lock *locks, int numLocks) {
+	int i;
+	qsort(locks, numLocks, sizeof(txn_lock), compareLocks);
+	int numUnique = 0;
+	for(i = 0; i < numLocks; i++) {
+		if(numUnique == 0 || locks[numUnique - 1].r != locks[i].r)
+			locks[numUnique++] = locks[i];
+	}
+	numLocks = numUnique;
+
+	bool removed = false;
+	for(i = 0; i < numLocks; i++) {
+		lockRecord(locks[i].r);
+		removed = removed || locks[i].r->removed;
+	}
+	if(!removed)
+		return numLocks;
+	// The caller looks the keys up again
+	for(i = numLocks - 1; i >= 0; i--)
+		unlockRecord(locks[i].r);
+	return -1;
+}
+
+
+/**
+ * @brief Function to unlock the records locked by lockRecords(), leave the epoch and collect the garbage of their tables.
+ * @param locks The records locked
+ * @param numLocks Number of records locked
+ * @return Returns void
+ */
+static void unlockRecords(txn_lock *locks, int numLocks) {
+	int i;
+	// Empty records added for the locks are queued too, so the collector unlinks them again
+	for(i = numLocks - 1; i >= 0; i--) {
+		afterWrite(locks[i].t, locks[i].r);
+		unlockRecord(locks[i].r);
+	}
+	epoch_exit();
+	for(i = 0; i < numLocks; i++) {
+		int j;
+		for(j = 0; j < i && locks[j].t != locks[i].t; j++)
+			;
+		if(j == i)
+			collectGarbage(locks[i].t);
+	}
+}
+
+
+/**
+ * @brief Function to validate a transaction and apply all of its writes atomically.
+ * @param txn A pointer to the transaction
+ * @return Returns 0 if the transaction committed, -1 if a key it read or wrote changed since
+ */
+int txnCommit(transaction *txn) {
+	int n = txn->numReads + txn->numWrites;
+	if(n == 0)
+		return 0;
+
+	txn_lock *locks = malloc(n * sizeof(txn_lock));
+	version **vers = calloc(txn->numWrites + 1, sizeof(version*));
+	record **recs = malloc((txn->numWrites + 1) * sizeof(record*));
+	table **recTables = malloc((txn->numWrites + 1) * sizeof(table*));
+	if(locks == NULL || vers == NULL || recs == NULL || recTables == NULL)
+		die("Out of memory committing a transaction.", EXIT_FAILURE);
+	int i, numLocks;
+	epoch_enter();
+
+	// Lock the record of every key involved once, always in the same order.
+	// Keys that do not exist get an empty record, so nobody can add them meanwhile.
+	for(;;) {
+		numLocks = 0;
+		for(i = 0; i < txn->numReads; i++) {
+			locks[numLocks].t = txn->reads[i].t;
+			locks[numLocks++].r = findOrAddRecord(txn->reads[i].t, txn->reads[i].key);
+		}
+		for(i = 0; i < txn->numWrites; i++) {
+			locks[numLocks].t = txn->writes[i].t;
+			locks[numLocks++].r = findOrAddRecord(txn->writes[i].t, txn->writes[i].rp->key);
+		}
+		numLocks = lockRecords(locks, numLocks);
+		if(numLocks >= 0)
+			break;
+	}
+
+	int status = 0;
+	// Every key read must still be at the version read
+	for(i = 0; i < txn->numReads && status == 0; i++) {
+		version hdr;
+		version *v = currentVersion(findRecord(txn->reads[i].t, txn->reads[i].key), &hdr);
+		uint64_t ts = (v == NULL || v->deleted) ? 0 : v->ts;
+		if(ts != txn->reads[i].ts)
+			status = -1;
+	}
+
+	// Every write must apply on top of the current version, or on top of an earlier write of the same key
+	for(i = 0; i < txn->numWrites && status == 0; i++) {
+		txn_write *wr = &txn->writes[i];
+		int prev = txnFindWrite(txn, wr->t, wr->rp->key, i);
+		version hdr, *cur;
+		if(prev >= 0)
+			cur = vers[prev];
+		else
+			cur = currentVersion(findRecord(wr->t, wr->rp->key), &hdr);
+		vers[i] = buildVersion(wr->t, wr->rp, wr->del, cur);
+		if(vers[i] == NULL)
+			status = -1;
+	}
+
+	int numRecs = 0;
+	if(status == 0) {
+		// Only the last write of each key is committed
+		for(i = 0; i < txn->numWrites; i++) {
+			txn_write *wr = &txn->writes[i];
+			bool last = true;
+			int j;
+			for(j = i + 1; j < txn->numWrites && last; j++) {
+				if(txn->writes[j].t == wr->t && strcmp(txn->writes[j].rp->key, wr->rp->key) == 0)
+					last = false;
+			}
+			if(!last) {
+				free(vers[i]);
+				vers[i] = NULL;
+				continue;
+			}
+			recs[numRecs] = findRecord(wr->t, wr->rp->key);
+			recTables[numRecs] = wr->t;
+			vers[numRecs] = vers[i];
+			if(numRecs != i)
+				vers[i] = NULL;
+			numRecs++;
+		}
+		commitVersions(recTables, recs, vers, numRecs);
+	} else {
+		for(i = 0; i < txn->numWrites; i++)
+			free(vers[i]);
+	}
+
+	unlockRecords(locks, numLocks);
+	free(locks);
+	free(vers);
+	free(recs);
+	free(recTables);
+	return status;
+}
+
+
+/**
+ * @brief Function to commit several record images as they are, metadata included, under a single commit timestamp.
+ * @param tabs The table of each image
+ * @param rps The record images. They are copied, so the caller keeps ownership of them.
+ * @param dels True for each image that deletes its key
+ * @param n Number of images
+ * @return Returns void
+ *
+ * A snapshot sees all of the images or none of them. If a key comes more than once, its last image is committed.
+ */
+void applyRecords(table **tabs, census **rps, bool *dels, int n) {
+	if(n == 0)
+		return;
+	txn_lock *locks = malloc(n * sizeof(txn_lock));
+	version **vers = malloc(n * sizeof(version*));
+	record **recs = malloc(n * sizeof(record*));
+	table **recTables = malloc(n * sizeof(table*));
+	if(locks == NULL || vers == NULL || recs == NULL || recTables == NULL)
+		die("Out of memory applying records.", EXIT_FAILURE);
+	int i, numLocks;
+	epoch_enter();
+	for(;;) {
+		for(i = 0; i < n; i++) {
+			locks[i].t = tabs[i];
+			locks[i].r = findOrAddRecord(tabs[i], rps[i]->key);
+		}
+		numLocks = lockRecords(locks, n);
+		if(numLocks >= 0)
+			break;
+	}
+
+	int numRecs = 0;
+	for(i = 0; i < n; i++) {
+		bool last = true;
+		int j;
+		for(j = i + 1; j < n && last; j++) {
+			if(tabs[j] == tabs[i] && strcmp(rps[j]->key, rps[i]->key) == 0)
+				last = false;
+		}
+		record *r = findRecord(tabs[i], rps[i]->key);
+		// Already gone
+		if(!last || (dels[i] && r->deleted))
+			continue;
+		version *v = newVersion(tabs[i]->numColumns);
+		v->metadata = rps[i]->metadata;
+		v->deleted = dels[i];
+		if(!dels[i])
+			memcpy(v->value, rps[i]->value, (size_t)tabs[i]->numColumns * MAX_STRTYPE_SIZE);
+		recs[numRecs] = r;
+		recTables[numRecs] = tabs[i];
+		vers[numRecs++] = v;
+	}
+	if(numRecs > 0)
+		commitVersions(recTables, recs, vers, numRecs);
+
+	unlockRecords(locks, numLocks);
+	free(locks);
+	free(vers);
+	free(recs);
+	free(recTables);
+}
+
+
+
+
+
+/**
+ * @brief Function to find the table in the array of tables
+ * @param tableName The name of the table to find
+ * @param topTableNumber Number of tables in the array
+ * @return Returns a pointer to the table if found. Returns NULL otherwise
+ */
+table* getTable(char* tableName, int topTableNumber){
+	int i;
+
+	for (i=0; i < topTableNumber; i++) {
+		if (strcmp(tables[i]->name, tableName) == 0)
+			return tables[i];
+	}
+	return NULL;
+}
+
+
+
+/**
+ * @brief Function to add a new table to the array of tables, growing the array if it is full
+ * @param tableName The name of the table to insert
+ * @param indexToPutAt Index to put the table
+ * @return Returns void
+ */
+void addTable(char* tableName, int indexToPutAt){
+	if(indexToPutAt >= tableCap) {
+		int newCap = (tableCap == 0) ? INIT_NUM_OF_TABLES : tableCap * 2;
+		table **grown = realloc(tables, newCap * sizeof(table*));
+		if(grown == NULL)
+			die("Out of memory adding a table.", EXIT_FAILURE);
+		tables = grown;
+		tableCap = newCap;
+	}
+	table *t = calloc(1, sizeof(table));
+	if(t == NULL)
+		die("Out of memory adding a table.", EXIT_FAILURE);
+	strcpy(t->name, tableName);
+	hm_init(&t->map, retireRecord, t);
+	pthread_mutex_init(&t->gcLock, NULL);
+	tables[indexToPutAt] = t;
+}
+
+
+
+/**
+ * @brief Function to find a column in a table
+ * @param tab The name of the table to search
+ * @param colName Name of the column to be found
+ * @param num The index of the column to be found
+ * @param type The type of value that the column holds
+ * @return Returns Integer -1 if column isn't' found and 0 if the specified column is found
+ */
+int findColumn(table* tab, char colName[MAX_COLNAME_LEN], int *num, int *type) {
+	int i=0;	
+	for(i=0; i< tab->numColumns; i++) {
+		if(strcmp(tab->columnName[i], colName) == 0) {
+			*num = i;
+			*type = tab->columnType[i];
+			return 0;
+		}
+	}
+	return -1;
+}
+
+
+
+/**
+ * @brief Function to add a column to a table assuming that the column does not exist
+ * @param tab A pointer to the table
+ * @param colName The name of the column
+ * @param colType An integer indicating the type of column to be created
+ * @return Returns Integer 1 if unsuccessful, returns 0 if successful
+ */
+int addColumn(table* tab, char* colName, int colType){	
+	
+	if(colType == 0) {
+		return -1;
+	}
+
+	//Grow the column arrays if they are full
+	if (tab->numColumns == tab->columnCap){
+		int newCap = (tab->columnCap == 0) ? INIT_COLUMNS_PER_TABLE : tab->columnCap * 2;
+		char (*names)[MAX_COLNAME_LEN] = realloc(tab->columnName, newCap * sizeof(*names));
+		if (names == NULL)
+			return -1;
+		tab->columnName = names;
+		int *types = realloc(tab->columnType, newCap * sizeof(int));
+		if (types == NULL)
+			return -1;
+		tab->columnType = types;
+		tab->columnCap = newCap;
+	}
+
+	//Copies column name
+	strcpy(tab->columnName[tab->numColumns], colName);
+	tab->columnType[tab->numColumns] = colType;
+	tab->numColumns++;
+
+	return 0;
+} 
@@ -0,0 +1,246 @@
+/**
+ * @file
+ * @brief This file declares the storage engine of the server: tables of
+ * multi-versioned records, snapshot reads and transactions.
+ *
+ * The engine knows nothing about sockets or the protocol, so it is built
+ * into libengine.a and linked both by the server and by the in-process
+ * microbenchmark.  Every function may be called from any thread.  A
+ * thread that stops using the engine calls snapshot_release_slot() and
+ * epoch_thread_exit() before it exits.
+ */
+
+#ifndef	ENGINE_H
+#define ENGINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "hashmap.h"
+#include "epoch.h"
+
+// Storage server constants.
+#define MAX_TABLE_LENGTH 20	///< Max characters of a table name.
+#define MAX_KEY_LEN 20		///< Max characters of a key name.
+
+// Extended storage server constants.
+#define MAX_COLNAME_LEN 20	///< Max characters of a column name.
+#define MAX_STRTYPE_SIZE 40	///< Max SIZE of string types.
+
+// Initial sizes of the structures that grow on demand.
+#define INIT_NUM_OF_TABLES 8	///< Initial table slots, doubled when full.
+#define INIT_COLUMNS_PER_TABLE 4	///< Initial column slots per table, doubled when full.
+
+// Placement of the records of a table on a NUMA node.
+#define ARENA_CHUNK (2 * 1024 * 1024)	///< Bytes an arena maps and binds at a time.
+#define MAX_NUMA_NODES 64	///< Nodes a table can be bound to.
+
+/// Snapshot timestamp published by a thread that is not reading.
+#define SNAPSHOT_IDLE UINT64_MAX
+
+/**
+* @brief A struct to store a record image, as parsed from a SET or copied out for a GET.
+*/
+typedef struct {
+	// Key of the node
+	char key[MAX_KEY_LEN];
+	// metadata
+	int metadata;
+	// Value of the columns of the node, one slot per table column
+	char value[][MAX_STRTYPE_SIZE];
+} census;    /* allocated by newRecord */
+
+/**
+* @brief An older image of a stored record, kept while some snapshot may read it. It never changes once published.
+*/
+typedef struct version {
+	// Commit timestamp, compared against reader snapshots
+	uint64_t ts;
+	// Per-record version counter reported to clients as metadata
+	int metadata;
+	// True if this version deletes the record
+	bool deleted;
+	// Next older image still needed by some snapshot, or NULL
+	struct version *older;
+	// Value of the columns, one slot per table column
+	char value[][MAX_STRTYPE_SIZE];
+} version;
+
+/**
+* @brief A struct to store a record in a table: its key, its newest image in place and its older images.
+*/
+typedef struct record {
+	// Entry of the record in the table key index, must stay first
+	hm_node node;
+	// Key of the record, never changes
+	char key[MAX_KEY_LEN];
+	// Even while the newest image is stable, odd while a writer holds the record lock
+	uint64_t seq;
+	// Commit timestamp of the newest image, 0 until the first commit
+	uint64_t ts;
+	// Per-record version counter reported to clients as metadata
+	int metadata;
+	// True if the newest image is a delete
+	bool deleted;
+	// Older images still needed by some snapshot, newest first
+	version *older;
+	// True while the record is on the table garbage list
+	bool onGcList;
+	// True once the collector unlinked the record from the key index, writers must look the key up again
+	bool removed;
+	// Next record on the garbage list
+	struct record *gcNext;
+	// Reclamation entry, used once the record is unlinked from the key index
+	epoch_entry reclaim;
+	// Arena the record was carved from, NULL if it came from malloc
+	struct record_arena *arena;
+	// Newest value of the columns, one slot per table column, copied word by word under seq
+	char value[][MAX_STRTYPE_SIZE] __attribute__((aligned(8)));
+} record;
+
+/**
+* @brief Records of a table placed on one NUMA node, carved from chunks bound to it.
+*/
+typedef struct record_arena {
+	// The node the chunks are bound to
+	int node;
+	// Bytes of a record, rounded up to a cache line
+	size_t recordSize;
+	// Guards everything below
+	pthread_mutex_t lock;
+	// Freed records, linked through gcNext
+	record *freeList;
+	// Unused end of the newest chunk
+	char *next;
+	char *end;
+	// Bytes mapped
+	size_t bytes;
+} record_arena;
+
+/**
+* @brief A struct to store the predicate.
+*/
+typedef struct {
+	// Type of predicate
+	// -> '0' - String, '1' - Integer
+	int type;
+	// Value of predicate
+	char value[MAX_STRTYPE_SIZE];
+	// How the predicate needs to be compared
+	// -> '-1' - lesser, '0' - equal, '+1' - greater
+	int cmp;
+	// Column of predicate
+	int colNum;
+} predicate;    /* predicates for query */
+
+/**
+* @brief A struct to store a table.
+*/
+typedef struct {
+	// Name of the table
+	char name[MAX_TABLE_LENGTH];
+	// Records of the table indexed by key. Writers lock single records, readers take no lock.
+	hashmap map;
+	// Held by the thread collecting the garbage of the table
+	pthread_mutex_t gcLock;
+	// Records whose old versions or tombstones may become garbage
+	record *gcList;
+	// Oldest snapshot seen by the last garbage collection
+	uint64_t gcOldest;
+	// Where the records are placed, NULL to leave it to malloc
+	record_arena *arena;
+	int numColumns;
+	// Number of column slots allocated in columnName and columnType
+	int columnCap;
+
+	char (*columnName)[MAX_COLNAME_LEN];
+//-1 for integer, <size> for char[size]
+	int *columnType;
+} table;
+
+/**
+* @brief A struct to store a key read inside a transaction.
+*/
+typedef struct {
+	table *t;
+	char key[MAX_KEY_LEN];
+	// Commit timestamp of the version read, 0 if the key did not exist
+	uint64_t ts;
+} txn_read;
+
+/**
+* @brief A struct to store a write buffered inside a transaction.
+*/
+typedef struct {
+	table *t;
+	// Record image parsed from the SET, owned by the transaction
+	census *rp;
+	// True if the SET deletes the key
+	bool del;
+} txn_write;
+
+/**
+* @brief A struct to store a record locked by a committing transaction.
+*/
+typedef struct {
+	table *t;
+	record *r;
+} txn_lock;
+
+/**
+* @brief A struct to store the reads and writes of an open transaction.
+*/
+typedef struct transaction {
+	txn_read *reads;
+	int numReads;
+	int readCap;
+
+	txn_write *writes;
+	int numWrites;
+	int writeCap;
+} transaction;
+
+/**
+* @brief A function called for every record a commit writes, with its new image in place and the record still locked, then once with both arguments NULL when the commit wrote them all. It must not block.
+*/
+typedef void (*commit_hook)(table *t, record *r);
+
+/// All tables, filled by addTable().
+extern table **tables;
+/// Called by every commit unless NULL. Set before the engine is used.
+extern commit_hook commitHook;
+/// Number of slots allocated in tables, doubled when full.
+extern int tableCap;
+
+table* getTable(char* tableName, int topTableNumber);
+void addTable(char* tableName, int indexToPutAt);
+int bindTable(table *t, int node);
+//Returns -1 if unsuccessful, returns 1 if successful
+//Assumes that column does not exist
+int addColumn(table* tab, char* colName, int colType);
+int findColumn(table* tab, char colName[MAX_COLNAME_LEN], int *num, int *type);
+census* newRecord(int colNum);
+void trimColumns(table *t, census *rp);
+uint64_t snapshot_begin();
+void snapshot_end();
+void snapshot_release_slot();
+int insertRecord(table *t, census *rp);
+int deleteRecord(table *t, census *rp);
+void applyRecord(table *t, census *rp, bool del);
+void applyRecords(table **tabs, census **rps, bool *dels, int n);
+void scanSnapshot(table *t, uint64_t snapshot, void (*visit)(void *arg, const char *key, version *v), void *arg);
+record* findRecord(table *t, char *keyname);
+version* visibleVersion(record *r, uint64_t snapshot, version *scratch, int colNum);
+int readRecord(table *t, char *keyname, census *out, uint64_t *ts);
+int queryAllRecords(table *t, predicate *colPreds, int numPreds, char **keys_arr, int max_keys);
+int querySlice(table *t, uint64_t snapshot, predicate *colPreds, int numPreds, char **keys_arr, int max_keys,
+		unsigned slice, int bits);
+void collectGarbage(table *t);
+void displayAllRecords(table *t);
+void txnAddRead(transaction *txn, table *t, char *keyname, uint64_t ts);
+void txnAddWrite(transaction *txn, table *t, census *rp, bool del);
+int txnFindWrite(transaction *txn, table *t, char *keyname, int before);
+int txnCommit(transaction *txn);
+void txnFree(transaction *txn);
+
+#endif
@@ -0,0 +1,187 @@
+/**
+ * @file
+ * @brief This file implements the epoch-based reclamation declared in epoch.h.
+ *
+ * Every thread owns a slot where it publishes the global epoch it entered,
+ * or EPOCH_IDLE.  The global epoch advances from e to e + 1 only when every
+ * busy slot shows e, so once it reaches r + 2 no thread can still be inside
+ * an epoch that started before an object retired at r was unlinked.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "epoch.h"
+#include "utils.h"
+
+/**
+ * @brief A thread slot, one per thread that has ever entered an epoch.
+ */
+typedef struct epoch_slot {
+	// Epoch entered by the owner, EPOCH_IDLE when it is outside
+	uint64_t epoch;
+	// True while a thread owns the slot
+	bool inUse;
+	// Next slot, slots are never freed
+	struct epoch_slot *next;
+} epoch_slot;
+
+// The global epoch
+static uint64_t globalEpoch = 0;
+// All thread slots
+static epoch_slot *epochSlots = NULL;
+// Garbage left behind by exited threads
+static epoch_entry *orphans = NULL;
+static pthread_mutex_t orphanLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Slot owned by the current thread
+static __thread epoch_slot *mySlot = NULL;
+// Depth of nested epoch_enter() calls
+static __thread int nesting = 0;
+// Objects retired by the current thread, oldest first
+static __thread epoch_entry *limboHead = NULL;
+static __thread epoch_entry *limboTail = NULL;
+// Retires since the last collection
+static __thread int retiresSinceCollect = 0;
+
+
+/**
+ * @brief Function to give the current thread a slot, reusing a released one if possible.
+ * @return Returns the slot of the current thread
+ */
+static epoch_slot* slot_get()
+{
+	if (mySlot != NULL)
+		return mySlot;
+
+	epoch_slot *s;
+	for (s = __atomic_load_n(&epochSlots, __ATOMIC_ACQUIRE); s != NULL; s = s->next) {
+		bool expected = false;
+		if (__atomic_compare_exchange_n(&s->inUse, &expected, true, false,
+				__ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+			mySlot = s;
+			return s;
+		}
+	}
+
+	s = malloc(sizeof(epoch_slot));
+	if (s == NULL)
+		die("Out of memory allocating an epoch slot.", EXIT_FAILURE);
+	s->epoch = EPOCH_IDLE;
+	s->inUse = true;
+	s->next = __atomic_load_n(&epochSlots, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&epochSlots, &s->next, s, false,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+	mySlot = s;
+	return s;
+}
+
+
+void epoch_enter()
+{
+	if (nesting++ > 0)
+		return;
+	epoch_slot *slot = slot_get();
+	uint64_t e = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+	uint64_t now;
+
+	// Publish the epoch, then make sure no thread advancing it could have missed us
+	__atomic_store_n(&slot->epoch, e, __ATOMIC_SEQ_CST);
+	while ((now = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST)) != e) {
+		e = now;
+		__atomic_store_n(&slot->epoch, e, __ATOMIC_SEQ_CST);
+	}
+}
+
+
+void epoch_exit()
+{
+	if (--nesting > 0)
+		return;
+	__atomic_store_n(&mySlot->epoch, EPOCH_IDLE, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @brief Function to advance the global epoch if every thread inside an epoch has seen the current one.
+ * @return Returns the global epoch
+ */
+static uint64_t try_advance()
+{
+	uint64_t e = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+	epoch_slot *s;
+	for (s = __atomic_load_n(&epochSlots, __ATOMIC_ACQUIRE); s != NULL; s = s->next) {
+		uint64_t seen = __atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST);
+		if (seen != EPOCH_IDLE && seen != e)
+			return e;
+	}
+	if (__atomic_compare_exchange_n(&globalEpoch, &e, e + 1, false,
+			__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+		return e + 1;
+	return e;
+}
+
+
+void epoch_retire(epoch_entry *entry, void (*destroy)(epoch_entry *entry))
+{
+	slot_get();
+	entry->destroy = destroy;
+	entry->next = NULL;
+	entry->epoch = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+	if (limboTail == NULL)
+		limboHead = entry;
+	else
+		limboTail->next = entry;
+	limboTail = entry;
+
+	if (++retiresSinceCollect >= EPOCH_COLLECT_INTERVAL)
+		epoch_collect();
+}
+
+
+void epoch_collect()
+{
+	retiresSinceCollect = 0;
+	uint64_t e = try_advance();
+
+	// The limbo list is in retire order, so stop at the first object still in use
+	while (limboHead != NULL && limboHead->epoch + 2 <= e) {
+		epoch_entry *entry = limboHead;
+		limboHead = entry->next;
+		entry->destroy(entry);
+	}
+	if (limboHead == NULL)
+		limboTail = NULL;
+
+	if (__atomic_load_n(&orphans, __ATOMIC_RELAXED) == NULL ||
+			pthread_mutex_trylock(&orphanLock) != 0)
+		return;
+	epoch_entry **link = &orphans;
+	while (*link != NULL) {
+		epoch_entry *entry = *link;
+		if (entry->epoch + 2 <= e) {
+			*link = entry->next;
+			entry->destroy(entry);
+		} else {
+			link = &entry->next;
+		}
+	}
+	pthread_mutex_unlock(&orphanLock);
+}
+
+
+void epoch_thread_exit()
+{
+	if (mySlot == NULL)
+		return;
+	if (limboHead != NULL) {
+		pthread_mutex_lock(&orphanLock);
+		limboTail->next = orphans;
+		__atomic_store_n(&orphans, limboHead, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&orphanLock);
+		limboHead = limboTail = NULL;
+	}
+	__atomic_store_n(&mySlot->inUse, false, __ATOMIC_RELEASE);
+	mySlot = NULL;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file
+ * @brief This file declares epoch-based memory reclamation, used to free
+ * shared objects that lock-free readers may still be looking at.
+ *
+ * A thread brackets every access to shared objects with epoch_enter() and
+ * epoch_exit().  An object that has been unlinked, so that no new reader
+ * can find it, is handed to epoch_retire() instead of being freed.  It is
+ * destroyed once the global epoch has advanced twice, which can only
+ * happen after every thread that was inside an epoch at the time has left
+ * it.  Readers never write shared memory other than their own slot.
+ */
+
+#ifndef	EPOCH_H
+#define EPOCH_H
+
+#include <stdint.h>
+
+#define EPOCH_IDLE UINT64_MAX		///< Epoch published by a thread that is not inside an epoch.
+#define EPOCH_COLLECT_INTERVAL 64	///< Retires between two attempts to advance the epoch and free garbage.
+
+/**
+ * @brief Reclamation bookkeeping, embedded in every object that may be retired.
+ */
+typedef struct epoch_entry {
+	// Next retired object of the same thread
+	struct epoch_entry *next;
+	// Global epoch when the object was retired
+	uint64_t epoch;
+	// Frees the object
+	void (*destroy)(struct epoch_entry *entry);
+} epoch_entry;
+
+/**
+ * @brief Enter an epoch. Objects reached until epoch_exit() stay allocated.
+ *
+ * Calls nest, only the outermost pair has an effect.
+ */
+void epoch_enter();
+
+/**
+ * @brief Leave the epoch entered by the matching epoch_enter().
+ */
+void epoch_exit();
+
+/**
+ * @brief Free an unlinked object once no reader can hold it any more.
+ *
+ * @param entry The entry embedded in the object.
+ * @param destroy Function called with entry to free the object.
+ *
+ * The object must already be unreachable for readers that enter an epoch
+ * from now on.
+ */
+void epoch_retire(epoch_entry *entry, void (*destroy)(epoch_entry *entry));
+
+/**
+ * @brief Try to advance the global epoch and free the objects retired by
+ * the current thread, and by exited threads, that are safe to free.
+ */
+void epoch_collect();
+
+/**
+ * @brief Hand the slot and the pending garbage of an exiting thread over to
+ * other threads. Must be called outside of an epoch.
+ */
+void epoch_thread_exit();
+
+#endif
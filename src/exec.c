@@ -0,0 +1,227 @@
+/**
+ * @file
+ * @brief This file implements the core executors declared in exec.h.
+ *
+ * Each queue is an intrusive multi-producer, single-consumer list after
+ * Vyukov: a pusher swaps itself in as the head and then links the old head
+ * to itself, and the owner pops from the tail.  A task pushed but not yet
+ * linked is simply not seen until its pusher links it.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "exec.h"
+#include "hashmap.h"
+
+/**
+ * @brief An executor and its queue.
+ */
+typedef struct {
+	// Last task pushed, swapped by the pushers
+	exec_task *head;
+	// Bumped after every push, the word the executor sleeps on
+	uint32_t pushes;
+	// Set by the executor while it sleeps on pushes
+	uint32_t sleeping;
+	char pad1[48];
+	// Next task to pop, or the stub, touched by the executor only
+	exec_task *tail;
+	// Tasks run, read by STATS
+	uint64_t tasks;
+	// Placeholder that keeps the queue from ever being empty
+	exec_task stub;
+	char pad2[24];
+	pthread_t thread;
+	int index;
+} __attribute__((aligned(64))) exec_core;
+
+static exec_core *cores = NULL;
+static int numCores = 0;
+static int sliceBits = 0;
+static __thread int myCore = -1;
+
+
+/**
+ * @brief Function to link a task at the head of a queue.
+ * @param c The executor
+ * @param task The task
+ * @return Returns void
+ */
+static void push(exec_core *c, exec_task *task)
+{
+	__atomic_store_n(&task->next, NULL, __ATOMIC_RELAXED);
+	exec_task *prev = __atomic_exchange_n(&c->head, task, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&prev->next, task, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @brief Function to take the task at the tail of a queue. Called by its executor only.
+ * @param c The executor
+ * @return Returns the task, or NULL if none is linked yet
+ */
+static exec_task* pop(exec_core *c)
+{
+	exec_task *tail = c->tail;
+	exec_task *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (tail == &c->stub) {
+		if (next == NULL)
+			return NULL;
+		c->tail = tail = next;
+		next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	}
+	if (next != NULL) {
+		c->tail = next;
+		return tail;
+	}
+	// tail is the last task; a pusher may be between its swap and its link
+	if (tail != __atomic_load_n(&c->head, __ATOMIC_ACQUIRE))
+		return NULL;
+	// Put the stub behind it, so it can be taken without emptying the queue
+	push(c, &c->stub);
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next == NULL)
+		return NULL;
+	c->tail = next;
+	return tail;
+}
+
+
+/**
+ * @brief Function to tell the submitter of a task that it ran.
+ * @param task The task, which may be gone once this returns
+ * @return Returns void
+ */
+static void complete(exec_task *task)
+{
+	if (__atomic_exchange_n(&task->state, 1, __ATOMIC_ACQ_REL) == 2)
+		syscall(SYS_futex, &task->state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+
+/**
+ * @brief Thread function of an executor: run the tasks of its queue, sleeping while it is empty.
+ * @param arg The executor
+ * @return Returns NULL, never
+ */
+static void* core_main(void *arg)
+{
+	exec_core *c = arg;
+	myCore = c->index;
+	for (;;) {
+		exec_task *task = NULL;
+		int i;
+		for (i = 0; i < EXEC_SPIN && task == NULL; i++)
+			task = pop(c);
+		if (task == NULL) {
+			// A push after pushes is read bumps it, so the wait returns at once
+			uint32_t seen = __atomic_load_n(&c->pushes, __ATOMIC_SEQ_CST);
+			__atomic_store_n(&c->sleeping, 1, __ATOMIC_SEQ_CST);
+			task = pop(c);
+			if (task == NULL)
+				syscall(SYS_futex, &c->pushes, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+			__atomic_store_n(&c->sleeping, 0, __ATOMIC_RELAXED);
+			if (task == NULL)
+				continue;
+		}
+		task->run(task);
+		__atomic_store_n(&c->tasks, c->tasks + 1, __ATOMIC_RELAXED);
+		complete(task);
+	}
+	return NULL;
+}
+
+
+int exec_start(int n, const int *cpus, int numCpus)
+{
+	cores = aligned_alloc(64, (size_t)n * sizeof(exec_core));
+	if (cores == NULL)
+		return -1;
+	memset(cores, 0, (size_t)n * sizeof(exec_core));
+	sliceBits = __builtin_ctz(n);
+	int i;
+	for (i = 0; i < n; i++) {
+		exec_core *c = &cores[i];
+		c->head = c->tail = &c->stub;
+		c->index = i;
+	}
+	for (i = 0; i < n; i++) {
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		if (numCpus > 0) {
+			// One CPU each, so the slice of the executor stays in its cache
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(cpus[i % numCpus], &set);
+			pthread_attr_setaffinity_np(&attr, sizeof set, &set);
+		}
+		int status = pthread_create(&cores[i].thread, &attr, core_main, &cores[i]);
+		pthread_attr_destroy(&attr);
+		if (status != 0)
+			return -1;
+		pthread_detach(cores[i].thread);
+	}
+	numCores = n;
+	return 0;
+}
+
+
+int exec_cores()
+{
+	return numCores;
+}
+
+
+int exec_self()
+{
+	return myCore;
+}
+
+
+int exec_owner(const char *key)
+{
+	return (int)hm_slice_of(key, sliceBits);
+}
+
+
+int exec_bits()
+{
+	return sliceBits;
+}
+
+
+void exec_submit(int core, exec_task *task)
+{
+	exec_core *c = &cores[core];
+	task->state = 0;
+	push(c, task);
+	__atomic_add_fetch(&c->pushes, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&c->sleeping, __ATOMIC_SEQ_CST))
+		syscall(SYS_futex, &c->pushes, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+
+void exec_wait(exec_task *task)
+{
+	int i;
+	for (i = 0; i < EXEC_SPIN; i++)
+		if (__atomic_load_n(&task->state, __ATOMIC_ACQUIRE) == 1)
+			return;
+	uint32_t expected = 0;
+	__atomic_compare_exchange_n(&task->state, &expected, 2, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+	while (__atomic_load_n(&task->state, __ATOMIC_ACQUIRE) != 1)
+		syscall(SYS_futex, &task->state, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+}
+
+
+uint64_t exec_tasks(int core)
+{
+	return __atomic_load_n(&cores[core].tasks, __ATOMIC_RELAXED);
+}
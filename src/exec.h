@@ -0,0 +1,97 @@
+/**
+ * @file
+ * @brief This file declares the core executors: threads that each own a slice of every table.
+ *
+ * With "cores N" in the config, the server starts N executor threads.  The
+ * keys of every table are cut into N slices by their hash, the same cut
+ * the key index uses for its split-ordered list, and executor i is the only
+ * thread that runs GET and SET on the keys of slice i.  A connection thread
+ * hands such a command to the owner as a task on the owner's queue and
+ * waits for it; a QUERY becomes one task per executor, each scanning its own
+ * slice.  Writers of one key never meet on different cores, so record
+ * locks are never contended and each slice stays in one core's cache.
+ *
+ * The queues are lock-free: any number of threads push, and only the
+ * owner pops.  An idle executor spins briefly, then sleeps on a futex that
+ * a pusher wakes only when it knows the executor is asleep; a waiting
+ * connection thread does the same on its task.
+ */
+
+#ifndef	EXEC_H
+#define EXEC_H
+
+#include <stdint.h>
+
+#define MAX_CORES 64	///< Executors a server may run, a power of two at most 2^6 since slices come from the key index.
+#define EXEC_SPIN 200	///< Polls of an empty queue, or of an unfinished task, before sleeping.
+
+/**
+ * @brief A task for an executor, embedded first in the structure that carries its arguments.
+ */
+typedef struct exec_task {
+	// Next task in the queue
+	struct exec_task *next;
+	// Run by the executor
+	void (*run)(struct exec_task *task);
+	// 0 while queued or running, 1 once done, 2 while the submitter sleeps on it
+	uint32_t state;
+} exec_task;
+
+/**
+ * @brief Start the executors.
+ *
+ * @param numCores Number of executors, a power of two from 1 to MAX_CORES.
+ * @param cpus CPUs to pin the executors to, executor i on cpus[i % numCpus].
+ * @param numCpus Number of CPUs in cpus, 0 to leave the executors on the CPUs of the calling thread.
+ * @return Return 0 on success, -1 if a thread could not be started or pinned.
+ */
+int exec_start(int numCores, const int *cpus, int numCpus);
+
+/**
+ * @brief Number of executors, 0 until started.
+ */
+int exec_cores();
+
+/**
+ * @brief Tell which executor the calling thread is.
+ *
+ * @return Return the executor, or -1 for any other thread.
+ */
+int exec_self();
+
+/**
+ * @brief Tell which executor owns a key.
+ *
+ * @param key The key.
+ * @return Return the executor, which owns the key in every table.
+ */
+int exec_owner(const char *key);
+
+/**
+ * @brief Bits of the slice numbers of the executors, for querySlice().
+ */
+int exec_bits();
+
+/**
+ * @brief Queue a task on an executor.
+ *
+ * @param core The executor.
+ * @param task The task, with run set. It must stay valid until exec_wait() returns.
+ */
+void exec_submit(int core, exec_task *task);
+
+/**
+ * @brief Wait until an executor ran a task.
+ *
+ * @param task The task, submitted.
+ */
+void exec_wait(exec_task *task);
+
+/**
+ * @brief Count the tasks an executor ran.
+ *
+ * @param core The executor.
+ */
+uint64_t exec_tasks(int core);
+
+#endif
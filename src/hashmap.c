@@ -0,0 +1,303 @@
+/**
+ * @file
+ * @brief This file implements the concurrent hash map declared in hashmap.h.
+ *
+ * Split-ordered lists after Shalev and Shavit, with the list operations of
+ * Michael's lock-free linked list: a node is removed by first marking its
+ * next pointer and then unlinking it, and any traversal that meets a marked
+ * node helps to unlink it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "hashmap.h"
+#include "utils.h"
+
+// The low bit of a next pointer marks its node as removed
+#define MARK ((uintptr_t)1)
+
+static inline bool is_marked(hm_node *p) { return ((uintptr_t)p & MARK) != 0; }
+static inline hm_node* marked(hm_node *p) { return (hm_node*)((uintptr_t)p | MARK); }
+static inline hm_node* unmarked(hm_node *p) { return (hm_node*)((uintptr_t)p & ~MARK); }
+
+
+/**
+ * @brief Function to hash a key, 64 bit FNV-1a.
+ * @param key The key
+ * @return Returns the hash
+ */
+static uint64_t hash_key(const char *key)
+{
+	uint64_t h = 14695981039346656037ULL;
+	for (; *key != 0; key++) {
+		h ^= (unsigned char)*key;
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+
+/**
+ * @brief Function to reverse the bits of a word.
+ * @param x The word
+ * @return Returns x with bit 0 swapped with bit 63, bit 1 with bit 62 and so on
+ */
+static uint64_t reverse_bits(uint64_t x)
+{
+	x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+	x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+	x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+	return __builtin_bswap64(x);
+}
+
+
+/**
+ * @brief Function to order a node against a split-order key and key.
+ * @return Returns a negative, zero or positive number as the node sorts before, with or after them
+ */
+static int compare_node(hm_node *node, uint64_t sokey, const char *key)
+{
+	if (node->sokey != sokey)
+		return (node->sokey < sokey) ? -1 : 1;
+	// Equal split-order keys of bucket nodes are the same bucket
+	if (key == NULL)
+		return 0;
+	return strcmp(node->key, key);
+}
+
+
+/**
+ * @brief Function to find where a key belongs in the list, unlinking removed nodes on the way.
+ * @param m The map
+ * @param start The bucket node to start from
+ * @param sokey Split-order key searched
+ * @param key Key searched, NULL for a bucket node
+ * @param prevp Set to the link that points at *currp
+ * @param currp Set to the first node that does not sort before the key, or NULL
+ * @return Returns true if *currp holds the key
+ */
+static bool list_find(hashmap *m, hm_node *start, uint64_t sokey, const char *key,
+		hm_node ***prevp, hm_node **currp)
+{
+retry:
+	;
+	hm_node **prev = &start->next;
+	hm_node *curr = unmarked(__atomic_load_n(prev, __ATOMIC_ACQUIRE));
+	while (curr != NULL) {
+		hm_node *next = __atomic_load_n(&curr->next, __ATOMIC_ACQUIRE);
+		if (is_marked(next)) {
+			// curr is removed, help unlink it
+			hm_node *expected = curr;
+			if (!__atomic_compare_exchange_n(prev, &expected, unmarked(next), false,
+					__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+				goto retry;
+			m->retire(curr, m->retireArg);
+			curr = unmarked(next);
+			continue;
+		}
+		int cmp = compare_node(curr, sokey, key);
+		if (cmp >= 0) {
+			*prevp = prev;
+			*currp = curr;
+			return cmp == 0;
+		}
+		prev = &curr->next;
+		curr = next;
+	}
+	*prevp = prev;
+	*currp = NULL;
+	return false;
+}
+
+
+/**
+ * @brief Function to add a node to the list unless its key is there already.
+ * @return Returns node if it was added, or the node already holding the key
+ */
+static hm_node* list_insert(hashmap *m, hm_node *start, hm_node *node)
+{
+	for (;;) {
+		hm_node **prev, *curr;
+		if (list_find(m, start, node->sokey, node->key, &prev, &curr))
+			return curr;
+		node->next = curr;
+		if (__atomic_compare_exchange_n(prev, &curr, node, false,
+				__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			return node;
+	}
+}
+
+
+/**
+ * @brief Function to find the address of a bucket, allocating its segment if needed.
+ */
+static hm_node** bucket_slot(hashmap *m, size_t b)
+{
+	int k = 63 - __builtin_clzll(b / HM_BASE_BUCKETS + 1);
+	size_t first = (size_t)HM_BASE_BUCKETS * ((1UL << k) - 1);
+	hm_node **seg = __atomic_load_n(&m->segments[k], __ATOMIC_ACQUIRE);
+	if (seg == NULL) {
+		hm_node **fresh = calloc((size_t)HM_BASE_BUCKETS << k, sizeof(hm_node*));
+		if (fresh == NULL)
+			die("Out of memory growing a hash map.", EXIT_FAILURE);
+		if (__atomic_compare_exchange_n(&m->segments[k], &seg, fresh, false,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			seg = fresh;
+		else
+			free(fresh);
+	}
+	return &seg[b - first];
+}
+
+
+/**
+ * @brief Function to find the bucket node of a bucket, adding it to the list if needed.
+ */
+static hm_node* get_bucket(hashmap *m, size_t b)
+{
+	if (b == 0)
+		return &m->head;
+	hm_node **slot = bucket_slot(m, b);
+	hm_node *bucket = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+	if (bucket != NULL)
+		return bucket;
+
+	// A new bucket splits its parent, the bucket without the top bit
+	size_t parent = b & ~(1UL << (63 - __builtin_clzll(b)));
+	hm_node *node = calloc(1, sizeof(hm_node));
+	if (node == NULL)
+		die("Out of memory growing a hash map.", EXIT_FAILURE);
+	node->sokey = reverse_bits(b);
+	bucket = list_insert(m, get_bucket(m, parent), node);
+	if (bucket != node)
+		free(node);
+	__atomic_store_n(slot, bucket, __ATOMIC_RELEASE);
+	return bucket;
+}
+
+
+void hm_init(hashmap *m, void (*retire)(hm_node *node, void *arg), void *arg)
+{
+	memset(m, 0, sizeof *m);
+	m->size = HM_BASE_BUCKETS;
+	m->retire = retire;
+	m->retireArg = arg;
+}
+
+
+hm_node* hm_find(hashmap *m, const char *key)
+{
+	uint64_t h = hash_key(key);
+	size_t size = __atomic_load_n(&m->size, __ATOMIC_ACQUIRE);
+	hm_node *bucket = get_bucket(m, h & (size - 1));
+	uint64_t sokey = reverse_bits(h | (1ULL << 63));
+
+	// Read-only walk: removed nodes are skipped, not unlinked
+	hm_node *curr = unmarked(__atomic_load_n(&bucket->next, __ATOMIC_ACQUIRE));
+	while (curr != NULL) {
+		hm_node *next = __atomic_load_n(&curr->next, __ATOMIC_ACQUIRE);
+		int cmp = compare_node(curr, sokey, key);
+		if (cmp > 0)
+			return NULL;
+		if (cmp == 0 && !is_marked(next))
+			return curr;
+		curr = unmarked(next);
+	}
+	return NULL;
+}
+
+
+hm_node* hm_insert(hashmap *m, hm_node *node)
+{
+	uint64_t h = hash_key(node->key);
+	size_t size = __atomic_load_n(&m->size, __ATOMIC_ACQUIRE);
+	node->sokey = reverse_bits(h | (1ULL << 63));
+	hm_node *found = list_insert(m, get_bucket(m, h & (size - 1)), node);
+	if (found != node)
+		return found;
+
+	size_t count = __atomic_add_fetch(&m->count, 1, __ATOMIC_RELAXED);
+	size_t maxSize = (size_t)HM_BASE_BUCKETS << (HM_SEGMENTS - 1);
+	if (count > size * HM_LOAD_FACTOR && size < maxSize)
+		__atomic_compare_exchange_n(&m->size, &size, size * 2, false,
+				__ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+	return node;
+}
+
+
+int hm_remove(hashmap *m, hm_node *node)
+{
+	uint64_t h = hash_key(node->key);
+	size_t size = __atomic_load_n(&m->size, __ATOMIC_ACQUIRE);
+	hm_node *bucket = get_bucket(m, h & (size - 1));
+	for (;;) {
+		hm_node **prev, *curr;
+		if (!list_find(m, bucket, node->sokey, node->key, &prev, &curr) || curr != node)
+			return -1;
+		hm_node *next = __atomic_load_n(&curr->next, __ATOMIC_ACQUIRE);
+		if (is_marked(next))
+			return -1;
+		if (!__atomic_compare_exchange_n(&curr->next, &next, marked(next), false,
+				__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			continue;
+		__atomic_sub_fetch(&m->count, 1, __ATOMIC_RELAXED);
+		hm_node *expected = curr;
+		if (__atomic_compare_exchange_n(prev, &expected, next, false,
+				__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			m->retire(curr, m->retireArg);
+		else
+			list_find(m, bucket, node->sokey, node->key, &prev, &curr); // unlinks it
+		return 0;
+	}
+}
+
+
+hm_node* hm_first(hashmap *m)
+{
+	return hm_next(&m->head);
+}
+
+
+hm_node* hm_next(hm_node *node)
+{
+	hm_node *p = unmarked(__atomic_load_n(&node->next, __ATOMIC_ACQUIRE));
+	while (p != NULL) {
+		hm_node *next = __atomic_load_n(&p->next, __ATOMIC_ACQUIRE);
+		if (p->key != NULL && !is_marked(next))
+			return p;
+		p = unmarked(next);
+	}
+	return NULL;
+}
+
+
+unsigned hm_slice_of(const char *key, int bits)
+{
+	return (unsigned)(hash_key(key) & ((1ULL << bits) - 1));
+}
+
+
+hm_node* hm_slice_first(hashmap *m, unsigned slice, int bits)
+{
+	// The slice starts at its bucket, whose split-order key has the slice number reversed on top
+	hm_node *node = hm_next(get_bucket(m, slice));
+	if (node == NULL || bits == 0)
+		return node;
+	return ((node->sokey >> (64 - bits)) == (reverse_bits(slice) >> (64 - bits))) ? node : NULL;
+}
+
+
+hm_node* hm_slice_next(hm_node *node, int bits)
+{
+	hm_node *next = hm_next(node);
+	if (next == NULL || bits == 0)
+		return next;
+	return ((next->sokey >> (64 - bits)) == (node->sokey >> (64 - bits))) ? next : NULL;
+}
+
+
+size_t hm_count(hashmap *m)
+{
+	return __atomic_load_n(&m->count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,150 @@
+/**
+ * @file
+ * @brief This file declares a concurrent hash map of string keys used as
+ * the key index of a table.
+ *
+ * The map is a split-ordered list: every node sits in a single lock-free
+ * linked list sorted by the bit-reversed hash of its key, and the buckets
+ * are shortcuts into that list.  Growing the map only adds buckets, so no
+ * node ever moves.  Lookups and iteration take no lock.
+ *
+ * Nodes are embedded in the caller's structures.  A removed node may still
+ * be read by lookups that started before the removal, so the map never
+ * frees nodes: once a node is unlinked it is handed to the retire function
+ * given to hm_init(), which must delay freeing it until those lookups are
+ * done.
+ */
+
+#ifndef	HASHMAP_H
+#define HASHMAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HM_BASE_BUCKETS 64	///< Buckets in the first bucket segment, each later segment doubles.
+#define HM_SEGMENTS 40		///< Max bucket segments.
+#define HM_LOAD_FACTOR 2	///< Average nodes per bucket before the map doubles its buckets.
+
+/**
+ * @brief A node of the map, embedded in the structure it indexes.
+ */
+typedef struct hm_node {
+	// Bit-reversed hash, odd for key nodes and even for bucket nodes
+	uint64_t sokey;
+	// Next node in split order, the low bit marks this node as removed
+	struct hm_node *next;
+	// Key of the node, NULL for bucket nodes. Must not change while the node is in the map.
+	const char *key;
+} hm_node;
+
+/**
+ * @brief A concurrent hash map.
+ */
+typedef struct {
+	// Segment k holds HM_BASE_BUCKETS << k bucket nodes, allocated when first needed
+	hm_node **segments[HM_SEGMENTS];
+	// Number of buckets in use, a power of two
+	size_t size;
+	// Number of key nodes in the map
+	size_t count;
+	// Called once for every key node after it is unlinked
+	void (*retire)(hm_node *node, void *arg);
+	void *retireArg;
+	// Bucket node of bucket 0, the head of the list
+	hm_node head;
+} hashmap;
+
+/**
+ * @brief Initialize an empty map.
+ *
+ * @param m The map.
+ * @param retire Function called with every key node the map unlinks.
+ * @param arg Passed to retire.
+ */
+void hm_init(hashmap *m, void (*retire)(hm_node *node, void *arg), void *arg);
+
+/**
+ * @brief Find the node of a key.
+ *
+ * @param m The map.
+ * @param key The key.
+ * @return Return the node, or NULL if the key is not in the map.
+ */
+hm_node* hm_find(hashmap *m, const char *key);
+
+/**
+ * @brief Add a node unless its key is already in the map.
+ *
+ * @param m The map.
+ * @param node The node to add, with its key set.
+ * @return Return node if it was added, or the node already holding the key.
+ */
+hm_node* hm_insert(hashmap *m, hm_node *node);
+
+/**
+ * @brief Remove a node from the map.
+ *
+ * @param m The map.
+ * @param node The node to remove.
+ * @return Return 0 if this call removed the node, -1 if it was not in the map.
+ */
+int hm_remove(hashmap *m, hm_node *node);
+
+/**
+ * @brief Start an iteration over the key nodes, in no particular order.
+ *
+ * @param m The map.
+ * @return Return the first key node, or NULL if the map is empty.
+ *
+ * Nodes added or removed during the iteration may or may not be returned.
+ */
+hm_node* hm_first(hashmap *m);
+
+/**
+ * @brief Continue an iteration started by hm_first().
+ *
+ * @param node The node returned last.
+ * @return Return the next key node, or NULL at the end.
+ */
+hm_node* hm_next(hm_node *node);
+
+/**
+ * @brief Tell which slice of the map a key falls in, when the map is cut in 2^bits slices.
+ *
+ * @param key The key.
+ * @param bits Bits of the slice number, at most 6.
+ * @return Return the slice, from 0 to 2^bits - 1, the same for every map.
+ *
+ * A slice is the keys whose hash ends with the slice number. Since the list
+ * is sorted by bit-reversed hash, they are next to each other in it.
+ */
+unsigned hm_slice_of(const char *key, int bits);
+
+/**
+ * @brief Start an iteration over the key nodes of one slice.
+ *
+ * @param m The map.
+ * @param slice The slice, from 0 to 2^bits - 1.
+ * @param bits Bits of the slice number, at most 6. 0 iterates over the whole map.
+ * @return Return the first key node of the slice, or NULL if it is empty.
+ */
+hm_node* hm_slice_first(hashmap *m, unsigned slice, int bits);
+
+/**
+ * @brief Continue an iteration started by hm_slice_first().
+ *
+ * @param node The node returned last.
+ * @param bits Bits of the slice number, as given to hm_slice_first().
+ * @return Return the next key node of the slice, or NULL at its end.
+ */
+hm_node* hm_slice_next(hm_node *node, int bits);
+
+/**
+ * @brief Number of keys in the map.
+ *
+ * @param m The map.
+ * @return Return the number of key nodes, which may be stale under concurrent updates.
+ */
+size_t hm_count(hashmap *m);
+
+#endif
@@ -0,0 +1,344 @@
+/**
+ * @file
+ * @brief This file implements an in-process microbenchmark of the storage engine.
+ *
+ * The benchmark links libengine.a directly, so it measures the engine
+ * without sockets, parsing or replies.  For every table size and column
+ * count of the sweep it fills a fresh table, then times insertRecord(),
+ * findRecord(), queryAllRecords() at every predicate selectivity and
+ * deleteRecord(), and prints the nanoseconds, bytes allocated and
+ * allocations per operation.
+ *
+ * Column c0 is an int column and the record of key "k<i>" holds i % 100
+ * in it, so the predicate "c0 < s" selects s percent of the rows.  The
+ * other columns are strings.  Allocations are counted by wrapping
+ * malloc(), calloc() and realloc(); the few aligned allocations of the
+ * statistics blocks are not counted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include "utils.h"
+#include "engine.h"
+
+#define MICROBENCH_MAX_SWEEP 16	///< Max values in a column count or selectivity list.
+
+/**
+ * @brief Settings of a run, from the command line.
+ */
+typedef struct {
+	// Smallest and largest table size, the sweep multiplies by 10
+	long minRows;
+	long maxRows;
+	// Column counts to sweep
+	int cols[MICROBENCH_MAX_SWEEP];
+	int numCols;
+	// Predicate selectivities to sweep, in percent
+	int sels[MICROBENCH_MAX_SWEEP];
+	int numSels;
+	// Rows scanned by the queries of one selectivity, at least 3 queries are run
+	long scanBudget;
+} microbench_config;
+
+/**
+ * @brief Cost of one timed phase.
+ */
+typedef struct {
+	uint64_t ns;
+	uint64_t bytes;
+	uint64_t allocs;
+} phase_cost;
+
+static microbench_config config;
+
+// Bytes and calls of every allocation made so far
+static uint64_t allocBytes = 0;
+static uint64_t allocCalls = 0;
+// Tables created so far
+static int numTables = 0;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+
+void *malloc(size_t size)
+{
+	__atomic_add_fetch(&allocBytes, size, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&allocCalls, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+
+void *calloc(size_t n, size_t size)
+{
+	__atomic_add_fetch(&allocBytes, n * size, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&allocCalls, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(n, size);
+}
+
+
+void *realloc(void *ptr, size_t size)
+{
+	__atomic_add_fetch(&allocBytes, size, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&allocCalls, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(ptr, size);
+}
+
+
+/**
+ * @brief Function to read the monotonic clock.
+ * @return Returns nanoseconds since an arbitrary start
+ */
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/**
+ * @brief Function to draw a random number, xorshift64*.
+ * @param state The generator state, never 0
+ * @return Returns 64 random bits
+ */
+static uint64_t next_random(uint64_t *state)
+{
+	uint64_t x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 2685821657736338717ULL;
+}
+
+
+/**
+ * @brief Function to start a timed phase.
+ * @param cost Filled with the clock and allocation counters at the start
+ */
+static void phase_start(phase_cost *cost)
+{
+	cost->bytes = __atomic_load_n(&allocBytes, __ATOMIC_RELAXED);
+	cost->allocs = __atomic_load_n(&allocCalls, __ATOMIC_RELAXED);
+	cost->ns = now_ns();
+}
+
+
+/**
+ * @brief Function to end a timed phase.
+ * @param cost Turned from the counters at the start into the cost of the phase
+ */
+static void phase_end(phase_cost *cost)
+{
+	cost->ns = now_ns() - cost->ns;
+	cost->bytes = __atomic_load_n(&allocBytes, __ATOMIC_RELAXED) - cost->bytes;
+	cost->allocs = __atomic_load_n(&allocCalls, __ATOMIC_RELAXED) - cost->allocs;
+}
+
+
+/**
+ * @brief Function to print the cost of a phase per operation.
+ * @param rows Rows in the table
+ * @param cols Columns in the table
+ * @param op Name of the operation
+ * @param sel Selectivity of a query in percent, -1 for other operations
+ * @param cost Cost of the phase
+ * @param ops Operations in the phase
+ * @param matched Rows matched by a query, per query
+ * @return Returns void
+ */
+static void print_cost(long rows, int cols, const char *op, int sel, const phase_cost *cost,
+	long ops, long matched)
+{
+	char selText[12] = "-";
+	char matchedText[24] = "-";
+	if (sel >= 0) {
+		snprintf(selText, sizeof selText, "%d%%", sel);
+		snprintf(matchedText, sizeof matchedText, "%ld", matched);
+	}
+	printf("%9ld %5d %-7s %5s %10s %12.1f %10.1f %9.2f\n", rows, cols, op, selText, matchedText,
+		(double)cost->ns / ops, (double)cost->bytes / ops, (double)cost->allocs / ops);
+}
+
+
+/**
+ * @brief Function to create a fresh table with an int column c0 and string columns c1 and up.
+ * @param cols Number of columns
+ * @return Returns the table
+ */
+static table* make_table(int cols)
+{
+	char name[MAX_TABLE_LENGTH];
+	snprintf(name, sizeof name, "mb%d", numTables);
+	addTable(name, numTables);
+	table *t = tables[numTables++];
+	int i;
+	for (i = 0; i < cols; i++) {
+		char colName[MAX_COLNAME_LEN];
+		snprintf(colName, sizeof colName, "c%d", i);
+		if (addColumn(t, colName, (i == 0) ? -1 : MAX_STRTYPE_SIZE) != 0)
+			die("Out of memory adding a column.", EXIT_FAILURE);
+	}
+	return t;
+}
+
+
+/**
+ * @brief Function to run every phase on a table of the given shape.
+ * @param rows Rows in the table
+ * @param cols Columns in the table
+ * @return Returns void
+ */
+static void run_one(long rows, int cols)
+{
+	table *t = make_table(cols);
+	census *rp = newRecord(cols);
+	phase_cost cost;
+	long i;
+	int j;
+
+	phase_start(&cost);
+	for (i = 0; i < rows; i++) {
+		snprintf(rp->key, sizeof rp->key, "k%d", (int)i);
+		rp->metadata = 0;
+		snprintf(rp->value[0], MAX_STRTYPE_SIZE, "%d", (int)(i % 100));
+		for (j = 1; j < cols; j++)
+			snprintf(rp->value[j], MAX_STRTYPE_SIZE, "v%d", (int)i);
+		if (insertRecord(t, rp) != 0)
+			die("Insert failed.", EXIT_FAILURE);
+	}
+	phase_end(&cost);
+	print_cost(rows, cols, "insert", -1, &cost, rows, 0);
+
+	// Random hits, the epoch is what the server pays around every lookup
+	uint64_t rng = 0x9E3779B97F4A7C15ULL;
+	char key[MAX_KEY_LEN];
+	long found = 0;
+	phase_start(&cost);
+	for (i = 0; i < rows; i++) {
+		snprintf(key, sizeof key, "k%d", (int)(next_random(&rng) % rows));
+		epoch_enter();
+		if (findRecord(t, key) != NULL)
+			found++;
+		epoch_exit();
+	}
+	phase_end(&cost);
+	if (found != rows)
+		die("Find missed a key.", EXIT_FAILURE);
+	print_cost(rows, cols, "find", -1, &cost, rows, 0);
+
+	long queries = config.scanBudget / rows;
+	if (queries < 3)
+		queries = 3;
+	for (j = 0; j < config.numSels; j++) {
+		predicate pred;
+		memset(&pred, 0, sizeof pred);
+		pred.type = -1;
+		pred.cmp = -1;
+		pred.colNum = 0;
+		snprintf(pred.value, sizeof pred.value, "%d", config.sels[j]);
+		long matched = 0;
+		phase_start(&cost);
+		for (i = 0; i < queries; i++)
+			matched = queryAllRecords(t, &pred, 1, NULL, 0);
+		phase_end(&cost);
+		print_cost(rows, cols, "query", config.sels[j], &cost, queries, matched);
+	}
+
+	phase_start(&cost);
+	for (i = 0; i < rows; i++) {
+		snprintf(rp->key, sizeof rp->key, "k%d", (int)i);
+		if (deleteRecord(t, rp) != 0)
+			die("Delete failed.", EXIT_FAILURE);
+	}
+	phase_end(&cost);
+	print_cost(rows, cols, "delete", -1, &cost, rows, 0);
+
+	// Free what the deletes left behind before the next table is filled
+	collectGarbage(t);
+	epoch_collect();
+	free(rp);
+}
+
+
+/**
+ * @brief Function to parse a comma separated list of integers.
+ * @param s The list
+ * @param out Where to store the integers
+ * @param min Smallest valid integer
+ * @param max Largest valid integer
+ * @return Returns the number of integers, -1 if the list is not valid
+ */
+static int parse_list(const char *s, int *out, int min, int max)
+{
+	int n = 0;
+	while (*s != '\0') {
+		char *end;
+		long v = strtol(s, &end, 10);
+		if (end == s || v < min || v > max || n == MICROBENCH_MAX_SWEEP)
+			return -1;
+		out[n++] = (int)v;
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return -1;
+		s = end;
+	}
+	return (n > 0) ? n : -1;
+}
+
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [options]\n"
+		"  -m rows        smallest table (1000)\n"
+		"  -n rows        largest table, the sweep multiplies by 10 (1000000)\n"
+		"  -c c1,c2,...   column counts (1,4,16)\n"
+		"  -s s1,s2,...   query selectivities in percent (1,10,50,100)\n"
+		"  -q rows        rows scanned by the queries of one selectivity (1000000)\n", prog);
+}
+
+
+int main(int argc, char *argv[])
+{
+	config.minRows = 1000;
+	config.maxRows = 1000000;
+	config.numCols = parse_list("1,4,16", config.cols, 1, 1024);
+	config.numSels = parse_list("1,10,50,100", config.sels, 0, 100);
+	config.scanBudget = 1000000;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "m:n:c:s:q:")) != -1) {
+		switch (opt) {
+		case 'm': config.minRows = atol(optarg); break;
+		case 'n': config.maxRows = atol(optarg); break;
+		case 'c': config.numCols = parse_list(optarg, config.cols, 1, 1024); break;
+		case 's': config.numSels = parse_list(optarg, config.sels, 0, 100); break;
+		case 'q': config.scanBudget = atol(optarg); break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (config.minRows < 1 || config.maxRows < config.minRows || config.maxRows > 100000000 || config.numCols < 0 ||
+			config.numSels < 0 || config.scanBudget < 1) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	printf("%9s %5s %-7s %5s %10s %12s %10s %9s\n", "rows", "cols", "op", "sel", "matched",
+		"ns/op", "bytes/op", "allocs/op");
+	long rows;
+	int c;
+	for (rows = config.minRows; rows <= config.maxRows; rows *= 10)
+		for (c = 0; c < config.numCols; c++)
+			run_one(rows, config.cols[c]);
+	return EXIT_SUCCESS;
+}
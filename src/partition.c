@@ -0,0 +1,86 @@
+/**
+ * @file
+ * @brief This file implements the partitions declared in partition.h.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "partition.h"
+#include "utils.h"
+
+
+int partition_of(const char *key, int numPartitions)
+{
+	// FNV-1a, then a finalizer so that close keys spread evenly
+	uint64_t h = 14695981039346656037ULL;
+	const char *p;
+	for (p = key; *p != '\0'; p++)
+		h = (h ^ (unsigned char)*p) * 1099511628211ULL;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (int)(h % (uint64_t)numPartitions);
+}
+
+
+void partition_socket(char *buf, size_t len, int port, int partition)
+{
+	snprintf(buf, len, PARTITION_SOCKET_FMT, port, partition);
+}
+
+
+int peer_connect(peer_link *link, const char *path, const char *username, const char *password)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof addr.sun_path, "%s", path);
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0)
+		return -1;
+	if (connect(sock, (struct sockaddr*)&addr, sizeof addr) != 0) {
+		close(sock);
+		return -1;
+	}
+	link->sock = sock;
+	memset(&link->in, 0, sizeof link->in);
+
+	char cmd[MAX_CMD_LEN];
+	snprintf(cmd, sizeof cmd, "AUTH,%s,%s\n", username, password);
+	char *reply;
+	if (peer_send(link, cmd, strlen(cmd)) != 0 || peer_reply(link, &reply) != 0 || strncmp(reply, "1,0", 3) != 0) {
+		peer_close(link);
+		return -1;
+	}
+	return 0;
+}
+
+
+int peer_send(peer_link *link, const char *line, size_t len)
+{
+	return sendall(link->sock, line, len);
+}
+
+
+int peer_reply(peer_link *link, char **reply)
+{
+	size_t len;
+	while (!cmd_reader_line(&link->in, reply, &len))
+		if (cmd_reader_fill(&link->in, link->sock, 0) != 0)
+			return -1;
+	return 0;
+}
+
+
+void peer_close(peer_link *link)
+{
+	if (link->sock >= 0)
+		close(link->sock);
+	link->sock = -1;
+	cmd_reader_free(&link->in);
+}
@@ -0,0 +1,85 @@
+/**
+ * @file
+ * @brief This file declares the partitions of a server run as several processes on one port.
+ *
+ * With "processes N" in the config, the server forks into N processes that
+ * share nothing but the listening port, bound by each with SO_REUSEPORT so
+ * the kernel spreads the connections over them.  Every key of every table
+ * belongs to one partition, picked by its hash, and only the process of
+ * that partition stores it.  A process that receives a command for a key
+ * of another partition forwards the command line, unchanged, over a Unix
+ * socket to that process, and relays the reply.  A connection on such a
+ * socket is a peer, whose commands always run locally.
+ */
+
+#ifndef	PARTITION_H
+#define PARTITION_H
+
+#include <stddef.h>
+#include "command.h"
+
+#define MAX_PARTITIONS 64	///< Processes a server may run as.
+#define PARTITION_SOCKET_FMT "/tmp/storage-%d.%d.sock"	///< Unix socket of a partition, from the port and the partition.
+
+/**
+ * @brief A connection to the process of another partition.
+ */
+typedef struct peer_link {
+	// The socket, -1 until connected
+	int sock;
+	// Replies received and not taken yet
+	cmd_reader in;
+} peer_link;
+
+/**
+ * @brief Tell which partition a key belongs to.
+ *
+ * @param key The key.
+ * @param numPartitions Number of partitions.
+ * @return Return the partition, from 0 to numPartitions - 1.
+ */
+int partition_of(const char *key, int numPartitions);
+
+/**
+ * @brief Format the path of the Unix socket of a partition.
+ *
+ * @param buf Filled with the path.
+ * @param len Size of buf.
+ * @param port The TCP port of the server.
+ * @param partition The partition.
+ */
+void partition_socket(char *buf, size_t len, int port, int partition);
+
+/**
+ * @brief Connect and authenticate to the process of a partition.
+ *
+ * @param link The link, whose sock is -1.
+ * @param path The Unix socket of the partition.
+ * @param username The username of the server.
+ * @param password The encrypted password of the server.
+ * @return Return 0 on success, -1 otherwise, leaving the link unconnected.
+ */
+int peer_connect(peer_link *link, const char *path, const char *username, const char *password);
+
+/**
+ * @brief Send a command line, its newline included, to the process of a partition.
+ *
+ * @return Return 0 on success, -1 otherwise.
+ */
+int peer_send(peer_link *link, const char *line, size_t len);
+
+/**
+ * @brief Receive the next reply line from the process of a partition, waiting for it.
+ *
+ * @param link The link.
+ * @param reply Set to the line, without its newline, valid until the next call.
+ * @return Return 0 on success, -1 otherwise.
+ */
+int peer_reply(peer_link *link, char **reply);
+
+/**
+ * @brief Close a link, which can be connected again.
+ */
+void peer_close(peer_link *link);
+
+#endif
@@ -0,0 +1,562 @@
+/**
+ * @file
+ * @brief This file implements the replication declared in repl.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include "repl.h"
+#include "command.h"
+#include "storage.h"
+#include "srvlog.h"
+#include "utils.h"
+
+// Registered feeds
+static repl_feed *feeds = NULL;
+static int numFeeds = 0;
+// Taken for reading by commits, for writing by replicas coming and going
+static pthread_rwlock_t feedsLock = PTHREAD_RWLOCK_INITIALIZER;
+
+/**
+ * @brief The primary a replica follows.
+ */
+typedef struct {
+	char host[MAX_HOST_LEN];
+	int port;
+	char username[MAX_USERNAME_LEN];
+	char password[MAX_ENC_PASSWORD_LEN];
+	int numTables;
+} replica_source;
+
+static replica_source source;
+// 1 while the stream is up and its snapshot applied
+static int replicaConnected = 0;
+// Wall clock time of the last heartbeat applied, 0 before the first
+static int64_t lastHeartbeat = 0;
+
+/**
+ * @brief A key received in a snapshot.
+ */
+typedef struct {
+	table *t;
+	char key[MAX_KEY_LEN];
+} synced_key;
+
+/**
+ * @brief A growing list of keys.
+ */
+typedef struct {
+	synced_key *keys;
+	size_t num;
+	size_t cap;
+} key_list;
+
+/**
+ * @brief The records of one commit of the primary, applied together so that no reader sees part of it.
+ */
+typedef struct {
+	table **tabs;
+	census **rps;
+	bool *dels;
+	int num;
+	int cap;
+	// Commit timestamp of the records on the primary
+	uint64_t ts;
+	// Columns each image has room for
+	int numColumns;
+} record_batch;
+
+
+size_t repl_format(char *buf, size_t len, uint64_t ts, const char *table, const char *key,
+		int metadata, bool deleted, char (*value)[MAX_STRTYPE_SIZE], int numColumns)
+{
+	size_t n = snprintf(buf, len, "R,%llu,%s,%s,%d,%d", (unsigned long long)ts, table, key, metadata, deleted ? 1 : 0);
+	int i;
+	for (i = 0; !deleted && i < numColumns && n < len; i++)
+		n += snprintf(buf + n, len - n, ",%s", value[i]);
+	if (n + 1 < len) {
+		buf[n++] = '\n';
+		buf[n] = '\0';
+	}
+	return n;
+}
+
+
+int64_t repl_wall_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+int repl_feed_open(repl_feed *f)
+{
+	f->buf = malloc(REPL_FEED_SIZE);
+	if (f->buf == NULL)
+		return -1;
+	pthread_mutex_init(&f->lock, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&f->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	f->queued = 0;
+	f->taken = 0;
+	f->overflow = 0;
+	pthread_rwlock_wrlock(&feedsLock);
+	f->next = feeds;
+	feeds = f;
+	__atomic_store_n(&numFeeds, numFeeds + 1, __ATOMIC_RELEASE);
+	pthread_rwlock_unlock(&feedsLock);
+	return 0;
+}
+
+
+/**
+ * @brief Function to append a line to a feed, or mark it overflowed if the line does not fit.
+ * @param f The feed
+ * @param line The line
+ * @param len Length of the line
+ * @return Returns void
+ */
+static void feed_append(repl_feed *f, const char *line, size_t len)
+{
+	pthread_mutex_lock(&f->lock);
+	if (f->overflow) {
+		// The replica syncs again anyway
+	} else if (f->queued - f->taken + len > REPL_FEED_SIZE) {
+		f->overflow = 1;
+		pthread_cond_signal(&f->cond);
+	} else {
+		size_t at = f->queued % REPL_FEED_SIZE;
+		size_t first = (len < REPL_FEED_SIZE - at) ? len : REPL_FEED_SIZE - at;
+		memcpy(f->buf + at, line, first);
+		memcpy(f->buf, line + first, len - first);
+		// The sender empties the feed once woken, so only the first line wakes it
+		if (f->queued == f->taken)
+			pthread_cond_signal(&f->cond);
+		f->queued += len;
+	}
+	pthread_mutex_unlock(&f->lock);
+}
+
+
+void repl_publish(table *t, record *r)
+{
+	// The lines of the commit so far, appended to the feeds as one
+	static __thread char *pending = NULL;
+	static __thread size_t pendingLen = 0, pendingCap = 0;
+	if (r == NULL) {
+		if (pendingLen == 0)
+			return;
+		pthread_rwlock_rdlock(&feedsLock);
+		repl_feed *f;
+		for (f = feeds; f != NULL; f = f->next)
+			feed_append(f, pending, pendingLen);
+		pthread_rwlock_unlock(&feedsLock);
+		pendingLen = 0;
+		return;
+	}
+	if (__atomic_load_n(&numFeeds, __ATOMIC_ACQUIRE) == 0)
+		return;
+	size_t cap = REPL_LINE_LEN(t->numColumns);
+	if (pendingLen + cap > pendingCap) {
+		pendingCap = (pendingCap == 0) ? 2048 : pendingCap;
+		while (pendingLen + cap > pendingCap)
+			pendingCap *= 2;
+		pending = realloc(pending, pendingCap);
+		if (pending == NULL)
+			die("Out of memory replicating a record.", EXIT_FAILURE);
+	}
+	pendingLen += repl_format(pending + pendingLen, cap, r->ts, t->name, r->key, r->metadata, r->deleted, r->value, t->numColumns);
+}
+
+
+ssize_t repl_feed_take(repl_feed *f, char *out, size_t len, int timeout_ms, int64_t *drainedAt)
+{
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&f->lock);
+	while (f->queued == f->taken && !f->overflow)
+		if (pthread_cond_timedwait(&f->cond, &f->lock, &deadline) == ETIMEDOUT)
+			break;
+	if (f->overflow) {
+		pthread_mutex_unlock(&f->lock);
+		return -1;
+	}
+	size_t n = f->queued - f->taken;
+	if (n > len) {
+		// Whole lines only
+		n = len;
+		size_t at = (f->taken + n - 1) % REPL_FEED_SIZE;
+		while (n > 0 && f->buf[at] != '\n') {
+			n--;
+			at = (at + REPL_FEED_SIZE - 1) % REPL_FEED_SIZE;
+		}
+	}
+	size_t at = f->taken % REPL_FEED_SIZE;
+	size_t first = (n < REPL_FEED_SIZE - at) ? n : REPL_FEED_SIZE - at;
+	memcpy(out, f->buf + at, first);
+	memcpy(out + first, f->buf, n - first);
+	f->taken += n;
+	// Whatever was published up to now is in out
+	*drainedAt = (f->taken == f->queued) ? repl_wall_ms() : 0;
+	pthread_mutex_unlock(&f->lock);
+	return n;
+}
+
+
+void repl_feed_close(repl_feed *f)
+{
+	pthread_rwlock_wrlock(&feedsLock);
+	repl_feed **p;
+	for (p = &feeds; *p != NULL; p = &(*p)->next)
+		if (*p == f) {
+			*p = f->next;
+			break;
+		}
+	__atomic_store_n(&numFeeds, numFeeds - 1, __ATOMIC_RELEASE);
+	pthread_rwlock_unlock(&feedsLock);
+	pthread_cond_destroy(&f->cond);
+	pthread_mutex_destroy(&f->lock);
+	free(f->buf);
+}
+
+
+int repl_num_feeds()
+{
+	return __atomic_load_n(&numFeeds, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * @brief Function to connect to the primary.
+ * @return Returns the socket, or -1 on error
+ */
+static int connect_primary()
+{
+	struct addrinfo hints, *res;
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	char port[MAX_PORT_LEN];
+	snprintf(port, sizeof port, "%d", source.port);
+	if (getaddrinfo(source.host, port, &hints, &res) != 0)
+		return -1;
+	int sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	if (sock >= 0 && connect(sock, res->ai_addr, res->ai_addrlen) != 0) {
+		close(sock);
+		sock = -1;
+	}
+	freeaddrinfo(res);
+	return sock;
+}
+
+
+/**
+ * @brief Function to read the next line of the stream.
+ * @param in The receive buffer of the stream
+ * @param sock The socket of the stream
+ * @param line Set to the line, valid until the next call
+ * @return Returns 0 on success, -1 if the stream broke
+ */
+static int next_line(cmd_reader *in, int sock, char **line)
+{
+	size_t len;
+	while (!cmd_reader_line(in, line, &len))
+		if (cmd_reader_fill(in, sock, 0) != 0)
+			return -1;
+	return 0;
+}
+
+
+/**
+ * @brief Function to add a key to a list.
+ * @return Returns void
+ */
+static void key_list_add(key_list *l, table *t, const char *key)
+{
+	if (l->num == l->cap) {
+		l->cap = (l->cap == 0) ? 256 : l->cap * 2;
+		l->keys = realloc(l->keys, l->cap * sizeof(synced_key));
+		if (l->keys == NULL)
+			die("Out of memory syncing a replica.", EXIT_FAILURE);
+	}
+	l->keys[l->num].t = t;
+	strcpy(l->keys[l->num].key, key);
+	l->num++;
+}
+
+
+/**
+ * @brief Function to order keys by table, then by name.
+ */
+static int compare_keys(const void *a, const void *b)
+{
+	const synced_key *x = a, *y = b;
+	if (x->t != y->t)
+		return (x->t < y->t) ? -1 : 1;
+	return strcmp(x->key, y->key);
+}
+
+
+/**
+ * @brief Function to collect a key of a local table, called by scanSnapshot().
+ */
+static void collect_key(void *arg, const char *key, version *v)
+{
+	key_list *l = arg;
+	key_list_add(l, NULL, key);
+}
+
+
+/**
+ * @brief Function to delete the local keys the snapshot of the primary did not have, left from an earlier stream.
+ * @param seen The keys of the snapshot, sorted
+ * @param rp A record image to delete with
+ * @return Returns void
+ */
+static void drop_unsynced(key_list *seen, census *rp)
+{
+	int i;
+	for (i = 0; i < source.numTables; i++) {
+		table *t = tables[i];
+		key_list local = { NULL, 0, 0 };
+		uint64_t snapshot = snapshot_begin();
+		scanSnapshot(t, snapshot, collect_key, &local);
+		snapshot_end();
+		size_t j;
+		for (j = 0; j < local.num; j++) {
+			local.keys[j].t = t;
+			if (bsearch(&local.keys[j], seen->keys, seen->num, sizeof(synced_key), compare_keys) == NULL) {
+				strcpy(rp->key, local.keys[j].key);
+				applyRecord(t, rp, true);
+			}
+		}
+		free(local.keys);
+	}
+}
+
+
+/**
+ * @brief Function to parse a record line of the stream.
+ * @param line The line, split in place
+ * @param rp Filled with the record image. It has room for the columns of every table.
+ * @param t Set to the table of the record
+ * @param del Set to true if the image deletes the key
+ * @param ts Set to the commit timestamp of the image on the primary
+ * @return Returns 0 on success, -1 if the line does not fit the tables
+ */
+static int parse_line(char *line, census *rp, table **t, bool *del, uint64_t *ts)
+{
+	char *p = line + 2;
+	char *stamp = strsep(&p, ",");
+	char *name = strsep(&p, ",");
+	char *key = strsep(&p, ",");
+	char *metadata = strsep(&p, ",");
+	char *deleted = strsep(&p, ",");
+	if (deleted == NULL)
+		return -1;
+	*ts = strtoull(stamp, NULL, 10);
+	*t = getTable(name, source.numTables);
+	if (*t == NULL || strlen(key) >= MAX_KEY_LEN)
+		return -1;
+	strcpy(rp->key, key);
+	rp->metadata = atoi(metadata);
+	*del = (deleted[0] == '1');
+	int i;
+	for (i = 0; !*del && i < (*t)->numColumns; i++) {
+		char *value = strsep(&p, ",");
+		if (value == NULL || strlen(value) >= MAX_STRTYPE_SIZE)
+			return -1;
+		strncpy(rp->value[i], value, MAX_STRTYPE_SIZE);
+	}
+	return (p == NULL) ? 0 : -1;
+}
+
+
+/**
+ * @brief Function to apply the records of a batch as one commit and empty it.
+ * @return Returns void
+ */
+static void batch_apply(record_batch *b)
+{
+	applyRecords(b->tabs, b->rps, b->dels, b->num);
+	b->num = 0;
+}
+
+
+/**
+ * @brief Function to add a copy of a record image to a batch. The images of an earlier commit are applied first.
+ * @param b The batch
+ * @param t The table of the record
+ * @param rp The record image
+ * @param del True if the image deletes the key
+ * @param ts The commit timestamp of the image on the primary
+ * @return Returns void
+ */
+static void batch_add(record_batch *b, table *t, census *rp, bool del, uint64_t ts)
+{
+	if (b->num > 0 && b->ts != ts)
+		batch_apply(b);
+	if (b->num == b->cap) {
+		b->cap = (b->cap == 0) ? 16 : b->cap * 2;
+		b->tabs = realloc(b->tabs, b->cap * sizeof(table*));
+		b->rps = realloc(b->rps, b->cap * sizeof(census*));
+		b->dels = realloc(b->dels, b->cap * sizeof(bool));
+		if (b->tabs == NULL || b->rps == NULL || b->dels == NULL)
+			die("Out of memory following the primary.", EXIT_FAILURE);
+		int i;
+		for (i = b->num; i < b->cap; i++)
+			b->rps[i] = newRecord(b->numColumns);
+	}
+	memcpy(b->rps[b->num], rp, sizeof(census) + (size_t)b->numColumns * MAX_STRTYPE_SIZE);
+	b->tabs[b->num] = t;
+	b->dels[b->num] = del;
+	b->ts = ts;
+	b->num++;
+}
+
+
+/**
+ * @brief Function to follow the stream of the primary on a connected socket until it breaks.
+ * @param sock The socket
+ * @return Returns void
+ */
+static void follow(int sock)
+{
+	cmd_reader in;
+	memset(&in, 0, sizeof in);
+	key_list seen = { NULL, 0, 0 };
+	int maxColumns = 1;
+	int i;
+	for (i = 0; i < source.numTables; i++)
+		if (tables[i]->numColumns > maxColumns)
+			maxColumns = tables[i]->numColumns;
+	census *rp = newRecord(maxColumns);
+	record_batch batch;
+	memset(&batch, 0, sizeof batch);
+	batch.numColumns = maxColumns;
+
+	char cmd[MAX_CMD_LEN];
+	snprintf(cmd, sizeof cmd, "AUTH,%s,%s\nSYNC\n", source.username, source.password);
+	char *line;
+	unsigned long long snapshot;
+	if (sendall(sock, cmd, strlen(cmd)) != 0 || next_line(&in, sock, &line) != 0)
+		goto done;
+	if (strncmp(line, "1,0", 3) != 0) {
+		SRVLOG(SRVLOG_ERROR, "Replication: the primary refused the login: %s", line);
+		goto done;
+	}
+	if (next_line(&in, sock, &line) != 0)
+		goto done;
+	if (sscanf(line, "1,0,%llu", &snapshot) != 1) {
+		SRVLOG(SRVLOG_ERROR, "Replication: the primary refused to sync: %s", line);
+		goto done;
+	}
+	SRVLOG(SRVLOG_INFO, "Replication: receiving the snapshot at %llu", snapshot);
+
+	int synced = 0;
+	while (next_line(&in, sock, &line) == 0) {
+		if (line[0] == 'R' && line[1] == ',') {
+			table *t;
+			bool del;
+			uint64_t ts;
+			if (parse_line(line, rp, &t, &del, &ts) != 0) {
+				SRVLOG(SRVLOG_ERROR, "Replication: a record does not fit the tables, are they those of the primary?");
+				break;
+			}
+			// Committed before the snapshot, so already applied
+			if (synced && ts <= snapshot)
+				continue;
+			if (!synced)
+				key_list_add(&seen, t, rp->key);
+			// The lines of a commit share its timestamp and come one after another
+			batch_add(&batch, t, rp, del, ts);
+		} else if (line[0] == 'S' && !synced) {
+			batch_apply(&batch);
+			if (seen.num > 0)
+				qsort(seen.keys, seen.num, sizeof(synced_key), compare_keys);
+			drop_unsynced(&seen, rp);
+			synced = 1;
+			__atomic_store_n(&replicaConnected, 1, __ATOMIC_RELAXED);
+			SRVLOG(SRVLOG_INFO, "Replication: %zu records synced, following the primary", seen.num);
+		} else if (line[0] == 'H' && line[1] == ',') {
+			// The primary only sends a heartbeat once it sent whole commits
+			batch_apply(&batch);
+			__atomic_store_n(&lastHeartbeat, atoll(line + 2), __ATOMIC_RELAXED);
+		} else {
+			SRVLOG(SRVLOG_ERROR, "Replication: unexpected line from the primary: %s", line);
+			break;
+		}
+	}
+
+done:
+	__atomic_store_n(&replicaConnected, 0, __ATOMIC_RELAXED);
+	cmd_reader_free(&in);
+	free(seen.keys);
+	free(rp);
+	for (i = 0; i < batch.cap; i++)
+		free(batch.rps[i]);
+	free(batch.tabs);
+	free(batch.rps);
+	free(batch.dels);
+}
+
+
+/**
+ * @brief Function run by the replication thread: follow the primary, connecting again whenever the stream breaks.
+ * @param arg Unused
+ * @return Never returns
+ */
+static void* replica_main(void *arg)
+{
+	for (;;) {
+		int sock = connect_primary();
+		if (sock >= 0) {
+			SRVLOG(SRVLOG_INFO, "Replication: connected to %s:%d", source.host, source.port);
+			follow(sock);
+			close(sock);
+			SRVLOG(SRVLOG_WARN, "Replication: lost the primary, connecting again");
+		}
+		sleep(REPL_RETRY_SECS);
+	}
+	return NULL;
+}
+
+
+int repl_start(const char *host, int port, const char *username, const char *password, int numTables)
+{
+	snprintf(source.host, sizeof source.host, "%s", host);
+	source.port = port;
+	snprintf(source.username, sizeof source.username, "%s", username);
+	snprintf(source.password, sizeof source.password, "%s", password);
+	source.numTables = numTables;
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, replica_main, NULL) != 0)
+		return -1;
+	pthread_detach(thread);
+	return 0;
+}
+
+
+int64_t repl_lag_ms(int *connected)
+{
+	*connected = __atomic_load_n(&replicaConnected, __ATOMIC_RELAXED);
+	int64_t beat = __atomic_load_n(&lastHeartbeat, __ATOMIC_RELAXED);
+	return (beat == 0) ? -1 : repl_wall_ms() - beat;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file
+ * @brief This file declares the replication of a primary server to read-only replicas.
+ *
+ * A replica connects to its primary like a client, authenticates with its
+ * own username and password, which must be the primary's too, and sends
+ * SYNC.  The primary answers with every record of a snapshot, then streams
+ * the records each commit writes, in commit order, as they are published.
+ * Every line carries the commit timestamp of the image; the replica
+ * applies the snapshot, then the streamed images newer than it.
+ *
+ * A commit only appends its lines to a bounded buffer per replica and
+ * never waits for one.  A replica that falls too far behind overflows its
+ * buffer; the primary then drops it, and it connects again and syncs from
+ * a new snapshot.  Heartbeats in the stream tell the replica how recent
+ * its data is.
+ *
+ * Stream lines:
+ * - "R,<ts>,<table>,<key>,<metadata>,<deleted>,<column 1 value>,..." for a
+ *   record image, without column values for a delete;
+ * - "S,<ts>" once the snapshot at timestamp ts is sent;
+ * - "H,<ms>" for a heartbeat: everything published before wall clock time
+ *   ms, in milliseconds since the epoch, was sent before it.
+ */
+
+#ifndef	REPL_H
+#define REPL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include "engine.h"
+
+#define REPL_FEED_SIZE (8 * 1024 * 1024)	///< Bytes queued for a replica before it is dropped, a power of two.
+#define REPL_HEARTBEAT_MS 20	///< Heartbeat interval of an idle stream, which bounds the lag a replica reports.
+#define REPL_RETRY_SECS 1	///< Seconds a replica waits before connecting again.
+#define REPL_STALL_SECS 5	///< Seconds a send to a replica may block before the replica is dropped.
+
+/**
+ * @brief The lines queued for one replica.
+ */
+typedef struct repl_feed {
+	// Guards everything below but next
+	pthread_mutex_t lock;
+	// Signalled when lines are queued on an empty buffer
+	pthread_cond_t cond;
+	char *buf;
+	// Bytes ever queued and ever taken; the queued ones are buf[taken % REPL_FEED_SIZE] on
+	uint64_t queued;
+	uint64_t taken;
+	// Set when a line did not fit, after which nothing more is queued
+	int overflow;
+	// Next feed, guarded by the feed list lock
+	struct repl_feed *next;
+} repl_feed;
+
+/**
+ * @brief Format a record image as a stream line.
+ *
+ * @param buf Filled with the line and a NUL.
+ * @param len Size of buf. REPL_LINE_LEN(numColumns) is enough.
+ * @return Return the length of the line.
+ */
+size_t repl_format(char *buf, size_t len, uint64_t ts, const char *table, const char *key,
+		int metadata, bool deleted, char (*value)[MAX_STRTYPE_SIZE], int numColumns);
+
+/// Room a stream line of a table with n columns needs, its NUL included.
+#define REPL_LINE_LEN(n) (96 + (size_t)(n) * (MAX_STRTYPE_SIZE + 1))
+
+/**
+ * @brief Register a feed, so commits from now on are queued on it.
+ *
+ * @return Return 0 on success, -1 if out of memory.
+ */
+int repl_feed_open(repl_feed *f);
+
+/**
+ * @brief Queue a committed record on every feed. Called by the commit hook; never blocks.
+ *
+ * The records of a commit are held back until its end, so they are queued
+ * together and a heartbeat never falls between them.
+ *
+ * @param t The table.
+ * @param r The record, locked, with its new image in place, or NULL at the end of the commit.
+ */
+void repl_publish(table *t, record *r);
+
+/**
+ * @brief Take the bytes queued on a feed, waiting for some.
+ *
+ * @param f The feed.
+ * @param out Filled with whole lines.
+ * @param len Size of out, at least REPL_LINE_LEN of the widest table.
+ * @param timeout_ms Milliseconds to wait at most.
+ * @param drainedAt Set to the wall clock time the feed was found empty after the take, everything
+ *	published before it being in out, or to 0 if lines are left.
+ * @return Return the number of bytes taken, 0 if none came in time, or -1 if the feed overflowed.
+ */
+ssize_t repl_feed_take(repl_feed *f, char *out, size_t len, int timeout_ms, int64_t *drainedAt);
+
+/**
+ * @brief Unregister a feed and release its buffer.
+ */
+void repl_feed_close(repl_feed *f);
+
+/**
+ * @brief Count the registered feeds.
+ */
+int repl_num_feeds();
+
+/**
+ * @brief Read the wall clock.
+ *
+ * @return Return the milliseconds since the epoch.
+ */
+int64_t repl_wall_ms();
+
+/**
+ * @brief Start following a primary on a thread of its own, connecting again whenever the stream breaks.
+ *
+ * @param host The primary's host.
+ * @param port The primary's port.
+ * @param username The username to authenticate with.
+ * @param password The encrypted password to authenticate with.
+ * @param numTables Number of tables, which must be those of the primary.
+ * @return Return 0 on success, -1 if the thread could not be started.
+ */
+int repl_start(const char *host, int port, const char *username, const char *password, int numTables);
+
+/**
+ * @brief Tell how current a replica is.
+ *
+ * @param connected Set to 1 while the stream is up and its snapshot applied, 0 otherwise.
+ * @return Return the milliseconds since the last heartbeat applied, or -1 if none was yet.
+ */
+int64_t repl_lag_ms(int *connected);
+
+#endif
@@ -0,0 +1,239 @@
+/**
+ * @file
+ * @brief This file implements the reply builder declared in reply.h.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include "reply.h"
+#include "utils.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+
+/**
+ * @brief Function to add an iovec, growing the slots if they are full.
+ * @param out The replies
+ * @param p Start of the piece
+ * @param len Length of the piece
+ * @return Returns void
+ */
+static void add_iov(reply_buf *out, const char *p, size_t len)
+{
+	if (out->numIov == out->iovCap) {
+		int newCap = (out->iovCap == 0) ? REPLY_INIT_IOVS : out->iovCap * 2;
+		struct iovec *grown = realloc(out->iov, newCap * sizeof(struct iovec));
+		if (grown == NULL)
+			die("Out of memory building a reply.", EXIT_FAILURE);
+		out->iov = grown;
+		out->iovCap = newCap;
+	}
+	out->iov[out->numIov].iov_base = (void*)p;
+	out->iov[out->numIov].iov_len = len;
+	out->numIov++;
+}
+
+
+char* reply_reserve(reply_buf *out, size_t len)
+{
+	reply_chunk *c = out->chunks;
+	if (c != NULL && c->size - c->used >= len)
+		return c->data + c->used;
+
+	// Reuse an empty chunk kept from an earlier batch if it is big enough
+	size_t size = (len > REPLY_CHUNK_SIZE) ? len : REPLY_CHUNK_SIZE;
+	reply_chunk **link;
+	for (link = &out->chunks; *link != NULL; link = &(*link)->next) {
+		reply_chunk *spare = *link;
+		if (spare->used == 0 && spare->size >= len) {
+			*link = spare->next;
+			spare->next = out->chunks;
+			out->chunks = spare;
+			return spare->data;
+		}
+	}
+	reply_chunk *fresh = malloc(sizeof(reply_chunk) + size);
+	if (fresh == NULL)
+		die("Out of memory building a reply.", EXIT_FAILURE);
+	fresh->size = size;
+	fresh->used = 0;
+	fresh->next = c;
+	out->chunks = fresh;
+	return fresh->data;
+}
+
+
+void reply_commit(reply_buf *out, size_t len)
+{
+	if (len == 0)
+		return;
+	reply_chunk *c = out->chunks;
+	char *p = c->data + c->used;
+	c->used += len;
+	out->bytes += len;
+	// Extend the last iovec if the piece follows it in the same chunk
+	if (out->numIov > 0) {
+		struct iovec *last = &out->iov[out->numIov - 1];
+		if ((char*)last->iov_base + last->iov_len == p) {
+			last->iov_len += len;
+			return;
+		}
+	}
+	add_iov(out, p, len);
+}
+
+
+void reply_copy(reply_buf *out, const char *p, size_t len)
+{
+	if (len == 0)
+		return;
+	memcpy(reply_reserve(out, len), p, len);
+	reply_commit(out, len);
+}
+
+
+void reply_ref(reply_buf *out, const char *p, size_t len)
+{
+	if (len < REPLY_REF_MIN) {
+		reply_copy(out, p, len);
+		return;
+	}
+	out->bytes += len;
+	add_iov(out, p, len);
+}
+
+
+void reply_printf(reply_buf *out, const char *fmt, ...)
+{
+	reply_chunk *c = out->chunks;
+	size_t room = (c != NULL) ? c->size - c->used : 0;
+	char *p = (c != NULL) ? c->data + c->used : NULL;
+	va_list ap;
+	va_start(ap, fmt);
+	int len = vsnprintf(p, room, fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return;
+	if ((size_t)len >= room) {
+		// Did not fit, format again into a chunk with room for it
+		p = reply_reserve(out, (size_t)len + 1);
+		va_start(ap, fmt);
+		vsnprintf(p, (size_t)len + 1, fmt, ap);
+		va_end(ap);
+	}
+	reply_commit(out, (size_t)len);
+}
+
+
+void reply_reset(reply_buf *out)
+{
+	out->numIov = 0;
+	out->bytes = 0;
+	int kept = 0;
+	reply_chunk **link = &out->chunks;
+	while (*link != NULL) {
+		reply_chunk *c = *link;
+		if (kept < REPLY_KEEP_CHUNKS && c->size == REPLY_CHUNK_SIZE) {
+			c->used = 0;
+			kept++;
+			link = &c->next;
+		} else {
+			*link = c->next;
+			free(c);
+		}
+	}
+}
+
+
+/**
+ * @brief Function to skip the iovecs a write took, the last one may be partly written.
+ * @param iov Points to the first iovec not written yet, advanced past those written
+ * @param left Points to the number of iovecs not written yet, decreased accordingly
+ * @param sent Bytes written
+ * @return Returns void
+ */
+static void skip_sent(struct iovec **iov, int *left, size_t sent)
+{
+	while (*left > 0 && sent >= (*iov)->iov_len) {
+		sent -= (*iov)->iov_len;
+		(*iov)++;
+		(*left)--;
+	}
+	if (*left > 0) {
+		(*iov)->iov_base = (char*)(*iov)->iov_base + sent;
+		(*iov)->iov_len -= sent;
+	}
+}
+
+
+int reply_flush(reply_buf *out, int sock)
+{
+	struct iovec *iov = out->iov;
+	int left = out->numIov;
+	int status = 0;
+	while (left > 0) {
+		ssize_t sent = writev(sock, iov, (left < IOV_MAX) ? left : IOV_MAX);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent <= 0) {
+			status = -1;
+			break;
+		}
+		skip_sent(&iov, &left, sent);
+	}
+	reply_reset(out);
+	return status;
+}
+
+
+int reply_send(reply_buf *out, int sock)
+{
+	struct iovec *iov = out->iov;
+	int left = out->numIov;
+	while (left > 0) {
+		struct msghdr msg;
+		memset(&msg, 0, sizeof msg);
+		msg.msg_iov = iov;
+		msg.msg_iovlen = (left < IOV_MAX) ? left : IOV_MAX;
+		ssize_t sent = sendmsg(sock, &msg, MSG_DONTWAIT);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (sent <= 0) {
+			reply_reset(out);
+			return -1;
+		}
+		skip_sent(&iov, &left, sent);
+	}
+	if (left == 0) {
+		reply_reset(out);
+		return 0;
+	}
+	// Keep the rest for the next call, its chunks stay in use
+	memmove(out->iov, iov, left * sizeof(struct iovec));
+	out->numIov = left;
+	return 1;
+}
+
+
+void reply_free(reply_buf *out)
+{
+	while (out->chunks != NULL) {
+		reply_chunk *c = out->chunks;
+		out->chunks = c->next;
+		free(c);
+	}
+	free(out->iov);
+	out->iov = NULL;
+	out->numIov = out->iovCap = 0;
+	out->bytes = 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file
+ * @brief This file declares the reply builder of the server.
+ *
+ * Replies are queued as a list of iovecs and written with one writev()
+ * per batch of pipelined commands.  Small or short-lived pieces are
+ * copied into fixed-size chunks; consecutive copies land next to each
+ * other and share one iovec.  Large pieces that stay valid until the
+ * flush are queued by reference.  Chunks never move once allocated, so
+ * queued pieces keep their address until reply_flush() recycles them.
+ */
+
+#ifndef	REPLY_H
+#define REPLY_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#define REPLY_CHUNK_SIZE 4096	///< Size of a copy chunk, larger pieces get a chunk of their own.
+#define REPLY_KEEP_CHUNKS 4	///< Chunks kept for the next batch, the rest are freed by reply_flush().
+#define REPLY_REF_MIN 256	///< Pieces passed to reply_ref() shorter than this are copied.
+#define REPLY_INIT_IOVS 16	///< Initial iovec slots, doubled when full.
+
+/**
+ * @brief A chunk holding copied pieces.
+ */
+typedef struct reply_chunk {
+	struct reply_chunk *next;
+	size_t size;
+	size_t used;
+	char data[];
+} reply_chunk;
+
+/**
+ * @brief The replies queued on one connection.
+ */
+typedef struct {
+	struct iovec *iov;
+	int numIov;
+	// Number of slots allocated in iov
+	int iovCap;
+	// Chunks in use, the one being filled first
+	reply_chunk *chunks;
+	// Bytes queued since the last flush
+	size_t bytes;
+} reply_buf;
+
+/**
+ * @brief Queue a copy of a piece.
+ *
+ * @param out The replies.
+ * @param p The piece, which may be freed or reused right after the call.
+ * @param len Length of the piece.
+ */
+void reply_copy(reply_buf *out, const char *p, size_t len);
+
+/**
+ * @brief Queue a piece that stays valid until the next reply_flush(). Short pieces are copied anyway.
+ *
+ * @param out The replies.
+ * @param p The piece.
+ * @param len Length of the piece.
+ */
+void reply_ref(reply_buf *out, const char *p, size_t len);
+
+/**
+ * @brief Queue a copy of a NUL terminated string.
+ */
+static inline void reply_str(reply_buf *out, const char *str)
+{
+	size_t len = 0;
+	while (str[len] != '\0')
+		len++;
+	reply_copy(out, str, len);
+}
+
+/**
+ * @brief Queue a formatted piece.
+ *
+ * @param out The replies.
+ * @param fmt A printf format.
+ */
+void reply_printf(reply_buf *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Get room to write a piece in place. Follow with reply_commit().
+ *
+ * @param out The replies.
+ * @param len Room needed.
+ * @return Return where to write, at least len bytes.
+ */
+char* reply_reserve(reply_buf *out, size_t len);
+
+/**
+ * @brief Queue the first len bytes of the room returned by the last reply_reserve().
+ */
+void reply_commit(reply_buf *out, size_t len);
+
+/**
+ * @brief Write every queued piece and start a new batch.
+ *
+ * @param out The replies.
+ * @param sock Where to write.
+ * @return Return 0 on success, -1 if the connection failed. The queue is emptied either way.
+ */
+int reply_flush(reply_buf *out, int sock);
+
+/**
+ * @brief Write as much of the queued pieces as the socket takes without blocking.
+ *
+ * @param out The replies.
+ * @param sock Where to write.
+ * @return Return 0 if all were written and a new batch started, 1 if the socket
+ * is full and the rest stays queued for the next call, -1 if the connection failed.
+ * No piece may be queued until a call returns 0.
+ */
+int reply_send(reply_buf *out, int sock);
+
+/**
+ * @brief Start a new batch once the queued pieces were written some other way, keeping a few chunks.
+ */
+void reply_reset(reply_buf *out);
+
+/**
+ * @brief Release the iovecs and chunks of a connection.
+ */
+void reply_free(reply_buf *out);
+
+#endif
@@ -8,54 +8,78 @@
  * The storage server should be able to communicate with the client
  * library functions declared in storage.h and implemented in storage.c.
  *
- * Used an open source data structure library called SimCList. 
- * 
- * SimCList library. See http://mij.oltrelinux.com/devel/simclist
- * Copyright (c) 2007,2008 Mij <mij@bitchx.it>
+ * The tables themselves live in the storage engine of engine.h; this file
+ * parses commands, runs them against the engine and sends the replies.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <poll.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <string.h>
 #include <assert.h>
 #include <signal.h>
 #include <ctype.h>
+#include <errno.h>
 #include <stdbool.h>
 #include "utils.h"
 #include "server.h"
+#include "epoch.h"
+#include "stats.h"
+#include "srvlog.h"
+#include "session.h"
+#include "watch.h"
+#include "repl.h"
 #include <time.h>
 
 // Threading
 #include <pthread.h>
 #include <semaphore.h>
+#include <sched.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
 
+// Where the log goes: 1 for stdout, 2 for a Server-<date>.log file
 #define LOGGING 1
 
 int strClearBoundWS(char* str);
 
 FILE* serverLog;
-table tables[MAX_NUM_OF_TABLES];
 config_params params;
 //user_info user;
 int concurrency;
 
 
-/** 
- * @brief Structure to indentify a particular thread 
- */
-typedef struct {
-	pthread_t pth;	// this is our thread identifier
-	bool active;
-} thread;
-thread threadpool[MAX_CONNECTIONS];
-
-// Condition variable -- used to wait for avaiable threads, and signal when available 
-pthread_mutex_t  getLock  = PTHREAD_MUTEX_INITIALIZER;
+// Number of client connections currently being served
+int activeConnections = 0;
+// Guards activeConnections
+pthread_mutex_t connLock = PTHREAD_MUTEX_INITIALIZER;
+// Condition variable -- used to wait for a free connection slot when max_connections is reached
+pthread_cond_t connCond = PTHREAD_COND_INITIALIZER;
+
+// Nanoseconds the latency histograms add to a command, measured at startup
+uint64_t latencyOverhead = 0;
+// Set by SIGINT or SIGTERM to stop the listen loop
+volatile sig_atomic_t shutdownRequested = 0;
+
+// Partition of the keys this process owns, and the number of processes the server runs as
+int myPartition = 0;
+int numPartitions = 1;
+// Commands forwarded to the process owning their key
+uint64_t forwardedCommands = 0;
+// Processes of the other partitions, forked by the first one
+pid_t partitionPids[MAX_PARTITIONS];
+// Connections waiting for commands when the workers run them, -1 without workers
+int workEpoll = -1;
 
 /** 
  * @brief Creates a File for logging 
@@ -85,485 +109,453 @@ FILE* createLog()
 
 
 
-/** 
- * @brief Function returns the size of each node in the list. It is used for malloc purposes.
- * @param el Points a node in the list.
- * @return Returns size of structure census.
- */
-size_t meter(const void *el) {
-    return sizeof(census);
-}
-
-
-
-
-/** 
- * @brief Function to find if the node->key is same as given key.
- * @param el Points a node in the list.
- * @param key Contains the key given by the user
- * @return Returns true when the key of the node matches the key given.
- */
-int seeker(const void *el, const void *key) {
-    /* let's assume el and key being always != NULL */
-    const census *cont = (census *)el;
-    const char *key_city = (char *)key;
-
-    if (!strcmp(cont->key, key_city))
-        return 1;
-    return 0;
-}
-
-
-
-
 
 /**
- * @brief Function to insert a node in the list
- * @param lp A pointer to the list
- * @param rp A pointer to the new node
- * @param colNum Number of columns in the table
- * @param colType An array containing the column types of all the columns(i.e string,int)
+ * @brief Function to queue an error reply, counting it in the server statistics.
+ * @param user A pointer to the user information of the connection.
+ * @param code The error code
+ * @param tail What follows the code, up to and including the newline
  * @return Returns void
  */
-int insertRecord(list_t *lp, census *rp, int colNum, int columnType[MAX_COLUMNS_PER_TABLE]) {
-    census *tuple = (census *)list_seek(lp, rp->key);
-    int j=0;
-    for(j=0; j< colNum; j++) {
-	if(columnType[j] > 0) {
-		int indexTrim = columnType[j];
-		if(indexTrim < MAX_STRTYPE_SIZE)
-			rp->value[j][indexTrim-1] = 0;
-		else
-			rp->value[j][MAX_STRTYPE_SIZE-1] = 0;
-	}
-    }
-    if(tuple == NULL) {
-		if(rp->metadata != 0)
-			return -1;
-		rp->metadata = 1;
-        list_append(lp, rp);
-    }
-    else {
-		if(rp->metadata != tuple->metadata && rp->metadata != 0)
-			return -1;
-		int i;
-		for(i=0; i < colNum; i++) {
-			strcpy(tuple->value[i], rp->value[i]);
-		}
-		tuple->metadata++;
-    }
-    return 0;
+void replyError(user_info *user, int code, const char *tail) {
+	stats_error(code);
+	reply_printf(&user->out, "0,%d%s", code, tail);
 }
 
 
-
-
 /**
- * @brief Function to find record into the list
- * @param lp A pointer to the list
- * @param keyname A string containing the key
- * @return Returns a pointer to the found tuple. Returns NULL if nothing is found
- */
-census* findRecord(list_t *lp, char *keyname) {
-    census *tuple = (census *)list_seek(lp, keyname);
-    return tuple;
-}
-
-
-/**
- * @brief Function to find record into the list
- * @param lp A pointer to the list
- * @param rp A pointer to the census report
- * @return Returns a pointer to the found tuple. Returns NULL if nothing is found
- */
-int deleteRecord(list_t *lp, census *rp) {
-    census *tuple = (census *)list_seek(lp, rp->key);
-    if(tuple == NULL) {
-	return -1;
-    } 
-    list_delete(lp, tuple);
-    return 0; 
-}
-
-
-/**
- * @brief Function to display all records in the list
- * @param lp A pointer to the list
- * @param colNum Column index
+ * @brief Function to queue a success reply without data.
+ * @param user A pointer to the user information of the connection.
  * @return Returns void
  */
-void displayAllRecords(list_t *lp, int colNum) {
-    /* [display list ...] */
-    census *data;
-    list_iterator_start(lp);        /* starting an iteration "session" */
-    while (list_iterator_hasnext(lp)) { /* tell whether more values available */
-        data = (census *)list_iterator_next(lp);
-        printf("%s:\n", data->key);
-	int i;
-	for(i=0; i < colNum; i++) {
-		printf("\t::%s\n", data->value[i]);
-	} 
-    }
-    list_iterator_stop(lp);
+void replyOk(user_info *user) {
+	reply_copy(&user->out, "1,0\n", 4);
 }
 
 
-
-
 /**
- * @brief Function called for sorting the linked list
- * @param lp A pointer to the list
- * @param order 1 -> ascending , -1 -> descending
- * @return Returns void
+ * @brief Function to rebuild a command line from its fields, as the process of another partition expects it.
+ * @param c The parsed command, whose fields were not changed since
+ * @param len Set to the length of the line, its newline included
+ * @return Returns the line, to free
  */
-void sortAllRecords(list_t *lp, int order) {
-    list_sort(lp, order);
+char* joinFields(cmd_line *c, size_t *len) {
+	size_t size = 1;
+	int i;
+	for (i = 0; i < c->numFields; i++)
+		size += c->fields[i].len + 1;
+	char *line = malloc(size);
+	if (line == NULL)
+		die("Out of memory forwarding a command.", EXIT_FAILURE);
+	size_t n = 0;
+	for (i = 0; i < c->numFields; i++) {
+		memcpy(line + n, c->fields[i].ptr, c->fields[i].len);
+		n += c->fields[i].len;
+		line[n++] = (i == c->numFields - 1) ? '\n' : ',';
+	}
+	line[n] = '\0';
+	*len = n;
+	return line;
 }
 
 
-
 /**
- * @brief Function to query all stored records
- * @param lp A pointer to the list
- * @param colPreds[MAX_PREDICATES] A string containing all predicates to query for
- * @param numPreds Integer number of provided perdicates
- * @param keys_arr An array of stings containing all keys found by the query function
- * @param max_keys Integer maximum number of keys to be found by the query function provided by the client
- * @return Returns Integer number of keys found with matching predicates 
+ * @brief Function to get the link of a connection to the process of a partition, connecting it if needed.
+ * @param user A pointer to the user information of the connection.
+ * @param partition The partition, not the one of this process
+ * @return Returns the link, or NULL if the process cannot be reached
  */
-int queryAllRecords(list_t *lp, predicate colPreds[MAX_PREDICATES], int numPreds, char **keys_arr, int max_keys) {
-    int keys_count = 0;
-    census *record;
-    list_iterator_start(lp);        /* starting an iteration "session" */
-    bool passFlag;
-    while (list_iterator_hasnext(lp)) { /* tell whether more values available */
-        record = (census *)list_iterator_next(lp);
-	passFlag = true;
-	int i;
-	for(i=0; i < numPreds && passFlag; i++) {
-		//Query each Predicate here
-		int columnNo = colPreds[i].colNum;
-		if(colPreds[i].type >= 0) {	/* Predicate is string type */
-			if(strcmp(colPreds[i].value, record->value[columnNo]) != 0) {
-				passFlag = false;
-			}
-		} else { /* Predicate is integer type */
-			switch(colPreds[i].cmp) {
-				case -1: /* lesser than */
-					 if(!(strtol(record->value[columnNo], NULL, 10) < 
-						strtol(colPreds[i].value, NULL, 10))) {
-					 	 passFlag = false;
-					 }
-					 break;
-				case 0: /* equal to */
-					 if(!(strtol(record->value[columnNo], NULL, 10) == 
-						strtol(colPreds[i].value, NULL, 10))) {
-					 	 passFlag = false;
-					 }
-					 break;
-				case 1: /* greater than */
-					 if(!(strtol(record->value[columnNo], NULL, 10) > 
-						strtol(colPreds[i].value, NULL, 10))) {
-					 	 passFlag = false;
-					 }
-					 break;
-			}
+peer_link* peerLink(user_info *user, int partition) {
+	if (user->peers == NULL) {
+		user->peers = malloc(numPartitions * sizeof(peer_link));
+		if (user->peers == NULL)
+			die("Out of memory linking partitions.", EXIT_FAILURE);
+		int i;
+		for (i = 0; i < numPartitions; i++) {
+			user->peers[i].sock = -1;
+			memset(&user->peers[i].in, 0, sizeof user->peers[i].in);
 		}
 	}
-	if(passFlag) {
-		/* Record satisfies all predicates */
-		
-		if(keys_count < max_keys) {
-			printf("f:%s:\n", record->key);
-			strcpy(keys_arr[keys_count], record->key);
+	peer_link *link = &user->peers[partition];
+	if (link->sock < 0) {
+		char path[MAX_SOCKET_PATH_LEN];
+		partition_socket(path, sizeof path, params.server_port, partition);
+		if (peer_connect(link, path, params.username, params.password) != 0) {
+			SRVLOG(SRVLOG_ERROR, "Cannot reach partition %d on %s.", partition, path);
+			return NULL;
 		}
-		keys_count++;
 	}
-    }
-    list_iterator_stop(lp);
-    return keys_count;
+	return link;
 }
 
 
 /**
- * @brief Function to initialize the list. This also sets the custom meter and seeker functions
- * @param lp A pointer to the list
- * @return Returns void
+ * @brief Function to forward a command on a key to the process of the partition owning the key, and queue its reply.
+ * @param c The parsed command, whose fields were not changed since
+ * @param user A pointer to the user information of the connection.
+ * @param key The key
+ * @return Returns true if the command was forwarded, or failed to be, with the reply queued; false if it is to run here
  */
-void list_set_init(list_t *lp) {
-
-    list_init(lp);
-
-    /* setting the custom spanning function */
-    list_attributes_copy(lp, meter, 1);
-
-    /* set the custom seeker function */
-    list_attributes_seeker(lp, seeker);
-
-    /* setting the custom comparator */
-    //list_attributes_comparator(lp, comparator);
+bool forwardToOwner(cmd_line *c, user_info *user, const char *key) {
+	if (numPartitions == 1 || user->peer)
+		return false;
+	int owner = partition_of(key, numPartitions);
+	if (owner == myPartition)
+		return false;
+
+	size_t len;
+	char *line = joinFields(c, &len);
+	peer_link *link = peerLink(user, owner);
+	char *reply;
+	if (link != NULL && peer_send(link, line, len) == 0 && peer_reply(link, &reply) == 0) {
+		reply_str(&user->out, reply);
+		reply_copy(&user->out, "\n", 1);
+		__atomic_add_fetch(&forwardedCommands, 1, __ATOMIC_RELAXED);
+	} else {
+		if (link != NULL)
+			peer_close(link);
+		replyError(user, ERR_UNKNOWN, ",0,0\n");
+	}
+	free(line);
+	return true;
 }
 
 
-
-
-
 /**
- * @brief Function to find the table in the array of tables
- * @param tableName The name of the table to find
- * @param topTableNumber Number of tables in the array
- * @return Returns a pointer to the table if found. Returns NULL otherwise
+ * @brief A GET or SET handed to the executor owning its key.
  */
-table* getTable(char* tableName, int topTableNumber){
-	int i;
-
-	for (i=0; i < topTableNumber; i++) {
-		if (strcmp(tables[i].name, tableName) == 0)
-			return &(tables[i]);
-	}
-	return NULL;
-}
+typedef struct {
+	exec_task task;
+	cmd_line *c;
+	int sock;
+	user_info *user;
+	void (*handler)(cmd_line *c, int sock, user_info *user);
+	// Timing of the command, carried to the executor and back
+	stats_timer timer;
+} command_task;
 
+/**
+ * @brief The scan of one slice of a table for a QUERY, run by the executor owning the slice.
+ */
+typedef struct {
+	exec_task task;
+	table *t;
+	uint64_t snapshot;
+	predicate *preds;
+	int numPreds;
+	char **keys;
+	int maxKeys;
+	int found;
+} query_task;
 
 
 /**
- * @brief Function to add a new table to the array of tables
- * @param tableName The name of the table to insert
- * @param indexToPutAt Index to put the table
+ * @brief Task function running a command on the executor owning its key.
+ * @param task The command_task
  * @return Returns void
  */
-void addTable(char* tableName, int indexToPutAt){
-	strcpy(tables[indexToPutAt].name, tableName);
-	list_set_init(&(tables[indexToPutAt].list));
+void runCommandTask(exec_task *task) {
+	command_task *ct = (command_task*)task;
+	// The phases marked by the handler belong to the submitter's command
+	stats_timer own = myTimer;
+	myTimer = ct->timer;
+	ct->handler(ct->c, ct->sock, ct->user);
+	ct->timer = myTimer;
+	myTimer = own;
 }
 
 
-
 /**
- * @brief Function to find a column in a table
- * @param tab The name of the table to search
- * @param colName Name of the column to be found
- * @param num The index of the column to be found
- * @param type The type of value that the column holds
- * @return Returns Integer -1 if column isn't' found and 0 if the specified column is found
+ * @brief Function to run a command on the executor owning its key, waiting for its reply to be queued.
+ * @param c The parsed command
+ * @param sock An integer type that specifies the socket system is working on.
+ * @param user A pointer to the user information of the connection.
+ * @param key The key
+ * @param handler The handler of the command, called again by the executor
+ * @return Returns true if the executor ran the command, false if it is to run on this thread
  */
-int findColumn(table* tab, char colName[MAX_COLNAME_LEN], int *num, int *type) {
-	int i=0;	
-	for(i=0; i< tab->numColumns; i++) {
-		if(strcmp(tab->columnName[i], colName) == 0) {
-			*num = i;
-			*type = tab->columnType[i];
-			return 0;
-		}
-	}
-	return -1;
+bool runOnOwner(cmd_line *c, int sock, user_info *user, const char *key,
+		void (*handler)(cmd_line *c, int sock, user_info *user)) {
+	// A transaction reads and buffers on its connection, and commits there
+	if (exec_cores() == 0 || exec_self() >= 0 || user->txn != NULL)
+		return false;
+	command_task ct = { .c = c, .sock = sock, .user = user, .handler = handler, .timer = myTimer };
+	ct.task.run = runCommandTask;
+	exec_submit(exec_owner(key), &ct.task);
+	exec_wait(&ct.task);
+	myTimer = ct.timer;
+	return true;
 }
 
 
-
-
 /**
- * @brief Function to remove spaces preciding a particular string
- * @param str A character pointer pointing to a string
- * @return Returns The character string pointer with all preciding spaces removed
+ * @brief Task function scanning one slice of a table for a QUERY.
+ * @param task The query_task
+ * @return Returns void
  */
-char *trimbeforespace(char *str) {
-	char *end;
-
-	// Trim leading space
-	while(isspace(*str)) 
-		str++;
-
-	if(*str == 0)  // All spaces?
-		return str;
-
-	// Trim trailing space
-	end = str + strlen(str) - 1;
-	while(end > str && isspace(*end)) 
-		end--;
-
-	// Write new null terminator
-	*(end+1) = 0;
-
-	return str;
+void runQueryTask(exec_task *task) {
+	query_task *qt = (query_task*)task;
+	qt->found = querySlice(qt->t, qt->snapshot, qt->preds, qt->numPreds, qt->keys, qt->maxKeys,
+			exec_self(), exec_bits());
 }
 
 
-
 /**
- * @brief Function to remove spaces following a particular string
- * @param str A character pointer pointing to a string
- * @return Returns The character string pointer with all following spaces removed
+ * @brief Function to run a QUERY on every executor, each scanning its slice of the table in one snapshot.
+ * @param t A pointer to the table
+ * @param preds The predicates
+ * @param numPreds Number of predicates
+ * @param keys_arr Filled with the keys found, up to max_keys
+ * @param max_keys Keys returned at most
+ * @return Returns the number of keys matching, which may be more than max_keys
  */
-char *trimafterspace(char *str) {
-	char *start = str;
-	while(*str != 0) 
-		str++;
-
-	str--;
-	// Trim leading space
-	while(isspace(*str)) {
-		*str = '\0';
-		str--;
+int queryOnCores(table *t, predicate *preds, int numPreds, char **keys_arr, int max_keys) {
+	int n = exec_cores();
+	query_task tasks[MAX_CORES];
+	// Every slice but the first gets room of its own, merged once all are done
+	char **slots = malloc((size_t)(n - 1) * max_keys * (sizeof(char*) + MAX_KEY_LEN) + 1);
+	if (slots == NULL)
+		die("Out of memory running a query.", EXIT_FAILURE);
+	char *room = (char*)(slots + (size_t)(n - 1) * max_keys);
+	size_t i;
+	for (i = 0; i < (size_t)(n - 1) * max_keys; i++)
+		slots[i] = room + i * MAX_KEY_LEN;
+
+	// The snapshot of this thread keeps the versions the executors read
+	uint64_t snapshot = snapshot_begin();
+	int core;
+	for (core = 0; core < n; core++) {
+		query_task *qt = &tasks[core];
+		qt->t = t;
+		qt->snapshot = snapshot;
+		qt->preds = preds;
+		qt->numPreds = numPreds;
+		qt->keys = (core == 0) ? keys_arr : slots + (size_t)(core - 1) * max_keys;
+		qt->maxKeys = max_keys;
+		qt->task.run = runQueryTask;
+		exec_submit(core, &qt->task);
 	}
-	//if(*str == 0)  // All spaces?
-	str = start;
-	return str;
+	int found = 0, numKeys = 0;
+	for (core = 0; core < n; core++) {
+		query_task *qt = &tasks[core];
+		exec_wait(&qt->task);
+		int copied = (qt->found < max_keys) ? qt->found : max_keys;
+		if (core == 0)
+			numKeys = copied;
+		for (i = 0; core > 0 && i < (size_t)copied && numKeys < max_keys; i++)
+			strcpy(keys_arr[numKeys++], qt->keys[i]);
+		found += qt->found;
+	}
+	snapshot_end();
+	free(slots);
+	return found;
 }
 
 
-
-
-
 /**
- * @brief Function to remove spaces preciding and following a particular string by calling functions trimafterspaces and trimbeforespaces
- * @param str A character pointer pointing to a string
- * @return Returns The character string pointer with al
-l preciding and following spaces removed
+ * @brief Function to merge the QUERY reply of another partition into the keys found here.
+ * @param reply The reply, split in place
+ * @param keys Room for maxKeys keys
+ * @param maxKeys Keys returned at most
+ * @param numKeys Keys in keys, increased by those of the reply that fit
+ * @return Returns the number of matches of the partition, or -1 if it replied with an error
  */
-char* tok_helper (char *str) {
-	str = trimbeforespace(str);
-	str = trimafterspace(str);
-	return str;
+int mergePeerQuery(char *reply, char **keys, int maxKeys, int *numKeys) {
+	// "1,0,<found>,<key>,<key>"
+	char *status = strsep(&reply, ",");
+	char *err = strsep(&reply, ",");
+	char *found = strsep(&reply, ",");
+	if (found == NULL || strcmp(status, "1") != 0 || strcmp(err, "0") != 0)
+		return -1;
+	char *key;
+	while ((key = strsep(&reply, ",")) != NULL && *numKeys < maxKeys)
+		if (key[0] != '\0' && strlen(key) < MAX_KEY_LEN)
+			strcpy(keys[(*numKeys)++], key);
+	return atoi(found);
 }
 
 
 
 
 /**
- * @brief Function breaks down string and compare parameters to authenticate user
- * @param commandstring A string type
+ * @brief Function compares the parameters of an AUTH command to authenticate user
+ * @param c The parsed command
  * @param sock An integer type which specifies the socket you want to connect to.
  * @return Returns nothing (void).
+ *
+ * On success the reply is "1,0,<token>,<ttl>" if session tokens are enabled:
+ * RESUME,<token> authenticates a later connection for the next ttl seconds.
  */
-void ifauthenticate(char *commandstring, int sock, user_info *user)
+void ifauthenticate(cmd_line *c, int sock, user_info *user)
 {	
-	char command[MAX_USERNAME_LEN] = {0};
-	char username[MAX_USERNAME_LEN] = {0};
-	char password[MAX_ENC_PASSWORD_LEN] = {0};
-	char logMessage[MAX_LOG_LEN] = {0};
-	int paramnumber = 0;
 	
-	char buf[MAX_CMD_LEN];
-	memset(buf, 0, sizeof buf);
-	
-	//Unmarshall the TCP message
-	char *saveptr;
-	char *pch = strtok_r(commandstring, ",", &saveptr);
-
-	while(pch != NULL){
-		paramnumber++;
-
-		if(paramnumber == 2) {
-			strcpy(username, tok_helper (pch));
-
-		} else if(paramnumber == 3) {
-			strcpy(password, tok_helper (pch));
-
-		}
-		pch = strtok_r(NULL, ",", &saveptr);
-	}
-	if(paramnumber != 3) {
-		snprintf(buf, sizeof buf, "0,%d\n", ERR_INVALID_PARAM);
-		sendall(sock, buf, strlen(buf));
+	if(c->numFields != 3) {
+		replyError(user, ERR_INVALID_PARAM, "\n");
 		return;
     	}
-	//sscanf(commandstring, "%s,%s,%s", command, username, password);
+	char *username = c->fields[1].ptr;
+	char *password = c->fields[2].ptr;
 	if(strcmp(params.username, username) != 0 || strcmp(params.password, password) != 0) {
 		//AUTH failed with the given username and password
-		snprintf(logMessage, sizeof logMessage, "Authentication failed %d:%d\n", strcmp(params.username, username), strcmp(params.password, password));
-		logger(LOGGING, serverLog, logMessage);
-		snprintf(buf, sizeof buf, "0,%d\n", ERR_AUTHENTICATION_FAILED);
-		sendall(sock, buf, strlen(buf));
+		SRVLOG(SRVLOG_INFO, "Authentication failed %d:%d", strcmp(params.username, username), strcmp(params.password, password));
+		replyError(user, ERR_AUTHENTICATION_FAILED, "\n");
 		return;
 	}
 	// Authentication successfull
 	user->authenticated = 1;
-	snprintf(logMessage, sizeof logMessage, "Authenticated with username: %s and password: %s, %s\n", username, password, command);
-	logger(LOGGING, serverLog, logMessage);
-	snprintf(buf, sizeof buf, "1,0\n");
-	sendall(sock, buf, strlen(buf));
+	SRVLOG(SRVLOG_INFO, "Authenticated with username: %s", username);
+	char token[SESSION_TOKEN_LEN + 1];
+	if(params.session_ttl > 0 && session_issue(params.session_ttl, token) == 0)
+		reply_printf(&user->out, "1,0,%s,%d\n", token, params.session_ttl);
+	else
+		replyOk(user);
 }
 
 
 
 
 /**
- * @brief Function breaks down string, checks for authentication and finds user defined data from specified table.
- * @param commandstring A string type	
- * @param sock An integer type that specifies the socket system is working on.
+ * @brief Function authenticates the connection with a session token issued by an earlier AUTH.
+ * @param c The parsed command
+ * @param sock An integer type which specifies the socket you want to connect to.
+ * @param user A pointer to the user information of the connection.
  * @return Returns nothing (void).
  */
-void ifdataget(char *commandstring, int sock, user_info *user)
+void ifresume(cmd_line *c, int sock, user_info *user)
 {
-    char buf[MAX_CMD_LEN];
-    memset(buf, 0, sizeof buf);
-    char logMessage[MAX_LOG_LEN] = {0};
-
-    if(user->authenticated == 0) {
-	// USER not authenticated
-	snprintf(buf, sizeof buf, "0,%d,0,0\n", ERR_NOT_AUTHENTICATED);
-	sendall(sock, buf, strlen(buf));
-	return;
-    }
-    char* data_key;
-    char* data_table;
+	if(c->numFields != 2) {
+		replyError(user, ERR_INVALID_PARAM, "\n");
+		return;
+	}
+	if(!session_valid(c->fields[1].ptr)) {
+		// Unknown or expired, the client authenticates again
+		SRVLOG(SRVLOG_INFO, "Session token refused");
+		replyError(user, ERR_AUTHENTICATION_FAILED, "\n");
+		return;
+	}
+	user->authenticated = 1;
+	SRVLOG(SRVLOG_INFO, "Resumed a session");
+	replyOk(user);
+}
 
-    int paramnumber = 0;
-    char *saveptr;
-    char * pch = strtok_r(commandstring, ",", &saveptr);
 
-    while(pch != NULL){
-		paramnumber++;
 
-		if(paramnumber == 2) {
-			data_table = tok_helper (pch);
 
-		} else if(paramnumber == 3) {
-			data_key = tok_helper (pch);
-		
-		}
-		pch = strtok_r(NULL, ",", &saveptr);
+/**
+ * @brief Function finds user defined data from specified table and queues the GET or GETV reply.
+ * @param c The parsed command
+ * @param user A pointer to the user information of the connection.
+ * @param conditional True for GETV, whose fourth field is the commit timestamp of a cached copy
+ * @return Returns nothing (void).
+ */
+void getRecord(cmd_line *c, user_info *user, bool conditional)
+{
 
+    if(user->authenticated == 0) {
+	// USER not authenticated
+	replyError(user, ERR_NOT_AUTHENTICATED, ",0,0\n");
+	return;
     }
-    if(paramnumber != 3) {
-	snprintf(buf, sizeof buf, "0,%d,0,0\n", ERR_INVALID_PARAM);
-	sendall(sock, buf, strlen(buf));
+    if(c->numFields != (conditional ? 4 : 3) || c->fields[2].len >= MAX_KEY_LEN) {
+	replyError(user, ERR_INVALID_PARAM, ",0,0\n");
 	return;
     }
-	// find the table and pointer to its list
-	table* t = getTable(data_table, params.tableNum);
-	if(t == NULL) {
-		//TABLE not found
-		snprintf(buf, sizeof buf, "0,%d,0,0\n", ERR_TABLE_NOT_FOUND);
-		sendall(sock, buf, strlen(buf));
-		return;
+    // find the table and pointer to its list, before the command goes to the owner of its key
+    table* t = getTable(c->fields[1].ptr, params.tableNum);
+    if(t == NULL) {
+	//TABLE not found
+	replyError(user, ERR_TABLE_NOT_FOUND, ",0,0\n");
+	return;
+    }
+    if(forwardToOwner(c, user, c->fields[2].ptr))
+	return;
+    if(runOnOwner(c, 0, user, c->fields[2].ptr, conditional ? ifdatagetversion : ifdataget))
+	return;
+    char *data_key = c->fields[2].ptr;
+    uint64_t cached = conditional ? strtoull(c->fields[3].ptr, NULL, 10) : 0;
+	stats_mark(STATS_PHASE_PARSE);
+	// copy the newest version of the record
+	if(user->scratchCols < t->numColumns) {
+		free(user->scratch);
+		user->scratch = newRecord(t->numColumns);
+		user->scratchCols = t->numColumns;
 	}
-	// find the record in the list
-	pthread_mutex_lock( &getLock );
-	census* tuple = findRecord(&(t->list), data_key);
-	pthread_mutex_unlock( &getLock );
-	if(tuple == NULL) {
+	census* tuple = user->scratch;
+	int getStatus;
+	// Commit timestamp of the version read, 0 for a write of the transaction
+	uint64_t ts = 0;
+	int w = (user->txn == NULL) ? -1 : txnFindWrite(user->txn, t, data_key, user->txn->numWrites);
+	if(w >= 0) {
+		// A transaction sees its own writes, which have no metadata until commit
+		txn_write *wr = &user->txn->writes[w];
+		getStatus = wr->del ? -1 : 0;
+		tuple->metadata = 0;
+		strcpy(tuple->key, wr->rp->key);
+		// A delete is not read, and its record may have fewer columns than the table
+		if(!wr->del)
+			memcpy(tuple->value, wr->rp->value, (size_t)t->numColumns * MAX_STRTYPE_SIZE);
+	} else {
+		// Lock free, retries if a writer changes the record while it is copied
+		getStatus = readRecord(t, data_key, tuple, &ts);
+		// Validated at commit, so a missing key is remembered too
+		if(user->txn != NULL)
+			txnAddRead(user->txn, t, data_key, ts);
+	}
+	if(getStatus == -1) {
 		//RECORD not found
-		snprintf(buf, sizeof buf, "0,%d,0,0\n", ERR_KEY_NOT_FOUND);
-		sendall(sock, buf, strlen(buf));
+		replyError(user, ERR_KEY_NOT_FOUND, ",0,0\n");
 		return;
 	}
-        //snprintf(logMessage, sizeof logMessage, "Got value: %s from table: %s and key: %s\n", tuple->value[0], data_table, data_key);
-	//logger(LOGGING, serverLog, logMessage);
-	char bufTemp[MAX_CMD_LEN];
-	memset(bufTemp, 0, sizeof bufTemp);
-    	int i=0;
-    	for(i=0; i<t->numColumns; i++) {
-		strcat(bufTemp, t->columnName[i]);
-		strcat(bufTemp, " ");
-		strcat(bufTemp, tuple->value[i]);
-		if(i != t->numColumns - 1)
-			strcat(bufTemp, ",");
-    	}
-	//printf(":%s:", bufTemp);
-	snprintf(buf, sizeof buf, "1,0,%d,%s\n", tuple->metadata, bufTemp);
-	sendall(sock, buf, strlen(buf));
+	//SRVLOG(SRVLOG_DEBUG, "Got value: %s from table: %s and key: %s", tuple->value[0], data_table, data_key);
+	// "1,0,<metadata>,<name> <value>,<name> <value>" queued piece by piece, without a line buffer
+	reply_buf *out = &user->out;
+	if(conditional) {
+		// "1,0,<metadata>,<timestamp>" alone tells the client its copy is current
+		if(ts != 0 && ts == cached) {
+			reply_printf(out, "1,0,%d,%llu\n", tuple->metadata, (unsigned long long)ts);
+			return;
+		}
+		reply_printf(out, "1,0,%d,%llu,", tuple->metadata, (unsigned long long)ts);
+	} else
+		reply_printf(out, "1,0,%d,", tuple->metadata);
+	int i;
+	for(i = 0; i < t->numColumns; i++) {
+		if(i != 0)
+			reply_copy(out, ",", 1);
+		reply_str(out, t->columnName[i]);
+		reply_copy(out, " ", 1);
+		reply_str(out, tuple->value[i]);
+	}
+	reply_copy(out, "\n", 1);
+}
+
+
+/**
+ * @brief Function checks for authentication and finds user defined data from specified table.
+ * @param c The parsed command
+ * @param sock An integer type that specifies the socket system is working on.
+ * @return Returns nothing (void).
+ */
+void ifdataget(cmd_line *c, int sock, user_info *user)
+{
+	getRecord(c, user, false);
+}
+
+
+/**
+ * @brief Function answers a GET revalidating a copy the client cached: "GETV,<table>,<key>,<timestamp>".
+ * @param c The parsed command
+ * @param sock An integer type that specifies the socket system is working on.
+ * @return Returns nothing (void).
+ *
+ * The reply is the GET reply with the commit timestamp of the record after
+ * its metadata, which the client keeps with its copy.  If the timestamp is
+ * the one given, the columns are left out.  A record written earlier in the
+ * transaction of the connection has timestamp 0, which never matches.
+ */
+void ifdatagetversion(cmd_line *c, int sock, user_info *user)
+{
+	getRecord(c, user, true);
 }
 
 
@@ -572,11 +564,10 @@ void ifdataget(char *commandstring, int sock, user_info *user)
 /**
  * @brief Function to check if column sequence follows the same order as config file
  * @parameter t A pointer to the table to check columns
- * @parameter columns An array of strings containing names of columns
- * @parameter numCol Number of columns in the table
- * @parameter value An array of strings containing values to be inserted
+ * @parameter names The column name of each value, NUL terminated in the command line
+ * @parameter numCol Number of columns given
  */
-int check_columnname_error (table *t, char columns[MAX_COLUMNS_PER_TABLE][MAX_COLNAME_LEN], int numCol, char value[MAX_COLUMNS_PER_TABLE][MAX_STRTYPE_SIZE]) {
+int check_columnname_error (table *t, cmd_slice *names, int numCol) {
 
     //check if i == colNum
     if(numCol != t->numColumns)
@@ -585,7 +576,7 @@ int check_columnname_error (table *t, char columns[MAX_COLUMNS_PER_TABLE][MAX_CO
     	
     int j = 0;
     while (j < numCol){
-    	if(strcmp (columns[j], t->columnName[j]) != 0)
+    	if(strcmp (names[j].ptr, t->columnName[j]) != 0)
 		return -1;
 	j++;
     }
@@ -647,7 +638,7 @@ bool check_valid_integer (const char * str)
  * @param val Set of values to be checked and inserted into the table
  * @return Returns an integer value of 0 if value is valid and -1 otherwise
  */
-int checkColumnVal(table *tab, char val[MAX_COLUMNS_PER_TABLE][MAX_STRTYPE_SIZE]) {
+int checkColumnVal(table *tab, char (*val)[MAX_STRTYPE_SIZE]) {
 	int i=0;	
 	for(i=0; i< tab->numColumns; i++) {
 		if(tab->columnType[i] >= 0) { //Column is of string type
@@ -667,367 +658,1158 @@ int checkColumnVal(table *tab, char val[MAX_COLUMNS_PER_TABLE][MAX_STRTYPE_SIZE]
 
 
 /**
- * @brief Function breaks down string, checks for authentication and retrieves user defined data from specified table.
- * @param commandstring A string type	
+ * @brief Function checks for authentication and stores user defined data in specified table.
+ * @param c The parsed command
  * @param sock An integer type that specifies the socket system is working on.
  * @return Returns nothing (void).
  */
-void ifdataset(char *commandstring, int sock, user_info *user)
+void ifdataset(cmd_line *c, int sock, user_info *user)
 {
-    char buf[MAX_CMD_LEN];
-    memset(buf, 0, sizeof buf);
 	
     if(user->authenticated == 0) {
 	// USER not authenticated
-	snprintf(buf, sizeof buf, "0,%d\n", ERR_NOT_AUTHENTICATED);
-	sendall(sock, buf, strlen(buf));
+	replyError(user, ERR_NOT_AUTHENTICATED, "\n");
 	return;
     }
-    char data_table[MAX_TABLE_LENGTH] = {0};
-    char columnName[MAX_COLUMNS_PER_TABLE][MAX_COLNAME_LEN];
+    if(params.replicaSet) {
+	// Writes go to the primary
+	replyError(user, ERR_READ_ONLY, "\n");
+	return;
+    }
+    census *record = NULL;
+    if(c->numFields < 5 || c->fields[2].len >= MAX_KEY_LEN) {
+	replyError(user, ERR_INVALID_PARAM, "\n");
+	goto reply;
+    }
+    // find the table and pointer to its list, before the command goes to the owner of its key
+    table *t = getTable(c->fields[1].ptr, params.tableNum);
+    if(t == NULL) {
+	//TABLE not found
+	replyError(user, ERR_TABLE_NOT_FOUND, "\n");
+	goto reply;
+    }
+    if(forwardToOwner(c, user, c->fields[2].ptr))
+	goto reply;
+    if(runOnOwner(c, sock, user, c->fields[2].ptr, ifdataset))
+	goto reply;
+
+    // Fields from the fifth on are "<column> <value>"
+    int numColumns = c->numFields - 4;
+    cmd_slice *names = c->fields + 4;
+    // Room for every column of the table too, as a transaction reads its writes back whole
+    record = newRecord((t->numColumns > numColumns) ? t->numColumns : numColumns);
+    memcpy(record->key, c->fields[2].ptr, c->fields[2].len + 1);
+    record->metadata = atoi(c->fields[3].ptr);
+    int i;
+    for(i = 0; i < numColumns; i++) {
+	cmd_slice value;
+	cmd_split(names[i], &names[i], &value);
+	if(names[i].len >= MAX_COLNAME_LEN || value.len >= MAX_STRTYPE_SIZE) {
+		replyError(user, ERR_INVALID_PARAM, "\n");
+		goto reply;
+	}
+	memcpy(record->value[i], value.ptr, value.len);
+    }
 
-    int numColumns = 0;
-    census record;
-    int paramnumber = 0;
-    char tempS[40] = {0};
+	bool del = (strcmp(record->value[0],"NULL") == 0);
+	if(!del && (check_columnname_error (t, names, numColumns) == -1 ||
+		checkColumnVal(t,record->value) == -1)) {
+		replyError(user, ERR_INVALID_PARAM, "\n");
+		goto reply;
+	}
 
-    char *saveptr;
-    char * pch = strtok_r(commandstring, ",", &saveptr);
+	stats_mark(STATS_PHASE_PARSE);
+	if(user->txn != NULL) {
+		// Buffered until COMMIT, which checks the metadata
+		if(!del)
+			trimColumns(t, record);
+		txnAddWrite(user->txn, t, record, del);
+		record = NULL;
+		replyOk(user);
+		goto reply;
+	}
 
-    while(pch != NULL){
-		paramnumber++;
+	if(del) {
+		if(deleteRecord(t, record) == -1) {
+			//RECORD not found
+			replyError(user, ERR_KEY_NOT_FOUND, "\n");
+			goto reply;
+		}
+		replyOk(user);
+		goto reply;
+	}
 
-		if(paramnumber == 2) {
-			strcpy(data_table, tok_helper (pch));
+	// insert the record in the table
+	if(insertRecord(t, record) == -1)
+	{
+		replyError(user, ERR_TRANSACTION_ABORT, "\n");
+		goto reply;
+	}
+	replyOk(user);
 
-		} else if(paramnumber == 3) {
-			strcpy(record.key, tok_helper (pch));
+reply:
+	free(record);
+}
 
-		} else if(paramnumber == 4) {
-			record.metadata = atoi(pch);
 
-		} else if(paramnumber >= 5) {
+/**
+ * @brief Function checks for authentication and queries for user defined data from specified table.
+ * @param c The parsed command
+ * @param sock An integer type that specifies the socket system is working on.
+ * @return Returns nothing (void).
+ */
+void ifdataquery(cmd_line *c, int sock, user_info *user)
+{
 	
-			strcpy(tempS, pch);
-
-			int count_pred_val = 0;
-			char *saveptr2;
-			char *ptemp = strtok_r(tempS, " ", &saveptr2);
-			while(ptemp != NULL) {
-				if(count_pred_val >= 1) {
-					strcpy(record.value[numColumns], tok_helper (ptemp));
-				} else {
-					strcpy(columnName[numColumns], tok_helper (ptemp));
-				}				
-				count_pred_val++;
-				if(count_pred_val >= 1)
-					ptemp = strtok_r(NULL, "\0", &saveptr2);
-				else
-					ptemp = strtok_r(NULL, " ", &saveptr2);
-			}
-
-			numColumns++;
-
-		}
-		pch = strtok_r(NULL, ",", &saveptr);
+    if(user->authenticated == 0) {
+	// USER not authenticated
+	replyError(user, ERR_NOT_AUTHENTICATED, "\n");
+    	return;
     }
-  
-    if(paramnumber < 5) {
-	snprintf(buf, sizeof buf, "0,%d\n", ERR_INVALID_PARAM);
-	sendall(sock, buf, strlen(buf));
-	return;
+
+    // Grows as predicates are parsed
+    int predCap = INIT_PREDICATES;
+    predicate *inputPreds = malloc(predCap * sizeof(predicate));
+    if(inputPreds == NULL)
+	die("Out of memory parsing a query.", EXIT_FAILURE);
+    int numPreds = 0;
+    table *t = NULL;
+    // Every partition is asked, unless this is one of them asking
+    size_t lineLen = 0;
+    char *line = (numPartitions > 1 && !user->peer) ? joinFields(c, &lineLen) : NULL;
+
+    if(c->numFields < 4) {
+	replyError(user, ERR_INVALID_PARAM, "\n");
+	goto reply;
     }
+    char *data_table = c->fields[1].ptr;
+    int maxKeys = atoi(c->fields[2].ptr);
+
+    int f;
+    for(f = 3; f < c->numFields; f++) {
+	// "<column> <op> <value>", the column alphanumeric and op one of < = >
+	char *p = c->fields[f].ptr;
+	char *end = p + c->fields[f].len;
+	char *name = p;
+	while(isalnum((unsigned char)*p))
+		p++;
+	char *nameEnd = p;
+	while(*p == ' ')
+		p++;
+	char sign = *p;
+	if(nameEnd == name || (sign != '<' && sign != '=' && sign != '>')) {
+		replyError(user, ERR_INVALID_PARAM, "\n");
+		goto reply;
+	}
+	p++;
+	while(p < end && isspace((unsigned char)*p))
+		p++;
+	size_t valueLen = end - p;
+	if(valueLen == 0 || valueLen >= MAX_STRTYPE_SIZE || strpbrk(p, "<=>") != NULL) {
+		replyError(user, ERR_INVALID_PARAM, "\n");
+		goto reply;
+	}
+	*nameEnd = '\0';
+
+	if(numPreds == predCap) {
+		predCap *= 2;
+		predicate *grown = realloc(inputPreds, predCap * sizeof(predicate));
+		if(grown == NULL)
+			die("Out of memory parsing a query.", EXIT_FAILURE);
+		inputPreds = grown;
+	}
+	inputPreds[numPreds].cmp = (sign == '<') ? -1 : (sign == '=') ? 0 : 1;
+	memcpy(inputPreds[numPreds].value, p, valueLen + 1);
 
 	// find the table and pointer to its list
-	table *t = getTable(data_table, params.tableNum);
+	if(t == NULL)
+		t = getTable(data_table, params.tableNum);
 	if(t == NULL) {
 		//TABLE not found
-		snprintf(buf, sizeof buf, "0,%d\n", ERR_TABLE_NOT_FOUND);
-		sendall(sock, buf, strlen(buf));
-		return;
+		replyError(user, ERR_TABLE_NOT_FOUND, "\n");
+		goto reply;
 	}
-	
-	if(strcmp(record.value[0],"NULL") == 0) {
-		pthread_mutex_lock( &getLock );
-		int delStatus = deleteRecord(&(t->list), &record);
-		pthread_mutex_unlock( &getLock );
-		if(delStatus == -1) {
-			//RECORD not found
-			snprintf(buf, sizeof buf, "0,%d\n", ERR_KEY_NOT_FOUND);
-			sendall(sock, buf, strlen(buf));
-			return;
-		}
-		snprintf(buf, sizeof buf, "1,0\n");
-		sendall(sock, buf, strlen(buf));
-		return;
+
+	int columnNumber, columnType;
+	if(findColumn(t, name, &columnNumber, &columnType) == -1) {
+		replyError(user, ERR_INVALID_PARAM, "\n");
+		goto reply;
 	}
 
-	//Check if coloumns are in correct order	
-	if(check_columnname_error (t, columnName, numColumns, record.value) == -1 ||
-		checkColumnVal(t,record.value) == -1){
-		snprintf(buf, sizeof buf, "0,%d\n", ERR_INVALID_PARAM);
-		sendall(sock, buf, strlen(buf));
-		return;
+	inputPreds[numPreds].colNum = columnNumber;
+	inputPreds[numPreds].type = columnType;
+	numPreds++;
+    }
+
+    stats_mark(STATS_PHASE_PARSE);
+    // The key pointers and the keys in one block
+    if(maxKeys < 0)
+	maxKeys = 0;
+    char **result_arr = malloc((size_t)maxKeys * (sizeof(char*) + MAX_KEY_LEN) + 1);
+    if(result_arr == NULL)
+	die("Out of memory running a query.", EXIT_FAILURE);
+    char *keys = (char*)(result_arr + maxKeys);
+    int i;
+    for (i = 0; i < maxKeys; i++)
+	result_arr[i] = keys + (size_t)i * MAX_KEY_LEN;
+    // The other partitions scan their keys meanwhile
+    bool failed = false;
+    peer_link *links[MAX_PARTITIONS];
+    for (i = 0; line != NULL && i < numPartitions; i++) {
+	links[i] = (i == myPartition) ? NULL : peerLink(user, i);
+	if (links[i] != NULL && peer_send(links[i], line, lineLen) != 0) {
+		peer_close(links[i]);
+		links[i] = NULL;
 	}
-	pthread_mutex_lock( &getLock );
-	// insert the record in the list
-	if(insertRecord(&(t->list), &record, t->numColumns, t->columnType) == -1)
-	{
-		pthread_mutex_unlock( &getLock );
-		snprintf(buf, sizeof buf, "0,%d\n", ERR_TRANSACTION_ABORT);
-		sendall(sock, buf, strlen(buf));
-		return;
+	if (links[i] == NULL && i != myPartition)
+		failed = true;
+    }
+    // The scan reads a snapshot and takes no lock
+    int numKeysFound = (exec_cores() > 0) ? queryOnCores(t, inputPreds, numPreds, result_arr, maxKeys) :
+	queryAllRecords(t, inputPreds, numPreds, result_arr, maxKeys);
+    // Versions kept alive for this snapshot can go now
+    if(__atomic_load_n(&t->gcList, __ATOMIC_ACQUIRE) != NULL)
+	collectGarbage(t);
+    int limit = (maxKeys < numKeysFound)?maxKeys:numKeysFound;
+    for (i = 0; line != NULL && i < numPartitions; i++) {
+	char *peerReply;
+	if (links[i] == NULL)
+		continue;
+	if (peer_reply(links[i], &peerReply) != 0) {
+		peer_close(links[i]);
+		failed = true;
+		continue;
 	}
-	pthread_mutex_unlock( &getLock );
-	snprintf(buf, sizeof buf, "1,0\n");
-	sendall(sock, buf, strlen(buf));
+	int found = mergePeerQuery(peerReply, result_arr, maxKeys, &limit);
+	if (found < 0)
+		failed = true;
+	else
+		numKeysFound += found;
+    }
+    if (failed) {
+	replyError(user, ERR_UNKNOWN, "\n");
+	free(result_arr);
+	goto reply;
+    }
+
+    // "1,0,<found>,<key>,<key>" queued key by key, without a line buffer
+    reply_buf *out = &user->out;
+    reply_printf(out, "1,0,%d,", numKeysFound);
+    for(i=0; i<limit; i++) {
+	if(i != 0)
+		reply_copy(out, ",", 1);
+	reply_str(out, result_arr[i]);
+    }
+    reply_copy(out, "\n", 1);
+    free(result_arr);
+
+reply:
+    free(line);
+    free(inputPreds);
 }
 
 
+
+
 /**
- * @brief Function breaks down string, checks for authentication and queries for user defined data from specified table.
- * @param commandstring A string type	
+ * @brief Function checks for authentication and starts a transaction on the connection.
+ * @param c The parsed command
  * @param sock An integer type that specifies the socket system is working on.
+ * @param user A pointer to the user information of the connection.
  * @return Returns nothing (void).
  */
-void ifdataquery(char *commandstring, int sock, user_info *user)
+void ifbegin(cmd_line *c, int sock, user_info *user)
 {
-    char buf[MAX_CMD_LEN];
-    memset(buf, 0, sizeof buf);
-	
+
     if(user->authenticated == 0) {
 	// USER not authenticated
-	snprintf(buf, sizeof buf, "0,%d\n", ERR_NOT_AUTHENTICATED);
-	sendall(sock, buf, strlen(buf));
-    	return;
+	replyError(user, ERR_NOT_AUTHENTICATED, "\n");
+    } else if(user->txn != NULL || (numPartitions > 1 && !user->peer)) {
+	// Transactions do not nest, nor span partitions
+	replyError(user, ERR_INVALID_PARAM, "\n");
+    } else {
+	user->txn = calloc(1, sizeof(transaction));
+	if(user->txn == NULL)
+		die("Out of memory starting a transaction.", EXIT_FAILURE);
+	replyOk(user);
     }
+}
 
-    char data_table[MAX_TABLE_LENGTH] = {0};
-	
-    predicate inputPreds[MAX_PREDICATES];
-    int maxKeys;
-    int paramnumber = 0;
-    int numPreds = 0;
-    char tempS[40] = {0}, tempS2[40] = {0};
-
-    table *t;
-    //printf("%s\n", commandstring);
-    char *saveptr;
-    char * pch = strtok_r(commandstring, ",", &saveptr);
-
-    while(pch != NULL){
-		paramnumber++;
-
-		if(paramnumber == 2) {
-			strcpy(data_table, tok_helper (pch));
-
-		} else if(paramnumber == 3) {
-			maxKeys = atoi(tok_helper (pch));
-
-		} else if(paramnumber >= 4) {
-			strcpy(tempS, tok_helper (pch));
-			strcpy(tempS2, tok_helper (pch));
-			//char *tempS2p = tempS2;
-			// pred_val[0] -> name of the column
-			// pred_val[1] -> value of predicate
-			char pred_val[2][40];
-
-			// sign value of predicate -> '>,<,='
-			char pred_sign_val;
-			
-			int count_pred_val = 0;
-			char *saveptr2;
-			char *ptemp = strtok_r(tempS, "><=", &saveptr2);
-			while(ptemp != NULL && count_pred_val < 2) {
-				strcpy(pred_val[count_pred_val], tok_helper (ptemp));
-				count_pred_val++;
-				ptemp = strtok_r(NULL, "><=", &saveptr2);
-			}
-			if((count_pred_val == 2 && ptemp != NULL) || (ptemp == NULL && count_pred_val != 2)) {
-				//printf("INVALID_PARAM:strtok\n");
-				snprintf(buf, sizeof buf, "0,%d\n", ERR_INVALID_PARAM);
-				sendall(sock, buf, strlen(buf));
-				return;
-			}
-				
-			char tempS3[40] = {0}, tempS4[40] = {0};				
-			int scount = sscanf(tempS2, "%[a-zA-Z0-9] %c %s", tempS3, &pred_sign_val, tempS4);
-			if(scount != 3) {
-				//printf("INVALID_PARAM:sscanf\n");
-				snprintf(buf, sizeof buf, "0,%d\n", ERR_INVALID_PARAM);
-				sendall(sock, buf, strlen(buf));
-				return;
-			}
-			//printf(":%c:\n", pred_sign_val);
-			inputPreds[numPreds].cmp = -2;		
-
-			if(pred_sign_val == '<') {
-				inputPreds[numPreds].cmp = -1;
-			} else if(pred_sign_val == '=') {
-				inputPreds[numPreds].cmp = 0;
-			} else if(pred_sign_val == '>') {
-				inputPreds[numPreds].cmp = 1;
-			} else {
-				//printf("INVALID_PARAM:signval\n");
-				snprintf(buf, sizeof buf, "0,%d\n", ERR_INVALID_PARAM);
-				sendall(sock, buf, strlen(buf));
-				return;
-			}
 
-			strcpy(inputPreds[numPreds].value, pred_val[1]);
-			
-			// find the table and pointer to its list
-			t = getTable(data_table, params.tableNum);			
-			if(t == NULL) {
-				//TABLE not found
-				snprintf(buf, sizeof buf, "0,%d\n", ERR_TABLE_NOT_FOUND);
-				sendall(sock, buf, strlen(buf));
-				return;
-			}
 
-			int columnNumber, columnType;
-			if(findColumn(t,pred_val[0], &columnNumber, &columnType) == -1) {
-				//printf("INVALID_PARAM:column\n");
-				snprintf(buf, sizeof buf, "0,%d\n", ERR_INVALID_PARAM);
-				sendall(sock, buf, strlen(buf));
-				return;
-			}
 
-			inputPreds[numPreds].colNum = columnNumber;
-			inputPreds[numPreds].type = columnType;
-			
-			numPreds++;
-		}
-		pch = strtok_r(NULL, ",", &saveptr);
+/**
+ * @brief Function commits the transaction of the connection, replying with a transaction abort if validation fails.
+ * @param c The parsed command
+ * @param sock An integer type that specifies the socket system is working on.
+ * @param user A pointer to the user information of the connection.
+ * @return Returns nothing (void).
+ */
+void ifcommit(cmd_line *c, int sock, user_info *user)
+{
+
+    if(user->authenticated == 0) {
+	// USER not authenticated
+	replyError(user, ERR_NOT_AUTHENTICATED, "\n");
+    } else if(user->txn == NULL) {
+	replyError(user, ERR_INVALID_PARAM, "\n");
+    } else {
+	if(txnCommit(user->txn) == -1)
+		replyError(user, ERR_TRANSACTION_ABORT, "\n");
+	else
+		replyOk(user);
+	txnFree(user->txn);
+	user->txn = NULL;
+    }
+}
+
+
+
+
+/**
+ * @brief Function discards the transaction of the connection.
+ * @param c The parsed command
+ * @param sock An integer type that specifies the socket system is working on.
+ * @param user A pointer to the user information of the connection.
+ * @return Returns nothing (void).
+ */
+void ifabort(cmd_line *c, int sock, user_info *user)
+{
+
+    if(user->authenticated == 0) {
+	// USER not authenticated
+	replyError(user, ERR_NOT_AUTHENTICATED, "\n");
+    } else if(user->txn == NULL) {
+	replyError(user, ERR_INVALID_PARAM, "\n");
+    } else {
+	txnFree(user->txn);
+	user->txn = NULL;
+	replyOk(user);
+    }
+}
 
+
+
+
+/**
+ * @brief Function checks for authentication and replies with the server statistics summed over all threads.
+ * @param c The parsed command
+ * @param sock An integer type that specifies the socket system is working on.
+ * @param user A pointer to the user information of the connection.
+ * @return Returns nothing (void).
+ *
+ * The reply is "1,0," followed by comma separated "name value" pairs: a
+ * cmd_<command> count per command, an err_<code> count per error code,
+ * connections, a records_<table> count per table, bytes_in, bytes_out,
+ * lock_wait_ns, lat_<command>_<phase>_<p50|p99|p999> latencies in ns for
+ * GET, SET and QUERY, and lat_overhead_ns, what timing costs per command.
+ */
+void ifstats(cmd_line *c, int sock, user_info *user)
+{
+    if(user->authenticated == 0) {
+	replyError(user, ERR_NOT_AUTHENTICATED, "\n");
+	return;
+    }
+
+    thread_stats *total = malloc(sizeof(thread_stats));
+    if(total == NULL)
+	die("Out of memory summing statistics.", EXIT_FAILURE);
+    stats_sum(total);
+    pthread_mutex_lock(&connLock);
+    int connections = activeConnections;
+    pthread_mutex_unlock(&connLock);
+
+    reply_buf *out = &user->out;
+    reply_copy(out, "1,0", 3);
+    int i;
+    for(i = 0; i < STATS_NUM_COMMANDS; i++)
+	reply_printf(out, ",cmd_%s %llu", stats_command_name(i), (unsigned long long)total->commands[i]);
+    for(i = 1; i < STATS_NUM_ERRORS; i++)
+	reply_printf(out, ",err_%d %llu", i, (unsigned long long)total->errors[i]);
+    reply_printf(out, ",connections %d,replicas %d", connections, repl_num_feeds());
+    if(numPartitions > 1)
+	reply_printf(out, ",partition %d,partitions %d,forwarded %llu", myPartition, numPartitions,
+		(unsigned long long)__atomic_load_n(&forwardedCommands, __ATOMIC_RELAXED));
+    reply_printf(out, ",cores %d", exec_cores());
+    for(i = 0; i < exec_cores(); i++)
+	reply_printf(out, ",core%d_tasks %llu", i, (unsigned long long)exec_tasks(i));
+    if(wq_workers() > 0) {
+	uint64_t run, stolen;
+	wq_counts(&run, &stolen);
+	reply_printf(out, ",workers %d,worker_tasks %llu,worker_steals %llu", wq_workers(),
+		(unsigned long long)run, (unsigned long long)stolen);
+    }
+    if(params.replicaSet) {
+	int connected;
+	int64_t lag = repl_lag_ms(&connected);
+	reply_printf(out, ",replica_connected %d,replica_lag_ms %lld", connected, (long long)lag);
     }
+    for(i = 0; i < params.tableNum; i++)
+	reply_printf(out, ",records_%s %zu", tables[i]->name, hm_count(&tables[i]->map));
+    reply_printf(out, ",bytes_in %llu,bytes_out %llu,lock_wait_ns %llu,numa_local %llu,numa_remote %llu",
+	(unsigned long long)total->bytesIn, (unsigned long long)total->bytesOut, (unsigned long long)total->lockWaitNs,
+	(unsigned long long)total->numaLocal, (unsigned long long)total->numaRemote);
+    // The latencies are formatted in place
+    char *room = reply_reserve(out, STATS_LATENCY_LEN);
+    reply_commit(out, stats_format_latency(total, room, STATS_LATENCY_LEN));
+    reply_printf(out, ",lat_overhead_ns %llu\n", (unsigned long long)latencyOverhead);
+    free(total);
+}
+
 
-    if(paramnumber < 4) {
-	snprintf(buf, sizeof buf, "0,%d\n", ERR_INVALID_PARAM);
-	sendall(sock, buf, strlen(buf));
+
+
+/**
+ * @brief Function ends the session of the connection. The client closes it.
+ * @param c The parsed command
+ * @param sock An integer type that specifies the socket system is working on.
+ * @param user A pointer to the user information of the connection.
+ * @return Returns nothing (void).
+ */
+void ifdisconnect(cmd_line *c, int sock, user_info *user)
+{
+    user->authenticated = 0;
+    txnFree(user->txn);
+    user->txn = NULL;
+}
+
+
+
+
+/**
+ * @brief Function moves the connection to a shared memory channel, whose descriptor goes with the reply.
+ * @param c The parsed command
+ * @param sock An integer type that specifies the socket system is working on.
+ * @param user A pointer to the user information of the connection.
+ * @return Returns nothing (void).
+ *
+ * Only connections on the Unix socket can ask, as the descriptor is passed
+ * over it. Later commands and replies go through the channel, and the
+ * socket stays open so either side notices when the other goes away.
+ * A connection that watches keys cannot move, as its thread would not be
+ * woken to send the changes.  Nor can one served by the workers, as they
+ * only wait on sockets.
+ */
+void ifsharedmemory(cmd_line *c, int sock, user_info *user)
+{
+    if(!user->local || user->shm != NULL || c->numFields != 1 || params.workers > 0 ||
+		(user->watch != NULL && user->watch->numSubs > 0)) {
+	replyError(user, ERR_INVALID_PARAM, "\n");
+	return;
+    }
+    // Earlier replies go first, on the socket
+    if(flushReplies(user) != 0)
+	return;
+
+    shm_channel *ch = malloc(sizeof(shm_channel));
+    if(ch == NULL)
+	die("Out of memory creating a shared memory channel.", EXIT_FAILURE);
+    if(shm_create(ch, sock, "1,0\n", 4) != 0) {
+	free(ch);
+	replyError(user, ERR_UNKNOWN, "\n");
 	return;
     }
+    stats_bytes_out(4);
+    user->shm = ch;
+    SRVLOG(SRVLOG_INFO, "Commands now go through shared memory.");
+}
+
 
-    char **result_arr;
 
-    result_arr = malloc(maxKeys * sizeof(char*));
-    int i=0;
-    for (i = 0; i < maxKeys; i++) {
-	result_arr[i] = malloc((MAX_KEY_LEN) * sizeof(char));
+
+/**
+ * @brief Function subscribes the connection to the changes of a key, or removes the subscription.
+ * @param c The parsed command: "WATCH,<table>,<key>", or "<prefix>*" in place of the key for every key starting with it
+ * @param user A pointer to the user information of the connection.
+ * @param add True for WATCH, false for UNWATCH
+ * @return Returns nothing (void).
+ */
+void watchKey(cmd_line *c, user_info *user, bool add)
+{
+    if(user->authenticated == 0) {
+	// USER not authenticated
+	replyError(user, ERR_NOT_AUTHENTICATED, "\n");
+	return;
     }
-    pthread_mutex_lock( &getLock );
-    int numKeysFound = queryAllRecords(&(t->list), inputPreds, numPreds, result_arr, maxKeys);
-    pthread_mutex_unlock( &getLock );
-    //printf(":%d:", numKeysFound);
-    char bufTemp[MAX_CMD_LEN];
-    memset(bufTemp, 0, sizeof bufTemp);
-    int limit = (maxKeys < numKeysFound)?maxKeys:numKeysFound;
+    // Changes are only seen by the process that owns the key, and only sent by a connection thread
+    if(c->numFields != 3 || user->shm != NULL || numPartitions > 1 || params.workers > 0) {
+	replyError(user, ERR_INVALID_PARAM, "\n");
+	return;
+    }
+    if(getTable(c->fields[1].ptr, params.tableNum) == NULL) {
+	replyError(user, ERR_TABLE_NOT_FOUND, "\n");
+	return;
+    }
+    cmd_slice key = c->fields[2];
+    bool prefix = (key.ptr[key.len - 1] == '*');
+    if(prefix)
+	key.ptr[--key.len] = '\0';
+
+    if(add && user->watch == NULL) {
+	user->watch = malloc(sizeof(watcher));
+	if(user->watch == NULL || watch_init(user->watch) != 0) {
+		free(user->watch);
+		user->watch = NULL;
+		replyError(user, ERR_UNKNOWN, "\n");
+		return;
+	}
+    }
+    int status;
+    if(add)
+	status = watch_add(user->watch, c->fields[1].ptr, key.ptr, prefix);
+    else
+	status = (user->watch == NULL) ? -1 : watch_remove(user->watch, c->fields[1].ptr, key.ptr, prefix);
+    if(status != 0) {
+	// Too many subscriptions, a key too long, or no such subscription
+	replyError(user, ERR_INVALID_PARAM, "\n");
+	return;
+    }
+    replyOk(user);
+}
 
-    for(i=0; i<limit; i++) {
-	strcat(bufTemp, result_arr[i]);
-	if(i != limit -1)
-		strcat(bufTemp, ",");
+
+/**
+ * @brief Function checks for authentication and subscribes the connection to the changes of a key or key prefix.
+ * @param c The parsed command
+ * @param sock An integer type that specifies the socket system is working on.
+ * @param user A pointer to the user information of the connection.
+ * @return Returns nothing (void).
+ *
+ * Every commit that then writes a matching key, by SET or COMMIT on any
+ * connection, queues "2,<table>,<key>" for this one.  The lines are sent
+ * between replies, or as soon as they are queued while the connection is
+ * idle.  A writer never waits for them: if the queue of the connection is
+ * full, the changes are dropped and "2,*,*" is sent once the queue is
+ * drained, telling the client any key may have changed.  Not available
+ * over shared memory.
+ */
+void ifwatch(cmd_line *c, int sock, user_info *user)
+{
+	watchKey(c, user, true);
+}
+
+
+/**
+ * @brief Function removes a subscription made with WATCH, given the same way.
+ * @param c The parsed command
+ * @param sock An integer type that specifies the socket system is working on.
+ * @param user A pointer to the user information of the connection.
+ * @return Returns nothing (void).
+ */
+void ifunwatch(cmd_line *c, int sock, user_info *user)
+{
+	watchKey(c, user, false);
+}
+
+
+/**
+ * @brief Function to queue the key changes waiting for a watching connection among its replies.
+ * @param user A pointer to the user information of the connection.
+ * @return Returns void
+ */
+void queueChanges(user_info *user) {
+	if (user->watch == NULL)
+		return;
+	watch_event events[WATCH_BATCH];
+	int n, lost;
+	do {
+		n = watch_take(user->watch, events, WATCH_BATCH, &lost);
+		if (lost)
+			reply_str(&user->out, "2,*,*\n");
+		int i;
+		for (i = 0; i < n; i++)
+			reply_printf(&user->out, "2,%s,%s\n", events[i].table, events[i].key);
+	} while (lost || n == WATCH_BATCH);
+}
+
+
+/**
+ * @brief Function to pass a committed record to the connections watching it and to the replicas.
+ * @param t A pointer to the table written
+ * @param r The record written, still locked, or NULL at the end of the commit
+ * @return Returns void
+ */
+void onCommit(table *t, record *r) {
+	if(r != NULL)
+		watch_notify(t->name, r->key);
+	repl_publish(t, r);
+}
+
+
+/**
+ * @brief The connection of a replica and the table whose snapshot is being sent.
+ */
+typedef struct {
+	user_info *user;
+	table *t;
+} sync_target;
+
+
+/**
+ * @brief Function to queue a record of a snapshot for a replica, called by scanSnapshot().
+ * @param arg The sync_target
+ * @param key The key of the record
+ * @param v The image of the record in the snapshot
+ * @return Returns void
+ */
+void queueSnapshotRecord(void *arg, const char *key, version *v) {
+	sync_target *target = arg;
+	table *t = target->t;
+	size_t len = REPL_LINE_LEN(t->numColumns);
+	char *room = reply_reserve(&target->user->out, len);
+	reply_commit(&target->user->out, repl_format(room, len, v->ts, t->name, key, v->metadata, false, v->value, t->numColumns));
+}
+
+
+/**
+ * @brief Function turns the connection into the replication stream of a replica.
+ * @param c The parsed command
+ * @param sock An integer type that specifies the socket system is working on.
+ * @param user A pointer to the user information of the connection.
+ * @return Returns nothing (void).
+ *
+ * The reply is "1,0,<ts>", followed by every record of the snapshot at
+ * timestamp ts, "S,<ts>", then the records of every later commit and
+ * heartbeats, in the stream format of repl.h.  The handler returns only
+ * when the replica goes away, or falls REPL_FEED_SIZE bytes behind, in
+ * which case the connection is closed and the replica syncs again.
+ */
+void ifsync(cmd_line *c, int sock, user_info *user)
+{
+    if(user->authenticated == 0) {
+	replyError(user, ERR_NOT_AUTHENTICATED, "\n");
+	return;
+    }
+    // The stream would hold a worker for as long as the replica stays
+    if(c->numFields != 1 || user->txn != NULL || user->shm != NULL || numPartitions > 1 || params.workers > 0) {
+	replyError(user, ERR_INVALID_PARAM, "\n");
+	return;
+    }
+    // Room for the widest line at least
+    size_t bufLen = 256 * 1024;
+    int i;
+    for(i = 0; i < params.tableNum; i++)
+	if(REPL_LINE_LEN(tables[i]->numColumns) > bufLen)
+		bufLen = REPL_LINE_LEN(tables[i]->numColumns);
+    repl_feed *feed = malloc(sizeof(repl_feed));
+    char *buf = malloc(bufLen);
+    // Commits are queued from before the snapshot, those it holds are skipped by the replica
+    if(feed == NULL || buf == NULL || repl_feed_open(feed) != 0) {
+	free(feed);
+	free(buf);
+	replyError(user, ERR_UNKNOWN, "\n");
+	return;
+    }
+    SRVLOG(SRVLOG_INFO, "Replica connected, sending a snapshot.");
+    // A replica that stops reading is dropped rather than holding this thread
+    struct timeval stall = { REPL_STALL_SECS, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &stall, sizeof stall);
+
+    int status = 0;
+    uint64_t snapshot = snapshot_begin();
+    reply_printf(&user->out, "1,0,%llu\n", (unsigned long long)snapshot);
+    for(i = 0; i < params.tableNum && status == 0; i++) {
+	sync_target target = { user, tables[i] };
+	scanSnapshot(tables[i], snapshot, queueSnapshotRecord, &target);
+	status = flushReplies(user);
     }
-    snprintf(buf, sizeof buf, "1,0,%d,%s\n", numKeysFound, bufTemp);
-    sendall(sock, buf, strlen(buf));
+    snapshot_end();
+    reply_printf(&user->out, "S,%llu\n", (unsigned long long)snapshot);
+    if(status == 0)
+	status = flushReplies(user);
+
+    int64_t lastBeat = 0;
+    while(status == 0) {
+	int64_t drainedAt;
+	ssize_t bytes = repl_feed_take(feed, buf, bufLen, REPL_HEARTBEAT_MS, &drainedAt);
+	if(bytes < 0) {
+		SRVLOG(SRVLOG_WARN, "Replica fell too far behind, dropping it.");
+		break;
+	}
+	if(bytes > 0 && sendall(sock, buf, bytes) != 0)
+		break;
+	stats_bytes_out(bytes);
+	if(drainedAt != 0 && drainedAt - lastBeat >= REPL_HEARTBEAT_MS) {
+		char beat[32];
+		int len = snprintf(beat, sizeof beat, "H,%lld\n", (long long)drainedAt);
+		if(sendall(sock, beat, len) != 0)
+			break;
+		stats_bytes_out(len);
+		lastBeat = drainedAt;
+	}
+    }
+    repl_feed_close(feed);
+    free(feed);
+    free(buf);
+    SRVLOG(SRVLOG_INFO, "Replica disconnected.");
+    // The stream cannot go on as a command connection
+    shutdown(sock, SHUT_RDWR);
+}
+
+
+/**
+ * @brief A command verb and the handler that runs it.
+ */
+typedef struct {
+	const char *name;
+	size_t len;
+	enum stats_command stat;
+	void (*run)(cmd_line *c, int sock, user_info *user);
+} command_verb;
+
+static const command_verb verbs[] = {
+	{ "GET", 3, STATS_CMD_GET, ifdataget },
+	{ "GETV", 4, STATS_CMD_GET, ifdatagetversion },
+	{ "SET", 3, STATS_CMD_SET, ifdataset },
+	{ "QUERY", 5, STATS_CMD_QUERY, ifdataquery },
+	{ "AUTH", 4, STATS_CMD_AUTH, ifauthenticate },
+	{ "BEGIN", 5, STATS_CMD_BEGIN, ifbegin },
+	{ "COMMIT", 6, STATS_CMD_COMMIT, ifcommit },
+	{ "ABORT", 5, STATS_CMD_ABORT, ifabort },
+	{ "STATS", 5, STATS_CMD_STATS, ifstats },
+	{ "DISCONN", 7, STATS_CMD_DISCONN, ifdisconnect },
+	{ "SHM", 3, STATS_CMD_SHM, ifsharedmemory },
+	{ "RESUME", 6, STATS_CMD_RESUME, ifresume },
+	{ "WATCH", 5, STATS_CMD_WATCH, ifwatch },
+	{ "UNWATCH", 7, STATS_CMD_UNWATCH, ifunwatch },
+	{ "SYNC", 4, STATS_CMD_SYNC, ifsync },
+};
+
+#define NUM_VERBS (sizeof verbs / sizeof verbs[0])
+
+
+/**
+ * @brief Function to send the queued replies through the transport of the connection.
+ * @param user A pointer to the user information of the connection.
+ * @return Returns 0 on success, -1 if the connection failed
+ *
+ * On the workers, what the socket does not take at once stays queued and
+ * outPending is set; the connection then waits for the socket to drain.
+ */
+int flushReplies(user_info *user) {
+	// Counted once, when first sent
+	if (!user->outPending)
+		stats_bytes_out(user->out.bytes);
+	if (user->shm != NULL) {
+		int status = shm_sendv(user->shm, user->out.iov, user->out.numIov);
+		reply_reset(&user->out);
+		return status;
+	}
+	if (params.workers == 0)
+		return reply_flush(&user->out, user->socket);
+	// A worker does not wait for a client that stops reading, the rest goes once its socket drains
+	int status = reply_send(&user->out, user->socket);
+	user->outPending = (status == 1);
+	return (status < 0) ? -1 : 0;
+}
+
+
+/**
+ * @brief Function to receive more commands through the transport of the connection, blocking until some arrive.
+ * @param user A pointer to the user information of the connection.
+ * @return Returns 0 on success, -1 if the connection closed or failed, or the pending command is too long
+ */
+int receiveCommands(user_info *user) {
+	if (user->shm == NULL && user->watch != NULL) {
+		// Send the changes of watched keys while waiting for commands
+		struct pollfd fds[2] = { { user->socket, POLLIN, 0 }, { user->watch->efd, POLLIN, 0 } };
+		for (;;) {
+			if (poll(fds, 2, -1) < 0) {
+				if (errno == EINTR)
+					continue;
+				return -1;
+			}
+			if (fds[1].revents & POLLIN) {
+				uint64_t count;
+				ssize_t bytes = read(user->watch->efd, &count, sizeof count);
+				(void)bytes;
+				queueChanges(user);
+				if (flushReplies(user) != 0)
+					return -1;
+			}
+			if (fds[0].revents != 0)
+				break;
+		}
+	}
+	if (user->shm == NULL)
+		return cmd_reader_fill(&user->in, user->socket, params.max_cmd_len);
+	size_t room;
+	char *space = cmd_reader_space(&user->in, params.max_cmd_len, &room);
+	if (space == NULL)
+		return -1;
+	ssize_t bytes = shm_recv(user->shm, space, room);
+	if (bytes < 0)
+		return -1;
+	cmd_reader_add(&user->in, bytes);
+	return 0;
+}
+
+
+/**
+ * @brief Function splits a command line once, in place, and calls the handler of its verb.
+ * @param sock An integer type that specifies the socket system is working on.
+ * @param cmd The command line. It is tokenized in place and must not be used afterwards.
+ * @param user A pointer to the user information of the connection.
+ * @return Returns 0, or -1 to close the connection.
+ *
+ * The reply is queued. Queued replies are written together once no further
+ * command is waiting in the receive buffer, so a client that pipelines its
+ * commands gets one write per batch.
+ */
+int handle_command(int sock, char *cmd, user_info *user)
+{
+	stats_start();
+	SRVLOG(SRVLOG_DEBUG, "Processing command '%s'", cmd);
+
+	int status = 0;
+	if (cmd_parse(cmd, &user->line) == 0) {
+		SRVLOG(SRVLOG_WARN, "Error: Wrong format or Null command");
+		status = -1;
+	} else {
+		cmd_slice verb = user->line.verb;
+		size_t i;
+		for (i = 0; i < NUM_VERBS; i++)
+			if (verbs[i].len == verb.len && memcmp(verbs[i].name, verb.ptr, verb.len) == 0)
+				break;
+		if (i < NUM_VERBS) {
+			stats_command(verbs[i].stat);
+			verbs[i].run(&user->line, sock, user);
+		} else {
+			stats_command(STATS_CMD_INVALID);
+			SRVLOG(SRVLOG_WARN, "Error: Invalid command");
+			status = -1;
+		}
+	}
+	stats_mark(STATS_PHASE_EXECUTE);
+
+	if (status == 0 && !cmd_reader_ready(&user->in)) {
+		queueChanges(user);
+		if (flushReplies(user) != 0)
+			status = -1;
+	}
+	stats_mark(STATS_PHASE_SEND);
+
+	stats_finish();
+	return status;
+}
+
+
+/**
+ * @brief Function to set up the state of a new connection.
+ * @param user A pointer to a heap allocated user_info holding the client socket.
+ * @return Returns nothing (void).
+ */
+void initUser(user_info *user)
+{
+	user->authenticated = 0;
+	user->txn = NULL;
+	memset(&user->line, 0, sizeof user->line);
+	memset(&user->in, 0, sizeof user->in);
+	memset(&user->out, 0, sizeof user->out);
+	user->scratch = NULL;
+	user->scratchCols = 0;
+	user->shm = NULL;
+	user->watch = NULL;
+	user->peers = NULL;
+	user->outPending = 0;
+	user->task.run = serveConnection;
+	user->turn = 0;
+}
+
+
+/**
+ * @brief Function to send what the last commands of a connection queued, close it and free its state.
+ * On the workers only what the socket takes at once is sent.
+ * @param user A pointer to the user information of the connection. It is freed.
+ * @return Returns nothing (void).
+ */
+void freeUser(user_info *user)
+{
+	flushReplies(user);
+	if (user->shm != NULL) {
+		shm_close(user->shm);
+		free(user->shm);
+	}
+	close(user->socket);
+	if (user->watch != NULL) {
+		watch_free(user->watch);
+		free(user->watch);
+	}
+	if (user->peers != NULL) {
+		int i;
+		for (i = 0; i < numPartitions; i++)
+			peer_close(&user->peers[i]);
+		free(user->peers);
+	}
+	// An open transaction is discarded with its connection
+	txnFree(user->txn);
+	cmd_free(&user->line);
+	cmd_reader_free(&user->in);
+	reply_free(&user->out);
+	free(user->scratch);
+	free(user);
+
+	// Release the connection slot.
+	pthread_mutex_lock(&connLock);
+	activeConnections--;
+	pthread_cond_signal(&connCond);
+	pthread_mutex_unlock(&connLock);
+}
+
+
+/**
+ * @brief Function to handle concurrent client commands.
+ * @param arguments A pointer to a heap allocated user_info holding the client socket. The handler frees it.
+ * @return Returns a void pointer.
+ */
+void* clientHandler(void* arguments) {
+	// Get commands from client.
+	//printf("In the handler");
+	user_info *user = (user_info*)arguments;
+	initUser(user);
+
+	int wait_for_commands = 1;
+	do {
+		// Take the next line the client sent, receiving more if none is complete.
+		char *cmd;
+		size_t len;
+		if (!cmd_reader_line(&user->in, &cmd, &len)) {
+			// Either an error occurred, the command was too long or the client closed the connection.
+			if (receiveCommands(user) != 0)
+				wait_for_commands = 0;
+		} else if (params.max_cmd_len > 0 && len > params.max_cmd_len) {
+			// Arrived whole in one receive, but too long all the same
+			wait_for_commands = 0;
+		} else {
+			// Handle the command from the client.
+			stats_bytes_in(len + 1);
+			int status = handle_command(user->socket, cmd, user);
+			if (status != 0)
+				wait_for_commands = 0; // Oops.  An error occured.
+		}
+	} while (wait_for_commands);
+
+	// Send what the last commands queued, then close the connection with the client.
+	freeUser(user);
+	snapshot_release_slot();
+	epoch_thread_exit();
+	stats_thread_exit();
+	srvlog_thread_exit();
+	//printf("Connection Closed by a client!");
+	
+	return NULL;
+}
+
+
+/**
+ * @brief Function to receive what a connection sent, without waiting for more.
+ * @param user A pointer to the user information of the connection.
+ * @return Returns 1 if bytes arrived, 0 if none were waiting, or -1 to close the connection.
+ */
+int receiveReady(user_info *user)
+{
+	size_t room;
+	char *space = cmd_reader_space(&user->in, params.max_cmd_len, &room);
+	if (space == NULL)
+		return -1;
+	ssize_t bytes;
+	do {
+		bytes = recv(user->socket, space, room, MSG_DONTWAIT);
+	} while (bytes < 0 && errno == EINTR);
+	if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return 0;
+	if (bytes <= 0)
+		return -1;
+	cmd_reader_add(&user->in, bytes);
+	return 1;
+}
+
+
+/**
+ * @brief Function to have the dispatcher queue a connection on the workers once it sends a command,
+ * or once its socket takes more of the replies left pending.
+ * @param user A pointer to the user information of the connection. Another worker may run it as soon as this returns.
+ * @param op EPOLL_CTL_ADD for a new connection, EPOLL_CTL_MOD for one that was served.
+ * @return Returns nothing (void).
+ */
+void armConnection(user_info *user, int op)
+{
+	// One shot, so at most one worker serves a connection at a time and its replies keep their order
+	struct epoll_event ev;
+	ev.events = (user->outPending ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+	ev.data.ptr = &user->task;
+	int sock = user->socket;
+	// Hands the state of the connection to the worker that next serves it, with the acquire in
+	// serveConnection; user is not touched after it
+	__atomic_store_n(&user->turn, user->turn, __ATOMIC_RELEASE);
+	if (epoll_ctl(workEpoll, op, sock, &ev) != 0)
+		die("Error waiting for the commands of a connection.", EXIT_FAILURE);
+}
+
+
+/**
+ * @brief Task function of a connection: run its next command on a worker.
+ * @param task The task of the connection.
+ * @return Returns nothing (void).
+ *
+ * A connection with another command already received queues itself again
+ * on the same worker, next in line so it keeps running while its buffers
+ * are warm.  Every COMMANDS_PER_TURN commands it goes after the tasks the
+ * worker already has instead, where idle workers steal it first, so a
+ * client that pipelines many commands does not hold up the others.
+ */
+void serveConnection(wq_task *task)
+{
+	user_info *user = (user_info*)((char*)task - offsetof(user_info, task));
+	__atomic_load_n(&user->turn, __ATOMIC_ACQUIRE);
+	// Replies the client was not reading go first, no further command runs until they are sent
+	if (user->outPending) {
+		if (flushReplies(user) != 0) {
+			freeUser(user);
+			return;
+		}
+		if (user->outPending) {
+			armConnection(user, EPOLL_CTL_MOD);
+			return;
+		}
+	}
+	char *cmd;
+	size_t len;
+	if (!cmd_reader_line(&user->in, &cmd, &len)) {
+		int status = receiveReady(user);
+		if (status < 0) {
+			freeUser(user);
+			return;
+		}
+		if (status == 0 || !cmd_reader_line(&user->in, &cmd, &len)) {
+			// Nothing yet, or only part of a line
+			armConnection(user, EPOLL_CTL_MOD);
+			return;
+		}
+	}
+	// Arrived whole in one receive, but too long all the same
+	if (params.max_cmd_len > 0 && len > params.max_cmd_len) {
+		freeUser(user);
+		return;
+	}
+	stats_bytes_in(len + 1);
+	if (handle_command(user->socket, cmd, user) != 0) {
+		freeUser(user);
+		return;
+	}
+	if (cmd_reader_ready(&user->in))
+		wq_push(task, ++user->turn % COMMANDS_PER_TURN == 0);
+	else
+		armConnection(user, EPOLL_CTL_MOD);
+}
+
+
+/**
+ * @brief Thread function of the dispatcher: queue each connection that sent a command on the workers.
+ * @param arg Unused.
+ * @return Returns NULL, never.
+ */
+void* dispatchConnections(void *arg)
+{
+	struct epoll_event events[MAX_LISTENQUEUELEN];
+	for (;;) {
+		int ready = epoll_wait(workEpoll, events, MAX_LISTENQUEUELEN, -1);
+		if (ready < 0) {
+			if (errno == EINTR)
+				continue;
+			die("Error waiting for commands.", EXIT_FAILURE);
+		}
+		int i;
+		for (i = 0; i < ready; i++)
+			wq_submit(events[i].data.ptr);
+	}
+	return NULL;
 }
 
 
+/**
+ * @brief Function to listen on a Unix socket, replacing a socket file left by an earlier run.
+ * @param path The path of the socket
+ * @return Returns the listening socket, or -1 on error
+ */
+int listenUnix(const char *path) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0)
+		return -1;
+	// Only a socket is replaced, never a regular file given by mistake
+	struct stat st;
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+	if (bind(sock, (struct sockaddr*)&addr, sizeof addr) != 0 || listen(sock, MAX_LISTENQUEUELEN) != 0) {
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
 
 
 /**
- * @brief Function checks the first parameter of the string to check for user command and calls user requested commands.
- * @param cmd A string type	
- * @param sock An integer type that specifies the socket system is working on.
- * @return Returns nothing (void).
+ * @brief Function to pin the calling thread to a set of CPUs, exiting if none of them can run it.
+ * @param cpus The set
+ * @return Returns void
  */
-int handle_command(int sock, char *cmd, user_info *user)
-{
-	char logMessage[MAX_LOG_LEN] = {0};
-	snprintf(logMessage, sizeof logMessage, "Processing command '%s'\n", cmd);
-	logger(LOGGING, serverLog, logMessage);
-
-	// For now, just send back the command to the client.
-	//---------
-	char inputstring[MAX_CMD_LEN] = {0};
-	strcpy(inputstring, cmd);
+void pinThread(cpu_set_t *cpus) {
+	if (pthread_setaffinity_np(pthread_self(), sizeof *cpus, cpus) != 0) {
+		printf("Error pinning a thread to its CPUs.\n");
+		exit(EXIT_FAILURE);
+	}
+}
 
-	char * pch;
-	char * mt_saveptr;
-	pch = strtok_r (cmd,", ",&mt_saveptr);
 
-	if (pch != NULL)
-	{
-		if(!strcmp(pch, "AUTH")) {   //Checking each command to call corresponding
-			ifauthenticate(inputstring, sock, user); //String broken down into parts inside each function
-			
-		} else if(!strcmp(pch, "GET")) {
-			ifdataget(inputstring, sock, user);
-			
-		} else if(!strcmp(pch, "SET")) {
-			ifdataset(inputstring, sock, user);
-			
-		} else if(!strcmp(pch, "QUERY")) {
-			ifdataquery(inputstring, sock, user);
-			
-		} else if(!strcmp(pch, "DISCONN")) {
-			user->authenticated = 0;
-			
-		} else {
-			snprintf(logMessage, sizeof logMessage, "Error: Invalid command\n");
-			logger(LOGGING, serverLog, logMessage);
-			return -1;
+/**
+ * @brief Function to fork the processes of the other partitions, each going on from here as its own server.
+ * @return Returns void
+ */
+void startPartitions() {
+	numPartitions = params.processes;
+	pid_t parent = getpid();
+	int i;
+	for (i = 1; i < numPartitions; i++) {
+		pid_t pid = fork();
+		if (pid < 0) {
+			printf("Error starting partition %d.\n", i);
+			exit(EXIT_FAILURE);
 		}
-		
-	} else {
-		//printf("Error: Wrong format or Null command\n");
-		snprintf(logMessage, sizeof logMessage, "Error: Wrong format or Null command\n");
-		logger(LOGGING, serverLog, logMessage);
-		return -1;
+		if (pid == 0) {
+			myPartition = i;
+			// Stop with the first process, even if it is killed
+			prctl(PR_SET_PDEATHSIG, SIGTERM);
+			if (getppid() != parent)
+				exit(EXIT_FAILURE);
+			return;
+		}
+		partitionPids[i] = pid;
 	}
-	//---------
-	//sendall(sock, buf, strlen(buf));
-	//sendall(sock, "\n", 1);
-	
-	return 0;
 }
 
 
 /**
- * @brief Function to handle concurrent client commands.
- * @param arguments A void pointer type.	
- * @return Returns a void pointer.
+ * @brief Signal handler asking the listen loop to stop.
+ * @param sig The signal number
+ * @return Returns void
  */
-void* clientHandler(void* arguments) {
-	// Get commands from client.
-	//printf("In the handler");
-	user_info user;
-	int threadNum;
-	sscanf((char*)arguments, "%d %d", &(user.socket), &threadNum);
-	user.authenticated = 0;
-	int wait_for_commands = 1;
-	do {
-		// Read a line from the client.
-		char cmd[MAX_CMD_LEN] = {0};
-		int status = recvline(user.socket, cmd, MAX_CMD_LEN);
-		if (status != 0) {
-			// Either an error occurred or the client closed the connection.
-			wait_for_commands = 0;
-		} else {
-			// Handle the command from the client.
-			int status = handle_command(user.socket, cmd, &user);
-			if (status != 0)
-				wait_for_commands = 0; // Oops.  An error occured.
-		}
-	} while (wait_for_commands);
+void requestShutdown(int sig) {
+	shutdownRequested = 1;
+}
 
-	// Close the connection with the client.
-	close(user.socket);
-	user.authenticated = 0;
-	threadpool[threadNum].active = false;
-	//printf("Connection Closed by a client!");
-	
-	return NULL;
+
+/**
+ * @brief Signal handler changing the log level, SIGUSR1 raises it and SIGUSR2 lowers it.
+ * @param sig The signal number
+ * @return Returns void
+ */
+void changeLogLevel(int sig) {
+	srvlog_set_level(__atomic_load_n(&srvlogLevel, __ATOMIC_RELAXED) + ((sig == SIGUSR1) ? 1 : -1));
 }
 
 
@@ -1045,7 +1827,7 @@ int main(int argc, char *argv[])
 	if(LOGGING == 2)
 		serverLog = createLog();
 	else
-		serverLog = NULL;
+		serverLog = stdout;
 
 	// Process command line arguments.
 	// This program expects exactly one argument: the config file name.
@@ -1067,6 +1849,25 @@ int main(int argc, char *argv[])
 	params.tableNum = 0;
 	params.concurrencySet = 0;
 	params.tableSet = 0;
+	params.maxConnectionsSet = 0;
+	params.maxCmdLenSet = 0;
+	params.logLevelSet = 0;
+	params.socketSet = 0;
+	params.sessionTtlSet = 0;
+	params.replicaSet = 0;
+	params.processesSet = 0;
+	params.processes = 1;
+	params.coresSet = 0;
+	params.cores = 0;
+	params.workersSet = 0;
+	params.workers = 0;
+	params.cpuAcceptSet = 0;
+	params.cpuWorkersSet = 0;
+	params.cpuCoresSet = 0;
+	params.cpuBackgroundSet = 0;
+	params.session_ttl = DEFAULT_SESSION_TTL;
+	params.max_connections = DEFAULT_MAX_CONNECTIONS;
+	params.max_cmd_len = DEFAULT_MAX_CMD_LEN;
 
 	// Read the config file.
 	int status = serverConfigParser(config_file);
@@ -1074,15 +1875,97 @@ int main(int argc, char *argv[])
 		printf("Error processing config file.\n");
 		exit(EXIT_FAILURE);
 	}
-	char logMessage[MAX_LOG_LEN] = {0};
-	snprintf(logMessage, sizeof logMessage, "Server on %s:%d\n", params.server_host, params.server_port);
-	logger(LOGGING, serverLog, logMessage);
+	// A partition keeps its writes to itself, and forwarding needs a thread per connection
+	if (params.processes > 1 && (params.replicaSet || concurrency != 1)) {
+		printf("processes needs concurrency 1 and no replicaof.\n");
+		exit(EXIT_FAILURE);
+	}
+	if (params.workers > 0 && concurrency != 1) {
+		printf("workers needs concurrency 1.\n");
+		exit(EXIT_FAILURE);
+	}
+	// Fork before any thread is started, so every process gets its own
+	fflush(stdout);
+	startPartitions();
+	// A send to a replica or primary that went away fails instead of killing the server
+	signal(SIGPIPE, SIG_IGN);
+	// The writer thread blocks the signals handled below, like the client threads
+	sigset_t mainSignals, oldMask;
+	sigemptyset(&mainSignals);
+	sigaddset(&mainSignals, SIGINT);
+	sigaddset(&mainSignals, SIGTERM);
+	sigaddset(&mainSignals, SIGUSR1);
+	sigaddset(&mainSignals, SIGUSR2);
+	pthread_sigmask(SIG_BLOCK, &mainSignals, &oldMask);
+	// Threads start on the CPUs of the thread that creates them
+	cpu_set_t mainCpus;
+	sched_getaffinity(0, sizeof mainCpus, &mainCpus);
+	pinThread(params.cpuBackgroundSet ? &params.cpuBackground : &mainCpus);
+	if(srvlog_start(serverLog) != 0) {
+		printf("Error starting the log writer.\n");
+		exit(EXIT_FAILURE);
+	}
+	pinThread(&mainCpus);
+	int coreCpus[CPU_SETSIZE];
+	int numCoreCpus = 0;
+	int cpu;
+	for(cpu = 0; params.cpuCoresSet && cpu < CPU_SETSIZE; cpu++)
+		if(CPU_ISSET(cpu, &params.cpuCores))
+			coreCpus[numCoreCpus++] = cpu;
+	if(params.cores > 0 && exec_start(params.cores, coreCpus, numCoreCpus) != 0) {
+		printf("Error starting the core executors.\n");
+		exit(EXIT_FAILURE);
+	}
+	// Connection threads, or the workers in their place, start on their own CPUs
+	pthread_attr_t workerAttr;
+	pthread_attr_init(&workerAttr);
+	if(params.cpuWorkersSet)
+		pthread_attr_setaffinity_np(&workerAttr, sizeof params.cpuWorkers, &params.cpuWorkers);
+	if(params.workers > 0) {
+		pthread_t dispatcher;
+		workEpoll = epoll_create1(0);
+		if(workEpoll < 0 || wq_start(params.workers, params.cpuWorkersSet ? &workerAttr : NULL) != 0 ||
+				pthread_create(&dispatcher, NULL, dispatchConnections, NULL) != 0) {
+			printf("Error starting the workers.\n");
+			exit(EXIT_FAILURE);
+		}
+		pthread_detach(dispatcher);
+	}
+	pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+	SRVLOG(SRVLOG_INFO, "Server on %s:%d", params.server_host, params.server_port);
+	if(params.socketSet && myPartition == 0)
+		SRVLOG(SRVLOG_INFO, "Server on %s", params.server_socket);
+	if(numPartitions > 1)
+		SRVLOG(SRVLOG_INFO, "Partition %d of %d", myPartition, numPartitions);
+	if(params.cores > 0)
+		SRVLOG(SRVLOG_INFO, "Running GET, SET and QUERY on %d core executors", params.cores);
+	if(params.workers > 0)
+		SRVLOG(SRVLOG_INFO, "Running the commands of every connection on %d workers", params.workers);
+	// Commits tell the connections that watch the keys they write, and the replicas
+	commitHook = onCommit;
+	if(params.replicaSet) {
+		SRVLOG(SRVLOG_INFO, "Replica of %s:%d", params.replica_host, params.replica_port);
+		pinThread(params.cpuBackgroundSet ? &params.cpuBackground : &mainCpus);
+		if(repl_start(params.replica_host, params.replica_port, params.username, params.password, params.tableNum) != 0) {
+			printf("Error starting replication.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	// Tried here, so CPUs that cannot run the connection threads stop the server now
+	if(params.cpuWorkersSet)
+		pinThread(&params.cpuWorkers);
+	// The listening thread stays on its own CPUs from now on
+	pinThread(params.cpuAcceptSet ? &params.cpuAccept : &mainCpus);
+	int i;
+	for(i = 0; i < params.tableNum; i++)
+		if(tables[i]->arena != NULL)
+			SRVLOG(SRVLOG_INFO, "Records of %s on NUMA node %d", tables[i]->name, tables[i]->arena->node);
 
 	if(load_workload) {
 		FILE *fin;            /* declare the file pointer */
 		fin = fopen ("../data/census/workload.txt", "r");  /* open the file for reading */
 		char line[80] = {0};
-		census record;
+		census *record;
 		char t[MAX_TABLE_LENGTH] = {0};
 		printf("Enter table to be populated: ");
 		scanf("%s",t);
@@ -1095,11 +1978,14 @@ int main(int argc, char *argv[])
 		}
 
 		/* acquire census data and insert in list ... */
+		record = newRecord(wtable->numColumns);
 		while(fgets(line, 80, fin) != NULL) {
 			/* get a line, up to 80 chars from fr.  done if NULL */
-			sscanf (line, "%s %[^\n]", record.key, record.value[0]);
-			insertRecord(&(wtable->list), &record, wtable->numColumns, wtable->columnType);
+			sscanf (line, "%s %[^\n]", record->key, record->value[0]);
+			record->metadata = 0;
+			insertRecord(wtable, record);
 		}
+		free(record);
 		fclose(fin);  /* close the file prior to exiting the routine */
 
 	}
@@ -1118,6 +2004,11 @@ int main(int argc, char *argv[])
 		printf("Error configuring socket.\n");
 		exit(EXIT_FAILURE);
 	}
+	// Every partition listens on the port, and the kernel spreads the connections over them
+	if (numPartitions > 1 && setsockopt(listensock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof yes) != 0) {
+		printf("Error configuring socket.\n");
+		exit(EXIT_FAILURE);
+	}
 
 	// Bind it to the listening port.
 	struct sockaddr_in listenaddr;
@@ -1138,52 +2029,133 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	int j=0;
-	for(j=0; j<MAX_CONNECTIONS; j++) {
-		threadpool[j].active = false;
+	// Clients on the same host can skip TCP through the optional Unix socket, served by the first partition
+	struct pollfd listeners[3];
+	int numListeners = 0;
+	int unixsock = -1, peersock = -1;
+	listeners[numListeners].fd = listensock;
+	listeners[numListeners++].events = POLLIN;
+	if(params.socketSet && myPartition == 0) {
+		unixsock = listenUnix(params.server_socket);
+		if (unixsock < 0) {
+			printf("Error listening on %s.\n", params.server_socket);
+			exit(EXIT_FAILURE);
+		}
+		listeners[numListeners].fd = unixsock;
+		listeners[numListeners++].events = POLLIN;
 	}
+	// The other partitions forward the commands on keys of this one through its own socket
+	char peerPath[MAX_SOCKET_PATH_LEN];
+	if(numPartitions > 1) {
+		partition_socket(peerPath, sizeof peerPath, params.server_port, myPartition);
+		peersock = listenUnix(peerPath);
+		if (peersock < 0) {
+			printf("Error listening on %s.\n", peerPath);
+			exit(EXIT_FAILURE);
+		}
+		listeners[numListeners].fd = peersock;
+		listeners[numListeners++].events = POLLIN;
+	}
+
+	// What the latency histograms cost, so their numbers can be read net of it
+	latencyOverhead = stats_overhead();
+	SRVLOG(SRVLOG_INFO, "Latency timing overhead: %llu ns per command", (unsigned long long)latencyOverhead);
+
+	// Stop on SIGINT or SIGTERM. No SA_RESTART, so accept() returns to check the flag.
+	struct sigaction sa;
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = requestShutdown;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	// SIGUSR1 logs more, SIGUSR2 logs less
+	sa.sa_handler = changeLogLevel;
+	sigaction(SIGUSR1, &sa, NULL);
+	sigaction(SIGUSR2, &sa, NULL);
+	// Client threads block all four, so they are delivered to the listening thread
+
 	// Listen loop.
 	int wait_for_connections = 1;
-	while (wait_for_connections) {
-		// Wait for a connection.
+	while (wait_for_connections && !shutdownRequested) {
+		// Wait for a free connection slot, leaving new clients queued in the backlog.
+		pthread_mutex_lock(&connLock);
+		while(params.max_connections > 0 && activeConnections >= params.max_connections)
+			pthread_cond_wait(&connCond, &connLock);
+		pthread_mutex_unlock(&connLock);
+
+		// Wait for a connection on either listener.
+		if (poll(listeners, numListeners, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			printf("Error waiting for a connection.\n");
+			exit(EXIT_FAILURE);
+		}
+		int l = 0;
+		while (l < numListeners - 1 && !(listeners[l].revents & POLLIN))
+			l++;
 		struct sockaddr_in clientaddr;
 		socklen_t clientaddrlen = sizeof clientaddr;
-		int clientsock = accept(listensock, (struct sockaddr*)&clientaddr, &clientaddrlen);
+		int clientsock = accept(listeners[l].fd, (struct sockaddr*)&clientaddr, &clientaddrlen);
 		if (clientsock < 0) {
+			if (errno == EINTR)
+				continue;
 			printf("Error accepting a connection.\n");
 			exit(EXIT_FAILURE);
 		}
 
-		snprintf(logMessage, sizeof logMessage, "Got a connection from %s:%d.\n", inet_ntoa(clientaddr.sin_addr), clientaddr.sin_port);
-		logger(LOGGING, serverLog, logMessage);
-		if(concurrency == 1) {
-			bool findthread = false;
-			while(findthread != true) {
-				int i=0;
-				for(i=0; i<MAX_CONNECTIONS; i++) {
-					if(threadpool[i].active == false) {
-						char threadArg[MAX_STRTYPE_SIZE];
-						snprintf(threadArg, sizeof threadArg, "%d %d", clientsock, i);
-						pthread_create(&(threadpool[i].pth),NULL,clientHandler,threadArg);
-						threadpool[i].active = true;
-						findthread = true;
-						break;
-					}
-				}
+		if (listeners[l].fd == listensock)
+			SRVLOG(SRVLOG_INFO, "Got a connection from %s:%d.", inet_ntoa(clientaddr.sin_addr), clientaddr.sin_port);
+		else
+			SRVLOG(SRVLOG_INFO, "Got a connection on %s.", (listeners[l].fd == peersock) ? peerPath : params.server_socket);
+
+		user_info *user = malloc(sizeof(user_info));
+		if(user == NULL)
+			die("Out of memory accepting a connection.", EXIT_FAILURE);
+		user->socket = clientsock;
+		user->local = (listeners[l].fd != listensock);
+		user->peer = (listeners[l].fd == peersock);
+		pthread_mutex_lock(&connLock);
+		activeConnections++;
+		pthread_mutex_unlock(&connLock);
+
+		if(params.workers > 0) {
+			// The dispatcher queues it on the workers once it sends a command
+			initUser(user);
+			armConnection(user, EPOLL_CTL_ADD);
+		} else if(concurrency == 1) {
+			pthread_t pth;
+			pthread_sigmask(SIG_BLOCK, &mainSignals, &oldMask);
+			if(pthread_create(&pth, params.cpuWorkersSet ? &workerAttr : NULL, clientHandler, user) != 0) {
+				printf("Error creating a client thread.\n");
+				exit(EXIT_FAILURE);
 			}
+			pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+			pthread_detach(pth);
 		} else {
-			threadpool[0].active = true;
-			char threadArg[MAX_STRTYPE_SIZE];
-			snprintf(threadArg, sizeof threadArg, "%d 0", clientsock);
-			pthread_create(&(threadpool[0].pth),NULL,clientHandler,threadArg);
-			while(threadpool[0].active == true);
+			// Serve one client at a time on the listening thread.
+			clientHandler(user);
 		}
-//		snprintf(logMessage, sizeof logMessage, "Closed connection from %s:%d.\n", inet_ntoa(clientaddr.sin_addr), clientaddr.sin_port);
-//		logger(LOGGING, serverLog, logMessage);
+//		SRVLOG(SRVLOG_INFO, "Closed connection from %s:%d.", inet_ntoa(clientaddr.sin_addr), clientaddr.sin_port);
 	}
 
 	// Stop listening for connections.
 	close(listensock);
+	if(unixsock >= 0) {
+		close(unixsock);
+		unlink(params.server_socket);
+	}
+	if(peersock >= 0) {
+		close(peersock);
+		unlink(peerPath);
+	}
+	// The first process stops with the others
+	for (i = 1; myPartition == 0 && i < numPartitions; i++) {
+		kill(partitionPids[i], SIGTERM);
+		waitpid(partitionPids[i], NULL, 0);
+	}
+	srvlog_stop();
+	printf("Latency of the commands served:\n");
+	stats_dump(stdout);
+	fflush(stdout);
 
 	if(LOGGING == 2)
 		fclose(serverLog);
@@ -1268,6 +2240,34 @@ int processLine(char* line){
 		return configTable();
 	else if (strcmp(parameter, "concurrency") == 0)
 		return configConcurrency();
+	else if (strcmp(parameter, "max_connections") == 0)
+		return configMaxConnections();
+	else if (strcmp(parameter, "max_cmd_len") == 0)
+		return configMaxCmdLen();
+	else if (strcmp(parameter, "log_level") == 0)
+		return configLogLevel();
+	else if (strcmp(parameter, "server_socket") == 0)
+		return configSocket();
+	else if (strcmp(parameter, "session_ttl") == 0)
+		return configSessionTtl();
+	else if (strcmp(parameter, "replicaof") == 0)
+		return configReplicaOf();
+	else if (strcmp(parameter, "processes") == 0)
+		return configProcesses();
+	else if (strcmp(parameter, "cores") == 0)
+		return configCores();
+	else if (strcmp(parameter, "workers") == 0)
+		return configWorkers();
+	else if (strcmp(parameter, "cpu_accept") == 0)
+		return configCpus(&params.cpuAcceptSet, &params.cpuAccept);
+	else if (strcmp(parameter, "cpu_workers") == 0)
+		return configCpus(&params.cpuWorkersSet, &params.cpuWorkers);
+	else if (strcmp(parameter, "cpu_cores") == 0)
+		return configCpus(&params.cpuCoresSet, &params.cpuCores);
+	else if (strcmp(parameter, "cpu_background") == 0)
+		return configCpus(&params.cpuBackgroundSet, &params.cpuBackground);
+	else if (strcmp(parameter, "numa_node") == 0)
+		return configNumaNode();
 	else if (isEmptyString(line))
 		return 0;
 	else
@@ -1304,6 +2304,271 @@ int configConcurrency(){
 
 
 
+/**
+ * @brief Responsible for setting up the optional cap on simultaneous client connections.
+ * @return Returns 1 if the cap was already set in a previous config line, or is not a non-negative integer
+ */
+int configMaxConnections(){
+	char* value = strtok(NULL, ", \r\t");
+	char* additionalArgs = strtok(NULL, ", \r\t");
+
+	if ((value == NULL) || (additionalArgs != NULL))
+		return 1;
+	if (isColSizeValid(value) == 1)
+		return 1;
+
+	//Determine if max_connections field already defined
+	if (params.maxConnectionsSet == 1)
+		return 1;
+	params.max_connections = atoi(value);
+	params.maxConnectionsSet = 1;
+
+	return 0;
+}
+
+
+
+/**
+ * @brief Responsible for setting up how long session tokens stay valid.
+ * @return Returns 1 if the lifetime was already set in a previous config line, or is not a non-negative integer
+ */
+int configSessionTtl(){
+	char* value = strtok(NULL, ", \r\t");
+	char* additionalArgs = strtok(NULL, ", \r\t");
+
+	if ((value == NULL) || (additionalArgs != NULL))
+		return 1;
+	if (isColSizeValid(value) == 1)
+		return 1;
+
+	//Determine if session_ttl field already defined
+	if (params.sessionTtlSet == 1)
+		return 1;
+	params.session_ttl = atoi(value);
+	params.sessionTtlSet = 1;
+
+	return 0;
+}
+
+
+
+/**
+ * @brief Responsible for setting up the primary a replica follows.
+ * @return Returns 1 if the primary was already set in a previous config line, or its host or port is invalid
+ */
+int configReplicaOf(){
+	char* host = strtok(NULL, ", \r\t");
+	char* port = strtok(NULL, ", \r\t");
+	char* additionalArgs = strtok(NULL, ", \r\t");
+
+	if ((host == NULL) || (port == NULL) || (additionalArgs != NULL) || strlen(host) >= MAX_HOST_LEN)
+		return 1;
+	if (isColSizeValid(port) == 1)
+		return 1;
+
+	//Determine if replicaof field already defined
+	if (params.replicaSet == 1)
+		return 1;
+	strcpy(params.replica_host, host);
+	params.replica_port = atoi(port);
+	params.replicaSet = 1;
+
+	return 0;
+}
+
+
+
+/**
+ * @brief Responsible for setting up the number of processes the server runs as.
+ * @return Returns 1 if the number was already set in a previous config line, or is not from 1 to MAX_PARTITIONS
+ */
+int configProcesses(){
+	char* value = strtok(NULL, ", \r\t");
+	char* additionalArgs = strtok(NULL, ", \r\t");
+
+	if ((value == NULL) || (additionalArgs != NULL))
+		return 1;
+	if (isColSizeValid(value) == 1)
+		return 1;
+
+	//Determine if processes field already defined
+	if (params.processesSet == 1)
+		return 1;
+	params.processes = atoi(value);
+	if (params.processes < 1 || params.processes > MAX_PARTITIONS)
+		return 1;
+	params.processesSet = 1;
+
+	return 0;
+}
+
+
+
+/**
+ * @brief Responsible for setting up the number of core executors that run GET, SET and QUERY.
+ * @return Returns 1 if the number was already set in a previous config line, or is not a power of two up to MAX_CORES
+ */
+int configCores(){
+	char* value = strtok(NULL, ", \r\t");
+	char* additionalArgs = strtok(NULL, ", \r\t");
+
+	if ((value == NULL) || (additionalArgs != NULL))
+		return 1;
+	if (isColSizeValid(value) == 1)
+		return 1;
+
+	//Determine if cores field already defined
+	if (params.coresSet == 1)
+		return 1;
+	params.cores = atoi(value);
+	// Each executor owns a slice of the key index, which comes in powers of two
+	if (params.cores < 0 || params.cores > MAX_CORES || (params.cores & (params.cores - 1)) != 0)
+		return 1;
+	params.coresSet = 1;
+
+	return 0;
+}
+
+
+/**
+ * @brief Function to check the workers parameter: the number of workers running the commands of every connection.
+ * @return Returns 0 if valid, 1 if invalid
+ */
+int configWorkers(){
+	char* value = strtok(NULL, ", \r\t");
+	char* additionalArgs = strtok(NULL, ", \r\t");
+
+	if ((value == NULL) || (additionalArgs != NULL))
+		return 1;
+	if (isColSizeValid(value) == 1)
+		return 1;
+
+	//Determine if workers field already defined
+	if (params.workersSet == 1)
+		return 1;
+	params.workers = atoi(value);
+	if (params.workers < 0 || params.workers > WQ_MAX_WORKERS)
+		return 1;
+	params.workersSet = 1;
+
+	return 0;
+}
+
+
+
+/**
+ * @brief Responsible for setting up a set of CPUs to pin threads to, given as CPUs and ranges such as "0-3,8".
+ * @param isSet The flag of the set, raised once it is set
+ * @param cpus The set
+ * @return Returns 1 if the set was already set in a previous config line, or is empty or malformed
+ */
+int configCpus(int *isSet, cpu_set_t *cpus){
+	char* value;
+
+	//Determine if the set was already defined
+	if (*isSet == 1)
+		return 1;
+	CPU_ZERO(cpus);
+	while ((value = strtok(NULL, ", \r\t")) != NULL) {
+		char *end;
+		long first = strtol(value, &end, 10);
+		long last = first;
+		if (end == value || first < 0)
+			return 1;
+		if (*end == '-') {
+			char *range = end + 1;
+			last = strtol(range, &end, 10);
+			if (end == range)
+				return 1;
+		}
+		if (*end != '\0' || last < first || last >= CPU_SETSIZE)
+			return 1;
+		for (; first <= last; first++)
+			CPU_SET(first, cpus);
+	}
+	if (CPU_COUNT(cpus) == 0)
+		return 1;
+	*isSet = 1;
+
+	return 0;
+}
+
+
+
+/**
+ * @brief Responsible for placing the records of a table, defined on an earlier line, on a NUMA node.
+ * @return Returns 1 if the table is not defined, or its records cannot be bound to the node
+ */
+int configNumaNode(){
+	char* tableName = strtok(NULL, ", \r\t");
+	char* node = strtok(NULL, ", \r\t");
+	char* additionalArgs = strtok(NULL, ", \r\t");
+
+	if ((tableName == NULL) || (node == NULL) || (additionalArgs != NULL))
+		return 1;
+	if (isColSizeValid(node) == 1)
+		return 1;
+	table *t = getTable(tableName, params.tableNum);
+	if (t == NULL)
+		return 1;
+	// Fails for a node that does not exist, or a table bound already
+	if (bindTable(t, atoi(node)) != 0)
+		return 1;
+
+	return 0;
+}
+
+
+
+/**
+ * @brief Responsible for setting up the optional cap on the length of a single command.
+ * @return Returns 1 if the cap was already set in a previous config line, or is not a non-negative integer
+ */
+int configMaxCmdLen(){
+	char* value = strtok(NULL, ", \r\t");
+	char* additionalArgs = strtok(NULL, ", \r\t");
+
+	if ((value == NULL) || (additionalArgs != NULL))
+		return 1;
+	if (isColSizeValid(value) == 1)
+		return 1;
+
+	//Determine if max_cmd_len field already defined
+	if (params.maxCmdLenSet == 1)
+		return 1;
+	params.max_cmd_len = strtoul(value, NULL, 10);
+	params.maxCmdLenSet = 1;
+
+	return 0;
+}
+
+
+
+/**
+ * @brief Responsible for setting up the log level the server starts with.
+ * @return Returns 1 if the level was already set in a previous config line, or is not a known level name
+ */
+int configLogLevel(){
+	char* value = strtok(NULL, ", \r\t");
+	char* additionalArgs = strtok(NULL, ", \r\t");
+
+	if ((value == NULL) || (additionalArgs != NULL))
+		return 1;
+	int level = srvlog_level_from_name(value);
+	if (level < 0)
+		return 1;
+
+	//Determine if log_level field already defined
+	if (params.logLevelSet == 1)
+		return 1;
+	srvlog_set_level(level);
+	params.logLevelSet = 1;
+
+	return 0;
+}
+
+
+
 /**
  * @brief Responsible for setting up hostname parameter in server.
  * @return Returns 1 if hostname was already set in a previous config line, or hostname is invalid
@@ -1325,6 +2590,28 @@ int configHost(){
 
 
 
+/**
+ * @brief Responsible for setting up the Unix socket path of the server.
+ * @return Returns 1 if the path was already set in a previous config line, or the path is invalid
+ */
+int configSocket(){
+	char* path = strtok(NULL, ", \r\t");
+	char* additionalArgs = strtok(NULL, ", \r\t");
+
+	if ((path == NULL) || (additionalArgs != NULL) || strlen(path) >= MAX_SOCKET_PATH_LEN)
+		return 1;
+
+	//Determine if server_socket field already defined
+	if (params.socketSet == 1)
+		return 1;
+	strcpy(params.server_socket, path);
+	params.socketSet = 1;
+
+	return 0;
+}
+
+
+
 /**
  * @brief Responsible for setting up port parameter in server.
  * @return Returns 1 if port was already set in a previous config line, or port is invalid
@@ -1586,7 +2873,7 @@ int isColSizeValid(char * str){
 
 
 /**
- * @brief Determines if a column already exists or is invalid, or max columns reached
+ * @brief Determines if a column already exists or is invalid
  * @param tableName Name of the table
  * @param name Name of the column
  * @param type Type of the column
@@ -1671,33 +2958,6 @@ int tableValidConfig(char* tableName){
 
 
 
-/**
- * @brief Function to add a column to a table assuming that the column does not exist
- * @param tab A pointer to the table
- * @param colName The name of the column
- * @param colType An integer indicating the type of column to be created
- * @return Returns Integer 1 if unsuccessful, returns 0 if successful
- */
-int addColumn(table* tab, char* colName, int colType){	
-	
-	//Check if we can't put anymore data in (max columns reached)
-	if (tab->numColumns == MAX_COLUMNS_PER_TABLE){
-		return -1;
-	}
-	if(colType == 0) {
-		return -1;
-	}
-
-	//Copies column name
-	strcpy(tab->columnName[tab->numColumns], colName);
-	tab->columnType[tab->numColumns] = colType;
-	tab->numColumns++;
-
-	return 0;
-} 
-
-
-
 /**
  * @brief Adds a table
  * @param tablename Name of the table
@@ -1,6 +1,6 @@
 /**
  * @file
- * @brief This file defines the the structures for user authentication, user params, tables and nodes. Also defines constants and error codes for the server side.
+ * @brief This file defines the the structures for user authentication and user params. Also defines constants and error codes for the server side.
  *
  * The functions here should be implemented in server.c.
  */
@@ -8,7 +8,18 @@
 #ifndef	SERVER_H
 #define SERVER_H
 
-#include "simclist.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include "engine.h"
+#include "command.h"
+#include "reply.h"
+#include "shmchan.h"
+#include "watch.h"
+#include "partition.h"
+#include "exec.h"
+#include "workq.h"
 
 // Error codes.
 #define ERR_INVALID_PARAM 1		///< A parameter is not valid.
@@ -18,27 +29,24 @@
 #define ERR_KEY_NOT_FOUND 6		///< The key does not exist.
 #define ERR_UNKNOWN 7			///< Any other error.
 #define ERR_TRANSACTION_ABORT 8		///< Transaction abort error.
+#define ERR_READ_ONLY 9			///< The server is a replica, which refuses writes.
 
 /* DANIEL'S CONSTANT*/
 #define MAX_LINE_LENGTH 500
 
 // LIMITS
-#define MAX_LISTENQUEUELEN 20	///< The maximum number of queued connections.
-
-// Storage server constants.
-#define MAX_NUM_OF_TABLES 100		///< Max tables supported by the server.
-#define MAX_RECORDS_PER_TABLE 1000 ///< Max records per table.
-#define MAX_TABLE_LENGTH 20	///< Max characters of a table name.
-#define MAX_KEY_LEN 20		///< Max characters of a key name.
-#define MAX_CONNECTIONS 10	///< Max simultaneous client connections.
+#define MAX_LISTENQUEUELEN 1024	///< The maximum number of queued connections.
+#define MAX_SOCKET_PATH_LEN 108	///< Max characters of a Unix socket path, its NUL included.
 
 // Extended storage server constants.
-#define MAX_COLUMNS_PER_TABLE 10 ///< Max columns per table.
-#define MAX_COLNAME_LEN 20	///< Max characters of a column name.
-#define MAX_STRTYPE_SIZE 40	///< Max SIZE of string types.
 #define MAX_VALUE_LEN 800	///< Max characters of a value.
+#define INIT_PREDICATES 4	///< Initial predicate slots per query, doubled when full.
+#define WATCH_BATCH 32		///< Key changes taken from a watcher at a time.
+#define COMMANDS_PER_TURN 16	///< Pipelined commands a worker runs for one connection before serving others.
 
-#define MAX_PREDICATES 100	///< Max number of predicates.
+// Configurable limits (0 means unlimited).
+#define DEFAULT_MAX_CONNECTIONS 0	///< Default cap on simultaneous client connections.
+#define DEFAULT_MAX_CMD_LEN (1024 * 1024)	///< Default cap on the length of one command.
 
 /**
 * @brief Any lines in the config file that start with this character
@@ -61,6 +69,32 @@ typedef struct {
 	int passSet;
 	int concurrencySet;
 	int tableSet;
+	/// If = 1, then it has been set once already
+	int maxConnectionsSet;
+	/// If = 1, then it has been set once already
+	int maxCmdLenSet;
+	/// If = 1, then it has been set once already
+	int logLevelSet;
+	/// If = 1, then it has been set once already
+	int socketSet;
+	/// If = 1, then it has been set once already
+	int sessionTtlSet;
+	/// If = 1, then it has been set once already
+	int replicaSet;
+	/// If = 1, then it has been set once already
+	int processesSet;
+	/// If = 1, then it has been set once already
+	int coresSet;
+	/// If = 1, then it has been set once already
+	int workersSet;
+	/// If = 1, then it has been set once already
+	int cpuAcceptSet;
+	/// If = 1, then it has been set once already
+	int cpuWorkersSet;
+	/// If = 1, then it has been set once already
+	int cpuCoresSet;
+	/// If = 1, then it has been set once already
+	int cpuBackgroundSet;
 
 	/// The hostname of the server.
 	char server_host[MAX_HOST_LEN];
@@ -68,6 +102,9 @@ typedef struct {
 	/// The listening port of the server.
 	int server_port;
 
+	/// Path of the Unix socket also listened on, for clients on the same host.
+	char server_socket[MAX_SOCKET_PATH_LEN];
+
 	/// The storage server's username
 	char username[MAX_USERNAME_LEN];
 
@@ -76,6 +113,39 @@ typedef struct {
 
 	int tableNum;
 
+	/// Max simultaneous client connections, 0 for no limit.
+	int max_connections;
+
+	/// Max characters in a single command, 0 for no limit.
+	size_t max_cmd_len;
+
+	/// Seconds a session token issued on AUTH stays valid, 0 to issue none.
+	int session_ttl;
+
+	/// Host of the primary this server replicates, if replicaSet.
+	char replica_host[MAX_HOST_LEN];
+
+	/// Port of the primary this server replicates, if replicaSet.
+	int replica_port;
+
+	/// Processes the server runs as, each owning a partition of the keys.
+	int processes;
+
+	/// Core executors running GET, SET and QUERY, 0 to run them on the connection threads.
+	int cores;
+
+	/// Workers running the commands of every connection, 0 for a thread per connection.
+	int workers;
+
+	/// CPUs of the listening thread, if cpuAcceptSet.
+	cpu_set_t cpuAccept;
+	/// CPUs of the connection threads, if cpuWorkersSet.
+	cpu_set_t cpuWorkers;
+	/// CPUs of the core executors, one each, if cpuCoresSet.
+	cpu_set_t cpuCores;
+	/// CPUs of the log writer and replication threads, if cpuBackgroundSet.
+	cpu_set_t cpuBackground;
+
 	/// The directory where tables are stored.
 	//	char data_directory[MAX_PATH_LEN];
 } config_params;
@@ -94,54 +164,39 @@ typedef struct {
 
 	//Socket file descriptor
 	int socket;
-} user_info;
-
-/**
-* @brief A struct to store the list node.
-*/
-typedef struct {
-	// Key of the node
-	char key[MAX_KEY_LEN];
-	// Value of the columns of the node
-	char value[MAX_COLUMNS_PER_TABLE][MAX_STRTYPE_SIZE];
-	// metadata
-	int metadata;
-} census;    /* custom data type to store in list */
 
-/**
-* @brief A struct to store the predicate.
-*/
-typedef struct {
-	// Type of predicate
-	// -> '0' - String, '1' - Integer
-	int type;
-	// Value of predicate
-	char value[MAX_STRTYPE_SIZE];
-	// How the predicate needs to be compared
-	// -> '-1' - lesser, '0' - equal, '+1' - greater
-	int cmp;
-	// Column of predicate
-	int colNum;
-} predicate;    /* predicates for query */
+	// Open transaction between BEGIN and COMMIT/ABORT, NULL outside one
+	struct transaction *txn;
+
+	// Set if the connection came in on the Unix socket
+	int local;
+	// Shared memory channel carrying the commands after SHM, NULL on a plain socket
+	shm_channel *shm;
+	// Changes of the keys the connection watches, NULL until its first WATCH
+	watcher *watch;
+	// Set if the connection came from the process of another partition, whose commands all run here
+	int peer;
+	// Links to the processes of the other partitions, one per partition, NULL until a command is forwarded
+	peer_link *peers;
+
+	// Fields of the command being handled, reused from one command to the next
+	cmd_line line;
+	// Commands received and not handled yet
+	cmd_reader in;
+	// Replies queued and not sent yet, written once per batch of pipelined commands
+	reply_buf out;
+	// Set when the workers left replies the socket did not take, no command runs until they are sent
+	int outPending;
+	// Record a GET copies into, reused while the table has at most scratchCols columns
+	census *scratch;
+	int scratchCols;
+
+	// Task that runs the next command, queued on the workers while the connection has one waiting
+	wq_task task;
+	// Commands run since the connection last let others go first
+	unsigned turn;
+} user_info;
 
-/**
-* @brief A struct to store a table.
-*/
-typedef struct {
-	// Name of the table
-	char name[MAX_TABLE_LENGTH];
-	// List inside the table
-	list_t list;
-	int numColumns;
-	
-	char columnName[MAX_COLUMNS_PER_TABLE][MAX_COLNAME_LEN];
-//-1 for integer, <size> for char[size]
-	int columnType[MAX_COLUMNS_PER_TABLE];
-} table;
-
-//Returns -1 if unsuccessful, returns 1 if successful
-//Assumes that column does not exist
-int addColumn(table* tab, char* colName, int colType);
 
 
 /**
@@ -169,19 +224,44 @@ int addColumn(table* tab, char* colName, int colType);
 */
 //void deleteTrailingWhitespace(char * str);
 int configConcurrency();
-table* getTable(char* tableName, int topTableNumber);
-void addTable(char* tableName, int indexToPutAt);
-int comparator(const void *a, const void *b);
-int seeker(const void *el, const void *key);
-int insertRecord(list_t *lp, census *rp, int colNum, int columnType[MAX_COLUMNS_PER_TABLE]);
-census* findRecord(list_t *lp, char *keyname);
-void displayAllRecords(list_t *lp, int colNum);
-void sortAllRecords(list_t *lp, int order);
-void list_set_init(list_t *lp);
-void ifauthenticate(char *commandstring, int sock, user_info *user);
-void ifdataget(char *commandstring, int sock, user_info *user);
-void ifdataset(char *commandstring, int sock, user_info *user);
+void ifauthenticate(cmd_line *c, int sock, user_info *user);
+void getRecord(cmd_line *c, user_info *user, bool conditional);
+void ifdataget(cmd_line *c, int sock, user_info *user);
+void ifdatagetversion(cmd_line *c, int sock, user_info *user);
+void ifdataset(cmd_line *c, int sock, user_info *user);
+void ifbegin(cmd_line *c, int sock, user_info *user);
+void ifcommit(cmd_line *c, int sock, user_info *user);
+void ifabort(cmd_line *c, int sock, user_info *user);
+void ifstats(cmd_line *c, int sock, user_info *user);
+void ifdisconnect(cmd_line *c, int sock, user_info *user);
+void ifsharedmemory(cmd_line *c, int sock, user_info *user);
+void ifresume(cmd_line *c, int sock, user_info *user);
+void watchKey(cmd_line *c, user_info *user, bool add);
+void ifwatch(cmd_line *c, int sock, user_info *user);
+void ifunwatch(cmd_line *c, int sock, user_info *user);
+void queueSnapshotRecord(void *arg, const char *key, version *v);
+void ifsync(cmd_line *c, int sock, user_info *user);
+void queueChanges(user_info *user);
+char* joinFields(cmd_line *c, size_t *len);
+peer_link* peerLink(user_info *user, int partition);
+bool forwardToOwner(cmd_line *c, user_info *user, const char *key);
+int mergePeerQuery(char *reply, char **keys, int maxKeys, int *numKeys);
+void runCommandTask(exec_task *task);
+bool runOnOwner(cmd_line *c, int sock, user_info *user, const char *key,
+		void (*handler)(cmd_line *c, int sock, user_info *user));
+void runQueryTask(exec_task *task);
+int queryOnCores(table *t, predicate *preds, int numPreds, char **keys_arr, int max_keys);
+void startPartitions();
+void pinThread(cpu_set_t *cpus);
+int flushReplies(user_info *user);
+void onCommit(table *t, record *r);
 int handle_command(int sock, char *cmd, user_info *user);
+void initUser(user_info *user);
+void freeUser(user_info *user);
+int receiveReady(user_info *user);
+void armConnection(user_info *user, int op);
+void serveConnection(wq_task *task);
+void* dispatchConnections(void *arg);
 
 
 int configTable();
@@ -201,6 +281,17 @@ int addColumnConfig(char* table, char* name, char* type, int size);
 int tableValidConfig(char* table);
 int addTableConfig(char* table);
 int configHost();
+int configMaxConnections();
+int configMaxCmdLen();
+int configLogLevel();
+int configSocket();
+int configSessionTtl();
+int configReplicaOf();
+int configProcesses();
+int configCores();
+int configWorkers();
+int configCpus(int *isSet, cpu_set_t *cpus);
+int configNumaNode();
 #endif
 
 
@@ -0,0 +1,121 @@
+/**
+ * @file
+ * @brief This file implements the session tokens declared in session.h.
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/random.h>
+#include "session.h"
+
+/**
+ * @brief A remembered token.
+ */
+typedef struct {
+	char token[SESSION_TOKEN_LEN];
+	// Seconds on the monotonic clock after which the token is refused, 0 for a free slot
+	time_t expires;
+} session_slot;
+
+static session_slot slots[SESSION_SLOTS];
+// Guards slots
+static pthread_mutex_t sessionLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/**
+ * @brief Function to read the monotonic clock in seconds.
+ * @return Returns the seconds, never 0
+ */
+static time_t now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return ts.tv_sec + 1;
+}
+
+
+/**
+ * @brief Function to find the first slot a token may be stored in.
+ * @param token The token
+ * @return Returns the slot index
+ */
+static size_t first_slot(const char *token)
+{
+	// The token is random, so its first digits are as good as a hash
+	size_t h = 0;
+	int i;
+	for (i = 0; i < 8; i++)
+		h = (h << 4) | (size_t)((token[i] <= '9') ? token[i] - '0' : token[i] - 'a' + 10);
+	return h & (SESSION_SLOTS - 1);
+}
+
+
+/**
+ * @brief Function to compare two tokens in a time that does not depend on where they differ.
+ * @param a A token
+ * @param b Another token
+ * @return Returns 1 if equal, 0 otherwise
+ */
+static int same_token(const char *a, const char *b)
+{
+	unsigned char diff = 0;
+	int i;
+	for (i = 0; i < SESSION_TOKEN_LEN; i++)
+		diff |= (unsigned char)a[i] ^ (unsigned char)b[i];
+	return diff == 0;
+}
+
+
+int session_issue(int ttl, char *token)
+{
+	static const char hex[] = "0123456789abcdef";
+	unsigned char bytes[SESSION_TOKEN_LEN / 2];
+	if (getrandom(bytes, sizeof bytes, 0) != (ssize_t)sizeof bytes)
+		return -1;
+	int i;
+	for (i = 0; i < (int)sizeof bytes; i++) {
+		token[2 * i] = hex[bytes[i] >> 4];
+		token[2 * i + 1] = hex[bytes[i] & 15];
+	}
+	token[SESSION_TOKEN_LEN] = '\0';
+
+	time_t t = now();
+	size_t start = first_slot(token);
+	pthread_mutex_lock(&sessionLock);
+	// The first free or expired slot, or else the one closest to expiring
+	session_slot *victim = &slots[start];
+	for (i = 0; i < SESSION_PROBE; i++) {
+		session_slot *s = &slots[(start + i) & (SESSION_SLOTS - 1)];
+		if (s->expires <= t) {
+			victim = s;
+			break;
+		}
+		if (s->expires < victim->expires)
+			victim = s;
+	}
+	memcpy(victim->token, token, SESSION_TOKEN_LEN);
+	victim->expires = t + ttl;
+	pthread_mutex_unlock(&sessionLock);
+	return 0;
+}
+
+
+int session_valid(const char *token)
+{
+	if (strlen(token) != SESSION_TOKEN_LEN || strspn(token, "0123456789abcdef") != SESSION_TOKEN_LEN)
+		return 0;
+	time_t t = now();
+	size_t start = first_slot(token);
+	int valid = 0;
+	int i;
+	pthread_mutex_lock(&sessionLock);
+	for (i = 0; i < SESSION_PROBE; i++) {
+		session_slot *s = &slots[(start + i) & (SESSION_SLOTS - 1)];
+		if (s->expires > t && same_token(s->token, token))
+			valid = 1;
+	}
+	pthread_mutex_unlock(&sessionLock);
+	return valid;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file
+ * @brief This file declares the session tokens the server issues on AUTH.
+ *
+ * A client that authenticated once can present its token with RESUME on a
+ * later connection instead of the password, until the token expires.  The
+ * tokens live in a fixed table: a token is looked up in the few slots
+ * following its hash, and a new one takes the first expired slot there,
+ * or else the one closest to expiring.  A token is SESSION_TOKEN_LEN hex
+ * digits of random bytes.
+ */
+
+#ifndef	SESSION_H
+#define SESSION_H
+
+#include "storage.h"
+
+#define SESSION_SLOTS 4096	///< Tokens remembered at most, a power of two.
+#define SESSION_PROBE 8		///< Slots a token may be stored in, starting at its hash.
+#define DEFAULT_SESSION_TTL 300	///< Default seconds a token stays valid.
+
+/**
+ * @brief Issue a new token.
+ *
+ * @param ttl Seconds the token stays valid.
+ * @param token Filled with the token, SESSION_TOKEN_LEN characters and a NUL.
+ * @return Return 0 on success, -1 if no random bytes could be had.
+ */
+int session_issue(int ttl, char *token);
+
+/**
+ * @brief Check a token presented to resume a session.
+ *
+ * @param token The token.
+ * @return Return 1 if the server issued it and it has not expired, 0 otherwise.
+ */
+int session_valid(const char *token);
+
+#endif
@@ -0,0 +1,375 @@
+/**
+ * @file
+ * @brief This file implements the shared memory transport declared in shmchan.h.
+ *
+ * The producer of a ring copies bytes in, then publishes them by storing
+ * head with release order; the consumer reads head with acquire order,
+ * copies the bytes out and publishes the room by storing tail.  Before
+ * sleeping a side raises its waiting flag and reads the counter again,
+ * and after publishing the other side reads the flag, both with
+ * sequential consistency, so either the sleeper sees the new counter or
+ * the publisher sees the flag and wakes it.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "shmchan.h"
+
+#define RING_MASK (SHM_RING_SIZE - 1)
+
+
+/**
+ * @brief Function to wake the side sleeping on a counter, if it said it would sleep.
+ * @param word The counter just advanced
+ * @param waiting The flag of the side that sleeps on it
+ * @return Returns void
+ */
+static void wake(uint32_t *word, uint32_t *waiting)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(waiting, __ATOMIC_RELAXED)) {
+		// Not FUTEX_PRIVATE_FLAG, the sleeper is in another process
+		syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+	}
+}
+
+
+/**
+ * @brief Function to tell whether the channel was closed by either side.
+ * @param ch The channel
+ * @return Returns 1 if closed, 0 otherwise
+ */
+static int is_closed(shm_channel *ch)
+{
+	return __atomic_load_n(&ch->seg->closed, __ATOMIC_ACQUIRE) != 0;
+}
+
+
+/**
+ * @brief Function to wait until a counter moves on from a value it was seen holding.
+ * @param ch The channel
+ * @param word The counter
+ * @param waiting The flag raised while sleeping on it
+ * @param seen The value seen
+ * @return Returns 0 once the counter may have moved, -1 if the channel closed or the peer went away
+ */
+static int wait_move(shm_channel *ch, uint32_t *word, uint32_t *waiting, uint32_t seen)
+{
+	int i;
+	for (i = 0; i < SHM_SPIN; i++) {
+		if (__atomic_load_n(word, __ATOMIC_ACQUIRE) != seen)
+			return 0;
+		if (is_closed(ch))
+			return -1;
+	}
+
+	__atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+	int timedOut = 0;
+	if (__atomic_load_n(word, __ATOMIC_SEQ_CST) == seen && !is_closed(ch)) {
+		struct timespec ts = { SHM_CHECK_MS / 1000, (SHM_CHECK_MS % 1000) * 1000000L };
+		if (syscall(SYS_futex, word, FUTEX_WAIT, seen, &ts, NULL, 0) != 0 && errno == ETIMEDOUT)
+			timedOut = 1;
+	}
+	__atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+	if (is_closed(ch))
+		return -1;
+
+	if (timedOut) {
+		// A peer that died without closing the channel leaves its socket closed
+		char c;
+		ssize_t n = recv(ch->sock, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+		if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+			return -1;
+	}
+	return 0;
+}
+
+
+/**
+ * @brief Function to copy as many bytes as fit into a ring, without publishing them.
+ * @param r The ring
+ * @param head Where the unpublished bytes end, advanced past the copied ones
+ * @param p The bytes
+ * @param len Number of bytes
+ * @return Returns the number copied, or -1 if the ring is corrupt
+ */
+static ssize_t ring_put(shm_ring *r, uint32_t *head, const char *p, size_t len)
+{
+	uint32_t used = *head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	if (used > SHM_RING_SIZE)
+		return -1;
+	size_t room = SHM_RING_SIZE - used;
+	if (len > room)
+		len = room;
+	size_t at = *head & RING_MASK;
+	size_t first = (len < SHM_RING_SIZE - at) ? len : SHM_RING_SIZE - at;
+	memcpy(r->data + at, p, first);
+	memcpy(r->data, p + first, len - first);
+	*head += len;
+	return len;
+}
+
+
+/**
+ * @brief Function to publish copied bytes and wait for room in the ring.
+ * @param ch The channel
+ * @param head Where the copied bytes end
+ * @return Returns 0 once there may be room, -1 if the channel closed
+ */
+static int publish_and_wait(shm_channel *ch, uint32_t head)
+{
+	shm_ring *r = ch->out;
+	__atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+	wake(&r->head, &r->headWaiting);
+	uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	if (head - tail < SHM_RING_SIZE)
+		return 0;
+	return wait_move(ch, &r->tail, &r->tailWaiting, tail);
+}
+
+
+int shm_send(shm_channel *ch, const char *buf, size_t len)
+{
+	struct iovec iov;
+	iov.iov_base = (void*)buf;
+	iov.iov_len = len;
+	return shm_sendv(ch, &iov, 1);
+}
+
+
+int shm_sendv(shm_channel *ch, const struct iovec *iov, int numIov)
+{
+	shm_ring *r = ch->out;
+	uint32_t head = r->head;
+	int i;
+	for (i = 0; i < numIov; i++) {
+		const char *p = iov[i].iov_base;
+		size_t left = iov[i].iov_len;
+		while (left > 0) {
+			if (is_closed(ch))
+				return -1;
+			ssize_t put = ring_put(r, &head, p, left);
+			if (put < 0)
+				return -1;
+			p += put;
+			left -= put;
+			// Full, let the reader drain it
+			if (left > 0 && publish_and_wait(ch, head) != 0)
+				return -1;
+		}
+	}
+	__atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+	wake(&r->head, &r->headWaiting);
+	return 0;
+}
+
+
+/**
+ * @brief Function to wait until the ring read by this side holds bytes.
+ * @param ch The channel
+ * @param avail Set to the number of bytes available
+ * @return Returns 0 once some are, -1 if the channel closed or the ring is corrupt
+ */
+static int wait_bytes(shm_channel *ch, uint32_t *avail)
+{
+	shm_ring *r = ch->in;
+	uint32_t tail = r->tail;
+	for (;;) {
+		uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		*avail = head - tail;
+		if (*avail > SHM_RING_SIZE)
+			return -1;
+		if (*avail > 0)
+			return 0;
+		if (wait_move(ch, &r->head, &r->headWaiting, head) != 0)
+			return -1;
+	}
+}
+
+
+/**
+ * @brief Function to hand room back to the writer of the ring read by this side.
+ * @param ch The channel
+ * @param len Number of bytes consumed
+ * @return Returns void
+ */
+static void consume(shm_channel *ch, size_t len)
+{
+	shm_ring *r = ch->in;
+	__atomic_store_n(&r->tail, r->tail + (uint32_t)len, __ATOMIC_RELEASE);
+	wake(&r->tail, &r->tailWaiting);
+}
+
+
+ssize_t shm_recv(shm_channel *ch, char *buf, size_t len)
+{
+	uint32_t avail;
+	if (len == 0)
+		return 0;
+	if (wait_bytes(ch, &avail) != 0)
+		return -1;
+	shm_ring *r = ch->in;
+	if (len > avail)
+		len = avail;
+	size_t at = r->tail & RING_MASK;
+	size_t first = (len < SHM_RING_SIZE - at) ? len : SHM_RING_SIZE - at;
+	memcpy(buf, r->data + at, first);
+	memcpy(buf + first, r->data, len - first);
+	consume(ch, len);
+	return len;
+}
+
+
+int shm_recvline(shm_channel *ch, char *buf, size_t buflen)
+{
+	shm_ring *r = ch->in;
+	size_t used = 0;
+	while (used + 1 < buflen) {
+		uint32_t avail;
+		if (wait_bytes(ch, &avail) != 0) {
+			buf[used] = '\0';
+			return -1;
+		}
+		// Copy up to the newline, or all that is there
+		size_t taken = 0;
+		while (taken < avail && used + 1 < buflen) {
+			char c = r->data[(r->tail + taken) & RING_MASK];
+			taken++;
+			if (c == '\n') {
+				consume(ch, taken);
+				buf[used] = '\0';
+				return 0;
+			}
+			buf[used++] = c;
+		}
+		consume(ch, taken);
+	}
+	buf[used] = '\0';
+	return 0;
+}
+
+
+int shm_create(shm_channel *ch, int sock, const char *msg, size_t len)
+{
+	int fd = memfd_create("storage-shm", MFD_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	// The pages of a new memfd are zero, so both rings start empty and the channel open
+	void *seg = MAP_FAILED;
+	if (ftruncate(fd, sizeof(shm_segment)) == 0)
+		seg = mmap(NULL, sizeof(shm_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (seg == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+
+	// The descriptor travels with the reply
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof control);
+	struct iovec iov = { (void*)msg, len };
+	struct msghdr mh;
+	memset(&mh, 0, sizeof mh);
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = control.buf;
+	mh.msg_controllen = sizeof control.buf;
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cm), &fd, sizeof(int));
+	ssize_t sent;
+	do {
+		sent = sendmsg(sock, &mh, MSG_NOSIGNAL);
+	} while (sent < 0 && errno == EINTR);
+	close(fd);
+	if (sent != (ssize_t)len) {
+		munmap(seg, sizeof(shm_segment));
+		return -1;
+	}
+
+	ch->seg = seg;
+	ch->in = &ch->seg->requests;
+	ch->out = &ch->seg->replies;
+	ch->sock = sock;
+	return 0;
+}
+
+
+int shm_attach(shm_channel *ch, int sock, char *buf, size_t buflen)
+{
+	int fd = -1;
+	size_t used = 0;
+	int done = 0;
+	// Read up to the newline, one byte at a time like recvline(), keeping the descriptor
+	while (!done && used + 1 < buflen) {
+		union {
+			char buf[CMSG_SPACE(sizeof(int))];
+			struct cmsghdr align;
+		} control;
+		struct iovec iov = { buf + used, 1 };
+		struct msghdr mh;
+		memset(&mh, 0, sizeof mh);
+		mh.msg_iov = &iov;
+		mh.msg_iovlen = 1;
+		mh.msg_control = control.buf;
+		mh.msg_controllen = sizeof control.buf;
+		ssize_t got = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			break;
+		struct cmsghdr *cm;
+		for (cm = CMSG_FIRSTHDR(&mh); cm != NULL; cm = CMSG_NXTHDR(&mh, cm)) {
+			if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS && fd < 0)
+				memcpy(&fd, CMSG_DATA(cm), sizeof(int));
+		}
+		if (buf[used] == '\n')
+			done = 1;
+		else
+			used++;
+	}
+	buf[used] = '\0';
+	if (!done || fd < 0) {
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	void *seg = mmap(NULL, sizeof(shm_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (seg == MAP_FAILED)
+		return -1;
+	ch->seg = seg;
+	ch->in = &ch->seg->replies;
+	ch->out = &ch->seg->requests;
+	ch->sock = sock;
+	return 0;
+}
+
+
+void shm_close(shm_channel *ch)
+{
+	if (ch->seg == NULL)
+		return;
+	__atomic_store_n(&ch->seg->closed, 1, __ATOMIC_RELEASE);
+	// Whatever the peer sleeps on, wake it to see the flag
+	uint32_t *words[4] = { &ch->in->head, &ch->in->tail, &ch->out->head, &ch->out->tail };
+	int i;
+	for (i = 0; i < 4; i++)
+		syscall(SYS_futex, words[i], FUTEX_WAKE, 1, NULL, NULL, 0);
+	munmap(ch->seg, sizeof(shm_segment));
+	ch->seg = NULL;
+	ch->in = ch->out = NULL;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file
+ * @brief This file declares the shared memory transport for clients on the same host.
+ *
+ * A channel is a memfd segment holding two single-producer,
+ * single-consumer byte rings: requests from the client to the server and
+ * replies back.  They carry the same lines as the socket protocol.  Each
+ * side moves bytes with plain loads and stores; a side that finds its
+ * ring empty (or full) spins briefly, then sleeps on a futex that the
+ * other side wakes only when it knows someone is asleep.  A busy
+ * connection makes no system call per request.
+ *
+ * The client asks for a channel with the SHM command over the Unix socket.
+ * The server answers with the segment's descriptor attached to its reply,
+ * and keeps the socket open to notice if the client goes away.
+ */
+
+#ifndef	SHMCHAN_H
+#define SHMCHAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define SHM_RING_SIZE (64 * 1024)	///< Bytes in each ring, a power of two.
+#define SHM_SPIN 200			///< Polls of an empty or full ring before sleeping.
+#define SHM_CHECK_MS 100		///< How often a sleeping side checks that the peer is still there.
+#define SHM_PREFIX "shm:"		///< storage_connect() hostname prefix selecting this transport.
+
+/**
+ * @brief A ring carrying bytes one way.
+ */
+typedef struct {
+	// Bytes ever written, advanced by the producer only
+	uint32_t head;
+	// Set by the consumer while it sleeps on head
+	uint32_t headWaiting;
+	char pad1[56];
+	// Bytes ever read, advanced by the consumer only
+	uint32_t tail;
+	// Set by the producer while it sleeps on tail
+	uint32_t tailWaiting;
+	char pad2[56];
+	char data[SHM_RING_SIZE];
+} shm_ring;
+
+/**
+ * @brief The shared segment.
+ */
+typedef struct {
+	// Set by the side that closes the channel first
+	uint32_t closed;
+	char pad[60];
+	// Client to server
+	shm_ring requests;
+	// Server to client
+	shm_ring replies;
+} shm_segment;
+
+/**
+ * @brief One side of a channel.
+ */
+typedef struct {
+	shm_segment *seg;
+	// The ring this side reads and the one it writes
+	shm_ring *in;
+	shm_ring *out;
+	// The Unix socket the channel was set up on, watched for the peer going away
+	int sock;
+} shm_channel;
+
+/**
+ * @brief Create a channel as the server and send its descriptor to the client.
+ *
+ * @param ch Filled with the server side of the channel.
+ * @param sock The Unix socket of the client.
+ * @param msg The reply line carrying the descriptor.
+ * @param len Length of msg.
+ * @return Return 0 on success, -1 otherwise. Nothing is sent on failure.
+ */
+int shm_create(shm_channel *ch, int sock, const char *msg, size_t len);
+
+/**
+ * @brief Receive the reply to an SHM command and attach to the channel it carries.
+ *
+ * @param ch Filled with the client side of the channel, if the reply carries one.
+ * @param sock The Unix socket the SHM command was sent on.
+ * @param buf Filled with the reply line, NUL terminated in place of its newline.
+ * @param buflen Size of buf.
+ * @return Return 0 if attached, -1 otherwise. buf holds the reply even if it refused the channel.
+ */
+int shm_attach(shm_channel *ch, int sock, char *buf, size_t buflen);
+
+/**
+ * @brief Write bytes, waiting while the ring is full.
+ *
+ * @return Return 0 on success, -1 if the channel closed.
+ */
+int shm_send(shm_channel *ch, const char *buf, size_t len);
+
+/**
+ * @brief Write the pieces of an iovec list, waiting while the ring is full.
+ *
+ * @return Return 0 on success, -1 if the channel closed.
+ */
+int shm_sendv(shm_channel *ch, const struct iovec *iov, int numIov);
+
+/**
+ * @brief Read the bytes available, waiting until there is at least one.
+ *
+ * @return Return the number of bytes read, or -1 if the channel closed.
+ */
+ssize_t shm_recv(shm_channel *ch, char *buf, size_t len);
+
+/**
+ * @brief Read one line like recvline().
+ *
+ * @param ch The channel.
+ * @param buf Filled with the line, NUL terminated in place of its newline.
+ * @param buflen Size of buf. A longer line is cut, and its rest is read as the next line.
+ * @return Return 0 on success, -1 if the channel closed.
+ */
+int shm_recvline(shm_channel *ch, char *buf, size_t buflen);
+
+/**
+ * @brief Close this side, waking the peer, and unmap the segment. The socket is left open.
+ */
+void shm_close(shm_channel *ch);
+
+#endif
@@ -0,0 +1,237 @@
+/**
+ * @file
+ * @brief This file implements the asynchronous server log declared in srvlog.h.
+ *
+ * A ring has a single producer, the thread that owns it, and a single
+ * consumer, the writer thread.  The owner fills the slot at head and then
+ * publishes head + 1; the writer copies the slot at tail out and then
+ * publishes tail + 1.  Rings of exited threads are reused by later
+ * threads, like the statistics blocks.
+ *
+ * Messages of one thread are written in order; messages of different
+ * threads are not, so each line starts with the time it was logged.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include "srvlog.h"
+
+/**
+ * @brief A formatted message waiting in a ring.
+ */
+typedef struct {
+	// When the message was logged
+	struct timespec when;
+	int level;
+	int len;
+	char text[SRVLOG_MSG_LEN];
+} srvlog_slot;
+
+/**
+ * @brief The ring of one thread.
+ */
+typedef struct srvlog_ring {
+	// Next slot the owner fills, written only by the owner
+	uint64_t head __attribute__((aligned(64)));
+	// Messages dropped because the ring was full, written only by the owner
+	uint64_t dropped;
+	// Next slot the writer reads, written only by the writer
+	uint64_t tail __attribute__((aligned(64)));
+	// Drops already reported by the writer
+	uint64_t reported;
+	// True while a thread owns the ring
+	bool inUse;
+	// Next ring, rings are never freed
+	struct srvlog_ring *next;
+	srvlog_slot slots[SRVLOG_RING_SLOTS];
+} srvlog_ring;
+
+_Static_assert((SRVLOG_RING_SLOTS & (SRVLOG_RING_SLOTS - 1)) == 0, "SRVLOG_RING_SLOTS must be a power of two");
+
+int srvlogLevel = SRVLOG_DEFAULT_LEVEL;
+
+static const char *levelNames[] = { "off", "error", "warn", "info", "debug" };
+
+// All rings
+static srvlog_ring *rings = NULL;
+// Ring owned by the current thread
+static __thread srvlog_ring *myRing = NULL;
+
+// The writer thread and where it writes
+static pthread_t writer;
+static FILE *writerOut = NULL;
+static bool writerRunning = false;
+// Set by srvlog_stop(), the writer exits once every ring is empty
+static int stopping = 0;
+
+
+/**
+ * @brief Function to give the current thread a ring, reusing a released one if possible.
+ * @return Returns the ring of the current thread, NULL if out of memory
+ */
+static srvlog_ring* ring_get()
+{
+	if (myRing != NULL)
+		return myRing;
+
+	srvlog_ring *r;
+	for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+		bool expected = false;
+		if (__atomic_compare_exchange_n(&r->inUse, &expected, true, false,
+				__ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+			myRing = r;
+			return r;
+		}
+	}
+
+	r = aligned_alloc(64, sizeof(srvlog_ring));
+	if (r == NULL)
+		return NULL;
+	memset(r, 0, sizeof *r);
+	r->inUse = true;
+	r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&rings, &r->next, r, false,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+	myRing = r;
+	return r;
+}
+
+
+void srvlog_write(int level, const char *fmt, ...)
+{
+	srvlog_ring *r = ring_get();
+	if (r == NULL)
+		return;
+	uint64_t head = r->head;
+	if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == SRVLOG_RING_SLOTS) {
+		__atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	srvlog_slot *s = &r->slots[head & (SRVLOG_RING_SLOTS - 1)];
+	va_list ap;
+	va_start(ap, fmt);
+	int len = vsnprintf(s->text, sizeof s->text, fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return;
+	if (len >= (int)sizeof s->text)
+		len = sizeof s->text - 1;
+	// Every message ends up on a line of its own
+	while (len > 0 && s->text[len - 1] == '\n')
+		len--;
+	s->len = len;
+	s->level = level;
+	clock_gettime(CLOCK_REALTIME_COARSE, &s->when);
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+
+void srvlog_set_level(int level)
+{
+	if (level < SRVLOG_OFF)
+		level = SRVLOG_OFF;
+	if (level > SRVLOG_DEBUG)
+		level = SRVLOG_DEBUG;
+	__atomic_store_n(&srvlogLevel, level, __ATOMIC_RELAXED);
+}
+
+
+int srvlog_level_from_name(const char *name)
+{
+	int i;
+	for (i = SRVLOG_OFF; i <= SRVLOG_DEBUG; i++)
+		if (strcmp(name, levelNames[i]) == 0)
+			return i;
+	return -1;
+}
+
+
+/**
+ * @brief Function to copy the waiting messages of every ring to the output.
+ * @return Returns the number of messages written
+ */
+static int drain_rings()
+{
+	int written = 0;
+	srvlog_ring *r;
+	for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+		uint64_t tail = r->tail;
+		uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		for (; tail != head; tail++) {
+			srvlog_slot *s = &r->slots[tail & (SRVLOG_RING_SLOTS - 1)];
+			fprintf(writerOut, "%ld.%03ld [%s] %.*s\n", (long)s->when.tv_sec, s->when.tv_nsec / 1000000,
+				levelNames[s->level], s->len, s->text);
+			written++;
+		}
+		__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+
+		uint64_t dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+		if (dropped != r->reported) {
+			fprintf(writerOut, "[warn] %llu log messages dropped\n",
+				(unsigned long long)(dropped - r->reported));
+			r->reported = dropped;
+			written++;
+		}
+	}
+	return written;
+}
+
+
+/**
+ * @brief Function run by the writer thread.
+ * @param arg Unused
+ * @return Returns NULL
+ */
+static void* writer_main(void *arg)
+{
+	const struct timespec idle = { 0, SRVLOG_IDLE_NS };
+	for (;;) {
+		// Read the flag first, so the drain after it catches every message logged before the stop
+		int stop = __atomic_load_n(&stopping, __ATOMIC_ACQUIRE);
+		if (drain_rings() > 0)
+			fflush(writerOut);
+		else if (stop)
+			break;
+		else
+			nanosleep(&idle, NULL);
+	}
+	return NULL;
+}
+
+
+int srvlog_start(FILE *out)
+{
+	if (writerRunning || out == NULL)
+		return -1;
+	writerOut = out;
+	__atomic_store_n(&stopping, 0, __ATOMIC_RELAXED);
+	if (pthread_create(&writer, NULL, writer_main, NULL) != 0)
+		return -1;
+	writerRunning = true;
+	return 0;
+}
+
+
+void srvlog_stop()
+{
+	if (!writerRunning)
+		return;
+	__atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+	pthread_join(writer, NULL);
+	writerRunning = false;
+}
+
+
+void srvlog_thread_exit()
+{
+	if (myRing == NULL)
+		return;
+	__atomic_store_n(&myRing->inUse, false, __ATOMIC_RELEASE);
+	myRing = NULL;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file
+ * @brief This file declares the asynchronous server log.
+ *
+ * Every thread formats its messages into its own ring of fixed-size
+ * slots, which only it writes and only the writer thread reads, so
+ * logging takes no lock and makes no system call.  The writer thread
+ * drains all rings in batches and flushes once per batch.  When a ring is
+ * full the message is dropped and counted rather than blocking the
+ * request.
+ *
+ * The level can change at any time.  SRVLOG() tests it before evaluating
+ * its arguments, so a disabled level costs one load and one branch.
+ */
+
+#ifndef	SRVLOG_H
+#define SRVLOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Log levels, a message is kept if its level is at most the current one.
+#define SRVLOG_OFF 0		///< Nothing is logged.
+#define SRVLOG_ERROR 1		///< Failures the server survives.
+#define SRVLOG_WARN 2		///< Bad input from clients.
+#define SRVLOG_INFO 3		///< Startup, connections and authentication.
+#define SRVLOG_DEBUG 4		///< Every command.
+
+#define SRVLOG_DEFAULT_LEVEL SRVLOG_INFO	///< Level until the config file sets one.
+#define SRVLOG_RING_SLOTS 256	///< Messages a thread can have waiting, a power of two.
+#define SRVLOG_MSG_LEN 232	///< Max characters of a message, longer ones are cut.
+#define SRVLOG_IDLE_NS 1000000	///< How long the writer sleeps when every ring is empty.
+
+/// Current log level, read with a relaxed load on every SRVLOG().
+extern int srvlogLevel;
+
+/**
+ * @brief Log a message if its level is enabled.
+ *
+ * @param level One of SRVLOG_ERROR to SRVLOG_DEBUG.
+ * @param ... A printf format and its arguments, evaluated only if the level is enabled.
+ */
+#define SRVLOG(level, ...) \
+	do { \
+		if ((level) <= __atomic_load_n(&srvlogLevel, __ATOMIC_RELAXED)) \
+			srvlog_write((level), __VA_ARGS__); \
+	} while (0)
+
+/**
+ * @brief Format a message into the ring of the current thread. Use SRVLOG() instead.
+ *
+ * @param level Level of the message.
+ * @param fmt A printf format.
+ */
+void srvlog_write(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Set the log level. Safe to call from a signal handler.
+ *
+ * @param level SRVLOG_OFF to SRVLOG_DEBUG, other values are clamped.
+ */
+void srvlog_set_level(int level);
+
+/**
+ * @brief Find a log level by name.
+ *
+ * @param name One of "off", "error", "warn", "info" or "debug".
+ * @return Return the level, or -1 if the name is not known.
+ */
+int srvlog_level_from_name(const char *name);
+
+/**
+ * @brief Start the writer thread.
+ *
+ * @param out Where the messages go. Messages logged before the start wait in their rings.
+ * @return Return 0 on success, -1 otherwise.
+ */
+int srvlog_start(FILE *out);
+
+/**
+ * @brief Write out every waiting message and stop the writer thread.
+ */
+void srvlog_stop();
+
+/**
+ * @brief Hand the ring of an exiting thread over to later threads. Its waiting messages are still written.
+ */
+void srvlog_thread_exit();
+
+#endif
@@ -0,0 +1,255 @@
+/**
+ * @file
+ * @brief This file implements the server metrics declared in stats.h.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "stats.h"
+#include "utils.h"
+
+// All counter blocks
+static thread_stats *statsBlocks = NULL;
+
+__thread thread_stats *myStats = NULL;
+__thread stats_timer myTimer = { .timed = -1 };
+
+static const char *commandNames[STATS_NUM_COMMANDS] = {
+	"auth", "get", "set", "query", "begin", "commit", "abort", "stats", "disconn", "shm", "resume", "watch", "unwatch", "sync", "invalid"
+};
+
+static const char *phaseNames[STATS_NUM_PHASES] = {
+	"parse", "lock", "execute", "send", "total"
+};
+
+// Percentiles reported by STATS and on shutdown
+static const double percentiles[] = { 0.50, 0.99, 0.999 };
+static const char *percentileNames[] = { "p50", "p99", "p999" };
+#define NUM_PERCENTILES 3
+
+
+thread_stats* stats_slot()
+{
+	if (myStats != NULL)
+		return myStats;
+
+	thread_stats *s;
+	for (s = __atomic_load_n(&statsBlocks, __ATOMIC_ACQUIRE); s != NULL; s = s->next) {
+		bool expected = false;
+		if (__atomic_compare_exchange_n(&s->inUse, &expected, true, false,
+				__ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+			myStats = s;
+			return s;
+		}
+	}
+
+	s = aligned_alloc(STATS_CACHE_LINE, sizeof(thread_stats));
+	if (s == NULL)
+		die("Out of memory allocating statistics.", EXIT_FAILURE);
+	memset(s, 0, sizeof *s);
+	s->inUse = true;
+	s->next = __atomic_load_n(&statsBlocks, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&statsBlocks, &s->next, s, false,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+	myStats = s;
+	return s;
+}
+
+
+/**
+ * @brief Function to find the histogram bucket of a value.
+ * @param v The value
+ * @return Returns the bucket: values below 4 have their own, then four per power of two
+ */
+static int bucket_of(uint64_t v)
+{
+	if (v < (1 << STATS_SUB_BITS))
+		return (int)v;
+	int msb = 63 - __builtin_clzll(v);
+	int sub = (int)(v >> (msb - STATS_SUB_BITS)) & ((1 << STATS_SUB_BITS) - 1);
+	return ((msb - STATS_SUB_BITS + 1) << STATS_SUB_BITS) + sub;
+}
+
+
+/**
+ * @brief Function to find the largest value of a histogram bucket.
+ * @param b The bucket
+ * @return Returns the upper bound of the bucket
+ */
+static uint64_t bucket_max(int b)
+{
+	if (b < (1 << STATS_SUB_BITS))
+		return (uint64_t)b;
+	int msb = (b >> STATS_SUB_BITS) + STATS_SUB_BITS - 1;
+	uint64_t sub = (uint64_t)(b & ((1 << STATS_SUB_BITS) - 1));
+	uint64_t low = ((1ULL << STATS_SUB_BITS) + sub) << (msb - STATS_SUB_BITS);
+	return low + (1ULL << (msb - STATS_SUB_BITS)) - 1;
+}
+
+
+/**
+ * @brief Function to record the phases of the current command in a counter block.
+ * @param s The block
+ * @return Returns void
+ */
+static void record_timer(thread_stats *s)
+{
+	uint64_t *phase = myTimer.phase;
+	phase[STATS_PHASE_TOTAL] = stats_now() - myTimer.start;
+	// Lock waits happen inside the execute phase
+	phase[STATS_PHASE_EXECUTE] -= (phase[STATS_PHASE_LOCK] < phase[STATS_PHASE_EXECUTE]) ?
+		phase[STATS_PHASE_LOCK] : phase[STATS_PHASE_EXECUTE];
+	int i;
+	for (i = 0; i < STATS_NUM_PHASES; i++)
+		stats_add(&s->latency[myTimer.timed][i][bucket_of(phase[i])], 1);
+	myTimer.timed = -1;
+}
+
+
+void stats_finish()
+{
+	if (myTimer.timed < 0)
+		return;
+	record_timer((myStats != NULL) ? myStats : stats_slot());
+}
+
+
+void stats_placement(int node)
+{
+	unsigned cpu, myNode;
+	// Read through the vDSO, no system call
+	if (getcpu(&cpu, &myNode) != 0)
+		return;
+	thread_stats *s = (myStats != NULL) ? myStats : stats_slot();
+	if ((int)myNode == node)
+		stats_add(&s->numaLocal, 1);
+	else
+		stats_add(&s->numaRemote, 1);
+}
+
+
+void stats_sum(thread_stats *total)
+{
+	memset(total, 0, sizeof *total);
+	thread_stats *s;
+	int i;
+	for (s = __atomic_load_n(&statsBlocks, __ATOMIC_ACQUIRE); s != NULL; s = s->next) {
+		for (i = 0; i < STATS_NUM_COMMANDS; i++)
+			total->commands[i] += __atomic_load_n(&s->commands[i], __ATOMIC_RELAXED);
+		for (i = 0; i < STATS_NUM_ERRORS; i++)
+			total->errors[i] += __atomic_load_n(&s->errors[i], __ATOMIC_RELAXED);
+		total->bytesIn += __atomic_load_n(&s->bytesIn, __ATOMIC_RELAXED);
+		total->bytesOut += __atomic_load_n(&s->bytesOut, __ATOMIC_RELAXED);
+		total->lockWaitNs += __atomic_load_n(&s->lockWaitNs, __ATOMIC_RELAXED);
+		total->numaLocal += __atomic_load_n(&s->numaLocal, __ATOMIC_RELAXED);
+		total->numaRemote += __atomic_load_n(&s->numaRemote, __ATOMIC_RELAXED);
+		int c, p;
+		for (c = 0; c < STATS_NUM_TIMED; c++)
+			for (p = 0; p < STATS_NUM_PHASES; p++)
+				for (i = 0; i < STATS_NUM_BUCKETS; i++)
+					total->latency[c][p][i] += __atomic_load_n(&s->latency[c][p][i], __ATOMIC_RELAXED);
+	}
+}
+
+
+uint64_t stats_percentile(const uint64_t *hist, double q)
+{
+	uint64_t count = 0, seen = 0;
+	int i;
+	for (i = 0; i < STATS_NUM_BUCKETS; i++)
+		count += hist[i];
+	if (count == 0)
+		return 0;
+	// Rank of the percentile, counting from 1
+	uint64_t rank = (uint64_t)(q * count);
+	if (rank < q * count || rank == 0)
+		rank++;
+	for (i = 0; i < STATS_NUM_BUCKETS; i++) {
+		seen += hist[i];
+		if (seen >= rank)
+			return bucket_max(i);
+	}
+	return bucket_max(STATS_NUM_BUCKETS - 1);
+}
+
+
+uint64_t stats_overhead()
+{
+	const int rounds = 100000;
+	thread_stats *scratch = aligned_alloc(STATS_CACHE_LINE, sizeof(thread_stats));
+	if (scratch == NULL)
+		die("Out of memory allocating statistics.", EXIT_FAILURE);
+	memset(scratch, 0, sizeof *scratch);
+
+	// The same calls a timed command makes, recorded into the scratch block
+	uint64_t start = stats_now();
+	int i;
+	for (i = 0; i < rounds; i++) {
+		stats_start();
+		myTimer.timed = i % STATS_NUM_TIMED;
+		stats_mark(STATS_PHASE_PARSE);
+		stats_mark(STATS_PHASE_EXECUTE);
+		stats_mark(STATS_PHASE_SEND);
+		record_timer(scratch);
+	}
+	uint64_t elapsed = stats_now() - start;
+	free(scratch);
+	return elapsed / rounds;
+}
+
+
+void stats_dump(FILE *out)
+{
+	thread_stats *total = malloc(sizeof(thread_stats));
+	if (total == NULL)
+		return;
+	stats_sum(total);
+	fprintf(out, "%-8s %-8s %10s %12s %12s %12s\n", "command", "phase", "count", "p50 ns", "p99 ns", "p999 ns");
+	int c, p, i;
+	for (c = 0; c < STATS_NUM_TIMED; c++) {
+		for (p = 0; p < STATS_NUM_PHASES; p++) {
+			uint64_t *hist = total->latency[c][p];
+			uint64_t count = 0;
+			for (i = 0; i < STATS_NUM_BUCKETS; i++)
+				count += hist[i];
+			fprintf(out, "%-8s %-8s %10llu", stats_command_name(STATS_CMD_GET + c), phaseNames[p],
+				(unsigned long long)count);
+			for (i = 0; i < NUM_PERCENTILES; i++)
+				fprintf(out, " %12llu", (unsigned long long)stats_percentile(hist, percentiles[i]));
+			fprintf(out, "\n");
+		}
+	}
+	free(total);
+}
+
+
+const char* stats_command_name(enum stats_command cmd)
+{
+	return commandNames[cmd];
+}
+
+
+size_t stats_format_latency(const thread_stats *total, char *buf, size_t len)
+{
+	size_t used = 0;
+	int c, p, i;
+	for (c = 0; c < STATS_NUM_TIMED; c++)
+		for (p = 0; p < STATS_NUM_PHASES; p++)
+			for (i = 0; i < NUM_PERCENTILES && used < len; i++)
+				used += snprintf(buf + used, len - used, ",lat_%s_%s_%s %llu",
+					stats_command_name(STATS_CMD_GET + c), phaseNames[p], percentileNames[i],
+					(unsigned long long)stats_percentile(total->latency[c][p], percentiles[i]));
+	return (used < len) ? used : len - 1;
+}
+
+
+void stats_thread_exit()
+{
+	if (myStats == NULL)
+		return;
+	__atomic_store_n(&myStats->inUse, false, __ATOMIC_RELEASE);
+	myStats = NULL;
+}
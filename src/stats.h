@@ -0,0 +1,277 @@
+/**
+ * @file
+ * @brief This file declares the server metrics reported by the STATS command.
+ *
+ * Every thread counts into its own cache-line aligned block, so counting is
+ * a plain add on memory no other thread writes.  A reader sums the blocks
+ * of all threads.  Blocks of exited threads are reused by later threads and
+ * keep their counts, so the sums only grow.
+ *
+ * GET, SET and QUERY are also timed phase by phase into log-bucketed
+ * histograms: four buckets per power of two of nanoseconds, so a reported
+ * percentile is at most 25% above the true one.
+ */
+
+#ifndef	STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#define STATS_CACHE_LINE 64	///< Alignment of the per-thread counter blocks.
+#define STATS_NUM_ERRORS 10	///< Error counters, indexed by ERR_* code (1 to 9).
+#define STATS_NUM_TIMED 3	///< Commands with latency histograms: GET, SET and QUERY.
+#define STATS_SUB_BITS 2	///< Histogram buckets per power of two are 1 << STATS_SUB_BITS.
+#define STATS_NUM_BUCKETS (64 << STATS_SUB_BITS)	///< Histogram buckets, enough for any 64 bit value.
+#define STATS_LATENCY_LEN (64 * STATS_NUM_TIMED * STATS_NUM_PHASES * 3)	///< Room for the latency pairs of a STATS reply.
+
+/**
+ * @brief Commands counted by the server.
+ */
+enum stats_command {
+	STATS_CMD_AUTH,
+	STATS_CMD_GET,
+	STATS_CMD_SET,
+	STATS_CMD_QUERY,
+	STATS_CMD_BEGIN,
+	STATS_CMD_COMMIT,
+	STATS_CMD_ABORT,
+	STATS_CMD_STATS,
+	STATS_CMD_DISCONN,
+	STATS_CMD_SHM,
+	STATS_CMD_RESUME,
+	STATS_CMD_WATCH,
+	STATS_CMD_UNWATCH,
+	STATS_CMD_SYNC,
+	STATS_CMD_INVALID,
+	STATS_NUM_COMMANDS
+};
+
+/**
+ * @brief Phases of a timed command.
+ */
+enum stats_phase {
+	STATS_PHASE_PARSE,	///< From the start of handle_command() until the arguments are checked.
+	STATS_PHASE_LOCK,	///< Waiting for record locks held by other threads.
+	STATS_PHASE_EXECUTE,	///< Running the command and building the reply, less the lock wait.
+	STATS_PHASE_SEND,	///< Sending the reply.
+	STATS_PHASE_TOTAL,	///< The whole command.
+	STATS_NUM_PHASES
+};
+
+/**
+ * @brief Counters of one thread, or their sum over all threads.
+ */
+typedef struct thread_stats {
+	// Commands handled, by stats_command
+	uint64_t commands[STATS_NUM_COMMANDS];
+	// Error replies sent, by ERR_* code
+	uint64_t errors[STATS_NUM_ERRORS];
+	// Bytes of commands received and of replies sent
+	uint64_t bytesIn;
+	uint64_t bytesOut;
+	// Nanoseconds spent waiting for record locks held by other threads
+	uint64_t lockWaitNs;
+	// Accesses to tables bound to a NUMA node from a CPU of that node, and of another
+	uint64_t numaLocal;
+	uint64_t numaRemote;
+	// Latency histograms of the timed commands, in nanoseconds
+	uint64_t latency[STATS_NUM_TIMED][STATS_NUM_PHASES][STATS_NUM_BUCKETS];
+	// True while a thread owns the block
+	bool inUse;
+	// Next block, blocks are never freed
+	struct thread_stats *next;
+} __attribute__((aligned(STATS_CACHE_LINE))) thread_stats;
+
+/**
+ * @brief Timing of the command the current thread is handling.
+ */
+typedef struct {
+	// Index of the command in the latency histograms, -1 if it is not timed
+	int timed;
+	// When the command started and when the current phase started
+	uint64_t start;
+	uint64_t mark;
+	// Time spent in each phase so far
+	uint64_t phase[STATS_NUM_PHASES];
+} stats_timer;
+
+/// Counter block of the current thread, NULL until it counts something.
+extern __thread thread_stats *myStats;
+/// Timing of the current command of this thread.
+extern __thread stats_timer myTimer;
+
+/**
+ * @brief Give the current thread a counter block.
+ *
+ * @return Return the block of the current thread.
+ */
+thread_stats* stats_slot();
+
+/**
+ * @brief Add to a counter of the current thread.
+ *
+ * @param counter Address of the counter in the block of the current thread.
+ * @param n Amount to add.
+ *
+ * Only the owner writes the block, so this is a load and a store, not a
+ * locked add. The store is atomic so readers never see a torn value.
+ */
+static inline void stats_add(uint64_t *counter, uint64_t n)
+{
+	__atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Read the monotonic clock.
+ *
+ * @return Return nanoseconds since an arbitrary start.
+ */
+static inline uint64_t stats_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Start timing a command, before it is parsed.
+ */
+static inline void stats_start()
+{
+	int i;
+	myTimer.timed = -1;
+	for (i = 0; i < STATS_NUM_PHASES; i++)
+		myTimer.phase[i] = 0;
+	myTimer.start = myTimer.mark = stats_now();
+}
+
+/**
+ * @brief Count a command, and time it if it is GET, SET or QUERY.
+ */
+static inline void stats_command(enum stats_command cmd)
+{
+	thread_stats *s = (myStats != NULL) ? myStats : stats_slot();
+	stats_add(&s->commands[cmd], 1);
+	if (cmd >= STATS_CMD_GET && cmd < STATS_CMD_GET + STATS_NUM_TIMED)
+		myTimer.timed = cmd - STATS_CMD_GET;
+}
+
+/**
+ * @brief End a phase of the current command. The next phase starts now.
+ *
+ * @param phase The phase that ended.
+ */
+static inline void stats_mark(enum stats_phase phase)
+{
+	if (myTimer.timed < 0)
+		return;
+	uint64_t now = stats_now();
+	myTimer.phase[phase] += now - myTimer.mark;
+	myTimer.mark = now;
+}
+
+/**
+ * @brief Record the phases of the current command in the histograms of this thread.
+ */
+void stats_finish();
+
+/**
+ * @brief Count bytes sent to a client, replies and pushes alike.
+ */
+static inline void stats_bytes_out(size_t len)
+{
+	thread_stats *s = (myStats != NULL) ? myStats : stats_slot();
+	stats_add(&s->bytesOut, len);
+}
+
+/**
+ * @brief Count an error code reported to a client.
+ */
+static inline void stats_error(int code)
+{
+	thread_stats *s = (myStats != NULL) ? myStats : stats_slot();
+	if (code > 0 && code < STATS_NUM_ERRORS)
+		stats_add(&s->errors[code], 1);
+}
+
+/**
+ * @brief Count the bytes of a command received from a client.
+ */
+static inline void stats_bytes_in(size_t len)
+{
+	thread_stats *s = (myStats != NULL) ? myStats : stats_slot();
+	stats_add(&s->bytesIn, len);
+}
+
+/**
+ * @brief Count time spent waiting for a lock.
+ */
+static inline void stats_lock_wait(uint64_t ns)
+{
+	thread_stats *s = (myStats != NULL) ? myStats : stats_slot();
+	stats_add(&s->lockWaitNs, ns);
+	myTimer.phase[STATS_PHASE_LOCK] += ns;
+}
+
+/**
+ * @brief Count an access to a table bound to a NUMA node, as local or remote to the CPU of the current thread.
+ *
+ * @param node The node of the table.
+ */
+void stats_placement(int node);
+
+/**
+ * @brief Sum the counters of all threads.
+ *
+ * @param total Filled with the sums. Counts still being made may or may not be included.
+ */
+void stats_sum(thread_stats *total);
+
+/**
+ * @brief Name of a command in the STATS reply.
+ */
+const char* stats_command_name(enum stats_command cmd);
+
+/**
+ * @brief Format the latency percentiles for the STATS reply.
+ *
+ * @param total Counters summed by stats_sum().
+ * @param buf Where to write ",lat_<command>_<phase>_<percentile> <ns>" pairs.
+ * @param len Size of buf, STATS_LATENCY_LEN is always enough.
+ * @return Return the number of characters written.
+ */
+size_t stats_format_latency(const thread_stats *total, char *buf, size_t len);
+
+/**
+ * @brief Find a percentile in a latency histogram.
+ *
+ * @param hist The histogram, STATS_NUM_BUCKETS buckets.
+ * @param q The percentile as a fraction, like 0.99.
+ * @return Return the upper bound in nanoseconds of the bucket holding the percentile, 0 if the histogram is empty.
+ */
+uint64_t stats_percentile(const uint64_t *hist, double q);
+
+/**
+ * @brief Measure what timing a command costs, on a throwaway histogram.
+ *
+ * @return Return the nanoseconds the instrumentation adds to one timed command.
+ */
+uint64_t stats_overhead();
+
+/**
+ * @brief Print the latency percentiles summed over all threads.
+ *
+ * @param out Where to print.
+ */
+void stats_dump(FILE *out);
+
+/**
+ * @brief Hand the counter block of an exiting thread over to later threads.
+ */
+void stats_thread_exit();
+
+#endif
@@ -12,9 +12,14 @@
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
 #include <netdb.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include "storage.h"
+#include "shmchan.h"
 #include "utils.h"
 
 
@@ -61,14 +66,692 @@ bool check_valid_value (const char * str)
 
 
 /**
- * @brief Implemented a connection establishing function according to team design needs.
+ * @brief A change of a watched key, received and not handed out yet.
  */
-void* storage_connect(const char *hostname, const int port)
+typedef struct {
+	char table[MAX_TABLE_LEN];
+	char key[MAX_KEY_LEN];
+} watch_note;
+
+/**
+ * @brief A point of a server on the hash ring of a sharded connection.
+ */
+typedef struct {
+	uint64_t hash;
+	int shard;
+} shard_point;
+
+/**
+ * @brief The servers of a sharded connection, and the hash ring that maps keys to them.
+ */
+typedef struct {
+	// One connection per server, in the order given
+	struct connection *conns[MAX_SHARDS];
+	int num;
+	// SHARD_POINTS points per server, sorted by hash
+	shard_point *ring;
+	int numPoints;
+} shard_set;
+
+/**
+ * @brief A connection to the server, handed to the caller as a void pointer.
+ */
+typedef struct connection {
+	// The socket, kept open under a shared memory channel to notice the server going away, -1 for a sharded connection
+	int sock;
+	// The shared memory channel commands go through, NULL to use the socket
+	shm_channel *shm;
+	// "host:port" or the socket path, telling apart the sessions of different servers
+	char server[MAX_PATH_LEN];
+	// Token of the session authenticated on this connection, empty if none
+	char token[SESSION_TOKEN_LEN + 1];
+	// When the token expires, on the monotonic clock
+	time_t expires;
+	// Set when a send or receive failed, so a pool replaces the connection
+	int broken;
+	// When a pool last got the connection back, on the monotonic clock
+	time_t idleSince;
+	// Set between a successful storage_begin() and the end of the transaction, which the read cache stays out of
+	int inTxn;
+	// Changes of watched keys received while waiting for replies, oldest at firstNote
+	watch_note notes[WATCH_PENDING];
+	int firstNote;
+	int numNotes;
+	// Set once a WATCH succeeded, after which the server may push changes at any time
+	int watched;
+	// The servers the keys are spread over, NULL for a connection to a single server
+	shard_set *shards;
+} connection;
+
+/**
+ * @brief A session remembered so another connection to the same server can resume it.
+ */
+typedef struct {
+	char server[MAX_PATH_LEN];
+	char username[MAX_USERNAME_LEN];
+	char passwd[MAX_ENC_PASSWORD_LEN];
+	char token[SESSION_TOKEN_LEN + 1];
+	// When the token expires, 0 for a free entry
+	time_t expires;
+} cached_session;
+
+static cached_session sessionCache[SESSION_CACHE_SIZE];
+// Guards sessionCache
+static pthread_mutex_t sessionCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief A record kept by the read cache, as the server last returned it.
+ */
+typedef struct {
+	char server[MAX_PATH_LEN];
+	char table[MAX_TABLE_LEN];
+	char key[MAX_KEY_LEN];
+	char value[MAX_VALUE_LEN];
+	uintptr_t metadata;
+	// Commit timestamp of the value, which a GETV sends back to revalidate it
+	uint64_t stamp;
+	// When the value was last known to be current, in milliseconds on the monotonic clock, 0 for a free slot
+	uint64_t checked;
+	// When the record was last returned, to pick the slot to reuse
+	uint64_t used;
+} cached_record;
+
+/**
+ * @brief What the read cache holds for a record.
+ */
+enum cache_state {
+	CACHE_OFF,	// Not cached: the cache is off, the connection is in a transaction or the names do not fit
+	CACHE_MISS,	// Cacheable but not cached
+	CACHE_STALE,	// Cached longer ago than the time to live, to revalidate
+	CACHE_FRESH	// Cached within the time to live
+};
+
+// Sets of CACHE_WAYS slots, NULL while the cache is off
+static cached_record *readCache;
+// Number of sets in readCache, a power of two
+static size_t cacheSets;
+static uint64_t cacheTtlMs;
+// Guards readCache and its settings
+static pthread_mutex_t readCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void conn_note(connection *conn, const char *line);
+static void conn_close(connection *c);
+
+
+/**
+ * @brief Function to send a command through the transport of a connection.
+ * @param conn The connection.
+ * @param buf The command.
+ * @param len Length of the command.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+static int conn_send(connection *conn, const char *buf, size_t len)
 {
-	if (hostname == NULL || (hostname && hostname[0] == '\0')) { //Errno for invalid parameter
+	int status = (conn->shm != NULL) ? shm_send(conn->shm, buf, len) : sendall(conn->sock, buf, len);
+	if (status != 0)
+		conn->broken = 1;
+	return status;
+}
+
+
+/**
+ * @brief Function to receive a reply line through the transport of a connection.
+ * @param conn The connection.
+ * @param buf Filled with the line.
+ * @param buflen Size of buf.
+ * @return Returns 0 on success, -1 otherwise.
+ */
+static int conn_recvline(connection *conn, char *buf, size_t buflen)
+{
+	for (;;) {
+		int status = (conn->shm != NULL) ? shm_recvline(conn->shm, buf, buflen) : recvline(conn->sock, buf, buflen);
+		if (status != 0) {
+			conn->broken = 1;
+			return status;
+		}
+		// A change of a watched key, pushed between replies
+		if (strncmp(buf, "2,", 2) != 0)
+			return 0;
+		conn_note(conn, buf);
+	}
+}
+
+
+/**
+ * @brief Function to wrap a connected socket into a connection.
+ * @param sock The socket.
+ * @return Returns the connection, or NULL with errno set.
+ */
+static connection* conn_new(int sock, const char *server)
+{
+	connection *conn = malloc(sizeof(connection));
+	if (conn == NULL) {
+		close(sock);
+		errno = ERR_UNKNOWN;
+		return NULL;
+	}
+	conn->sock = sock;
+	conn->shm = NULL;
+	snprintf(conn->server, sizeof conn->server, "%s", server);
+	conn->token[0] = '\0';
+	conn->expires = 0;
+	conn->broken = 0;
+	conn->idleSince = 0;
+	conn->inTxn = 0;
+	conn->watched = 0;
+	conn->firstNote = 0;
+	conn->numNotes = 0;
+	conn->shards = NULL;
+	return conn;
+}
+
+
+/**
+ * @brief Function to hash a name onto the ring of a sharded connection.
+ * @param name A key, or the name of a server.
+ * @param point The point of the server, 0 for a key.
+ * @return Returns the hash.
+ */
+static uint64_t ring_hash(const char *name, uint64_t point)
+{
+	// FNV-1a, then a finalizer so that close names and points land far apart
+	uint64_t h = 14695981039346656037ULL;
+	const char *p;
+	for (p = name; *p != '\0'; p++)
+		h = (h ^ (unsigned char)*p) * 1099511628211ULL;
+	h ^= point * 0x9e3779b97f4a7c15ULL;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+
+/**
+ * @brief Function to order ring points by hash.
+ */
+static int compare_points(const void *a, const void *b)
+{
+	const shard_point *x = a, *y = b;
+	if (x->hash != y->hash)
+		return (x->hash < y->hash) ? -1 : 1;
+	return x->shard - y->shard;
+}
+
+
+/**
+ * @brief Function to count the servers of a connection.
+ * @param c The connection.
+ * @return Returns the number of servers, 1 unless the connection is sharded.
+ */
+static int conn_count(connection *c)
+{
+	return (c->shards == NULL) ? 1 : c->shards->num;
+}
+
+
+/**
+ * @brief Function to get the connection to one server of a connection.
+ * @param c The connection.
+ * @param i The server, below conn_count(c).
+ * @return Returns the connection to the server, c itself unless it is sharded.
+ */
+static connection* conn_shard(connection *c, int i)
+{
+	return (c->shards == NULL) ? c : c->shards->conns[i];
+}
+
+
+/**
+ * @brief Function to get the connection to the server that owns a key.
+ * @param c The connection.
+ * @param key The key.
+ * @return Returns the connection to the server, c itself unless it is sharded.
+ */
+static connection* conn_route(connection *c, const char *key)
+{
+	shard_set *set = c->shards;
+	if (set == NULL)
+		return c;
+	// The first point at or after the hash of the key, going round past the last
+	uint64_t h = ring_hash(key, 0);
+	int lo = 0, hi = set->numPoints;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (set->ring[mid].hash < h)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return set->conns[set->ring[lo % set->numPoints].shard];
+}
+
+
+/**
+ * @brief Function to tell whether a connection, or any of its servers, watches keys or holds changes not taken yet.
+ * @param c The connection.
+ * @return Returns 1 if it does, 0 otherwise.
+ */
+static int conn_watching(connection *c)
+{
+	int i;
+	for (i = 0; i < conn_count(c); i++)
+		if (conn_shard(c, i)->watched || conn_shard(c, i)->numNotes > 0)
+			return 1;
+	return 0;
+}
+
+
+/**
+ * @brief Function to tell whether a send or receive failed on a connection, or on any of its servers.
+ * @param c The connection.
+ * @return Returns 1 if one did, 0 otherwise.
+ */
+static int conn_broken(connection *c)
+{
+	int i;
+	for (i = 0; i < conn_count(c); i++)
+		if (conn_shard(c, i)->broken)
+			return 1;
+	return 0;
+}
+
+
+/**
+ * @brief Function to read the monotonic clock in seconds.
+ * @return Returns the seconds.
+ */
+static time_t monotonic_seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+
+/**
+ * @brief Function to find a remembered session that has not expired.
+ * @param server The server of the connection.
+ * @param username The username.
+ * @param passwd The plain text password.
+ * @param token Filled with the token of the session, if one is found.
+ * @return Returns 1 if one is found, 0 otherwise.
+ */
+static int session_lookup(const char *server, const char *username, const char *passwd, char *token)
+{
+	// Leave a second of margin so the server does not see it expire in flight
+	time_t now = monotonic_seconds() + 1;
+	int found = 0;
+	int i;
+	pthread_mutex_lock(&sessionCacheLock);
+	for (i = 0; i < SESSION_CACHE_SIZE && !found; i++) {
+		cached_session *e = &sessionCache[i];
+		if (e->expires > now && strcmp(e->server, server) == 0 &&
+				strcmp(e->username, username) == 0 && strcmp(e->passwd, passwd) == 0) {
+			strcpy(token, e->token);
+			found = 1;
+		}
+	}
+	pthread_mutex_unlock(&sessionCacheLock);
+	return found;
+}
+
+
+/**
+ * @brief Function to remember a session, replacing the one of the same login or the one closest to expiring.
+ * @param server The server of the connection.
+ * @param username The username.
+ * @param passwd The plain text password.
+ * @param token The token of the session.
+ * @param expires When the token expires.
+ * @return Returns void.
+ */
+static void session_remember(const char *server, const char *username, const char *passwd, const char *token, time_t expires)
+{
+	if (strlen(server) >= MAX_PATH_LEN || strlen(username) >= MAX_USERNAME_LEN || strlen(passwd) >= MAX_ENC_PASSWORD_LEN)
+		return;
+	pthread_mutex_lock(&sessionCacheLock);
+	cached_session *victim = &sessionCache[0];
+	int i;
+	for (i = 0; i < SESSION_CACHE_SIZE; i++) {
+		cached_session *e = &sessionCache[i];
+		if (e->expires != 0 && strcmp(e->server, server) == 0 &&
+				strcmp(e->username, username) == 0 && strcmp(e->passwd, passwd) == 0) {
+			victim = e;
+			break;
+		}
+		if (e->expires < victim->expires)
+			victim = e;
+	}
+	strcpy(victim->server, server);
+	strcpy(victim->username, username);
+	strcpy(victim->passwd, passwd);
+	strcpy(victim->token, token);
+	victim->expires = expires;
+	pthread_mutex_unlock(&sessionCacheLock);
+}
+
+
+/**
+ * @brief Function to forget a session the server refused.
+ * @param token The token of the session.
+ * @return Returns void.
+ */
+static void session_forget(const char *token)
+{
+	int i;
+	pthread_mutex_lock(&sessionCacheLock);
+	for (i = 0; i < SESSION_CACHE_SIZE; i++)
+		if (sessionCache[i].expires != 0 && strcmp(sessionCache[i].token, token) == 0)
+			sessionCache[i].expires = 0;
+	pthread_mutex_unlock(&sessionCacheLock);
+}
+
+
+/**
+ * @brief Function to read the monotonic clock in milliseconds.
+ * @return Returns the milliseconds, never 0.
+ */
+static uint64_t monotonic_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 + 1;
+}
+
+
+/**
+ * @brief Function to find the slot of a record in the read cache. Call with readCacheLock held and the cache on.
+ * @param server The server of the connection.
+ * @param table The table.
+ * @param key The key.
+ * @param create If the record is not cached, return the slot to put it in instead of NULL.
+ * @return Returns the slot, or NULL.
+ */
+static cached_record* cache_slot(const char *server, const char *table, const char *key, int create)
+{
+	// FNV-1a over the three names, each with its NUL
+	uint64_t h = 14695981039346656037ULL;
+	const char *names[3] = { server, table, key };
+	int n;
+	for (n = 0; n < 3; n++) {
+		const char *p = names[n];
+		do
+			h = (h ^ (unsigned char)*p) * 1099511628211ULL;
+		while (*p++ != '\0');
+	}
+	cached_record *set = &readCache[(h & (cacheSets - 1)) * CACHE_WAYS];
+	cached_record *victim = &set[0];
+	int i;
+	for (i = 0; i < CACHE_WAYS; i++) {
+		cached_record *e = &set[i];
+		if (e->checked != 0 && strcmp(e->key, key) == 0 &&
+				strcmp(e->table, table) == 0 && strcmp(e->server, server) == 0)
+			return e;
+		// A free slot, or else the one returned least recently
+		if (victim->checked != 0 && (e->checked == 0 || e->used < victim->used))
+			victim = e;
+	}
+	return create ? victim : NULL;
+}
+
+
+/**
+ * @brief Function to look a record up in the read cache.
+ * @param conn The connection the record is read on.
+ * @param table The table.
+ * @param key The key.
+ * @param copy Filled with the cached record, unless the state is CACHE_OFF or CACHE_MISS.
+ * @param stamp Set to the commit timestamp of the cached record, 0 if there is none.
+ * @return Returns the state of the record in the cache.
+ */
+static enum cache_state cache_lookup(connection *conn, const char *table, const char *key,
+		struct storage_record *copy, uint64_t *stamp)
+{
+	*stamp = 0;
+	if (conn->inTxn || strlen(table) >= MAX_TABLE_LEN || strlen(key) >= MAX_KEY_LEN)
+		return CACHE_OFF;
+	enum cache_state state = CACHE_OFF;
+	pthread_mutex_lock(&readCacheLock);
+	if (readCache != NULL) {
+		cached_record *e = cache_slot(conn->server, table, key, 0);
+		if (e == NULL) {
+			state = CACHE_MISS;
+		} else {
+			uint64_t now = monotonic_ms();
+			memcpy(copy->value, e->value, sizeof copy->value);
+			copy->metadata[0] = e->metadata;
+			*stamp = e->stamp;
+			e->used = now;
+			state = (now - e->checked < cacheTtlMs) ? CACHE_FRESH : CACHE_STALE;
+		}
+	}
+	pthread_mutex_unlock(&readCacheLock);
+	return state;
+}
+
+
+/**
+ * @brief Function to put a record the server returned or confirmed into the read cache.
+ * @param conn The connection the record was read on.
+ * @param table The table.
+ * @param key The key.
+ * @param value The value.
+ * @param metadata The metadata.
+ * @param stamp The commit timestamp of the value.
+ * @return Returns void.
+ */
+static void cache_store(connection *conn, const char *table, const char *key, const char *value,
+		uintptr_t metadata, uint64_t stamp)
+{
+	pthread_mutex_lock(&readCacheLock);
+	if (readCache != NULL) {
+		cached_record *e = cache_slot(conn->server, table, key, 1);
+		if (e->checked == 0 || strcmp(e->key, key) != 0 || strcmp(e->table, table) != 0 ||
+				strcmp(e->server, conn->server) != 0) {
+			strcpy(e->server, conn->server);
+			strcpy(e->table, table);
+			strcpy(e->key, key);
+		}
+		if (e->value != value)
+			snprintf(e->value, sizeof e->value, "%s", value);
+		e->metadata = metadata;
+		e->stamp = stamp;
+		e->checked = e->used = monotonic_ms();
+	}
+	pthread_mutex_unlock(&readCacheLock);
+}
+
+
+/**
+ * @brief Function to remove a record from the read cache.
+ * @param conn The connection the record was read or written on.
+ * @param table The table.
+ * @param key The key.
+ * @return Returns void.
+ */
+static void cache_drop(connection *conn, const char *table, const char *key)
+{
+	if (strlen(table) >= MAX_TABLE_LEN || strlen(key) >= MAX_KEY_LEN)
+		return;
+	pthread_mutex_lock(&readCacheLock);
+	if (readCache != NULL) {
+		cached_record *e = cache_slot(conn->server, table, key, 0);
+		if (e != NULL)
+			e->checked = 0;
+	}
+	pthread_mutex_unlock(&readCacheLock);
+}
+
+
+/**
+ * @brief Function to remove every record of a server from the read cache.
+ * @param conn A connection to the server.
+ * @return Returns void.
+ */
+static void cache_forget(connection *conn)
+{
+	pthread_mutex_lock(&readCacheLock);
+	size_t i;
+	for (i = 0; readCache != NULL && i < cacheSets * CACHE_WAYS; i++)
+		if (readCache[i].checked != 0 && strcmp(readCache[i].server, conn->server) == 0)
+			readCache[i].checked = 0;
+	pthread_mutex_unlock(&readCacheLock);
+}
+
+
+/**
+ * @brief Function to take in a change of a watched key: drop it from the read cache and keep it for storage_notification().
+ * @param conn The connection it came on.
+ * @param line The line "2,<table>,<key>", or "2,*,*" if changes were lost.
+ * @return Returns void.
+ */
+static void conn_note(connection *conn, const char *line)
+{
+	watch_note note;
+	if (sscanf(line, "2,%19[^,],%19s", note.table, note.key) != 2)
+		return;
+	int lost = (strcmp(note.table, "*") == 0);
+	if (lost)
+		cache_forget(conn);
+	else
+		cache_drop(conn, note.table, note.key);
+	if (lost || conn->numNotes == WATCH_PENDING) {
+		// What is kept says nothing more than that any key may have changed
+		strcpy(note.table, "*");
+		strcpy(note.key, "*");
+		conn->firstNote = 0;
+		conn->numNotes = 0;
+	}
+	conn->notes[(conn->firstNote + conn->numNotes) % WATCH_PENDING] = note;
+	conn->numNotes++;
+}
+
+
+/**
+ * @brief Function to update the read cache from the reply to a GETV.
+ * @param conn The connection the GETV was sent on.
+ * @param table The table.
+ * @param key The key.
+ * @param reply The reply line.
+ * @param cached The cached record the GETV revalidated, or NULL if it asked for timestamp 0.
+ * @param record If not NULL, filled with the record on success.
+ * @return Returns 0 on success, and -1 with errno set otherwise.
+ */
+static int cache_reply(connection *conn, const char *table, const char *key, const char *reply,
+		const struct storage_record *cached, struct storage_record *record)
+{
+	int status, err, metadata, skip = 0;
+	unsigned long long stamp;
+	if (sscanf(reply, "%d,%d,%d,%llu%n", &status, &err, &metadata, &stamp, &skip) < 2) {
+		errno = ERR_UNKNOWN;
+		return -1;
+	}
+	if (err != 0) {
+		if (err == ERR_KEY_NOT_FOUND || err == ERR_TABLE_NOT_FOUND)
+			cache_drop(conn, table, key);
+		errno = err;
+		return -1;
+	}
+	const char *value;
+	if (skip != 0 && reply[skip] == ',')
+		value = reply + skip + 1;
+	else if (skip != 0 && reply[skip] == '\0' && cached != NULL)
+		// Not modified since it was cached
+		value = cached->value;
+	else {
+		errno = ERR_UNKNOWN;
+		return -1;
+	}
+	cache_store(conn, table, key, value, metadata, stamp);
+	if (record != NULL) {
+		record->metadata[0] = metadata;
+		snprintf(record->value, sizeof record->value, "%s", value);
+	}
+	return 0;
+}
+
+
+/**
+ * @brief Function to connect to the Unix socket of a server on the same host.
+ * @param path The path of the socket.
+ * @return Returns the socket, or -1 with errno set.
+ */
+static int connect_unix(const char *path)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof addr.sun_path) {
 		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0) {
+		errno = ERR_CONNECTION_FAIL;
+		return -1;
+	}
+	if (connect(sock, (struct sockaddr*)&addr, sizeof addr) != 0) {
+		close(sock);
+		errno = ERR_CONNECTION_FAIL;
+		return -1;
+	}
+	return sock;
+}
+
+
+/**
+ * @brief Function to connect through a shared memory channel, set up over the Unix socket of the server.
+ * @param path The path of the socket.
+ * @return Returns the connection, or NULL with errno set.
+ */
+static connection* connect_shm(const char *path)
+{
+	int sock = connect_unix(path);
+	if (sock < 0)
+		return NULL;
+	connection *conn = conn_new(sock, path);
+	if (conn == NULL)
 		return NULL;
+	conn->shm = malloc(sizeof(shm_channel));
+	char buf[MAX_CMD_LEN];
+	buf[0] = '\0';
+	if (conn->shm != NULL && sendall(sock, "SHM\n", 4) == 0 &&
+			shm_attach(conn->shm, sock, buf, sizeof buf) == 0)
+		return conn;
+
+	// The reply tells why the server refused
+	int status, err;
+	errno = (sscanf(buf, "%d,%d", &status, &err) == 2 && err != 0) ? err : ERR_CONNECTION_FAIL;
+	free(conn->shm);
+	free(conn);
+	close(sock);
+	return NULL;
+}
+
+
+/**
+ * @brief Function to connect to a single server.
+ * @param hostname The server, as for storage_connect().
+ * @param port The TCP port of the server.
+ * @return Returns the connection, or NULL with errno set.
+ */
+static connection* connect_one(const char *hostname, const int port)
+{
+	// "shm:<path>" asks for shared memory through the Unix socket at path
+	if (strncmp(hostname, SHM_PREFIX, strlen(SHM_PREFIX)) == 0)
+		return connect_shm(hostname + strlen(SHM_PREFIX));
+	// A path names the Unix socket of a server on this host
+	if (strchr(hostname, '/') != NULL) {
+		int sock = connect_unix(hostname);
+		return (sock < 0) ? NULL : conn_new(sock, hostname);
 	}
+
 	// Create a socket.
 	int sock = socket(PF_INET, SOCK_STREAM, 0);
 	if (sock < 0)
@@ -83,18 +766,114 @@ void* storage_connect(const char *hostname, const int port)
 	snprintf(portstr, sizeof portstr, "%d", port);
 	int status = getaddrinfo(hostname, portstr, &serveraddr, &res);
 	if (status != 0){
+		close(sock);
 		errno = ERR_CONNECTION_FAIL;
 		return NULL;
 	}
 
 	// Connect to the server.
 	status = connect(sock, res->ai_addr, res->ai_addrlen);
+	freeaddrinfo(res);
 	if (status != 0){
+		close(sock);
 		errno = ERR_CONNECTION_FAIL;
 		return NULL;
 	}
 
-	return (void*) sock;
+	char server[MAX_PATH_LEN];
+	snprintf(server, sizeof server, "%s:%d", hostname, port);
+	return conn_new(sock, server);
+}
+
+
+/**
+ * @brief Function to connect to every server of a list, and build the hash ring that spreads the keys over them.
+ * @param list The servers, separated by commas.
+ * @param port The TCP port of the servers given without one.
+ * @return Returns the sharded connection, or NULL with errno set.
+ */
+static connection* connect_shards(const char *list, const int port)
+{
+	char names[MAX_CMD_LEN];
+	shard_set *set = calloc(1, sizeof(shard_set));
+	connection *conn = (set == NULL) ? NULL : conn_new(-1, list);
+	if (conn == NULL) {
+		free(set);
+		errno = ERR_UNKNOWN;
+		return NULL;
+	}
+	conn->shards = set;
+	if (strlen(list) >= sizeof names) {
+		errno = ERR_INVALID_PARAM;
+		goto fail;
+	}
+	strcpy(names, list);
+
+	char *rest = names;
+	char *name;
+	while ((name = strsep(&rest, ",")) != NULL) {
+		if (name[0] == '\0' || set->num == MAX_SHARDS) {
+			errno = ERR_INVALID_PARAM;
+			goto fail;
+		}
+		// "host:port", unless it is a socket path
+		int p = port;
+		char *colon = strrchr(name, ':');
+		if (colon != NULL && strchr(name, '/') == NULL && colon[1] != '\0' &&
+				strspn(colon + 1, "0123456789") == strlen(colon + 1)) {
+			*colon = '\0';
+			p = atoi(colon + 1);
+		}
+		connection *c = connect_one(name, p);
+		if (c == NULL)
+			goto fail;
+		set->conns[set->num++] = c;
+		int i;
+		for (i = 0; i < set->num - 1; i++)
+			if (strcmp(set->conns[i]->server, c->server) == 0) {
+				// Twice the same server
+				errno = ERR_INVALID_PARAM;
+				goto fail;
+			}
+	}
+
+	set->numPoints = set->num * SHARD_POINTS;
+	set->ring = malloc(set->numPoints * sizeof(shard_point));
+	if (set->ring == NULL) {
+		errno = ERR_UNKNOWN;
+		goto fail;
+	}
+	int i, j;
+	for (i = 0; i < set->num; i++)
+		for (j = 0; j < SHARD_POINTS; j++) {
+			shard_point *pt = &set->ring[i * SHARD_POINTS + j];
+			pt->hash = ring_hash(set->conns[i]->server, j + 1);
+			pt->shard = i;
+		}
+	qsort(set->ring, set->numPoints, sizeof(shard_point), compare_points);
+	return conn;
+
+fail:;
+	int err = errno;
+	conn_close(conn);
+	errno = err;
+	return NULL;
+}
+
+
+/**
+ * @brief Implemented a connection establishing function according to team design needs.
+ */
+void* storage_connect(const char *hostname, const int port)
+{
+	if (hostname == NULL || (hostname && hostname[0] == '\0')) { //Errno for invalid parameter
+		errno = ERR_INVALID_PARAM;
+		return NULL;
+	}
+	// A list of servers spreads the keys over them
+	if (strchr(hostname, ',') != NULL)
+		return connect_shards(hostname, port);
+	return connect_one(hostname, port);
 }
 
 
@@ -106,9 +885,25 @@ int storage_auth(const char *username, const char *passwd, void *conn)
 	if(conn == NULL || username == NULL || passwd == NULL || (username && username[0] == '\0') || (passwd && passwd[0] == '\0')) { //Error for invalid parameter
 		errno = ERR_INVALID_PARAM;
 
+	} else if (((connection*)conn)->shards != NULL) {
+		// Every server authenticates the client on its own
+		shard_set *set = ((connection*)conn)->shards;
+		int i;
+		for (i = 0; i < set->num; i++)
+			if (storage_auth(username, passwd, set->conns[i]) != 0)
+				return -1;
+		return 0;
 	} else {
-		// Connection is really just a socket file descriptor.
-		int sock = (int)conn;
+		connection *c = conn;
+		// A remembered session skips encrypting the password
+		char token[SESSION_TOKEN_LEN + 1];
+		if (session_lookup(c->server, username, passwd, token)) {
+			if (storage_resume(token, conn) == 0)
+				return 0;
+			if (errno != ERR_AUTHENTICATION_FAILED)
+				return -1;
+			session_forget(token);
+		}
 
 		int status, err;
 
@@ -117,18 +912,74 @@ int storage_auth(const char *username, const char *passwd, void *conn)
 		memset(buf, 0, sizeof buf);
 		char *encrypted_passwd = generate_encrypted_password(passwd, NULL);
 		snprintf(buf, sizeof buf, "AUTH,%s,%s\n", username, encrypted_passwd);
-		if (sendall(sock, buf, strlen(buf)) == 0 && recvline(sock, buf, sizeof buf) == 0) {
-			sscanf( buf, "%d,%d", &status, &err);
+		if (conn_send(conn, buf, strlen(buf)) == 0 && conn_recvline(conn, buf, sizeof buf) == 0) {
+			int ttl;
+			int fields = sscanf( buf, "%d,%d,%32[0-9a-f],%d", &status, &err, token, &ttl);
 			//printf("%s\n", buf);
 			errno = err;
 			if(errno != 0)
 				return -1;
+			// "1,0,<token>,<ttl>" if the server issues session tokens
+			if (fields == 4 && strlen(token) == SESSION_TOKEN_LEN && ttl > 0) {
+				strcpy(c->token, token);
+				c->expires = monotonic_seconds() + ttl;
+				session_remember(c->server, username, passwd, token, c->expires);
+			}
 			return 0;
 		}
 	}
 	return -1;
 }
 
+
+
+/**
+ * @brief Implemented a session token function according to team design needs.
+ */
+int storage_session(char *token, const int len, void *conn)
+{
+	if (conn == NULL || token == NULL || len <= SESSION_TOKEN_LEN || ((connection*)conn)->token[0] == '\0') { //Errno for invalid parameter, a sharded connection having no token of its own
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	connection *c = conn;
+	time_t left = c->expires - monotonic_seconds();
+	if (left <= 0) {
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	strcpy(token, c->token);
+	return (int)left;
+}
+
+
+
+/**
+ * @brief Implemented a session resuming function according to team design needs.
+ */
+int storage_resume(const char *token, void *conn)
+{
+	if (conn == NULL || token == NULL || strlen(token) != SESSION_TOKEN_LEN || ((connection*)conn)->shards != NULL) { //Errno for invalid parameter
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	int status, err;
+	char buf[MAX_CMD_LEN];
+	snprintf(buf, sizeof buf, "RESUME,%s\n", token);
+	if (conn_send(conn, buf, strlen(buf)) == 0 && conn_recvline(conn, buf, sizeof buf) == 0) {
+		if (sscanf(buf, "%d,%d", &status, &err) != 2) {
+			errno = ERR_UNKNOWN;
+			return -1;
+		}
+		errno = err;
+		if (errno != 0)
+			return -1;
+		return 0;
+	}
+	errno = ERR_CONNECTION_FAIL;
+	return -1;
+}
+
 /**
  * @brief Implemented a get key function according to team design needs.
  */
@@ -138,18 +989,37 @@ int storage_get(const char *table, const char *key, struct storage_record *recor
 		errno = ERR_INVALID_PARAM;
 
 	} else {
-		// Connection is really just a socket file descriptor.
-		int sock = (int)conn;
 		int metadata;
 		int status, err;
-		char value[50];
+		char value[MAX_VALUE_LEN] = {0};
+		// Asked of the server that owns the key
+		conn = conn_route(conn, key);
 
 		// Send some data.
 		char buf[MAX_CMD_LEN];
 		memset(buf, 0, sizeof buf);
+
+		struct storage_record cached;
+		uint64_t stamp;
+		enum cache_state state = cache_lookup(conn, table, key, &cached, &stamp);
+		if (state == CACHE_FRESH) {
+			record->metadata[0] = cached.metadata[0];
+			memcpy(record->value, cached.value, sizeof record->value);
+			errno = 0;
+			return 0;
+		}
+		if (state != CACHE_OFF) {
+			// Only the timestamp comes back if the cached copy is still current
+			snprintf(buf, sizeof buf, "GETV,%s,%s,%llu\n", table, key, (unsigned long long)stamp);
+			if (conn_send(conn, buf, strlen(buf)) == 0 && conn_recvline(conn, buf, sizeof buf) == 0)
+				return cache_reply(conn, table, key, buf, (state == CACHE_STALE) ? &cached : NULL, record);
+			errno = ERR_CONNECTION_FAIL;
+			return -1;
+		}
+
 		snprintf(buf, sizeof buf, "GET,%s,%s\n", table, key);
-		if (sendall(sock, buf, strlen(buf)) == 0 && recvline(sock, buf, sizeof buf) == 0) {
-			sscanf( buf, "%d%*[ ,]%d%*[ ,]%d%*[ ,]%[^\n]", &status, &err, &metadata, value );
+		if (conn_send(conn, buf, strlen(buf)) == 0 && conn_recvline(conn, buf, sizeof buf) == 0) {
+			sscanf( buf, "%d%*[ ,]%d%*[ ,]%d%*[ ,]%799[^\n]", &status, &err, &metadata, value );
 			//printf("%s\n", value);
 			errno = err;
 			record->metadata[0] = metadata;
@@ -176,23 +1046,38 @@ int storage_query(const char *table, const char *predicates, char **keys, const
 		errno = ERR_INVALID_PARAM;
 
 	} else {
-		// Connection is really just a socket file descriptor.
-		int sock = (int)conn;
 
-		int status, err;
-		int number_of_keys;
+		connection *c = conn;
+		int status, err = 0;
+		int number_of_keys = 0;
+		int i = 0;
 		//char *keys[max_keys];
 
-		// Send some data.
-		char buf[MAX_CMD_LEN];
-		memset(buf, 0, sizeof buf);
-		snprintf(buf, sizeof buf, "QUERY,%s,%d,%s\n", table, max_keys, predicates);
+		// Send some data. The reply carries up to max_keys keys, so size the buffer for them.
+		size_t buflen = MAX_CMD_LEN + (size_t)max_keys * MAX_KEY_LEN;
+		char *buf = calloc(1, buflen);
+		if (buf == NULL) {
+			errno = ERR_UNKNOWN;
+			return -1;
+		}
+		snprintf(buf, buflen, "QUERY,%s,%d,%s\n", table, max_keys, predicates);
 
-		if (sendall(sock, buf, strlen(buf)) == 0 && recvline(sock, buf, sizeof buf) == 0) {
+		// Every server gets the query before any reply is read, so they all run it at once
+		int sent = 0;
+		while (sent < conn_count(c) && conn_send(conn_shard(c, sent), buf, strlen(buf)) == 0)
+			sent++;
+		int failed = (sent < conn_count(c));
 
+		int shard;
+		for (shard = 0; shard < sent; shard++) {
+			// Read even after a failure, to keep every connection in step
+			if (conn_recvline(conn_shard(c, shard), buf, buflen) != 0) {
+				failed = 1;
+				continue;
+			}
 
-			int i = 0;
     			int param_num = 0;
+			int shard_err = 0;
     			char * pch;
   			pch = strtok (buf,",");
 
@@ -205,16 +1090,17 @@ int storage_query(const char *table, const char *predicates, char **keys, const
 
     				else if (param_num==1)
 				{
-        				err = atoi(pch);
+        				shard_err = atoi(pch);
 				}
 
 				else if (param_num==2)
 				{
-        				number_of_keys = atoi(pch);
+					// The matches of every server add up
+        				number_of_keys += atoi(pch);
 				}
 
 
-    				else if(param_num>2)
+    				else if(param_num>2 && i < max_keys)
 				{
     					strcpy(keys[i], pch);
     					i++;
@@ -224,16 +1110,19 @@ int storage_query(const char *table, const char *predicates, char **keys, const
     				param_num++;
 
 			}
+			if (err == 0)
+				err = shard_err;
+		}
 
-			errno = err;
+		free(buf);
+		errno = failed ? ERR_CONNECTION_FAIL : err;
 
-			if(errno != 0)
-				return -1;
-			//if(errno == 0)
-				//snprintf(record->value, sizeof record->value, "%s", value);	//No error so do whatever with the keys array.
+		if(errno != 0)
+			return -1;
+		//if(errno == 0)
+			//snprintf(record->value, sizeof record->value, "%s", value);	//No error so do whatever with the keys array.
 
-			return number_of_keys;
-		}
+		return number_of_keys;
 	}
 	return -1;
 }
@@ -251,10 +1140,11 @@ int storage_set(const char *table, const char *key, struct storage_record *recor
 		errno = ERR_INVALID_PARAM;
 
 	} else {
-		// Connection is really just a socket file descriptor.
-		int sock = (int)conn;
 
 		int status, err;
+		// Written on the server that owns the key
+		connection *c = conn_route(conn, key);
+		conn = c;
 
 		// Send some data.
 		char buf[MAX_CMD_LEN];
@@ -263,19 +1153,182 @@ int storage_set(const char *table, const char *key, struct storage_record *recor
 			snprintf(buf, sizeof buf, "SET,%s,%s,0,NULL NULL\n", table, key);
 		else
 			snprintf(buf, sizeof buf, "SET,%s,%s,%d,%s\n", table, key, record->metadata[0], record->value);
-		if (sendall(sock, buf, strlen(buf)) == 0 && recvline(sock, buf, sizeof buf) == 0) {
+
+		// With the read cache on, the record as stored is read back in the same round trip.
+		// The server trims values, so the cached copy comes from it rather than from record.
+		struct storage_record unused;
+		uint64_t stamp;
+		int refresh = 0;
+		if (cache_lookup(c, table, key, &unused, &stamp) != CACHE_OFF) {
+			size_t len = strlen(buf);
+			refresh = snprintf(buf + len, sizeof buf - len, "GETV,%s,%s,0\n", table, key) < (int)(sizeof buf - len);
+			if (!refresh)
+				buf[len] = '\0';
+		}
+		// Written in a transaction, the record may change at commit
+		if (c->inTxn)
+			cache_drop(c, table, key);
+
+		if (conn_send(conn, buf, strlen(buf)) == 0 && conn_recvline(conn, buf, sizeof buf) == 0) {
 			sscanf( buf, "%d,%d", &status, &err);
 			//printf("%s\n", buf);
+			if (refresh) {
+				if (conn_recvline(conn, buf, sizeof buf) == 0)
+					cache_reply(c, table, key, buf, NULL, NULL);
+				else
+					cache_drop(c, table, key);
+			}
 			errno = err;
 			if(errno != 0)
 				return -1;
 			return 0;
 		}
+		cache_drop(c, table, key);
+	}
+	return -1;
+}
+
+
+/**
+ * @brief Sends a transaction command and reads back the status reply.
+ * @param command The command, one of BEGIN, COMMIT or ABORT.
+ * @param conn A connection to the server.
+ * @return Return 0 if successful, and -1 otherwise.
+ */
+static int storage_txn_command(const char *command, void *conn)
+{
+	// A transaction cannot span the servers of a sharded connection
+	if (conn == NULL || ((connection*)conn)->shards != NULL) { //Errno for invalid parameter
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+
+	int status, err;
+	char buf[MAX_CMD_LEN];
+	snprintf(buf, sizeof buf, "%s\n", command);
+	if (conn_send(conn, buf, strlen(buf)) == 0 && conn_recvline(conn, buf, sizeof buf) == 0) {
+		if (sscanf(buf, "%d,%d", &status, &err) != 2) {
+			errno = ERR_UNKNOWN;
+			return -1;
+		}
+		errno = err;
+		if (errno != 0)
+			return -1;
+		return 0;
+	}
+	errno = ERR_CONNECTION_FAIL;
+	return -1;
+}
+
+
+
+/**
+ * @brief Implemented a transaction start function according to team design needs.
+ */
+int storage_begin(void *conn)
+{
+	int status = storage_txn_command("BEGIN", conn);
+	if (status == 0)
+		((connection*)conn)->inTxn = 1;
+	return status;
+}
+
+
+
+/**
+ * @brief Implemented a transaction commit function according to team design needs.
+ */
+int storage_commit(void *conn)
+{
+	int status = storage_txn_command("COMMIT", conn);
+	if (conn != NULL)
+		((connection*)conn)->inTxn = 0;
+	return status;
+}
+
+
+
+/**
+ * @brief Implemented a transaction abort function according to team design needs.
+ */
+int storage_abort(void *conn)
+{
+	int status = storage_txn_command("ABORT", conn);
+	if (conn != NULL)
+		((connection*)conn)->inTxn = 0;
+	return status;
+}
+
+
+
+/**
+ * @brief Implemented a statistics function according to team design needs.
+ */
+int storage_stats(char *stats, const int len, void *conn)
+{
+	if (conn == NULL || stats == NULL || len <= 0) { //Errno for invalid parameter
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	shard_set *set = ((connection*)conn)->shards;
+	if (set != NULL) {
+		// "server <name>," and the statistics of the server, a line each
+		int i, used = 0;
+		stats[0] = '\0';
+		for (i = 0; i < set->num && used < len - 1; i++) {
+			used += snprintf(stats + used, len - used, "%sserver %s,", (i > 0) ? "\n" : "", set->conns[i]->server);
+			if (used < len - 1 && storage_stats(stats + used, len - used, set->conns[i]) != 0)
+				return -1;
+			used += strlen(stats + used);
+		}
+		return 0;
+	}
+
+	int status, err, skip = 0;
+	char buf[MAX_CMD_LEN];
+	snprintf(buf, sizeof buf, "STATS\n");
+	if (conn_send(conn, buf, strlen(buf)) == 0 && conn_recvline(conn, buf, sizeof buf) == 0) {
+		if (sscanf(buf, "%d,%d,%n", &status, &err, &skip) < 2) {
+			errno = ERR_UNKNOWN;
+			return -1;
+		}
+		errno = err;
+		if (errno != 0)
+			return -1;
+		snprintf(stats, len, "%s", buf + skip);
+		return 0;
 	}
+	errno = ERR_CONNECTION_FAIL;
 	return -1;
 }
 
 
+
+/**
+ * @brief Function to close a connection and release it.
+ * @param c The connection.
+ * @return Returns void.
+ */
+static void conn_close(connection *c)
+{
+	if (c->shards != NULL) {
+		int i;
+		for (i = 0; i < c->shards->num; i++)
+			conn_close(c->shards->conns[i]);
+		free(c->shards->ring);
+		free(c->shards);
+	}
+	if (c->shm != NULL) {
+		shm_close(c->shm);
+		free(c->shm);
+	}
+	if (c->sock >= 0)
+		close(c->sock);
+	free(c);
+}
+
+
+
 /**
  * @brief Implemented a disconnection function according to team design needs.
  */
@@ -285,15 +1338,405 @@ int storage_disconnect(void *conn)
 		errno = ERR_INVALID_PARAM;
 		return -1;
 	}
-	// Cleanup
-	int sock = (int)conn;
-	
+	connection *c = conn;
 	char buf[MAX_CMD_LEN] = "DISCONN";
+	int i;
+	for (i = 0; i < conn_count(c); i++)
+		if (!conn_shard(c, i)->broken)
+			conn_send(conn_shard(c, i), buf, strlen(buf));
+	conn_close(c);
 
-	if(sendall(sock, buf, strlen(buf)) == 0){
-		close(sock);
+	return 0;
+}
+
+
+
+/**
+ * @brief Function checks if a string is a key, or a key prefix followed by a '*'.
+ * @param key A string type input.
+ * @return Returns true if it is, false otherwise.
+ */
+static bool check_watch_key(const char *key)
+{
+	size_t len = strlen(key);
+	if (len > 0 && key[len - 1] == '*')
+		len--;
+	else if (len == 0)
+		return false;
+	size_t i;
+	for (i = 0; i < len; i++)
+		if (!isalnum((unsigned char)key[i]))
+			return false;
+	return len < MAX_KEY_LEN;
+}
+
+
+/**
+ * @brief Sends WATCH or UNWATCH and reads back the status reply.
+ * @param verb WATCH or UNWATCH.
+ * @param table The table.
+ * @param key The key, or a prefix followed by a '*'.
+ * @param conn A connection to the server.
+ * @return Return 0 if successful, and -1 otherwise.
+ */
+static int storage_watch_command(const char *verb, const char *table, const char *key, void *conn)
+{
+	if (conn == NULL || table == NULL || key == NULL || table[0] == '\0' || !check_alphanum(table) || !check_watch_key(key)) { //Errno for invalid parameter
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+
+	connection *c = conn;
+	if (c->shards != NULL) {
+		// A prefix may match keys of every server
+		if (key[strlen(key) - 1] != '*')
+			return storage_watch_command(verb, table, key, conn_route(c, key));
+		int i;
+		for (i = 0; i < c->shards->num; i++)
+			if (storage_watch_command(verb, table, key, c->shards->conns[i]) != 0)
+				return -1;
+		return 0;
+	}
+
+	int status, err;
+	char buf[MAX_CMD_LEN];
+	snprintf(buf, sizeof buf, "%s,%s,%s\n", verb, table, key);
+	if (conn_send(conn, buf, strlen(buf)) == 0 && conn_recvline(conn, buf, sizeof buf) == 0) {
+		if (sscanf(buf, "%d,%d", &status, &err) != 2) {
+			errno = ERR_UNKNOWN;
+			return -1;
+		}
+		errno = err;
+		if (errno != 0)
+			return -1;
+		if (strcmp(verb, "WATCH") == 0)
+			c->watched = 1;
+		return 0;
+	}
+	errno = ERR_CONNECTION_FAIL;
+	return -1;
+}
+
+
+
+/**
+ * @brief Implemented a key watching function according to team design needs.
+ */
+int storage_watch(const char *table, const char *key, void *conn)
+{
+	return storage_watch_command("WATCH", table, key, conn);
+}
+
+
+
+/**
+ * @brief Implemented a key unwatching function according to team design needs.
+ */
+int storage_unwatch(const char *table, const char *key, void *conn)
+{
+	return storage_watch_command("UNWATCH", table, key, conn);
+}
+
+
+
+/**
+ * @brief Implemented a change notification function according to team design needs.
+ */
+int storage_notification(char *table, char *key, const int timeout_ms, void *conn)
+{
+	if (conn == NULL || table == NULL || key == NULL) { //Errno for invalid parameter
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	connection *c = conn;
+	int n = conn_count(c);
+	// The changes kept by any server of the connection first
+	connection *from = NULL;
+	int i;
+	for (i = 0; i < n && from == NULL; i++)
+		if (conn_shard(c, i)->numNotes > 0)
+			from = conn_shard(c, i);
+	if (from == NULL) {
+		struct pollfd p[MAX_SHARDS];
+		for (i = 0; i < n; i++) {
+			if (conn_shard(c, i)->shm != NULL) {
+				errno = ERR_INVALID_PARAM;
+				return -1;
+			}
+			p[i].fd = conn_shard(c, i)->sock;
+			p[i].events = POLLIN;
+			p[i].revents = 0;
+		}
+		int ready = poll(p, n, timeout_ms);
+		if (ready == 0)
+			return 0;
+		if (ready < 0) {
+			errno = ERR_CONNECTION_FAIL;
+			return -1;
+		}
+		for (i = 0; i < n; i++) {
+			if (p[i].revents == 0)
+				continue;
+			connection *s = conn_shard(c, i);
+			char buf[MAX_CMD_LEN];
+			if (recvline(s->sock, buf, sizeof buf) != 0) {
+				s->broken = 1;
+				errno = ERR_CONNECTION_FAIL;
+				return -1;
+			}
+			if (strncmp(buf, "2,", 2) != 0) {
+				// Only a reply nobody waits for could come here
+				errno = ERR_UNKNOWN;
+				return -1;
+			}
+			conn_note(s, buf);
+			if (from == NULL && s->numNotes > 0)
+				from = s;
+		}
+		if (from == NULL) {
+			errno = ERR_UNKNOWN;
+			return -1;
+		}
+	}
+	watch_note *note = &from->notes[from->firstNote];
+	strcpy(table, note->table);
+	strcpy(key, note->key);
+	from->firstNote = (from->firstNote + 1) % WATCH_PENDING;
+	from->numNotes--;
+	return 1;
+}
+
+
+
+/**
+ * @brief Implemented a read cache setup function according to team design needs.
+ */
+int storage_cache_config(const int entries, const int ttl_ms)
+{
+	if (entries < 0 || ttl_ms < 0) { //Errno for invalid parameter
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	cached_record *slots = NULL;
+	size_t sets = 1;
+	if (entries > 0) {
+		while (sets * CACHE_WAYS < (size_t)entries)
+			sets <<= 1;
+		slots = calloc(sets * CACHE_WAYS, sizeof(cached_record));
+		if (slots == NULL) {
+			errno = ERR_UNKNOWN;
+			return -1;
+		}
+	}
+	pthread_mutex_lock(&readCacheLock);
+	cached_record *old = readCache;
+	readCache = slots;
+	cacheSets = sets;
+	cacheTtlMs = ttl_ms;
+	pthread_mutex_unlock(&readCacheLock);
+	free(old);
+	return 0;
+}
+
+
+
+/**
+ * @brief A pool of authenticated connections to one server.
+ */
+typedef struct {
+	char hostname[MAX_PATH_LEN];
+	int port;
+	char username[MAX_USERNAME_LEN];
+	char passwd[MAX_ENC_PASSWORD_LEN];
+	// Connections open at most
+	int size;
+	// Connections open, idle or checked out
+	int numOpen;
+	// Idle connections, the most recently used last
+	connection **idle;
+	int numIdle;
+	// Guards the counts and idle
+	pthread_mutex_t lock;
+	// Signalled when a connection is checked in or closed
+	pthread_cond_t freed;
+} connection_pool;
+
+
+/**
+ * @brief Function to tell whether an idle connection still reaches the server, without blocking.
+ * @param c The connection.
+ * @return Returns 1 if it does, 0 if the server closed it.
+ */
+static int conn_alive(connection *c)
+{
+	if (c->shards != NULL) {
+		int i;
+		for (i = 0; i < c->shards->num; i++)
+			if (!conn_alive(c->shards->conns[i]))
+				return 0;
+		return 1;
+	}
+	char byte;
+	ssize_t n = recv(c->sock, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+	if (n == 0)
+		return 0;
+	// Bytes nobody asked for mean the connection is out of step
+	if (n > 0)
+		return 0;
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+
+/**
+ * @brief Function to open an authenticated connection for a pool.
+ * @param pool The pool.
+ * @return Returns the connection, or NULL with errno set.
+ */
+static connection* pool_open(connection_pool *pool)
+{
+	connection *c = storage_connect(pool->hostname, pool->port);
+	if (c == NULL)
+		return NULL;
+	// A remembered session makes this a RESUME rather than a full AUTH
+	if (storage_auth(pool->username, pool->passwd, c) != 0) {
+		int err = errno;
+		conn_close(c);
+		errno = err;
+		return NULL;
+	}
+	return c;
+}
+
+
+/**
+ * @brief Implemented a connection pool creation function according to team design needs.
+ */
+void* storage_pool_create(const char *hostname, const int port, const char *username, const char *passwd, const int size)
+{
+	if (hostname == NULL || username == NULL || passwd == NULL || hostname[0] == '\0' || size <= 0 ||
+			strlen(hostname) >= MAX_PATH_LEN || strlen(username) >= MAX_USERNAME_LEN ||
+			strlen(passwd) >= MAX_ENC_PASSWORD_LEN) { //Errno for invalid parameter
+		errno = ERR_INVALID_PARAM;
+		return NULL;
 	}
+	connection_pool *pool = calloc(1, sizeof(connection_pool));
+	if (pool != NULL)
+		pool->idle = malloc(size * sizeof(connection*));
+	if (pool == NULL || pool->idle == NULL) {
+		free(pool);
+		errno = ERR_UNKNOWN;
+		return NULL;
+	}
+	strcpy(pool->hostname, hostname);
+	pool->port = port;
+	strcpy(pool->username, username);
+	strcpy(pool->passwd, passwd);
+	pool->size = size;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->freed, NULL);
+
+	// One connection up front checks the address and the login
+	connection *c = pool_open(pool);
+	if (c == NULL) {
+		int err = errno;
+		storage_pool_destroy(pool);
+		errno = err;
+		return NULL;
+	}
+	pool->numOpen = 1;
+	storage_pool_checkin(pool, c);
+	return pool;
+}
 
+
+/**
+ * @brief Implemented a connection checkout function according to team design needs.
+ */
+void* storage_pool_checkout(void *p)
+{
+	if (p == NULL) { //Errno for invalid parameter
+		errno = ERR_INVALID_PARAM;
+		return NULL;
+	}
+	connection_pool *pool = p;
+	pthread_mutex_lock(&pool->lock);
+	while (pool->numIdle == 0 && pool->numOpen == pool->size)
+		pthread_cond_wait(&pool->freed, &pool->lock);
+	connection *c = NULL;
+	if (pool->numIdle > 0)
+		c = pool->idle[--pool->numIdle];
+	else
+		pool->numOpen++;
+	pthread_mutex_unlock(&pool->lock);
+
+	// A connection idle for a while may have been closed by the server
+	if (c != NULL && c->idleSince + POOL_CHECK_SECS <= monotonic_seconds() && !conn_alive(c)) {
+		conn_close(c);
+		c = NULL;
+	}
+	if (c == NULL) {
+		c = pool_open(pool);
+		if (c == NULL) {
+			int err = errno;
+			pthread_mutex_lock(&pool->lock);
+			pool->numOpen--;
+			pthread_cond_signal(&pool->freed);
+			pthread_mutex_unlock(&pool->lock);
+			errno = err;
+		}
+	}
+	return c;
+}
+
+
+/**
+ * @brief Implemented a connection checkin function according to team design needs.
+ */
+int storage_pool_checkin(void *p, void *conn)
+{
+	if (p == NULL || conn == NULL) { //Errno for invalid parameter
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	connection_pool *pool = p;
+	connection *c = conn;
+	// An open transaction would take in the writes of the next caller
+	if (c->inTxn && !conn_broken(c) && storage_abort(c) != 0)
+		c->broken = 1;
+	// Nor may the next caller get the changes this one watches, so such a connection is not reused
+	if (conn_broken(c) || conn_watching(c)) {
+		// Replaced by a new connection at a later checkout
+		conn_close(c);
+		pthread_mutex_lock(&pool->lock);
+		pool->numOpen--;
+	} else {
+		c->idleSince = monotonic_seconds();
+		pthread_mutex_lock(&pool->lock);
+		pool->idle[pool->numIdle++] = c;
+	}
+	pthread_cond_signal(&pool->freed);
+	pthread_mutex_unlock(&pool->lock);
+	return 0;
+}
+
+
+/**
+ * @brief Implemented a connection pool destruction function according to team design needs.
+ */
+int storage_pool_destroy(void *p)
+{
+	if (p == NULL) { //Errno for invalid parameter
+		errno = ERR_INVALID_PARAM;
+		return -1;
+	}
+	connection_pool *pool = p;
+	int i;
+	for (i = 0; i < pool->numIdle; i++)
+		storage_disconnect(pool->idle[i]);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->freed);
+	free(pool->idle);
+	free(pool);
 	return 0;
 }
 
@@ -21,6 +21,13 @@
 #define MAX_HOST_LEN 64		///< Max characters of server hostname.
 #define MAX_PORT_LEN 8		///< Max characters of server port.
 #define MAX_PATH_LEN 256	///< Max characters of data directory path.
+#define SESSION_TOKEN_LEN 32	///< Characters of a session token issued on AUTH.
+#define SESSION_CACHE_SIZE 16	///< Sessions the client library remembers per process.
+#define POOL_CHECK_SECS 1	///< A pooled connection idle this long is checked before it is handed out.
+#define CACHE_WAYS 4		///< Slots of the client read cache a record may be kept in.
+#define WATCH_PENDING 64	///< Changes of watched keys a client connection holds until they are asked for.
+#define MAX_SHARDS 32		///< Servers a sharded connection spreads the keys over.
+#define SHARD_POINTS 160	///< Points of each server on the hash ring of a sharded connection.
 
 // Storage server constants.
 #define MAX_TABLES 100		///< Max tables supported by the server.
@@ -44,6 +51,7 @@
 #define ERR_KEY_NOT_FOUND 6		///< The key does not exist.
 #define ERR_UNKNOWN 7			///< Any other error.
 #define ERR_TRANSACTION_ABORT 8		///< Transaction abort error.
+#define ERR_READ_ONLY 9			///< The server is a replica, which refuses writes.
 
 
 /**
@@ -62,13 +70,28 @@ struct storage_record {
 /**
  * @brief Establish a connection to the server.
  *
- * @param hostname The IP address or hostname of the server.
- * @param port The TCP port of the server.
+ * @param hostname The IP address or hostname of the server, or the path of
+ * its Unix socket (any name containing a '/') when it runs on the same host.
+ * A comma separated list of servers, each "host:port", "host" or a path,
+ * shards the keys over them.
+ * @param port The TCP port of the server. Ignored for a socket path, and for
+ * a server of a list given with its port.
  * @return If successful, return a pointer to a data structure that represents 
  * a connection to the server. Otherwise return NULL.
  *
  * On error, errno will be set to one of the following, as appropriate: 
  * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, or ERR_UNKNOWN.
+ *
+ * A sharded connection holds a connection to each of up to MAX_SHARDS
+ * servers.  storage_get(), storage_set() and storage_watch() of a key go to
+ * the server that owns the key on a consistent hash ring, where each
+ * server has SHARD_POINTS points hashed from its name, whatever the order of
+ * the list.  Adding a server to the list thus moves about one key in N+1 to
+ * it, and no other key.  storage_query() and the watches of a prefix go to
+ * every server: the keys found are merged, and the matches counted on all
+ * of them.  storage_auth() authenticates with every server.  Transactions
+ * and storage_session() / storage_resume() are for single server
+ * connections only; storage_stats() returns one line per server.
  */
 void* storage_connect(const char *hostname, const int port);
 
@@ -81,9 +104,40 @@ void* storage_connect(const char *hostname, const int port);
  * @return Return 0 if successful, and -1 otherwise.
  *
  * On error, errno will be set to ERR_AUTHENTICATION_FAILED.
+ *
+ * The session token the server issues is remembered until it expires.  A
+ * later call with the same server, username and password presents it
+ * instead of encrypting the password again, and falls back to a full
+ * authentication if the server no longer accepts it.
  */
 int storage_auth(const char *username, const char *passwd, void *conn);
 
+/**
+ * @brief Get the session token of an authenticated connection, to resume the session elsewhere.
+ *
+ * @param token A buffer where the token is copied, SESSION_TOKEN_LEN characters and a NUL.
+ * @param len The size of the token buffer.
+ * @param conn A connection authenticated by storage_auth().
+ * @return Return the seconds the token has left if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to ERR_INVALID_PARAM, for instance if the
+ * server issued no token.
+ */
+int storage_session(char *token, const int len, void *conn);
+
+/**
+ * @brief Authenticate a connection with a session token, in one round trip.
+ *
+ * @param token A token from storage_session(), possibly obtained by another process.
+ * @param conn A connection to the server that issued the token.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate:
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, or ERR_AUTHENTICATION_FAILED if
+ * the token is unknown or expired.
+ */
+int storage_resume(const char *token, void *conn);
+
 /**
  * @brief Retrieve the value associated with a key in a table.
  *
@@ -116,7 +170,8 @@ int storage_get(const char *table, const char *key, struct storage_record
  *
  * On error, errno will be set to one of the following, as appropriate: 
  * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND, 
- * ERR_KEY_NOT_FOUND, ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ * ERR_KEY_NOT_FOUND, ERR_NOT_AUTHENTICATED, ERR_READ_ONLY if the server
+ * is a replica, or ERR_UNKNOWN.
  *
  * The key and record are stored in the table of the database using the
  * connection. If the key already exists in the table, the corresponding
@@ -152,6 +207,76 @@ int storage_set(const char *table, const char *key, struct storage_record
 int storage_query(const char *table, const char *predicates, char **keys, 
 		const int max_keys, void *conn);
 
+/**
+ * @brief Start a transaction on the connection.
+ *
+ * @param conn A connection to the server.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate: 
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_NOT_AUTHENTICATED, or
+ * ERR_UNKNOWN. ERR_INVALID_PARAM is also returned if a transaction is
+ * already open; transactions do not nest.
+ *
+ * Until storage_commit() or storage_abort() is called, storage_set() only
+ * buffers its write on the server and storage_get() remembers the version
+ * it read. A get of a key written earlier in the transaction returns the
+ * buffered value with metadata 0. storage_query() is not part of the
+ * transaction and reads committed data only.
+ */
+int storage_begin(void *conn);
+
+/**
+ * @brief Commit the transaction open on the connection.
+ *
+ * @param conn A connection to the server.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate: 
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_NOT_AUTHENTICATED, 
+ * ERR_TRANSACTION_ABORT, or ERR_UNKNOWN.
+ *
+ * The commit succeeds only if every key read in the transaction is still at
+ * the version read, and every write still passes the metadata check of
+ * storage_set(). All writes then become visible at once. Otherwise nothing
+ * is written and errno is ERR_TRANSACTION_ABORT. Either way the
+ * transaction is closed.
+ */
+int storage_commit(void *conn);
+
+/**
+ * @brief Discard the transaction open on the connection.
+ *
+ * @param conn A connection to the server.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate: 
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_NOT_AUTHENTICATED, or
+ * ERR_UNKNOWN.
+ */
+int storage_abort(void *conn);
+
+/**
+ * @brief Retrieve the server statistics.
+ *
+ * @param stats A buffer where the statistics are copied.
+ * @param len The size of the stats buffer. Longer statistics are truncated.
+ * @param conn A connection to the server.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate: 
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_NOT_AUTHENTICATED, or
+ * ERR_UNKNOWN.
+ *
+ * The statistics are comma separated "name value" pairs, summed over the
+ * server threads since the server started: cmd_<command> counts for every
+ * command, err_<code> counts for every error code, connections (open
+ * now), records_<table> (keys indexed now) for every table, bytes_in,
+ * bytes_out and lock_wait_ns. An example is
+ * "cmd_auth 1,cmd_get 10,...,bytes_out 420,lock_wait_ns 0".
+ */
+int storage_stats(char *stats, const int len, void *conn);
+
 /**
  * @brief Close the connection to the server.
  *
@@ -164,4 +289,122 @@ int storage_query(const char *table, const char *predicates, char **keys,
  */
 int storage_disconnect(void *conn);
 
+/**
+ * @brief Ask the server to push the changes of a key, or of every key starting with a prefix.
+ *
+ * @param table A table in the database.
+ * @param key A key, or a prefix followed by a '*'. A '*' alone watches the whole table.
+ * @param conn A connection to the server, not a shared memory one.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate:
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, ERR_TABLE_NOT_FOUND,
+ * ERR_NOT_AUTHENTICATED, or ERR_UNKNOWN.
+ *
+ * From then on, every SET or COMMIT that writes a matching key, on any
+ * connection, sends the table and key to this one, to be taken with
+ * storage_notification().  Changes that arrive while another call waits
+ * for its reply are kept, WATCH_PENDING at most, and drop the key from the
+ * read cache.  The server never waits for a slow client: if too many
+ * changes pile up, they are replaced by one change with table and key "*",
+ * meaning any key may have changed.
+ */
+int storage_watch(const char *table, const char *key, void *conn);
+
+/**
+ * @brief Stop the changes asked for with storage_watch(), given the same table and key.
+ *
+ * @return Return 0 if successful, and -1 otherwise, with errno set as for storage_watch().
+ */
+int storage_unwatch(const char *table, const char *key, void *conn);
+
+/**
+ * @brief Take the next change of a watched key, waiting for one if none is kept.
+ *
+ * @param table A buffer of MAX_TABLE_LEN characters where the table is copied.
+ * @param key A buffer of MAX_KEY_LEN characters where the key is copied.
+ * @param timeout_ms Milliseconds to wait at most, -1 to wait as long as it takes.
+ * @param conn A connection on which storage_watch() was called.
+ * @return Return 1 if a change was taken, 0 if none came in time, and -1 otherwise.
+ *
+ * On error, errno will be set to one of the following, as appropriate:
+ * ERR_INVALID_PARAM, ERR_CONNECTION_FAIL, or ERR_UNKNOWN.  Table and key
+ * are both "*" if changes were lost.
+ */
+int storage_notification(char *table, char *key, const int timeout_ms, void *conn);
+
+/**
+ * @brief Turn the read cache of storage_get() on, resize it, or turn it off.
+ *
+ * @param entries Records cached at most, rounded up to a power of two
+ * times CACHE_WAYS. 0 turns the cache off.
+ * @param ttl_ms Milliseconds a cached record is returned without asking the
+ * server.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * The cache is shared by the connections of the process and starts off.
+ * Changing it drops every cached record.  A cached record is tagged with
+ * its metadata and the commit timestamp the server gave with it.  Once its
+ * time to live is over, storage_get() revalidates it with a GETV, to which
+ * the server answers with the timestamp alone while the record is
+ * unchanged.  storage_set() reads the record as stored back in the same
+ * round trip, so a connection sees its own writes at once; writes by other
+ * clients are seen within ttl_ms.  Connections in a transaction bypass the
+ * cache, and drop what they write from it.  On error, errno will be set
+ * to ERR_INVALID_PARAM or ERR_UNKNOWN.
+ */
+int storage_cache_config(const int entries, const int ttl_ms);
+
+/**
+ * @brief Create a pool of authenticated connections that threads share.
+ *
+ * @param hostname The server, as for storage_connect().
+ * @param port The TCP port of the server, as for storage_connect().
+ * @param username Username to access the storage server.
+ * @param passwd Password in its plain text form.
+ * @param size Connections open at most. They are opened as needed.
+ * @return If successful, return a pointer to the pool. Otherwise return NULL.
+ *
+ * One connection is opened and authenticated right away, so a wrong
+ * address or login fails here.  On error, errno will be set to one of the
+ * following, as appropriate: ERR_INVALID_PARAM, ERR_CONNECTION_FAIL,
+ * ERR_AUTHENTICATION_FAILED, or ERR_UNKNOWN.
+ */
+void* storage_pool_create(const char *hostname, const int port, const char *username, const char *passwd, const int size);
+
+/**
+ * @brief Take an authenticated connection out of a pool, waiting while all are in use.
+ *
+ * @param pool A pool returned by storage_pool_create().
+ * @return If successful, return a connection usable with the other storage
+ * functions until it is checked in. Otherwise return NULL.
+ *
+ * A connection that has been idle POOL_CHECK_SECS or more is checked first,
+ * and replaced if the server closed it.  On error, errno will be set as for
+ * storage_pool_create().
+ */
+void* storage_pool_checkout(void *pool);
+
+/**
+ * @brief Give a connection back to its pool.
+ *
+ * @param pool The pool the connection was checked out of.
+ * @param conn The connection.
+ * @return Return 0 if successful, and -1 otherwise.
+ *
+ * A transaction left open on the connection is aborted.  A connection on
+ * which a call failed to reach the server, or that watched keys, is closed,
+ * and a new one is opened at a later checkout.  On error, errno will be set
+ * to ERR_INVALID_PARAM.
+ */
+int storage_pool_checkin(void *pool, void *conn);
+
+/**
+ * @brief Close the connections of a pool and release it. Every connection must be checked in first.
+ *
+ * @param pool A pool returned by storage_pool_create().
+ * @return Return 0 if successful, and -1 otherwise.
+ */
+int storage_pool_destroy(void *pool);
+
 #endif
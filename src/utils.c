@@ -14,6 +14,7 @@
 #include <unistd.h>
 #include "utils.h"
 #include <pthread.h>
+#include <crypt.h>
 
 /* Mutex to guard print statements */ 
 pthread_mutex_t  printMutex    = PTHREAD_MUTEX_INITIALIZER; 
@@ -13,7 +13,8 @@
 #define MAX_LOG_LEN 128
 
 /**
- * @brief The max length in bytes of a command from the client to the server.
+ * @brief The length in bytes of a fixed command buffer, such as those of the client library.
+ * The server reads lines of up to max_cmd_len into a growing cmd_reader instead.
  */
 #define MAX_CMD_LEN (1024 * 8)
 
@@ -0,0 +1,187 @@
+/**
+ * @file
+ * @brief This file implements the key change notifications declared in watch.h.
+ *
+ * The subscriptions of all watchers are kept in one array scanned by
+ * every notification, under a read-write lock that commits share.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "watch.h"
+
+/**
+ * @brief A subscription of a watcher.
+ */
+typedef struct {
+	watcher *w;
+	char table[MAX_TABLE_LEN];
+	char key[MAX_KEY_LEN];
+	size_t keyLen;
+	int prefix;
+} watch_sub;
+
+static watch_sub *subs = NULL;
+static int numSubs = 0;
+// Slots allocated in subs, doubled when full
+static int subCap = 0;
+// Taken for reading by notifications, for writing by subscription changes
+static pthread_rwlock_t subsLock = PTHREAD_RWLOCK_INITIALIZER;
+
+
+int watch_init(watcher *w)
+{
+	w->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (w->efd < 0)
+		return -1;
+	pthread_mutex_init(&w->lock, NULL);
+	w->queued = 0;
+	w->taken = 0;
+	w->lossy = 0;
+	w->numSubs = 0;
+	return 0;
+}
+
+
+int watch_add(watcher *w, const char *table, const char *key, int prefix)
+{
+	if (w->numSubs >= WATCH_MAX_SUBS || strlen(table) >= MAX_TABLE_LEN || strlen(key) >= MAX_KEY_LEN)
+		return -1;
+	pthread_rwlock_wrlock(&subsLock);
+	if (numSubs == subCap) {
+		int cap = (subCap == 0) ? 16 : subCap * 2;
+		watch_sub *grown = realloc(subs, cap * sizeof(watch_sub));
+		if (grown == NULL) {
+			pthread_rwlock_unlock(&subsLock);
+			return -1;
+		}
+		subs = grown;
+		subCap = cap;
+	}
+	watch_sub *s = &subs[numSubs];
+	s->w = w;
+	strcpy(s->table, table);
+	strcpy(s->key, key);
+	s->keyLen = strlen(key);
+	s->prefix = prefix;
+	__atomic_store_n(&numSubs, numSubs + 1, __ATOMIC_RELEASE);
+	w->numSubs++;
+	pthread_rwlock_unlock(&subsLock);
+	return 0;
+}
+
+
+/**
+ * @brief Function to remove the subscription at an index of subs. Call with subsLock held for writing.
+ * @param i The index
+ * @return Returns void
+ */
+static void remove_sub(int i)
+{
+	subs[i].w->numSubs--;
+	subs[i] = subs[numSubs - 1];
+	__atomic_store_n(&numSubs, numSubs - 1, __ATOMIC_RELEASE);
+}
+
+
+int watch_remove(watcher *w, const char *table, const char *key, int prefix)
+{
+	int found = -1;
+	int i;
+	pthread_rwlock_wrlock(&subsLock);
+	for (i = 0; i < numSubs; i++) {
+		watch_sub *s = &subs[i];
+		if (s->w == w && s->prefix == prefix && strcmp(s->table, table) == 0 && strcmp(s->key, key) == 0) {
+			remove_sub(i);
+			found = 0;
+			break;
+		}
+	}
+	pthread_rwlock_unlock(&subsLock);
+	return found;
+}
+
+
+/**
+ * @brief Function to queue a change on a watcher, or mark it lossy if its queue is full.
+ * @param w The watcher
+ * @param table The table written
+ * @param key The key written
+ * @return Returns void
+ */
+static void enqueue(watcher *w, const char *table, const char *key)
+{
+	int wake = 0;
+	pthread_mutex_lock(&w->lock);
+	if (w->queued - w->taken == WATCH_QUEUE_LEN) {
+		// A full queue has already woken the thread of the connection
+		w->lossy = 1;
+	} else if (!w->lossy) {
+		watch_event *e = &w->queue[w->queued % WATCH_QUEUE_LEN];
+		strcpy(e->table, table);
+		strcpy(e->key, key);
+		// The thread of the connection empties the queue once woken, so only the first change wakes it
+		wake = (w->queued == w->taken);
+		w->queued++;
+	}
+	pthread_mutex_unlock(&w->lock);
+	if (wake) {
+		uint64_t one = 1;
+		// Never blocks, the counter is read long before it could overflow
+		ssize_t bytes = write(w->efd, &one, sizeof one);
+		(void)bytes;
+	}
+}
+
+
+void watch_notify(const char *table, const char *key)
+{
+	if (__atomic_load_n(&numSubs, __ATOMIC_ACQUIRE) == 0)
+		return;
+	size_t keyLen = strlen(key);
+	int i;
+	pthread_rwlock_rdlock(&subsLock);
+	for (i = 0; i < numSubs; i++) {
+		watch_sub *s = &subs[i];
+		if (strcmp(s->table, table) != 0)
+			continue;
+		if (s->prefix ? (s->keyLen <= keyLen && memcmp(s->key, key, s->keyLen) == 0) : strcmp(s->key, key) == 0)
+			enqueue(s->w, table, key);
+	}
+	pthread_rwlock_unlock(&subsLock);
+}
+
+
+int watch_take(watcher *w, watch_event *events, int max, int *lost)
+{
+	int n = 0;
+	pthread_mutex_lock(&w->lock);
+	*lost = w->lossy;
+	if (w->lossy) {
+		w->lossy = 0;
+		w->taken = w->queued;
+	} else {
+		while (n < max && w->taken != w->queued) {
+			events[n++] = w->queue[w->taken % WATCH_QUEUE_LEN];
+			w->taken++;
+		}
+	}
+	pthread_mutex_unlock(&w->lock);
+	return n;
+}
+
+
+void watch_free(watcher *w)
+{
+	int i;
+	pthread_rwlock_wrlock(&subsLock);
+	for (i = numSubs - 1; i >= 0; i--)
+		if (subs[i].w == w)
+			remove_sub(i);
+	pthread_rwlock_unlock(&subsLock);
+	close(w->efd);
+	pthread_mutex_destroy(&w->lock);
+}
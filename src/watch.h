@@ -0,0 +1,99 @@
+/**
+ * @file
+ * @brief This file declares the key change notifications pushed to the connections that sent WATCH.
+ *
+ * A subscription names a table and either a key or a key prefix.  When a
+ * commit writes a record, watch_notify() queues the table and key on
+ * every watcher with a matching subscription, and wakes the thread of the
+ * connection through an eventfd if its queue was empty.  That thread sends
+ * the queued notifications between its replies.  A writer only takes the
+ * queue lock of each watcher, never waits for a client: a watcher whose
+ * queue is full becomes lossy, and drops changes until its thread drains
+ * the queue and tells the client that changes were lost.
+ */
+
+#ifndef	WATCH_H
+#define WATCH_H
+
+#include <pthread.h>
+#include "storage.h"
+
+#define WATCH_QUEUE_LEN 256	///< Notifications a watcher queues before it becomes lossy.
+#define WATCH_MAX_SUBS 64	///< Subscriptions of one watcher.
+
+/**
+ * @brief A change waiting to be sent.
+ */
+typedef struct {
+	char table[MAX_TABLE_LEN];
+	char key[MAX_KEY_LEN];
+} watch_event;
+
+/**
+ * @brief The notifications of one connection.
+ */
+typedef struct {
+	// Guards the queue and lossy
+	pthread_mutex_t lock;
+	watch_event queue[WATCH_QUEUE_LEN];
+	// Events ever queued and ever taken; the queued ones are queue[taken % WATCH_QUEUE_LEN] on
+	unsigned queued;
+	unsigned taken;
+	// Set when a change was dropped because the queue was full
+	int lossy;
+	// Readable while changes are queued, polled by the thread of the connection
+	int efd;
+	// Subscriptions registered, changed by the thread of the connection only
+	int numSubs;
+} watcher;
+
+/**
+ * @brief Set up a watcher with no subscription.
+ *
+ * @return Return 0 on success, -1 if no eventfd could be had.
+ */
+int watch_init(watcher *w);
+
+/**
+ * @brief Subscribe a watcher to a key, or to every key starting with a prefix.
+ *
+ * @param w The watcher.
+ * @param table The table.
+ * @param key The key, or the prefix.
+ * @param prefix True to match every key starting with key.
+ * @return Return 0 on success, -1 if the watcher has WATCH_MAX_SUBS subscriptions already.
+ */
+int watch_add(watcher *w, const char *table, const char *key, int prefix);
+
+/**
+ * @brief Remove a subscription made with watch_add().
+ *
+ * @return Return 0 on success, -1 if there is no such subscription.
+ */
+int watch_remove(watcher *w, const char *table, const char *key, int prefix);
+
+/**
+ * @brief Queue a change on every watcher subscribed to it. Never blocks on a client.
+ *
+ * @param table The table written.
+ * @param key The key written.
+ */
+void watch_notify(const char *table, const char *key);
+
+/**
+ * @brief Take the changes queued on a watcher. Call after the eventfd turned readable and was read.
+ *
+ * @param w The watcher.
+ * @param events Filled with the changes, oldest first.
+ * @param max Room in events.
+ * @param lost Set to 1 if changes were dropped since the last call, in which case no event is returned.
+ * @return Return the number of events taken.
+ */
+int watch_take(watcher *w, watch_event *events, int max, int *lost);
+
+/**
+ * @brief Remove every subscription of a watcher and release its eventfd.
+ */
+void watch_free(watcher *w);
+
+#endif
@@ -0,0 +1,252 @@
+/**
+ * @file
+ * @brief This file implements the work-stealing scheduler declared in workq.h.
+ *
+ * A deque is a growable ring under a mutex of its own.  Its owner pushes
+ * and pops at the bottom; thieves, and the tasks dealt out from outside,
+ * use the top.  The owner and another thread only meet on a deque when it
+ * is being stolen from or handed work, so the mutex is rarely contended.
+ * Sleeping workers wait on a futex bumped by every push, and a pusher
+ * only makes the wake system call when some worker said it would sleep.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "workq.h"
+#include "utils.h"
+
+/**
+ * @brief A worker and its deque.
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	// Ring of tasks, the oldest at top and the newest at bottom - 1, counted modulo cap.
+	// Changed under the lock only, but read without it by thieves looking for work.
+	wq_task **ring;
+	size_t cap;
+	size_t top;
+	size_t bottom;
+	// Tasks run and stolen, read by STATS
+	uint64_t run;
+	uint64_t stolen;
+	pthread_t thread;
+	int index;
+} __attribute__((aligned(64))) wq_worker;
+
+static wq_worker *workers = NULL;
+static int numWorkers = 0;
+// Next worker dealt a task from outside the pool
+static unsigned nextWorker = 0;
+// Bumped by every push, the word sleeping workers wait on
+static uint32_t pushes = 0;
+// Workers asleep or about to be
+static int sleepers = 0;
+static __thread wq_worker *me = NULL;
+
+
+/**
+ * @brief Function to move the ends of a deque. Called with the deque locked.
+ * @param w The worker
+ * @param top The new top
+ * @param bottom The new bottom
+ * @return Returns void
+ */
+static void set_ends(wq_worker *w, size_t top, size_t bottom)
+{
+	__atomic_store_n(&w->top, top, __ATOMIC_RELAXED);
+	__atomic_store_n(&w->bottom, bottom, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * @brief Function to tell whether a deque looks empty, without locking it.
+ * @param w The worker
+ * @return Returns true if it was empty when looked at
+ */
+static bool looks_empty(wq_worker *w)
+{
+	return __atomic_load_n(&w->bottom, __ATOMIC_RELAXED) == __atomic_load_n(&w->top, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * @brief Function to add a task to a deque, at either end. Called with the deque locked.
+ * @param w The worker
+ * @param task The task
+ * @param atTop True to add it at the top, the end taken last by the owner and first by thieves
+ * @return Returns the number of tasks in the deque after it
+ */
+static size_t deque_add(wq_worker *w, wq_task *task, bool atTop)
+{
+	if (w->bottom - w->top == w->cap) {
+		size_t newCap = (w->cap == 0) ? WQ_INIT_DEQUE : w->cap * 2;
+		wq_task **grown = malloc(newCap * sizeof(wq_task*));
+		if (grown == NULL)
+			die("Out of memory queueing a task.", EXIT_FAILURE);
+		size_t i;
+		for (i = 0; i < w->bottom - w->top; i++)
+			grown[i] = w->ring[(w->top + i) % w->cap];
+		free(w->ring);
+		w->ring = grown;
+		set_ends(w, 0, w->bottom - w->top);
+		w->cap = newCap;
+	}
+	size_t top = w->top, bottom = w->bottom;
+	if (atTop) {
+		// top never goes below 0: the indexes are shifted up instead
+		if (top == 0) {
+			top += w->cap;
+			bottom += w->cap;
+		}
+		w->ring[--top % w->cap] = task;
+	} else
+		w->ring[bottom++ % w->cap] = task;
+	set_ends(w, top, bottom);
+	return bottom - top;
+}
+
+
+/**
+ * @brief Function to wake a sleeping worker after a push, if one is asleep.
+ * @return Returns void
+ */
+static void wake_one()
+{
+	__atomic_add_fetch(&pushes, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&sleepers, __ATOMIC_SEQ_CST) > 0)
+		syscall(SYS_futex, &pushes, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+
+/**
+ * @brief Function to find a task for a worker: its newest one, or else the oldest one of another worker.
+ * @param w The worker
+ * @return Returns the task, or NULL if every deque is empty
+ */
+static wq_task* take(wq_worker *w)
+{
+	wq_task *task = NULL;
+	if (!looks_empty(w)) {
+		pthread_mutex_lock(&w->lock);
+		if (w->bottom != w->top) {
+			task = w->ring[(w->bottom - 1) % w->cap];
+			set_ends(w, w->top, w->bottom - 1);
+		}
+		pthread_mutex_unlock(&w->lock);
+		if (task != NULL)
+			return task;
+	}
+
+	// Victims in turn from the next worker, so thieves spread out
+	int i;
+	for (i = 1; i < numWorkers && task == NULL; i++) {
+		wq_worker *v = &workers[(w->index + i) % numWorkers];
+		if (looks_empty(v))
+			continue;
+		pthread_mutex_lock(&v->lock);
+		if (v->bottom != v->top) {
+			task = v->ring[v->top % v->cap];
+			set_ends(v, v->top + 1, v->bottom);
+		}
+		pthread_mutex_unlock(&v->lock);
+	}
+	if (task != NULL)
+		__atomic_store_n(&w->stolen, w->stolen + 1, __ATOMIC_RELAXED);
+	return task;
+}
+
+
+/**
+ * @brief Thread function of a worker: run tasks, sleeping while there are none.
+ * @param arg The worker
+ * @return Returns NULL, never
+ */
+static void* worker_main(void *arg)
+{
+	wq_worker *w = arg;
+	me = w;
+	for (;;) {
+		wq_task *task = NULL;
+		int i;
+		for (i = 0; i < WQ_SPIN && task == NULL; i++)
+			task = take(w);
+		if (task == NULL) {
+			// A push after pushes is read bumps it, so the wait returns at once
+			uint32_t seen = __atomic_load_n(&pushes, __ATOMIC_SEQ_CST);
+			__atomic_add_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+			task = take(w);
+			if (task == NULL)
+				syscall(SYS_futex, &pushes, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+			__atomic_sub_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+			if (task == NULL)
+				continue;
+		}
+		task->run(task);
+		__atomic_store_n(&w->run, w->run + 1, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+
+int wq_start(int n, const pthread_attr_t *attr)
+{
+	workers = aligned_alloc(64, (size_t)n * sizeof(wq_worker));
+	if (workers == NULL)
+		return -1;
+	memset(workers, 0, (size_t)n * sizeof(wq_worker));
+	int i;
+	for (i = 0; i < n; i++) {
+		pthread_mutex_init(&workers[i].lock, NULL);
+		workers[i].index = i;
+	}
+	numWorkers = n;
+	for (i = 0; i < n; i++) {
+		if (pthread_create(&workers[i].thread, attr, worker_main, &workers[i]) != 0)
+			return -1;
+		pthread_detach(workers[i].thread);
+	}
+	return 0;
+}
+
+
+int wq_workers()
+{
+	return numWorkers;
+}
+
+
+void wq_submit(wq_task *task)
+{
+	wq_worker *w = &workers[__atomic_fetch_add(&nextWorker, 1, __ATOMIC_RELAXED) % numWorkers];
+	pthread_mutex_lock(&w->lock);
+	// At the top: stolen first by an idle worker, run by the owner after the work it has
+	deque_add(w, task, true);
+	pthread_mutex_unlock(&w->lock);
+	wake_one();
+}
+
+
+void wq_push(wq_task *task, bool yield)
+{
+	wq_worker *w = me;
+	pthread_mutex_lock(&w->lock);
+	size_t queued = deque_add(w, task, yield);
+	pthread_mutex_unlock(&w->lock);
+	// The owner runs its only task itself; a second one is worth waking a thief for
+	if (queued > 1)
+		wake_one();
+}
+
+
+void wq_counts(uint64_t *run, uint64_t *stolen)
+{
+	*run = *stolen = 0;
+	int i;
+	for (i = 0; i < numWorkers; i++) {
+		*run += __atomic_load_n(&workers[i].run, __ATOMIC_RELAXED);
+		*stolen += __atomic_load_n(&workers[i].stolen, __ATOMIC_RELAXED);
+	}
+}
@@ -0,0 +1,68 @@
+/**
+ * @file
+ * @brief This file declares the work-stealing scheduler that runs commands on a fixed pool of workers.
+ *
+ * With "workers N" in the config, connections no longer get a thread each.
+ * Their commands run as tasks on N worker threads, each with a deque of
+ * its own.  A worker takes its newest task first, so a connection with
+ * more commands waiting keeps running where its data is warm; a worker
+ * with nothing left steals the oldest task of another, so one busy worker
+ * never holds up tasks that idle ones could run.  Tasks from outside the
+ * pool are dealt out to the workers in turn.  A worker that finds no
+ * task anywhere spins briefly, then sleeps until a task is queued.
+ */
+
+#ifndef	WORKQ_H
+#define WORKQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define WQ_MAX_WORKERS 256	///< Workers a server may run.
+#define WQ_INIT_DEQUE 64	///< Initial task slots of a deque, doubled when full.
+#define WQ_SPIN 100	///< Rounds over every deque before an idle worker sleeps.
+
+/**
+ * @brief A task, embedded in the structure that carries its arguments.
+ */
+typedef struct wq_task {
+	// Run by a worker
+	void (*run)(struct wq_task *task);
+} wq_task;
+
+/**
+ * @brief Start the workers.
+ *
+ * @param numWorkers Number of workers, from 1 to WQ_MAX_WORKERS.
+ * @param attr Attributes of the worker threads, or NULL.
+ * @return Return 0 on success, -1 if a thread could not be started.
+ */
+int wq_start(int numWorkers, const pthread_attr_t *attr);
+
+/**
+ * @brief Number of workers, 0 until started.
+ */
+int wq_workers();
+
+/**
+ * @brief Queue a task from outside the pool, on the next worker in turn.
+ *
+ * @param task The task. It must stay valid until it runs.
+ */
+void wq_submit(wq_task *task);
+
+/**
+ * @brief Queue a task from a worker, on its own deque.
+ *
+ * @param task The task. It must stay valid until it runs.
+ * @param yield False to run it next, true to run it after the tasks already queued.
+ */
+void wq_push(wq_task *task, bool yield);
+
+/**
+ * @brief Count the tasks run and the tasks stolen, over all workers.
+ */
+void wq_counts(uint64_t *run, uint64_t *stolen);
+
+#endif
@@ -0,0 +1,379 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <check.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include "storage.h"
+#include "utils.h"
+
+#define TESTTIMEOUT	10		// How long to wait for each test to run.
+#define SERVEREXEC	"./server"	// Server executable file.
+#define SERVEROUT	"default.serverout"	// File where the server's output is stored.
+#define SERVEROUT_MODE	0666		// Permissions of the server ouptut file.
+#define CACHE_CONF	"conf-cache.conf"	// Server configuration file with a three column table.
+#define CACHEENTRIES	64		// Records the read cache of the tests holds.
+#define LONGTTL		60000		// Milliseconds a cached record lives in tests that never revalidate it.
+#define SHORTTTL	100		// Milliseconds a cached record lives in tests that revalidate it.
+#define KEY1		"somekey1"	// A key used in the test cases.
+#define KEY2		"somekey2"	// A key used in the test cases.
+
+// These settings should correspond to what's in the config file.
+#define SERVERHOST	"localhost"	// The hostname where the server is running.
+#define SERVERPORT	4848		// The port where the server is running.
+#define SERVERUSERNAME	"admin"		// The server username
+#define SERVERPASSWORD	"dog4sale"	// The server password
+#define SERVERENCRYPTED	"xxxnq.BMCifhU"	// The server password as sent in AUTH.
+#define THREECOLSTABLE	"threecols"	// A table with three columns.
+
+/* Server port used by test */
+int server_port;
+
+/**
+ * @brief Start the storage server.
+ *
+ * @param config_file The configuration file the server should use.
+ * @param serverout_file File where server output is stored.
+ * @return Return server process id on success, or -1 otherwise.
+ */
+int start_server(char *config_file, const char *serverout_file)
+{
+	pid_t childpid = fork();
+	if (childpid < 0) {
+		// Failed to create child.
+		return -1;
+	} else if (childpid == 0) {
+		// The child.
+
+		// Redirect stdout and stderr to a file.
+		const char *outfile = serverout_file == NULL ? SERVEROUT : serverout_file;
+		int outfd = open(outfile, O_CREAT|O_WRONLY|O_TRUNC, SERVEROUT_MODE);
+		close(STDOUT_FILENO);
+		close(STDERR_FILENO);
+		if (dup2(outfd, STDOUT_FILENO) < 0 || dup2(outfd, STDERR_FILENO) < 0) {
+			perror("dup2 error");
+			return -1;
+		}
+
+		// Start the server
+		execl(SERVEREXEC, SERVEREXEC, config_file, NULL);
+
+		// Should never get here.
+		perror("Couldn't start server");
+		exit(EXIT_FAILURE);
+	} else {
+		// The parent.
+
+		// If the child terminates quickly, then there was probably a
+		// problem running the server (e.g., config file not found).
+		sleep(1);
+		int pid = waitpid(childpid, NULL, WNOHANG);
+		if (pid == childpid)
+			return -1; // Probably a problem starting the server.
+		else
+			return childpid; // Probably ok.
+	}
+}
+
+/**
+ * @brief Connect to the server and authenticate.
+ * @return A connection to the server if successful.
+ */
+void* connect_auth()
+{
+	void *conn = storage_connect(SERVERHOST, server_port);
+	fail_unless(conn != NULL, "Couldn't connect to server.");
+
+	int status = storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn);
+	fail_unless(status == 0, "Authentication failed.");
+
+	return conn;
+}
+
+
+/// Connections used by test fixture.
+void *test_conn = NULL;
+void *other_conn = NULL;
+
+/// Server started by test fixture.
+int test_serverpid = -1;
+
+/**
+ * @brief Text fixture setup.  Start the server with a three column table, store two records and open two connections.
+ */
+void test_setup_cache()
+{
+	test_serverpid = start_server(CACHE_CONF, "cache.serverout");
+	fail_unless(test_serverpid > 0, "Server didn't run properly.");
+	test_conn = connect_auth();
+	other_conn = connect_auth();
+
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	strncpy(record.value, "col1 1,col2 2,col3 abc", sizeof record.value);
+	int status = storage_set(THREECOLSTABLE, KEY1, &record, other_conn);
+	fail_unless(status == 0, "Error setting a key/value pair.");
+	strncpy(record.value, "col1 3,col2 4,col3 def", sizeof record.value);
+	status = storage_set(THREECOLSTABLE, KEY2, &record, other_conn);
+	fail_unless(status == 0, "Error setting a key/value pair.");
+}
+
+/**
+ * @brief Text fixture teardown.  Disconnect from the server and stop it.
+ */
+void test_teardown()
+{
+	storage_disconnect(other_conn);
+	storage_disconnect(test_conn);
+	kill(test_serverpid, SIGKILL);
+	waitpid(test_serverpid, NULL, 0);
+}
+
+
+/**
+ * @brief Set a key with the given first column.
+ * @return Return 0 on success, -1 otherwise.
+ */
+int set_col1(const char *key, int col1, void *conn)
+{
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	snprintf(record.value, sizeof record.value, "col1 %d,col2 0,col3 abc", col1);
+	return storage_set(THREECOLSTABLE, key, &record, conn);
+}
+
+/**
+ * @brief Get a record and check its first column.
+ * @return The value of col1, or -1 if the get failed.
+ */
+int get_col1(const char *key, void *conn)
+{
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	int col1 = -1;
+	if (storage_get(THREECOLSTABLE, key, &record, conn) != 0)
+		return -1;
+	fail_unless(sscanf(record.value, "col1 %d", &col1) == 1, "Got wrong value.");
+	return col1;
+}
+
+/**
+ * @brief Read the number of GET and GETV commands the server ran.
+ * @return The count.
+ */
+long get_count()
+{
+	char stats[4096];
+	int status = storage_stats(stats, sizeof stats, other_conn);
+	fail_unless(status == 0, "Error getting statistics.");
+	char *at = strstr(stats, "cmd_get ");
+	fail_unless(at != NULL, "Server didn't report cmd_get.");
+	return atol(at + strlen("cmd_get "));
+}
+
+
+/*
+ * GETV tests:
+ * 	timestamp 0 (pass, record and its timestamp)
+ * 	timestamp of the stored version (pass, timestamp alone)
+ * 	timestamp of an older version (pass, record and the new timestamp)
+ * 	missing key (fail, key not found)
+ */
+
+/// Socket speaking the protocol directly, for the commands the library keeps to itself.
+int test_sock = -1;
+
+/**
+ * @brief Send a command on test_sock and read its reply.
+ */
+void command(const char *cmd, char *reply, size_t len)
+{
+	char line[MAX_CMD_LEN];
+	snprintf(line, sizeof line, "%s\n", cmd);
+	fail_unless(sendall(test_sock, line, strlen(line)) == 0 && recvline(test_sock, reply, len) == 0, "Error sending a command.");
+}
+
+/**
+ * @brief Text fixture setup.  As test_setup_cache(), with test_sock connected and authenticated.
+ */
+void test_setup_getv()
+{
+	test_setup_cache();
+	struct addrinfo hints, *res;
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	char port[MAX_PORT_LEN];
+	snprintf(port, sizeof port, "%d", server_port);
+	fail_unless(getaddrinfo(SERVERHOST, port, &hints, &res) == 0, "Couldn't resolve the server.");
+	test_sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	fail_unless(connect(test_sock, res->ai_addr, res->ai_addrlen) == 0, "Couldn't connect to server.");
+	freeaddrinfo(res);
+
+	char reply[MAX_CMD_LEN];
+	command("AUTH," SERVERUSERNAME "," SERVERENCRYPTED, reply, sizeof reply);
+	fail_unless(strncmp(reply, "1,0", 3) == 0, "Authentication failed.");
+}
+
+/**
+ * @brief Text fixture teardown.  As test_teardown(), closing test_sock too.
+ */
+void test_teardown_getv()
+{
+	close(test_sock);
+	test_teardown();
+}
+
+START_TEST (test_getv_unchanged)
+{
+	char reply[MAX_CMD_LEN], expect[MAX_CMD_LEN];
+	unsigned long long ts;
+	command("GETV," THREECOLSTABLE "," KEY1 ",0", reply, sizeof reply);
+	fail_unless(sscanf(reply, "1,0,1,%llu,", &ts) == 1 && ts > 0, "No timestamp in the reply of GETV.");
+	fail_unless(strstr(reply, ",col1 1,col2 2,col3 abc") != NULL, "Record missing from the reply of GETV.");
+
+	char cmd[MAX_CMD_LEN];
+	snprintf(cmd, sizeof cmd, "GETV,%s,%s,%llu", THREECOLSTABLE, KEY1, ts);
+	command(cmd, reply, sizeof reply);
+	snprintf(expect, sizeof expect, "1,0,1,%llu", ts);
+	fail_unless(strcmp(reply, expect) == 0, "Columns sent for an unchanged record.");
+}
+END_TEST
+
+START_TEST (test_getv_changed)
+{
+	char reply[MAX_CMD_LEN];
+	unsigned long long ts, newts;
+	command("GETV," THREECOLSTABLE "," KEY1 ",0", reply, sizeof reply);
+	fail_unless(sscanf(reply, "1,0,1,%llu,", &ts) == 1, "No timestamp in the reply of GETV.");
+	fail_unless(set_col1(KEY1, 5, other_conn) == 0, "Error setting a key/value pair.");
+
+	char cmd[MAX_CMD_LEN];
+	snprintf(cmd, sizeof cmd, "GETV,%s,%s,%llu", THREECOLSTABLE, KEY1, ts);
+	command(cmd, reply, sizeof reply);
+	fail_unless(sscanf(reply, "1,0,2,%llu,", &newts) == 1 && newts > ts, "No new timestamp for a changed record.");
+	fail_unless(strstr(reply, ",col1 5,") != NULL, "Changed record missing from the reply of GETV.");
+}
+END_TEST
+
+START_TEST (test_getv_missing)
+{
+	char reply[MAX_CMD_LEN];
+	command("GETV," THREECOLSTABLE ",missingkey,0", reply, sizeof reply);
+	fail_unless(strncmp(reply, "0,6", 3) == 0, "GETV of a missing key should fail with ERR_KEY_NOT_FOUND.");
+}
+END_TEST
+
+
+/*
+ * Read cache tests:
+ * 	get within the ttl (pass, no GET sent)
+ * 	get after own set (pass, new value without a GET)
+ * 	get past the ttl (pass, revalidated, sees other writes)
+ * 	get inside a transaction (pass, cache bypassed)
+ */
+
+START_TEST (test_readcache_hit)
+{
+	int status = storage_cache_config(CACHEENTRIES, LONGTTL);
+	fail_unless(status == 0, "Error turning the read cache on.");
+	fail_unless(get_col1(KEY1, test_conn) == 1, "Got wrong value.");
+	long gets = get_count();
+	fail_unless(get_col1(KEY1, test_conn) == 1, "Got wrong value from the cache.");
+	fail_unless(get_count() == gets, "Cached record asked for again within its ttl.");
+}
+END_TEST
+
+START_TEST (test_readcache_ownset)
+{
+	int status = storage_cache_config(CACHEENTRIES, LONGTTL);
+	fail_unless(status == 0, "Error turning the read cache on.");
+	fail_unless(get_col1(KEY1, test_conn) == 1, "Got wrong value.");
+	fail_unless(set_col1(KEY1, 5, test_conn) == 0, "Error setting a key/value pair.");
+	long gets = get_count();
+	fail_unless(get_col1(KEY1, test_conn) == 5, "Own write not seen through the cache.");
+	fail_unless(get_count() == gets, "Record refreshed by the set asked for again.");
+}
+END_TEST
+
+START_TEST (test_readcache_revalidate)
+{
+	int status = storage_cache_config(CACHEENTRIES, SHORTTTL);
+	fail_unless(status == 0, "Error turning the read cache on.");
+	fail_unless(get_col1(KEY1, test_conn) == 1, "Got wrong value.");
+	usleep(2 * SHORTTTL * 1000);
+	long gets = get_count();
+	fail_unless(get_col1(KEY1, test_conn) == 1, "Got wrong value for an unchanged record.");
+	fail_unless(get_count() == gets + 1, "Record not revalidated past its ttl.");
+
+	fail_unless(set_col1(KEY1, 7, other_conn) == 0, "Error setting a key/value pair.");
+	usleep(2 * SHORTTTL * 1000);
+	fail_unless(get_col1(KEY1, test_conn) == 7, "Write of another connection not seen past the ttl.");
+}
+END_TEST
+
+START_TEST (test_readcache_txn)
+{
+	int status = storage_cache_config(CACHEENTRIES, LONGTTL);
+	fail_unless(status == 0, "Error turning the read cache on.");
+	fail_unless(get_col1(KEY1, test_conn) == 1, "Got wrong value.");
+
+	status = storage_begin(test_conn);
+	fail_unless(status == 0, "Error starting a transaction.");
+	long gets = get_count();
+	fail_unless(get_col1(KEY1, test_conn) == 1, "Got wrong value in a transaction.");
+	fail_unless(get_count() == gets + 1, "Cache not bypassed in a transaction.");
+	fail_unless(set_col1(KEY1, 8, test_conn) == 0, "Error setting a key/value pair in a transaction.");
+	fail_unless(get_col1(KEY1, test_conn) == 8, "Transaction doesn't see its own write.");
+	status = storage_abort(test_conn);
+	fail_unless(status == 0, "Error aborting a transaction.");
+
+	fail_unless(get_col1(KEY1, test_conn) == 1, "Aborted write served from the cache.");
+}
+END_TEST
+
+
+int main(int argc, char *argv[])
+{
+	if(argc == 2)
+		server_port = atoi(argv[1]);
+	else
+		server_port = SERVERPORT;
+	printf("Using server port: %d.\n", server_port);
+	Suite *s = suite_create("cache");
+	TCase *tc;
+
+	// GETV tests
+	tc = tcase_create("getv");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_getv, test_teardown_getv);
+	tcase_add_test(tc, test_getv_unchanged);
+	tcase_add_test(tc, test_getv_changed);
+	tcase_add_test(tc, test_getv_missing);
+	suite_add_tcase(s, tc);
+
+	// Read cache tests
+	tc = tcase_create("readcache");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_cache, test_teardown);
+	tcase_add_test(tc, test_readcache_hit);
+	tcase_add_test(tc, test_readcache_ownset);
+	tcase_add_test(tc, test_readcache_revalidate);
+	tcase_add_test(tc, test_readcache_txn);
+	suite_add_tcase(s, tc);
+
+	SRunner *sr = srunner_create(s);
+	srunner_set_log(sr, "results.log");
+	srunner_run_all(sr, CK_ENV);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,263 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <check.h>
+#include "command.h"
+
+#define TESTTIMEOUT	10		// How long to wait for each test to run.
+#define LONGKEY		1000		// Length of the over-long key, far above MAX_KEY_LEN.
+#define MAXLINE		64		// Longest line accepted by the reader tests.
+
+/// Line parsed by the tests, reused like the server does.
+cmd_line test_line;
+
+/// Copy of the text parsed, as cmd_parse() writes into it.
+char test_text[2 * LONGKEY];
+
+/**
+ * @brief Text fixture setup.
+ */
+void test_setup()
+{
+	memset(&test_line, 0, sizeof test_line);
+}
+
+/**
+ * @brief Text fixture teardown.
+ */
+void test_teardown()
+{
+	cmd_free(&test_line);
+}
+
+/**
+ * @brief Parse a copy of text into test_line.
+ * @return Return the number of fields.
+ */
+int parse(const char *text)
+{
+	strncpy(test_text, text, sizeof test_text - 1);
+	test_text[sizeof test_text - 1] = '\0';
+	return cmd_parse(test_text, &test_line);
+}
+
+/**
+ * @brief Tell whether field i of test_line is exactly str.
+ */
+int field_is(int i, const char *str)
+{
+	return i < test_line.numFields && cmd_equals(test_line.fields[i], str)
+		&& test_line.fields[i].ptr[test_line.fields[i].len] == '\0';
+}
+
+
+/*
+ * Parse tests:
+ * 	fields split at commas and trimmed (pass)
+ * 	empty fields (skipped)
+ * 	blank fields (skipped)
+ * 	empty and blank lines (0 fields)
+ * 	verb ending at a space (pass)
+ * 	more fields than the initial slots (pass)
+ * 	over-long key (kept whole)
+ */
+
+START_TEST (test_parse_fields)
+{
+	fail_unless(parse(" SET , t1 ,\tk1 ,col1 5 ") == 4, "Wrong number of fields.");
+	fail_unless(field_is(0, "SET"), "Field not trimmed.");
+	fail_unless(field_is(1, "t1"), "Field not trimmed.");
+	fail_unless(field_is(2, "k1"), "Field not trimmed.");
+	fail_unless(field_is(3, "col1 5"), "Blank inside a field lost.");
+	fail_unless(cmd_equals(test_line.verb, "SET"), "Wrong verb.");
+}
+END_TEST
+
+START_TEST (test_parse_empty)
+{
+	fail_unless(parse(",GET,,t1,,k1,") == 3, "Empty fields not skipped.");
+	fail_unless(field_is(0, "GET") && field_is(1, "t1") && field_is(2, "k1"), "Wrong fields around empty ones.");
+}
+END_TEST
+
+START_TEST (test_parse_blank)
+{
+	fail_unless(parse("GET, ,t1,\t \t,k1,  ") == 3, "Blank fields not skipped.");
+	fail_unless(field_is(0, "GET") && field_is(1, "t1") && field_is(2, "k1"), "Wrong fields around blank ones.");
+	int i;
+	for (i = 0; i < test_line.numFields; i++)
+		fail_unless(test_line.fields[i].len > 0, "Empty field returned.");
+}
+END_TEST
+
+START_TEST (test_parse_blankline)
+{
+	fail_unless(parse("") == 0, "Fields in an empty line.");
+	fail_unless(test_line.verb.len == 0, "Verb in an empty line.");
+	fail_unless(parse(" \t ") == 0, "Fields in a blank line.");
+	fail_unless(parse(" , ,,") == 0, "Fields in a line of blank fields.");
+	fail_unless(test_line.verb.len == 0, "Verb in a line of blank fields.");
+}
+END_TEST
+
+START_TEST (test_parse_verb)
+{
+	fail_unless(parse("AUTH admin xxx") == 1, "Wrong number of fields.");
+	fail_unless(cmd_equals(test_line.verb, "AUTH"), "Verb doesn't end at the space.");
+	fail_unless(field_is(0, "AUTH admin xxx"), "Field of the verb cut.");
+	fail_unless(!cmd_equals(test_line.verb, "AUTHX") && !cmd_equals(test_line.verb, "AUT"), "Verb matches another string.");
+}
+END_TEST
+
+START_TEST (test_parse_manyfields)
+{
+	char text[4 * CMD_INIT_FIELDS * 8] = "SET";
+	int i;
+	for (i = 1; i < 4 * CMD_INIT_FIELDS; i++)
+		sprintf(text + strlen(text), ",f%d", i);
+	fail_unless(parse(text) == 4 * CMD_INIT_FIELDS, "Fields lost growing the slots.");
+	fail_unless(field_is(4 * CMD_INIT_FIELDS - 1, "f63"), "Wrong last field.");
+
+	// The slots are reused by the next line
+	fail_unless(parse("GET,t1,k1") == 3, "Fields of the previous line left.");
+}
+END_TEST
+
+START_TEST (test_parse_longkey)
+{
+	char text[LONGKEY + 16] = "GET,t1,";
+	size_t at = strlen(text);
+	memset(text + at, 'k', LONGKEY);
+	text[at + LONGKEY] = '\0';
+	fail_unless(parse(text) == 3, "Wrong number of fields.");
+	fail_unless(test_line.fields[2].len == LONGKEY, "Over-long key cut.");
+	fail_unless(test_line.fields[2].ptr[LONGKEY] == '\0', "Over-long key not terminated.");
+}
+END_TEST
+
+
+/*
+ * Split tests:
+ * 	field split at its first space (pass)
+ * 	field without a space (empty tail)
+ */
+
+START_TEST (test_split_space)
+{
+	cmd_slice head, tail;
+	fail_unless(parse("SET,t1,k1,col1   5 6") == 4, "Wrong number of fields.");
+	cmd_split(test_line.fields[3], &head, &tail);
+	fail_unless(cmd_equals(head, "col1") && head.ptr[head.len] == '\0', "Wrong head.");
+	fail_unless(cmd_equals(tail, "5 6"), "Wrong tail.");
+}
+END_TEST
+
+START_TEST (test_split_nospace)
+{
+	cmd_slice head, tail;
+	fail_unless(parse("GET,t1,k1") == 3, "Wrong number of fields.");
+	cmd_split(test_line.fields[2], &head, &tail);
+	fail_unless(cmd_equals(head, "k1"), "Wrong head.");
+	fail_unless(tail.len == 0, "Tail of a field without a space.");
+}
+END_TEST
+
+
+/*
+ * Reader tests:
+ * 	lines taken one by one, partial line kept (pass)
+ * 	line longer than the limit (fail on the next fill)
+ */
+
+/**
+ * @brief Put str in the receive buffer as if received.
+ * @return Return 0 on success, -1 if the reader refused it.
+ */
+int feed(cmd_reader *r, const char *str, size_t maxlen)
+{
+	size_t len = strlen(str);
+	while (len > 0) {
+		size_t room;
+		char *space = cmd_reader_space(r, maxlen, &room);
+		if (space == NULL)
+			return -1;
+		size_t n = (len < room) ? len : room;
+		memcpy(space, str, n);
+		cmd_reader_add(r, n);
+		str += n;
+		len -= n;
+	}
+	return 0;
+}
+
+START_TEST (test_reader_lines)
+{
+	cmd_reader r;
+	memset(&r, 0, sizeof r);
+	char *line;
+	size_t len;
+	fail_unless(feed(&r, "GET,t1,k1\nGET,t1", MAXLINE) == 0, "Error filling the reader.");
+	fail_unless(cmd_reader_line(&r, &line, &len) == 1 && strcmp(line, "GET,t1,k1") == 0 && len == 9, "Wrong first line.");
+	fail_unless(!cmd_reader_ready(&r) && cmd_reader_line(&r, &line, &len) == 0, "Partial line taken.");
+	fail_unless(feed(&r, ",k2\n", MAXLINE) == 0, "Error filling the reader.");
+	fail_unless(cmd_reader_line(&r, &line, &len) == 1 && strcmp(line, "GET,t1,k2") == 0, "Partial line lost.");
+	cmd_reader_free(&r);
+}
+END_TEST
+
+START_TEST (test_reader_toolong)
+{
+	cmd_reader r;
+	memset(&r, 0, sizeof r);
+	char text[2 * MAXLINE];
+	memset(text, 'k', sizeof text - 1);
+	text[sizeof text - 1] = '\0';
+	fail_unless(feed(&r, text, MAXLINE) == 0, "Error filling the reader.");
+	fail_unless(!cmd_reader_ready(&r), "Line taken without its newline.");
+	fail_unless(feed(&r, "\n", MAXLINE) == -1, "Line longer than the limit accepted.");
+	cmd_reader_free(&r);
+}
+END_TEST
+
+
+int main(int argc, char *argv[])
+{
+	Suite *s = suite_create("command");
+	TCase *tc;
+
+	// Parse tests
+	tc = tcase_create("parse");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup, test_teardown);
+	tcase_add_test(tc, test_parse_fields);
+	tcase_add_test(tc, test_parse_empty);
+	tcase_add_test(tc, test_parse_blank);
+	tcase_add_test(tc, test_parse_blankline);
+	tcase_add_test(tc, test_parse_verb);
+	tcase_add_test(tc, test_parse_manyfields);
+	tcase_add_test(tc, test_parse_longkey);
+	suite_add_tcase(s, tc);
+
+	// Split tests
+	tc = tcase_create("split");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup, test_teardown);
+	tcase_add_test(tc, test_split_space);
+	tcase_add_test(tc, test_split_nospace);
+	suite_add_tcase(s, tc);
+
+	// Reader tests
+	tc = tcase_create("reader");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_test(tc, test_reader_lines);
+	tcase_add_test(tc, test_reader_toolong);
+	suite_add_tcase(s, tc);
+
+	SRunner *sr = srunner_create(s);
+	srunner_set_log(sr, "results.log");
+	srunner_run_all(sr, CK_ENV);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,377 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <check.h>
+#include "engine.h"
+
+#define TESTTIMEOUT	10		// How long to wait for each test to run.
+#define NUMKEYS		2000		// Keys in the table.
+#define NUMUPDATES	5		// Updates of a key while a snapshot is held.
+#define TESTTABLE	"t"		// Name of the table of the tests.
+#define NUMWRITERS	2		// Threads rewriting one key at once.
+#define NUMREADERS	2		// Threads reading it meanwhile.
+#define NUMROUNDS	20000		// Images each writer commits.
+#define TORNKEY		"torn"		// Key of the column tests.
+#define NUMCOLUMNS	64		// Columns of the table of the column tests, so a copy takes long enough to be cut.
+#define SCANEVERY	16		// GETs of the key between two snapshot scans.
+
+/// Table used by test fixture.
+table *test_table = NULL;
+
+/// Image written and read by the tests.
+census *test_rp = NULL;
+
+/// Set once the writer thread is done.
+int test_done = 0;
+
+/**
+ * @brief Text fixture setup.  Create a table with an int column and two string columns.
+ */
+void test_setup()
+{
+	addTable(TESTTABLE, 0);
+	test_table = tables[0];
+	fail_unless(addColumn(test_table, "col1", -1) == 0, "Error adding a column.");
+	fail_unless(addColumn(test_table, "col2", MAX_STRTYPE_SIZE) == 0, "Error adding a column.");
+	fail_unless(addColumn(test_table, "col3", MAX_STRTYPE_SIZE) == 0, "Error adding a column.");
+	test_rp = newRecord(test_table->numColumns);
+	test_done = 0;
+}
+
+/**
+ * @brief Write <prefix><i> with col1 set to col1, whatever its version.
+ * @return Return 0 on success, -1 on failure.
+ */
+int set_key(const char *prefix, int i, int col1)
+{
+	census *rp = newRecord(test_table->numColumns);
+	snprintf(rp->key, sizeof rp->key, "%s%d", prefix, i);
+	snprintf(rp->value[0], MAX_STRTYPE_SIZE, "%d", col1);
+	strcpy(rp->value[1], "abc");
+	strcpy(rp->value[2], "def");
+	int status = insertRecord(test_table, rp);
+	free(rp);
+	return status;
+}
+
+/**
+ * @brief Text fixture setup.  Create the table with key<i> holding col1 i.
+ */
+void test_setup_populate()
+{
+	test_setup();
+	int i;
+	for (i = 0; i < NUMKEYS; i++)
+		fail_unless(set_key("key", i, i) == 0, "Error inserting a key.");
+}
+
+/**
+ * @brief Text fixture setup.  Create a table of NUMCOLUMNS string columns besides the int one.
+ */
+void test_setup_wide()
+{
+	test_setup();
+	int j;
+	for (j = test_table->numColumns; j <= NUMCOLUMNS; j++) {
+		char name[MAX_COLNAME_LEN];
+		snprintf(name, sizeof name, "col%d", j + 1);
+		fail_unless(addColumn(test_table, name, MAX_STRTYPE_SIZE) == 0, "Error adding a column.");
+	}
+	free(test_rp);
+	test_rp = newRecord(test_table->numColumns);
+}
+
+/**
+ * @brief Text fixture teardown.
+ */
+void test_teardown()
+{
+	free(test_rp);
+}
+
+/**
+ * @brief Count the keys whose col1 is at least 0 in a snapshot.
+ */
+int count_snapshot(uint64_t snapshot)
+{
+	predicate pred;
+	memset(&pred, 0, sizeof pred);
+	pred.type = -1;
+	pred.cmp = 1;
+	pred.colNum = 0;
+	strcpy(pred.value, "-1");
+	return querySlice(test_table, snapshot, &pred, 1, NULL, 0, 0, 0);
+}
+
+/**
+ * @brief Count the older versions kept by a record.
+ * @return Return the count, or -1 if the key isn't in the table key index.
+ */
+int count_older(char *key)
+{
+	int count = -1;
+	epoch_enter();
+	record *r = findRecord(test_table, key);
+	if (r != NULL) {
+		version *v;
+		count = 0;
+		for (v = r->older; v != NULL; v = v->older)
+			count++;
+	}
+	epoch_exit();
+	return count;
+}
+
+
+/*
+ * Snapshot tests:
+ * 	snapshot doesn't see updates and inserts committed while it's scanned (pass)
+ * 	snapshot doesn't see a delete committed after it (pass)
+ */
+
+/**
+ * @brief Thread function setting col1 of every key to -1 and adding as many new keys.
+ */
+void* rewrite_keys(void *arg)
+{
+	int i;
+	for (i = 0; i < NUMKEYS; i++) {
+		fail_unless(set_key("key", i, -1) == 0, "Error updating a key.");
+		fail_unless(set_key("new", i, i) == 0, "Error inserting a key.");
+	}
+	__atomic_store_n(&test_done, 1, __ATOMIC_RELEASE);
+	snapshot_release_slot();
+	epoch_thread_exit();
+	return NULL;
+}
+
+START_TEST (test_snapshot_writes)
+{
+	uint64_t snapshot = snapshot_begin();
+	pthread_t writer;
+	fail_unless(pthread_create(&writer, NULL, rewrite_keys, NULL) == 0, "Error starting a thread.");
+
+	// Every scan of the snapshot sees the table as it was, whatever the writer has done so far
+	int scans = 0;
+	do {
+		fail_unless(count_snapshot(snapshot) == NUMKEYS, "Snapshot saw writes committed after it.");
+		scans++;
+	} while (!__atomic_load_n(&test_done, __ATOMIC_ACQUIRE));
+	pthread_join(writer, NULL);
+	fail_unless(count_snapshot(snapshot) == NUMKEYS, "Snapshot saw writes committed after it.");
+	snapshot_end();
+
+	// A fresh snapshot sees the rewrite: only the new keys still match
+	snapshot = snapshot_begin();
+	fail_unless(count_snapshot(snapshot) == NUMKEYS, "Fresh snapshot missed writes.");
+	snapshot_end();
+	fail_unless(readRecord(test_table, "key0", test_rp, NULL) == 0 && strcmp(test_rp->value[0], "-1") == 0,
+		"Update lost.");
+	fail_unless(scans > 0, "No scan ran.");
+}
+END_TEST
+
+START_TEST (test_snapshot_delete)
+{
+	uint64_t snapshot = snapshot_begin();
+	strcpy(test_rp->key, "key7");
+	fail_unless(deleteRecord(test_table, test_rp) == 0, "Error deleting a key.");
+	fail_unless(readRecord(test_table, "key7", test_rp, NULL) == -1, "Found a key deleted.");
+	fail_unless(count_snapshot(snapshot) == NUMKEYS, "Snapshot saw a delete committed after it.");
+	snapshot_end();
+
+	snapshot = snapshot_begin();
+	fail_unless(count_snapshot(snapshot) == NUMKEYS - 1, "Fresh snapshot missed a delete.");
+	snapshot_end();
+}
+END_TEST
+
+
+/*
+ * Garbage tests:
+ * 	older versions kept while a snapshot needs them, freed once it ends (pass)
+ * 	deleted key kept while a snapshot needs it, unlinked once it ends (pass)
+ */
+
+START_TEST (test_garbage_versions)
+{
+	fail_unless(count_older("key3") == 0, "Older versions kept with no snapshot.");
+	uint64_t snapshot = snapshot_begin();
+	int i;
+	for (i = 1; i <= NUMUPDATES; i++)
+		fail_unless(set_key("key", 3, 3 + i) == 0, "Error updating a key.");
+	fail_unless(count_older("key3") > 0, "Older version dropped while a snapshot needs it.");
+
+	// The snapshot still reads the first image
+	epoch_enter();
+	version *scratch = calloc(1, sizeof(version) + test_table->numColumns * MAX_STRTYPE_SIZE);
+	version *v = visibleVersion(findRecord(test_table, "key3"), snapshot, scratch, test_table->numColumns);
+	fail_unless(v != NULL && strcmp(v->value[0], "3") == 0, "Snapshot read the wrong version.");
+	free(scratch);
+	epoch_exit();
+	snapshot_end();
+
+	collectGarbage(test_table);
+	fail_unless(count_older("key3") == 0, "Older versions not freed once no snapshot needs them.");
+	fail_unless(readRecord(test_table, "key3", test_rp, NULL) == 0 && atoi(test_rp->value[0]) == 3 + NUMUPDATES,
+		"Newest version lost.");
+}
+END_TEST
+
+START_TEST (test_garbage_delete)
+{
+	uint64_t snapshot = snapshot_begin();
+	strcpy(test_rp->key, "key9");
+	fail_unless(deleteRecord(test_table, test_rp) == 0, "Error deleting a key.");
+	collectGarbage(test_table);
+	fail_unless(count_older("key9") > 0, "Deleted key unlinked while a snapshot needs it.");
+	fail_unless(count_snapshot(snapshot) == NUMKEYS, "Snapshot lost a deleted key.");
+	snapshot_end();
+
+	collectGarbage(test_table);
+	fail_unless(count_older("key9") == -1, "Deleted key not unlinked once no snapshot needs it.");
+	fail_unless(count_older("key8") == 0 && count_older("key10") == 0, "Lost a key next to the one deleted.");
+}
+END_TEST
+
+
+/*
+ * Column tests:
+ * 	writers rewrite every column of a key to one value, GET and QUERY never see two values (pass)
+ */
+
+/**
+ * @brief Thread function committing images of TORNKEY whose columns all hold the same value.
+ * @param arg The number of the writer, as an intptr_t.
+ */
+void* rewrite_columns(void *arg)
+{
+	int writer = (int)(intptr_t)arg;
+	census *rp = newRecord(test_table->numColumns);
+	strcpy(rp->key, TORNKEY);
+	int i, j;
+	for (i = 0; i < NUMROUNDS; i++) {
+		// As long as a column holds, so a torn copy can't pass for a whole one
+		char value[MAX_STRTYPE_SIZE];
+		memset(value, 'a' + (i + writer) % 26, sizeof value - 1);
+		value[sizeof value - 1] = '\0';
+		snprintf(value, 8, "%d", writer * NUMROUNDS + i);
+		value[strlen(value)] = '-';
+		for (j = 0; j < test_table->numColumns; j++)
+			strcpy(rp->value[j], value);
+		rp->metadata = 0;
+		fail_unless(insertRecord(test_table, rp) == 0, "Error updating a key.");
+	}
+	free(rp);
+	snapshot_release_slot();
+	epoch_thread_exit();
+	return NULL;
+}
+
+/**
+ * @brief Fail unless every column of an image holds the same value.
+ */
+void check_columns(char (*value)[MAX_STRTYPE_SIZE])
+{
+	int j;
+	for (j = 1; j < test_table->numColumns; j++)
+		fail_unless(strcmp(value[0], value[j]) == 0, "Read columns of two different images.");
+}
+
+/**
+ * @brief Visit function of scanSnapshot(): check the image of TORNKEY.
+ */
+void check_version(void *arg, const char *key, version *v)
+{
+	if (strcmp(key, TORNKEY) != 0)
+		return;
+	check_columns(v->value);
+	(*(int*)arg)++;
+}
+
+/**
+ * @brief Thread function reading TORNKEY by GET and by snapshot scan until the writers are done.
+ */
+void* read_columns(void *arg)
+{
+	census *out = newRecord(test_table->numColumns);
+	int gets = 0, reads = 0;
+	while (!__atomic_load_n(&test_done, __ATOMIC_ACQUIRE)) {
+		fail_unless(readRecord(test_table, TORNKEY, out, NULL) == 0, "Key not found.");
+		check_columns(out->value);
+		if (++gets % SCANEVERY != 0)
+			continue;
+		uint64_t snapshot = snapshot_begin();
+		scanSnapshot(test_table, snapshot, check_version, &reads);
+		snapshot_end();
+	}
+	fail_unless(reads > 0, "No snapshot scan found the key.");
+	free(out);
+	snapshot_release_slot();
+	epoch_thread_exit();
+	return NULL;
+}
+
+START_TEST (test_columns_torn)
+{
+	census *rp = newRecord(test_table->numColumns);
+	strcpy(rp->key, TORNKEY);
+	fail_unless(insertRecord(test_table, rp) == 0, "Error inserting a key.");
+	free(rp);
+
+	pthread_t writers[NUMWRITERS], readers[NUMREADERS];
+	int i;
+	for (i = 0; i < NUMREADERS; i++)
+		fail_unless(pthread_create(&readers[i], NULL, read_columns, NULL) == 0, "Error starting a thread.");
+	for (i = 0; i < NUMWRITERS; i++)
+		fail_unless(pthread_create(&writers[i], NULL, rewrite_columns, (void*)(intptr_t)i) == 0, "Error starting a thread.");
+	for (i = 0; i < NUMWRITERS; i++)
+		pthread_join(writers[i], NULL);
+	__atomic_store_n(&test_done, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < NUMREADERS; i++)
+		pthread_join(readers[i], NULL);
+
+	fail_unless(readRecord(test_table, TORNKEY, test_rp, NULL) == 0, "Key lost.");
+	check_columns(test_rp->value);
+	fail_unless(test_rp->metadata == 1 + NUMWRITERS * NUMROUNDS, "Lost updates of the key.");
+}
+END_TEST
+
+
+int main(int argc, char *argv[])
+{
+	Suite *s = suite_create("engine");
+	TCase *tc;
+
+	// Snapshot tests
+	tc = tcase_create("snapshot");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_populate, test_teardown);
+	tcase_add_test(tc, test_snapshot_writes);
+	tcase_add_test(tc, test_snapshot_delete);
+	suite_add_tcase(s, tc);
+
+	// Garbage tests
+	tc = tcase_create("garbage");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_populate, test_teardown);
+	tcase_add_test(tc, test_garbage_versions);
+	tcase_add_test(tc, test_garbage_delete);
+	suite_add_tcase(s, tc);
+
+	// Column tests
+	tc = tcase_create("columns");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_wide, test_teardown);
+	tcase_add_test(tc, test_columns_torn);
+	suite_add_tcase(s, tc);
+
+	SRunner *sr = srunner_create(s);
+	srunner_set_log(sr, "results.log");
+	srunner_run_all(sr, CK_ENV);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
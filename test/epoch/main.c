@@ -0,0 +1,271 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <check.h>
+#include "epoch.h"
+
+#define TESTTIMEOUT	10		// How long to wait for each test to run.
+#define NUMREADERS	3		// Reader threads in the stress test.
+#define NUMSWAPS	20000		// Objects the writer of the stress test replaces.
+#define LIVE		0x1234		// Value of an object not freed yet.
+
+/**
+ * @brief An object that may be retired.
+ */
+typedef struct {
+	epoch_entry entry;
+	int value;
+	int destroyed;
+} object;
+
+/**
+ * @brief Destroy function that only marks the object, so a test can look at it afterwards.
+ */
+void mark_destroyed(epoch_entry *entry)
+{
+	object *obj = (object*)entry;
+	__atomic_store_n(&obj->destroyed, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Destroy function that poisons and frees the object.
+ */
+void poison_free(epoch_entry *entry)
+{
+	object *obj = (object*)entry;
+	obj->value = 0;
+	free(obj);
+}
+
+/**
+ * @brief Call epoch_collect() often enough to advance the epoch several times if nothing holds it.
+ */
+void collect_many()
+{
+	int i;
+	for (i = 0; i < 5; i++)
+		epoch_collect();
+}
+
+
+/// Steps of the reader thread, driven by the test.
+pthread_mutex_t stepLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t stepCond = PTHREAD_COND_INITIALIZER;
+int readerStep = 0;
+int testStep = 0;
+
+/**
+ * @brief Wait until *step reaches value.
+ */
+void wait_step(int *step, int value)
+{
+	pthread_mutex_lock(&stepLock);
+	while (*step < value)
+		pthread_cond_wait(&stepCond, &stepLock);
+	pthread_mutex_unlock(&stepLock);
+}
+
+/**
+ * @brief Set *step to value.
+ */
+void set_step(int *step, int value)
+{
+	pthread_mutex_lock(&stepLock);
+	*step = value;
+	pthread_cond_broadcast(&stepCond);
+	pthread_mutex_unlock(&stepLock);
+}
+
+/**
+ * @brief Thread function of a reader that enters the epoch (twice if arg is set) and leaves when told.
+ */
+void* hold_epoch(void *arg)
+{
+	int nested = (arg != NULL);
+	epoch_enter();
+	if (nested) {
+		epoch_enter();
+		epoch_exit();
+	}
+	set_step(&readerStep, 1);
+	wait_step(&testStep, 1);
+	epoch_exit();
+	set_step(&readerStep, 2);
+	wait_step(&testStep, 2);
+	epoch_thread_exit();
+	return NULL;
+}
+
+
+/*
+ * Retire tests:
+ * 	retire with no reader (destroyed after collection)
+ * 	retire while a reader is inside an epoch (kept until it leaves)
+ * 	nested enter, left once (still kept)
+ */
+
+START_TEST (test_retire_noreader)
+{
+	object obj;
+	memset(&obj, 0, sizeof obj);
+	epoch_retire(&obj.entry, mark_destroyed);
+	fail_unless(obj.destroyed == 0, "Object destroyed on retire.");
+	collect_many();
+	fail_unless(obj.destroyed == 1, "Object not destroyed with no reader.");
+}
+END_TEST
+
+void check_reader_holds(int nested)
+{
+	object obj;
+	memset(&obj, 0, sizeof obj);
+	pthread_t reader;
+	fail_unless(pthread_create(&reader, NULL, hold_epoch, nested ? &obj : NULL) == 0, "Error starting a thread.");
+	wait_step(&readerStep, 1);
+
+	epoch_retire(&obj.entry, mark_destroyed);
+	collect_many();
+	fail_unless(obj.destroyed == 0, "Object destroyed while a reader is inside an epoch.");
+
+	set_step(&testStep, 1);
+	wait_step(&readerStep, 2);
+	collect_many();
+	fail_unless(obj.destroyed == 1, "Object not destroyed after the reader left.");
+
+	set_step(&testStep, 2);
+	pthread_join(reader, NULL);
+}
+
+START_TEST (test_retire_reader)
+{
+	check_reader_holds(0);
+}
+END_TEST
+
+START_TEST (test_retire_nested)
+{
+	check_reader_holds(1);
+}
+END_TEST
+
+
+/*
+ * Thread exit tests:
+ * 	garbage of an exited thread is destroyed by another (pass)
+ */
+
+/**
+ * @brief Thread function that retires an object and exits.
+ */
+void* retire_exit(void *arg)
+{
+	epoch_retire(&((object*)arg)->entry, mark_destroyed);
+	epoch_thread_exit();
+	return NULL;
+}
+
+START_TEST (test_exit_orphans)
+{
+	object obj;
+	memset(&obj, 0, sizeof obj);
+	pthread_t thread;
+	fail_unless(pthread_create(&thread, NULL, retire_exit, &obj) == 0, "Error starting a thread.");
+	pthread_join(thread, NULL);
+	fail_unless(obj.destroyed == 0, "Object destroyed on retire.");
+	collect_many();
+	fail_unless(obj.destroyed == 1, "Garbage of an exited thread not destroyed.");
+}
+END_TEST
+
+
+/*
+ * Stress tests:
+ * 	readers never see a freed object while a writer replaces it (pass)
+ */
+
+/// The shared object of the stress test.
+object *shared = NULL;
+int stop = 0;
+
+/**
+ * @brief Thread function of a reader of the shared object.
+ */
+void* read_shared(void *arg)
+{
+	int bad = 0;
+	while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE)) {
+		epoch_enter();
+		object *obj = __atomic_load_n(&shared, __ATOMIC_ACQUIRE);
+		if (obj->value != LIVE)
+			bad++;
+		epoch_exit();
+	}
+	epoch_thread_exit();
+	return (void*)(intptr_t)bad;
+}
+
+START_TEST (test_stress_swap)
+{
+	shared = malloc(sizeof(object));
+	shared->value = LIVE;
+	pthread_t readers[NUMREADERS];
+	int i;
+	for (i = 0; i < NUMREADERS; i++)
+		fail_unless(pthread_create(&readers[i], NULL, read_shared, NULL) == 0, "Error starting a thread.");
+
+	for (i = 0; i < NUMSWAPS; i++) {
+		object *obj = malloc(sizeof(object));
+		fail_unless(obj != NULL, "Out of memory.");
+		obj->value = LIVE;
+		object *old = __atomic_exchange_n(&shared, obj, __ATOMIC_ACQ_REL);
+		epoch_retire(&old->entry, poison_free);
+	}
+	__atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+
+	int bad = 0;
+	for (i = 0; i < NUMREADERS; i++) {
+		void *ret;
+		pthread_join(readers[i], &ret);
+		bad += (int)(intptr_t)ret;
+	}
+	fail_unless(bad == 0, "A reader saw a freed object.");
+	collect_many();
+	free(shared);
+}
+END_TEST
+
+
+int main(int argc, char *argv[])
+{
+	Suite *s = suite_create("epoch");
+	TCase *tc;
+
+	// Retire tests
+	tc = tcase_create("retire");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_test(tc, test_retire_noreader);
+	tcase_add_test(tc, test_retire_reader);
+	tcase_add_test(tc, test_retire_nested);
+	suite_add_tcase(s, tc);
+
+	// Thread exit tests
+	tc = tcase_create("exit");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_test(tc, test_exit_orphans);
+	suite_add_tcase(s, tc);
+
+	// Stress tests
+	tc = tcase_create("stress");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_test(tc, test_stress_swap);
+	suite_add_tcase(s, tc);
+
+	SRunner *sr = srunner_create(s);
+	srunner_set_log(sr, "results.log");
+	srunner_run_all(sr, CK_ENV);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <check.h>
+#include "hashmap.h"
+
+#define TESTTIMEOUT	10		// How long to wait for each test to run.
+#define NUMKEYS		20000		// Keys in the map, enough for several bucket segments.
+#define NUMTHREADS	4		// Threads updating the map at once.
+#define SLICEBITS	3		// Bits of the slice numbers in the slice tests.
+
+/**
+ * @brief A key node, as a table would embed it.
+ */
+typedef struct {
+	hm_node node;
+	char key[16];
+	int retired;
+} item;
+
+/// Map used by test fixture.
+hashmap test_map;
+
+/// Items used by test fixture, item i has key "key<i>".
+item *test_items = NULL;
+
+/// Number of nodes handed to the retire function.
+int test_retired = 0;
+
+/**
+ * @brief Retire function of the map: count the node, which is never freed here.
+ */
+void count_retired(hm_node *node, void *arg)
+{
+	item *it = (item*)node;
+	__atomic_add_fetch(&it->retired, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch((int*)arg, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Text fixture setup.  Create an empty map and the items.
+ */
+void test_setup()
+{
+	hm_init(&test_map, count_retired, &test_retired);
+	test_items = calloc(NUMKEYS, sizeof(item));
+	fail_unless(test_items != NULL, "Out of memory.");
+	int i;
+	for (i = 0; i < NUMKEYS; i++) {
+		snprintf(test_items[i].key, sizeof test_items[i].key, "key%d", i);
+		test_items[i].node.key = test_items[i].key;
+	}
+	test_retired = 0;
+}
+
+/**
+ * @brief Text fixture setup.  Create a map holding every item.
+ */
+void test_setup_populate()
+{
+	test_setup();
+	int i;
+	for (i = 0; i < NUMKEYS; i++)
+		fail_unless(hm_insert(&test_map, &test_items[i].node) == &test_items[i].node, "Error inserting a key.");
+}
+
+/**
+ * @brief Text fixture teardown.
+ */
+void test_teardown()
+{
+	free(test_items);
+}
+
+/**
+ * @brief Thread function inserting, or removing, every NUMTHREADS-th item.
+ * @param arg The first item, as an intptr_t, with the remove flag in bit 16.
+ */
+void* update_items(void *arg)
+{
+	int first = (int)((intptr_t)arg & 0xffff);
+	int remove = (int)((intptr_t)arg >> 16);
+	int i;
+	for (i = first; i < NUMKEYS; i += NUMTHREADS) {
+		if (remove)
+			fail_unless(hm_remove(&test_map, &test_items[i].node) == 0, "Error removing a key.");
+		else
+			fail_unless(hm_insert(&test_map, &test_items[i].node) == &test_items[i].node, "Error inserting a key.");
+	}
+	return NULL;
+}
+
+/**
+ * @brief Run update_items() on NUMTHREADS threads at once.
+ */
+void update_concurrently(int remove)
+{
+	pthread_t threads[NUMTHREADS];
+	int i;
+	for (i = 0; i < NUMTHREADS; i++)
+		fail_unless(pthread_create(&threads[i], NULL, update_items, (void*)(intptr_t)(i | (remove << 16))) == 0,
+			"Error starting a thread.");
+	for (i = 0; i < NUMTHREADS; i++)
+		pthread_join(threads[i], NULL);
+}
+
+
+/*
+ * Insert tests:
+ * 	insert and find keys (pass)
+ * 	insert a key already in the map (returns the node already there)
+ * 	insert from several threads at once (pass, every key found once)
+ */
+
+START_TEST (test_insert_find)
+{
+	fail_unless(hm_find(&test_map, "key0") == NULL, "Found a key in an empty map.");
+	fail_unless(hm_insert(&test_map, &test_items[0].node) == &test_items[0].node, "Error inserting a key.");
+	fail_unless(hm_insert(&test_map, &test_items[1].node) == &test_items[1].node, "Error inserting a key.");
+	fail_unless(hm_find(&test_map, "key0") == &test_items[0].node, "Didn't find a key inserted.");
+	fail_unless(hm_find(&test_map, "key1") == &test_items[1].node, "Didn't find a key inserted.");
+	fail_unless(hm_find(&test_map, "key2") == NULL, "Found a key never inserted.");
+	fail_unless(hm_count(&test_map) == 2, "Wrong number of keys.");
+}
+END_TEST
+
+START_TEST (test_insert_duplicate)
+{
+	item dup;
+	memset(&dup, 0, sizeof dup);
+	strcpy(dup.key, "key0");
+	dup.node.key = dup.key;
+	fail_unless(hm_insert(&test_map, &test_items[0].node) == &test_items[0].node, "Error inserting a key.");
+	fail_unless(hm_insert(&test_map, &dup.node) == &test_items[0].node, "Insert of a duplicate key didn't return the node there.");
+	fail_unless(hm_count(&test_map) == 1, "Wrong number of keys.");
+}
+END_TEST
+
+START_TEST (test_insert_concurrent)
+{
+	update_concurrently(0);
+	fail_unless(hm_count(&test_map) == NUMKEYS, "Wrong number of keys.");
+	int i;
+	for (i = 0; i < NUMKEYS; i++)
+		fail_unless(hm_find(&test_map, test_items[i].key) == &test_items[i].node, "Didn't find a key inserted.");
+
+	// Iteration returns each key once
+	int seen = 0;
+	hm_node *node;
+	for (node = hm_first(&test_map); node != NULL; node = hm_next(node)) {
+		item *it = (item*)node;
+		fail_unless(it->retired == 0, "Iteration returned a key twice.");
+		it->retired = 1;
+		seen++;
+	}
+	fail_unless(seen == NUMKEYS, "Iteration missed keys.");
+}
+END_TEST
+
+
+/*
+ * Remove tests:
+ * 	remove a key, and remove it again (fail)
+ * 	remove from several threads at once (pass, every node retired once)
+ */
+
+START_TEST (test_remove_twice)
+{
+	fail_unless(hm_remove(&test_map, &test_items[7].node) == 0, "Error removing a key.");
+	fail_unless(hm_find(&test_map, "key7") == NULL, "Found a key removed.");
+	fail_unless(hm_remove(&test_map, &test_items[7].node) == -1, "Removing a key twice should fail.");
+	fail_unless(test_items[7].retired == 1, "A removed key wasn't retired once.");
+	fail_unless(hm_count(&test_map) == NUMKEYS - 1, "Wrong number of keys.");
+	fail_unless(hm_find(&test_map, "key8") == &test_items[8].node, "Lost a key next to the one removed.");
+}
+END_TEST
+
+START_TEST (test_remove_concurrent)
+{
+	update_concurrently(1);
+	fail_unless(hm_count(&test_map) == 0, "Keys left after removing all.");
+	fail_unless(hm_first(&test_map) == NULL, "Iteration found a key in an empty map.");
+	fail_unless(test_retired == NUMKEYS, "Wrong number of keys retired.");
+	int i;
+	for (i = 0; i < NUMKEYS; i++)
+		fail_unless(test_items[i].retired == 1, "A removed key wasn't retired once.");
+}
+END_TEST
+
+
+/*
+ * Slice tests:
+ * 	the slices together return every key once, each in its own slice (pass)
+ * 	0 bits is the whole map (pass)
+ */
+
+START_TEST (test_slice_cover)
+{
+	int seen = 0;
+	unsigned slice;
+	for (slice = 0; slice < (1u << SLICEBITS); slice++) {
+		hm_node *node;
+		for (node = hm_slice_first(&test_map, slice, SLICEBITS); node != NULL; node = hm_slice_next(node, SLICEBITS)) {
+			item *it = (item*)node;
+			fail_unless(hm_slice_of(it->key, SLICEBITS) == slice, "Key iterated in the wrong slice.");
+			fail_unless(it->retired == 0, "Key iterated in two slices.");
+			it->retired = 1;
+			seen++;
+		}
+	}
+	fail_unless(seen == NUMKEYS, "Slices missed keys.");
+}
+END_TEST
+
+START_TEST (test_slice_whole)
+{
+	int seen = 0;
+	hm_node *node;
+	for (node = hm_slice_first(&test_map, 0, 0); node != NULL; node = hm_slice_next(node, 0))
+		seen++;
+	fail_unless(seen == NUMKEYS, "Slice of 0 bits isn't the whole map.");
+}
+END_TEST
+
+
+int main(int argc, char *argv[])
+{
+	Suite *s = suite_create("hashmap");
+	TCase *tc;
+
+	// Insert tests
+	tc = tcase_create("insert");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup, test_teardown);
+	tcase_add_test(tc, test_insert_find);
+	tcase_add_test(tc, test_insert_duplicate);
+	tcase_add_test(tc, test_insert_concurrent);
+	suite_add_tcase(s, tc);
+
+	// Remove tests
+	tc = tcase_create("remove");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_populate, test_teardown);
+	tcase_add_test(tc, test_remove_twice);
+	tcase_add_test(tc, test_remove_concurrent);
+	suite_add_tcase(s, tc);
+
+	// Slice tests
+	tc = tcase_create("slice");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_populate, test_teardown);
+	tcase_add_test(tc, test_slice_cover);
+	tcase_add_test(tc, test_slice_whole);
+	suite_add_tcase(s, tc);
+
+	SRunner *sr = srunner_create(s);
+	srunner_set_log(sr, "results.log");
+	srunner_run_all(sr, CK_ENV);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
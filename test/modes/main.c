@@ -0,0 +1,440 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <check.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include "storage.h"
+
+#define TESTTIMEOUT	10		// How long to wait for each test to run.
+#define SERVEREXEC	"./server"	// Server executable file.
+#define SERVEROUT	"default.serverout"	// File where the server's output is stored.
+#define SERVEROUT_MODE	0666		// Permissions of the server ouptut file.
+#define PROCESSES_CONF	"conf-processes.conf"	// Server configuration file running two processes.
+#define CORES_CONF	"conf-cores.conf"	// Server configuration file running four executors.
+#define NUMCORES	4		// Executors, as in the config file.
+#define WORKERS_CONF	"conf-workers.conf"	// Server configuration file running four worker threads.
+#define NUMWORKERS	4		// Worker threads, as in the config file.
+#define PIPELINED	20000		// Commands a client sends without reading their replies.
+#define REPLYTIMEOUT	5000		// Milliseconds to wait for more replies.
+#define NUMKEYS		100		// Keys stored by the tests.
+#define MAXQUERYKEYS	10		// Keys a query copies out.
+
+// These settings should correspond to what's in the config file.
+#define SERVERHOST	"localhost"	// The hostname where the server is running.
+#define SERVERPORT	4848		// The port where the server is running.
+#define SERVERUSERNAME	"admin"		// The server username
+#define SERVERPASSWORD	"dog4sale"	// The server password
+#define SERVERENCRYPTED	"xxxnq.BMCifhU"	// The server password as sent in AUTH.
+#define THREECOLSTABLE	"threecols"	// A table with three columns.
+
+/* Server port used by test */
+int server_port;
+
+/**
+ * @brief Start the storage server.
+ *
+ * @param config_file The configuration file the server should use.
+ * @param serverout_file File where server output is stored.
+ * @return Return server process id on success, or -1 otherwise.
+ */
+int start_server(char *config_file, const char *serverout_file)
+{
+	pid_t childpid = fork();
+	if (childpid < 0) {
+		// Failed to create child.
+		return -1;
+	} else if (childpid == 0) {
+		// The child.
+
+		// Redirect stdout and stderr to a file.
+		const char *outfile = serverout_file == NULL ? SERVEROUT : serverout_file;
+		int outfd = open(outfile, O_CREAT|O_WRONLY|O_TRUNC, SERVEROUT_MODE);
+		close(STDOUT_FILENO);
+		close(STDERR_FILENO);
+		if (dup2(outfd, STDOUT_FILENO) < 0 || dup2(outfd, STDERR_FILENO) < 0) {
+			perror("dup2 error");
+			return -1;
+		}
+
+		// Start the server
+		execl(SERVEREXEC, SERVEREXEC, config_file, NULL);
+
+		// Should never get here.
+		perror("Couldn't start server");
+		exit(EXIT_FAILURE);
+	} else {
+		// The parent.
+
+		// If the child terminates quickly, then there was probably a
+		// problem running the server (e.g., config file not found).
+		sleep(1);
+		int pid = waitpid(childpid, NULL, WNOHANG);
+		if (pid == childpid)
+			return -1; // Probably a problem starting the server.
+		else
+			return childpid; // Probably ok.
+	}
+}
+
+/**
+ * @brief Connect to the server and authenticate.
+ * @return A connection to the server if successful.
+ */
+void* connect_auth()
+{
+	void *conn = storage_connect(SERVERHOST, server_port);
+	fail_unless(conn != NULL, "Couldn't connect to server.");
+
+	int status = storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn);
+	fail_unless(status == 0, "Authentication failed.");
+
+	return conn;
+}
+
+
+/// Connection used by test fixture.
+void *test_conn = NULL;
+
+/// Server started by test fixture.
+int test_serverpid = -1;
+
+/**
+ * @brief Start the server with the given configuration and store NUMKEYS keys.
+ */
+void setup_mode(char *config_file)
+{
+	test_serverpid = start_server(config_file, "modes.serverout");
+	fail_unless(test_serverpid > 0, "Server didn't run properly.");
+	test_conn = connect_auth();
+
+	int i;
+	for (i = 0; i < NUMKEYS; i++) {
+		char key[MAX_KEY_LEN];
+		struct storage_record record;
+		memset(&record, 0, sizeof record);
+		snprintf(key, sizeof key, "key%d", i);
+		snprintf(record.value, sizeof record.value, "col1 %d,col2 0,col3 abc", i);
+		fail_unless(storage_set(THREECOLSTABLE, key, &record, test_conn) == 0, "Error setting a key/value pair.");
+	}
+}
+
+/**
+ * @brief Text fixture setup.  Start the server as two processes that own half of the keys each.
+ */
+void test_setup_processes()
+{
+	setup_mode(PROCESSES_CONF);
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with four executors that own a slice of the keys each.
+ */
+void test_setup_cores()
+{
+	setup_mode(CORES_CONF);
+}
+
+/**
+ * @brief Text fixture setup.  Start the server with the commands of every connection run by four worker threads.
+ */
+void test_setup_workers()
+{
+	setup_mode(WORKERS_CONF);
+}
+
+/**
+ * @brief Text fixture teardown.  Disconnect from the server and stop it.
+ */
+void test_teardown()
+{
+	storage_disconnect(test_conn);
+	kill(test_serverpid, SIGKILL);
+	waitpid(test_serverpid, NULL, 0);
+}
+
+
+/**
+ * @brief Get key i and check its first column.
+ * @return Return the value of col1, or -1 if the get failed.
+ */
+int get_col1(int i, void *conn)
+{
+	char key[MAX_KEY_LEN];
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	snprintf(key, sizeof key, "key%d", i);
+	int col1 = -1;
+	if (storage_get(THREECOLSTABLE, key, &record, conn) != 0)
+		return -1;
+	fail_unless(sscanf(record.value, "col1 %d", &col1) == 1, "Got wrong value.");
+	return col1;
+}
+
+/**
+ * @brief Read a number from the statistics of the server.
+ * @param name The statistic, such as "forwarded".
+ * @return The number, or -1 if the server didn't report it.
+ */
+long stat_value(const char *name)
+{
+	char stats[4096], pattern[64];
+	int status = storage_stats(stats, sizeof stats, test_conn);
+	fail_unless(status == 0, "Error getting statistics.");
+	snprintf(pattern, sizeof pattern, ",%s ", name);
+	char *at = strstr(stats, pattern);
+	return (at == NULL) ? -1 : atol(at + strlen(pattern));
+}
+
+
+/*
+ * Tests run in every mode:
+ * 	get of every key stored (pass)
+ * 	set and delete of every key (pass)
+ * 	query matching keys of every partition or slice (pass, matches merged)
+ * 	get, set and query of an unknown table (fail)
+ */
+
+START_TEST (test_mode_get)
+{
+	int i;
+	for (i = 0; i < NUMKEYS; i++)
+		fail_unless(get_col1(i, test_conn) == i, "Key stored not found.");
+}
+END_TEST
+
+START_TEST (test_mode_set)
+{
+	int i;
+	for (i = 0; i < NUMKEYS; i++) {
+		char key[MAX_KEY_LEN];
+		struct storage_record record;
+		memset(&record, 0, sizeof record);
+		snprintf(key, sizeof key, "key%d", i);
+		snprintf(record.value, sizeof record.value, "col1 %d,col2 1,col3 xyz", NUMKEYS + i);
+		record.metadata[0] = 1;
+		fail_unless(storage_set(THREECOLSTABLE, key, &record, test_conn) == 0, "Error updating a key/value pair.");
+		fail_unless(get_col1(i, test_conn) == NUMKEYS + i, "Update not seen.");
+		fail_unless(storage_set(THREECOLSTABLE, key, NULL, test_conn) == 0, "Error deleting a key.");
+		fail_unless(get_col1(i, test_conn) == -1 && errno == ERR_KEY_NOT_FOUND, "Deleted key still there.");
+	}
+}
+END_TEST
+
+START_TEST (test_mode_query)
+{
+	char *keys[MAXQUERYKEYS];
+	int i;
+	for (i = 0; i < MAXQUERYKEYS; i++)
+		keys[i] = calloc(MAX_KEY_LEN, 1);
+	int matches = storage_query(THREECOLSTABLE, "col1 < 50", keys, MAXQUERYKEYS, test_conn);
+	fail_unless(matches == 50, "Matches not merged.");
+	for (i = 0; i < MAXQUERYKEYS; i++) {
+		int n = -1;
+		fail_unless(sscanf(keys[i], "key%d", &n) == 1 && n >= 0 && n < 50, "Query returned a key that doesn't match.");
+		free(keys[i]);
+	}
+}
+END_TEST
+
+START_TEST (test_mode_badtable)
+{
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	strncpy(record.value, "col1 1,col2 2,col3 abc", sizeof record.value);
+	int i;
+	// Whichever process or core owns the key, the table is checked first
+	for (i = 0; i < 4; i++) {
+		char key[MAX_KEY_LEN];
+		snprintf(key, sizeof key, "key%d", i);
+		fail_unless(storage_get("badtable", key, &record, test_conn) == -1 && errno == ERR_TABLE_NOT_FOUND,
+				"storage_get of an unknown table not setting errno properly.");
+		fail_unless(storage_set("badtable", key, &record, test_conn) == -1 && errno == ERR_TABLE_NOT_FOUND,
+				"storage_set of an unknown table not setting errno properly.");
+	}
+	char *keys[1];
+	char key[MAX_KEY_LEN];
+	keys[0] = key;
+	fail_unless(storage_query("badtable", "col1 < 50", keys, 1, test_conn) == -1 && errno == ERR_TABLE_NOT_FOUND,
+			"storage_query of an unknown table not setting errno properly.");
+	fail_unless(get_col1(0, test_conn) == 0, "The server stopped serving after the errors.");
+}
+END_TEST
+
+
+/*
+ * Processes tests:
+ * 	keys owned by the other process (pass, forwarded)
+ */
+
+START_TEST (test_processes_forward)
+{
+	fail_unless(stat_value("partitions") == 2, "Server not running as two processes.");
+	fail_unless(stat_value("forwarded") > 0, "No key forwarded to the other process.");
+}
+END_TEST
+
+
+/*
+ * Cores tests:
+ * 	keys of every slice (pass, each executor ran some)
+ */
+
+START_TEST (test_cores_slices)
+{
+	fail_unless(stat_value("cores") == NUMCORES, "Server not running its executors.");
+	int i;
+	for (i = 0; i < NUMCORES; i++) {
+		char name[32];
+		snprintf(name, sizeof name, "core%d_tasks", i);
+		fail_unless(stat_value(name) > 0, "An executor ran no command, its slice got no key.");
+	}
+}
+END_TEST
+
+
+/*
+ * Workers tests:
+ * 	client sending commands without reading the replies (pass, other clients still served, replies in order)
+ */
+
+/**
+ * @brief Open a socket to the server and authenticate on it, to pipeline commands the library would wait on.
+ * @return Return the socket.
+ */
+int connect_raw()
+{
+	struct addrinfo hints, *res;
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	char port[MAX_PORT_LEN];
+	snprintf(port, sizeof port, "%d", server_port);
+	fail_unless(getaddrinfo(SERVERHOST, port, &hints, &res) == 0, "Couldn't resolve the server.");
+	int sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	fail_unless(connect(sock, res->ai_addr, res->ai_addrlen) == 0, "Couldn't connect to server.");
+	freeaddrinfo(res);
+
+	const char *auth = "AUTH," SERVERUSERNAME "," SERVERENCRYPTED "\n";
+	fail_unless(send(sock, auth, strlen(auth), MSG_NOSIGNAL) == (ssize_t)strlen(auth), "Couldn't authenticate.");
+	char reply[4];
+	fail_unless(recv(sock, reply, 4, MSG_WAITALL) == 4 && strncmp(reply, "1,0", 3) == 0, "Authentication failed.");
+	// The rest of the reply, the session token, up to its newline
+	char c = reply[3];
+	while (c != '\n')
+		fail_unless(recv(sock, &c, 1, 0) == 1, "Authentication failed.");
+	return sock;
+}
+
+START_TEST (test_workers_pipelined)
+{
+	fail_unless(stat_value("workers") == NUMWORKERS, "Server not running its workers.");
+	int sock = connect_raw();
+	size_t len = 0, cap = PIPELINED * 32;
+	char *cmds = malloc(cap);
+	int i;
+	for (i = 0; i < PIPELINED; i++)
+		len += snprintf(cmds + len, cap - len, "GET,%s,key%d\n", THREECOLSTABLE, i % NUMKEYS);
+
+	// Sent until the server stops taking them, with none of the replies read
+	size_t sent = 0;
+	ssize_t n;
+	while (sent < len && (n = send(sock, cmds + sent, len - sent, MSG_DONTWAIT | MSG_NOSIGNAL)) > 0)
+		sent += n;
+	usleep(200000);
+	fail_unless(get_col1(1, test_conn) == 1, "Other connection not served while a client doesn't read.");
+
+	// Every reply comes once read, in order, while the rest of the commands go out
+	char buf[4096], line[128];
+	size_t lineLen = 0;
+	int replies = 0;
+	while (replies < PIPELINED) {
+		struct pollfd p = { sock, POLLIN | ((sent < len) ? POLLOUT : 0), 0 };
+		fail_unless(poll(&p, 1, REPLYTIMEOUT) > 0, "Replies stopped coming.");
+		if ((p.revents & POLLOUT) && (n = send(sock, cmds + sent, len - sent, MSG_DONTWAIT | MSG_NOSIGNAL)) > 0)
+			sent += n;
+		if (!(p.revents & POLLIN))
+			continue;
+		n = recv(sock, buf, sizeof buf, 0);
+		fail_unless(n > 0, "Connection closed before every reply came.");
+		for (i = 0; i < n; i++) {
+			if (buf[i] != '\n') {
+				if (lineLen < sizeof line - 1)
+					line[lineLen++] = buf[i];
+				continue;
+			}
+			line[lineLen] = '\0';
+			lineLen = 0;
+			int col1 = -1;
+			fail_unless(sscanf(line, "1,0,%*d,col1 %d", &col1) == 1 && col1 == replies % NUMKEYS, "Wrong reply, or replies out of order.");
+			replies++;
+		}
+	}
+	close(sock);
+	free(cmds);
+}
+END_TEST
+
+
+/**
+ * @brief Add the tests run in every mode to a test case.
+ */
+void add_mode_tests(TCase *tc)
+{
+	tcase_add_test(tc, test_mode_get);
+	tcase_add_test(tc, test_mode_set);
+	tcase_add_test(tc, test_mode_query);
+	tcase_add_test(tc, test_mode_badtable);
+}
+
+
+int main(int argc, char *argv[])
+{
+	if(argc == 2)
+		server_port = atoi(argv[1]);
+	else
+		server_port = SERVERPORT;
+	printf("Using server port: %d.\n", server_port);
+	Suite *s = suite_create("modes");
+	TCase *tc;
+
+	// Processes tests
+	tc = tcase_create("processes");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_processes, test_teardown);
+	add_mode_tests(tc);
+	tcase_add_test(tc, test_processes_forward);
+	suite_add_tcase(s, tc);
+
+	// Cores tests
+	tc = tcase_create("cores");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_cores, test_teardown);
+	add_mode_tests(tc);
+	tcase_add_test(tc, test_cores_slices);
+	suite_add_tcase(s, tc);
+
+	// Workers tests
+	tc = tcase_create("workers");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_workers, test_teardown);
+	add_mode_tests(tc);
+	tcase_add_test(tc, test_workers_pipelined);
+	suite_add_tcase(s, tc);
+
+	SRunner *sr = srunner_create(s);
+	srunner_set_log(sr, "results.log");
+	srunner_run_all(sr, CK_ENV);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,322 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <check.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include "storage.h"
+
+#define TESTTIMEOUT	20		// How long to wait for each test to run.
+#define SERVEREXEC	"./server"	// Server executable file.
+#define SERVEROUT	"default.serverout"	// File where the server's output is stored.
+#define SERVEROUT_MODE	0666		// Permissions of the server ouptut file.
+#define PRIMARY_CONF	"primary.conf"	// Configuration file of the primary.
+#define REPLICA_CONF	"replica.conf"	// Configuration file of the replica, which follows the primary.
+#define WAITTRIES	100		// How many times to look for a write on the replica.
+#define WAITUSECS	50000		// How long to wait between two looks.
+#define KEY1		"somekey1"	// A key used in the test cases.
+#define KEY2		"somekey2"	// A key used in the test cases.
+
+// These settings should correspond to what's in the config file.
+#define SERVERHOST	"localhost"	// The hostname where the server is running.
+#define SERVERPORT	4848		// The port where the primary is running.
+#define REPLICAPORT	4849		// The port where the replica is running.
+#define SERVERUSERNAME	"admin"		// The server username
+#define SERVERPASSWORD	"dog4sale"	// The server password
+#define THREECOLSTABLE	"threecols"	// A table with three columns.
+
+/* Server ports used by test */
+int server_port;
+int replica_port;
+
+/**
+ * @brief Start the storage server.
+ *
+ * @param config_file The configuration file the server should use.
+ * @param serverout_file File where server output is stored.
+ * @return Return server process id on success, or -1 otherwise.
+ */
+int start_server(char *config_file, const char *serverout_file)
+{
+	pid_t childpid = fork();
+	if (childpid < 0) {
+		// Failed to create child.
+		return -1;
+	} else if (childpid == 0) {
+		// The child.
+
+		// Redirect stdout and stderr to a file.
+		const char *outfile = serverout_file == NULL ? SERVEROUT : serverout_file;
+		int outfd = open(outfile, O_CREAT|O_WRONLY|O_TRUNC, SERVEROUT_MODE);
+		close(STDOUT_FILENO);
+		close(STDERR_FILENO);
+		if (dup2(outfd, STDOUT_FILENO) < 0 || dup2(outfd, STDERR_FILENO) < 0) {
+			perror("dup2 error");
+			return -1;
+		}
+
+		// Start the server
+		execl(SERVEREXEC, SERVEREXEC, config_file, NULL);
+
+		// Should never get here.
+		perror("Couldn't start server");
+		exit(EXIT_FAILURE);
+	} else {
+		// The parent.
+
+		// If the child terminates quickly, then there was probably a
+		// problem running the server (e.g., config file not found).
+		sleep(1);
+		int pid = waitpid(childpid, NULL, WNOHANG);
+		if (pid == childpid)
+			return -1; // Probably a problem starting the server.
+		else
+			return childpid; // Probably ok.
+	}
+}
+
+/**
+ * @brief Connect to a server and authenticate.
+ * @param port The port of the server.
+ * @return A connection to the server if successful.
+ */
+void* connect_auth(int port)
+{
+	void *conn = storage_connect(SERVERHOST, port);
+	fail_unless(conn != NULL, "Couldn't connect to server.");
+
+	int status = storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn);
+	fail_unless(status == 0, "Authentication failed.");
+
+	return conn;
+}
+
+
+/// Connections used by test fixture.
+void *test_conn = NULL;
+void *replica_conn = NULL;
+
+/// Servers started by test fixture.
+int test_serverpid = -1;
+int replica_serverpid = -1;
+
+/**
+ * @brief Get a record and check its first column.
+ * @return The value of col1, or -1 if the get failed.
+ */
+int get_col1(const char *key, void *conn)
+{
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	int col1 = -1;
+	if (storage_get(THREECOLSTABLE, key, &record, conn) != 0)
+		return -1;
+	fail_unless(sscanf(record.value, "col1 %d", &col1) == 1, "Got wrong value.");
+	return col1;
+}
+
+/**
+ * @brief Wait until the replica serves a key with the given first column.
+ * @param col1 The value of col1 to wait for, or -1 to wait until the key is gone.
+ * @return Return 0 once it does, -1 if it still does not after WAITTRIES looks.
+ */
+int wait_col1(const char *key, int col1)
+{
+	int i;
+	for (i = 0; i < WAITTRIES; i++) {
+		if (get_col1(key, replica_conn) == col1)
+			return 0;
+		usleep(WAITUSECS);
+	}
+	return -1;
+}
+
+/**
+ * @brief Set a key on the primary.
+ * @return Return 0 on success, -1 otherwise.
+ */
+int set_key(const char *key, const char *value, void *conn)
+{
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	strncpy(record.value, value, sizeof record.value);
+	return storage_set(THREECOLSTABLE, key, &record, conn);
+}
+
+/**
+ * @brief Text fixture setup.  Start the primary and the replica, and store two records that reach the replica.
+ */
+void test_setup_replica()
+{
+	test_serverpid = start_server(PRIMARY_CONF, "primary.serverout");
+	fail_unless(test_serverpid > 0, "Primary didn't run properly.");
+	replica_serverpid = start_server(REPLICA_CONF, "replica.serverout");
+	fail_unless(replica_serverpid > 0, "Replica didn't run properly.");
+	test_conn = connect_auth(server_port);
+	replica_conn = connect_auth(replica_port);
+
+	fail_unless(set_key(KEY1, "col1 1,col2 2,col3 abc", test_conn) == 0, "Error setting a key/value pair.");
+	fail_unless(set_key(KEY2, "col1 3,col2 4,col3 def", test_conn) == 0, "Error setting a key/value pair.");
+	fail_unless(wait_col1(KEY1, 1) == 0 && wait_col1(KEY2, 3) == 0, "Records didn't reach the replica.");
+}
+
+/**
+ * @brief Text fixture teardown.  Disconnect from the servers and stop them.
+ */
+void test_teardown()
+{
+	storage_disconnect(replica_conn);
+	storage_disconnect(test_conn);
+	kill(replica_serverpid, SIGKILL);
+	waitpid(replica_serverpid, NULL, 0);
+	if (test_serverpid > 0) {
+		kill(test_serverpid, SIGKILL);
+		waitpid(test_serverpid, NULL, 0);
+	}
+}
+
+
+/*
+ * Follow tests:
+ * 	set on the primary (pass, replica gets it)
+ * 	delete on the primary (pass, replica drops it)
+ * 	transaction on the primary (pass, replica gets all of its writes)
+ */
+
+START_TEST (test_follow_set)
+{
+	fail_unless(set_key(KEY1, "col1 5,col2 6,col3 xyz", test_conn) == 0, "Error setting a key/value pair.");
+	fail_unless(wait_col1(KEY1, 5) == 0, "Set didn't reach the replica.");
+
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	int status = storage_get(THREECOLSTABLE, KEY1, &record, replica_conn);
+	fail_unless(status == 0, "Error getting a key from the replica.");
+	fail_unless(strcmp(record.value, "col1 5,col2 6,col3 xyz") == 0, "Replica got wrong value.");
+}
+END_TEST
+
+START_TEST (test_follow_delete)
+{
+	int status = storage_set(THREECOLSTABLE, KEY1, NULL, test_conn);
+	fail_unless(status == 0, "Error deleting a key.");
+	fail_unless(wait_col1(KEY1, -1) == 0, "Delete didn't reach the replica.");
+	fail_unless(errno == ERR_KEY_NOT_FOUND, "storage_get of a deleted key not setting errno properly.");
+}
+END_TEST
+
+START_TEST (test_follow_commit)
+{
+	int status = storage_begin(test_conn);
+	fail_unless(status == 0, "Error starting a transaction.");
+	fail_unless(set_key(KEY1, "col1 7,col2 7,col3 yyy", test_conn) == 0, "Error setting a key/value pair in a transaction.");
+	fail_unless(set_key(KEY2, "col1 8,col2 8,col3 zzz", test_conn) == 0, "Error setting a key/value pair in a transaction.");
+	status = storage_commit(test_conn);
+	fail_unless(status == 0, "Error committing a transaction.");
+
+	fail_unless(wait_col1(KEY2, 8) == 0, "Commit didn't reach the replica.");
+	fail_unless(get_col1(KEY1, replica_conn) == 7, "Replica applied part of a commit.");
+}
+END_TEST
+
+
+/*
+ * Read-only tests:
+ * 	set on the replica (fail, read only)
+ * 	replica statistics (pass, connected and lag reported)
+ */
+
+START_TEST (test_readonly_set)
+{
+	int status = set_key(KEY1, "col1 9,col2 9,col3 www", replica_conn);
+	fail_unless(status == -1, "storage_set on a replica should fail.");
+	fail_unless(errno == ERR_READ_ONLY, "storage_set on a replica not setting errno properly.");
+	fail_unless(get_col1(KEY1, test_conn) == 1, "Set on the replica reached the primary.");
+}
+END_TEST
+
+START_TEST (test_readonly_stats)
+{
+	char stats[4096];
+	int status = storage_stats(stats, sizeof stats, replica_conn);
+	fail_unless(status == 0, "Error getting statistics from the replica.");
+	fail_unless(strstr(stats, "replica_connected 1") != NULL, "Replica not reported connected.");
+	fail_unless(strstr(stats, "replica_lag_ms ") != NULL, "Replica lag not reported.");
+}
+END_TEST
+
+
+/*
+ * Resync tests:
+ * 	primary restarted without a key (pass, replica drops the key)
+ */
+
+START_TEST (test_resync_restart)
+{
+	storage_disconnect(test_conn);
+	kill(test_serverpid, SIGKILL);
+	waitpid(test_serverpid, NULL, 0);
+
+	// The new primary starts empty, so KEY1 is gone there
+	test_serverpid = start_server(PRIMARY_CONF, "restarted.serverout");
+	fail_unless(test_serverpid > 0, "Primary didn't run properly again.");
+	test_conn = connect_auth(server_port);
+	fail_unless(set_key(KEY2, "col1 6,col2 6,col3 vvv", test_conn) == 0, "Error setting a key/value pair.");
+
+	fail_unless(wait_col1(KEY2, 6) == 0, "Replica didn't follow the restarted primary.");
+	fail_unless(get_col1(KEY1, replica_conn) == -1, "Resync kept a key the primary no longer has.");
+	fail_unless(errno == ERR_KEY_NOT_FOUND, "storage_get of a dropped key not setting errno properly.");
+}
+END_TEST
+
+
+int main(int argc, char *argv[])
+{
+	if(argc == 3) {
+		server_port = atoi(argv[1]);
+		replica_port = atoi(argv[2]);
+	} else {
+		server_port = SERVERPORT;
+		replica_port = REPLICAPORT;
+	}
+	printf("Using server ports: %d, %d.\n", server_port, replica_port);
+	Suite *s = suite_create("replica");
+	TCase *tc;
+
+	// Follow tests
+	tc = tcase_create("follow");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_replica, test_teardown);
+	tcase_add_test(tc, test_follow_set);
+	tcase_add_test(tc, test_follow_delete);
+	tcase_add_test(tc, test_follow_commit);
+	suite_add_tcase(s, tc);
+
+	// Read-only tests
+	tc = tcase_create("readonly");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_replica, test_teardown);
+	tcase_add_test(tc, test_readonly_set);
+	tcase_add_test(tc, test_readonly_stats);
+	suite_add_tcase(s, tc);
+
+	// Resync tests
+	tc = tcase_create("resync");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_replica, test_teardown);
+	tcase_add_test(tc, test_resync_restart);
+	suite_add_tcase(s, tc);
+
+	SRunner *sr = srunner_create(s);
+	srunner_set_log(sr, "results.log");
+	srunner_run_all(sr, CK_ENV);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,288 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <check.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include "storage.h"
+
+#define TESTTIMEOUT	10		// How long to wait for each test to run.
+#define SERVEREXEC	"./server"	// Server executable file.
+#define SERVEROUT	"default.serverout"	// File where the server's output is stored.
+#define SERVEROUT_MODE	0666		// Permissions of the server ouptut file.
+#define SESSION_CONF	"conf-session.conf"	// Server configuration file whose session tokens expire soon.
+#define SESSIONTTL	4		// Seconds a token stays valid, as in the config file.
+#define BADTOKEN	"0123456789abcdef0123456789abcdef"	// A token the server never issued.
+#define KEY1		"somekey1"	// A key used in the test cases.
+
+// These settings should correspond to what's in the config file.
+#define SERVERHOST	"localhost"	// The hostname where the server is running.
+#define SERVERPORT	4848		// The port where the server is running.
+#define SERVERUSERNAME	"admin"		// The server username
+#define SERVERPASSWORD	"dog4sale"	// The server password
+#define THREECOLSTABLE	"threecols"	// A table with three columns.
+
+/* Server port used by test */
+int server_port;
+
+/**
+ * @brief Start the storage server.
+ *
+ * @param config_file The configuration file the server should use.
+ * @param serverout_file File where server output is stored.
+ * @return Return server process id on success, or -1 otherwise.
+ */
+int start_server(char *config_file, const char *serverout_file)
+{
+	pid_t childpid = fork();
+	if (childpid < 0) {
+		// Failed to create child.
+		return -1;
+	} else if (childpid == 0) {
+		// The child.
+
+		// Redirect stdout and stderr to a file.
+		const char *outfile = serverout_file == NULL ? SERVEROUT : serverout_file;
+		int outfd = open(outfile, O_CREAT|O_WRONLY|O_TRUNC, SERVEROUT_MODE);
+		close(STDOUT_FILENO);
+		close(STDERR_FILENO);
+		if (dup2(outfd, STDOUT_FILENO) < 0 || dup2(outfd, STDERR_FILENO) < 0) {
+			perror("dup2 error");
+			return -1;
+		}
+
+		// Start the server
+		execl(SERVEREXEC, SERVEREXEC, config_file, NULL);
+
+		// Should never get here.
+		perror("Couldn't start server");
+		exit(EXIT_FAILURE);
+	} else {
+		// The parent.
+
+		// If the child terminates quickly, then there was probably a
+		// problem running the server (e.g., config file not found).
+		sleep(1);
+		int pid = waitpid(childpid, NULL, WNOHANG);
+		if (pid == childpid)
+			return -1; // Probably a problem starting the server.
+		else
+			return childpid; // Probably ok.
+	}
+}
+
+/**
+ * @brief Connect to the server and authenticate.
+ * @return A connection to the server if successful.
+ */
+void* connect_auth()
+{
+	void *conn = storage_connect(SERVERHOST, server_port);
+	fail_unless(conn != NULL, "Couldn't connect to server.");
+
+	int status = storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn);
+	fail_unless(status == 0, "Authentication failed.");
+
+	return conn;
+}
+
+
+/// Connection used by test fixture.
+void *test_conn = NULL;
+
+/// Server started by test fixture.
+int test_serverpid = -1;
+
+/**
+ * @brief Text fixture setup.  Start the server, authenticate a connection and store a record.
+ */
+void test_setup_session()
+{
+	test_serverpid = start_server(SESSION_CONF, "session.serverout");
+	fail_unless(test_serverpid > 0, "Server didn't run properly.");
+	test_conn = connect_auth();
+
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	strncpy(record.value, "col1 1,col2 2,col3 abc", sizeof record.value);
+	int status = storage_set(THREECOLSTABLE, KEY1, &record, test_conn);
+	fail_unless(status == 0, "Error setting a key/value pair.");
+}
+
+/**
+ * @brief Text fixture teardown.  Disconnect from the server and stop it.
+ */
+void test_teardown()
+{
+	storage_disconnect(test_conn);
+	kill(test_serverpid, SIGKILL);
+	waitpid(test_serverpid, NULL, 0);
+}
+
+
+/**
+ * @brief Get the session token of test_conn.
+ */
+void get_token(char *token, int len)
+{
+	int ttl = storage_session(token, len, test_conn);
+	fail_unless(ttl > 0 && ttl <= SESSIONTTL, "Error getting the session token.");
+	fail_unless(strlen(token) == SESSION_TOKEN_LEN, "Session token of the wrong length.");
+}
+
+/**
+ * @brief Read a command count from the statistics of the server.
+ * @param name The statistic, such as "cmd_auth".
+ * @return The count, or -1 if the server didn't report it.
+ */
+long stat_count(const char *name, void *conn)
+{
+	char stats[4096], pattern[64];
+	int status = storage_stats(stats, sizeof stats, conn);
+	fail_unless(status == 0, "Error getting statistics.");
+	snprintf(pattern, sizeof pattern, "%s ", name);
+	char *at = stats;
+	while ((at = strstr(at, pattern)) != NULL && at != stats && at[-1] != ',')
+		at++;
+	return (at == NULL) ? -1 : atol(at + strlen(pattern));
+}
+
+
+/*
+ * Token tests:
+ * 	token of an authenticated connection (pass)
+ * 	resume another connection with it (pass, serves commands)
+ * 	token the server never issued (fail)
+ * 	token past its ttl (fail)
+ */
+
+START_TEST (test_token_issue)
+{
+	char token[SESSION_TOKEN_LEN + 1];
+	get_token(token, sizeof token);
+	int status = storage_session(token, SESSION_TOKEN_LEN, test_conn);
+	fail_unless(status == -1, "storage_session into a short buffer should fail.");
+	fail_unless(errno == ERR_INVALID_PARAM, "storage_session into a short buffer not setting errno properly.");
+}
+END_TEST
+
+START_TEST (test_token_resume)
+{
+	char token[SESSION_TOKEN_LEN + 1];
+	get_token(token, sizeof token);
+	void *other = storage_connect(SERVERHOST, server_port);
+	fail_unless(other != NULL, "Couldn't connect to server.");
+	int status = storage_resume(token, other);
+	fail_unless(status == 0, "Error resuming a session.");
+
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	status = storage_get(THREECOLSTABLE, KEY1, &record, other);
+	fail_unless(status == 0, "Resumed connection not authenticated.");
+	storage_disconnect(other);
+}
+END_TEST
+
+START_TEST (test_token_bad)
+{
+	void *other = storage_connect(SERVERHOST, server_port);
+	fail_unless(other != NULL, "Couldn't connect to server.");
+	int status = storage_resume(BADTOKEN, other);
+	fail_unless(status == -1, "storage_resume with a token never issued should fail.");
+	fail_unless(errno == ERR_AUTHENTICATION_FAILED, "storage_resume with a bad token not setting errno properly.");
+
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	status = storage_get(THREECOLSTABLE, KEY1, &record, other);
+	fail_unless(status == -1 && errno == ERR_NOT_AUTHENTICATED, "Bad token authenticated the connection.");
+	storage_disconnect(other);
+}
+END_TEST
+
+START_TEST (test_token_expired)
+{
+	char token[SESSION_TOKEN_LEN + 1];
+	get_token(token, sizeof token);
+	sleep(SESSIONTTL + 1);
+	void *other = storage_connect(SERVERHOST, server_port);
+	fail_unless(other != NULL, "Couldn't connect to server.");
+	int status = storage_resume(token, other);
+	fail_unless(status == -1, "storage_resume with an expired token should fail.");
+	fail_unless(errno == ERR_AUTHENTICATION_FAILED, "storage_resume with an expired token not setting errno properly.");
+	storage_disconnect(other);
+}
+END_TEST
+
+
+/*
+ * Session cache tests:
+ * 	auth again with the same password (pass, resumed without AUTH)
+ * 	auth again once the server forgot the token (pass, full AUTH)
+ */
+
+START_TEST (test_cache_resume)
+{
+	long auths = stat_count("cmd_auth", test_conn);
+	void *other = connect_auth();
+	fail_unless(stat_count("cmd_auth", test_conn) == auths, "Remembered session not used.");
+	fail_unless(stat_count("cmd_resume", test_conn) == 1, "Remembered session not resumed.");
+	storage_disconnect(other);
+}
+END_TEST
+
+START_TEST (test_cache_fallback)
+{
+	// A new server knows none of the tokens of the old one. Disconnecting would end the session, so the connection is left behind.
+	kill(test_serverpid, SIGKILL);
+	waitpid(test_serverpid, NULL, 0);
+	test_serverpid = start_server(SESSION_CONF, "restarted.serverout");
+	fail_unless(test_serverpid > 0, "Server didn't run properly again.");
+
+	test_conn = connect_auth();
+	fail_unless(stat_count("cmd_resume", test_conn) == 1, "Remembered session not tried.");
+	fail_unless(stat_count("cmd_auth", test_conn) == 1, "No full AUTH after the token was refused.");
+}
+END_TEST
+
+
+int main(int argc, char *argv[])
+{
+	if(argc == 2)
+		server_port = atoi(argv[1]);
+	else
+		server_port = SERVERPORT;
+	printf("Using server port: %d.\n", server_port);
+	Suite *s = suite_create("session");
+	TCase *tc;
+
+	// Token tests
+	tc = tcase_create("token");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_session, test_teardown);
+	tcase_add_test(tc, test_token_issue);
+	tcase_add_test(tc, test_token_resume);
+	tcase_add_test(tc, test_token_bad);
+	tcase_add_test(tc, test_token_expired);
+	suite_add_tcase(s, tc);
+
+	// Session cache tests
+	tc = tcase_create("cache");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_session, test_teardown);
+	tcase_add_test(tc, test_cache_resume);
+	tcase_add_test(tc, test_cache_fallback);
+	suite_add_tcase(s, tc);
+
+	SRunner *sr = srunner_create(s);
+	srunner_set_log(sr, "results.log");
+	srunner_run_all(sr, CK_ENV);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,337 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <check.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include "storage.h"
+
+#define TESTTIMEOUT	30		// How long to wait for each test to run.
+#define SERVEREXEC	"./server"	// Server executable file.
+#define SERVEROUT	"default.serverout"	// File where the server's output is stored.
+#define SERVEROUT_MODE	0666		// Permissions of the server ouptut file.
+#define SHARD_CONF	"shard%d.conf"	// Configuration file of each server, numbered from 1.
+#define NUMSERVERS	3		// Servers the keys are spread over.
+#define NUMKEYS		600		// Keys stored by the tests.
+#define MAXQUERYKEYS	10		// Keys a query copies out.
+
+// These settings should correspond to what's in the config file.
+#define SERVERHOST	"localhost"	// The hostname where the server is running.
+#define SERVERPORT	4848		// The port where the first server is running, the others run on the next ones.
+#define SERVERUSERNAME	"admin"		// The server username
+#define SERVERPASSWORD	"dog4sale"	// The server password
+#define THREECOLSTABLE	"threecols"	// A table with three columns.
+
+/* Port of the first server used by test */
+int server_port;
+
+/**
+ * @brief Start the storage server.
+ *
+ * @param config_file The configuration file the server should use.
+ * @param serverout_file File where server output is stored.
+ * @return Return server process id on success, or -1 otherwise.
+ */
+int start_server(char *config_file, const char *serverout_file)
+{
+	pid_t childpid = fork();
+	if (childpid < 0) {
+		// Failed to create child.
+		return -1;
+	} else if (childpid == 0) {
+		// The child.
+
+		// Redirect stdout and stderr to a file.
+		const char *outfile = serverout_file == NULL ? SERVEROUT : serverout_file;
+		int outfd = open(outfile, O_CREAT|O_WRONLY|O_TRUNC, SERVEROUT_MODE);
+		close(STDOUT_FILENO);
+		close(STDERR_FILENO);
+		if (dup2(outfd, STDOUT_FILENO) < 0 || dup2(outfd, STDERR_FILENO) < 0) {
+			perror("dup2 error");
+			return -1;
+		}
+
+		// Start the server
+		execl(SERVEREXEC, SERVEREXEC, config_file, NULL);
+
+		// Should never get here.
+		perror("Couldn't start server");
+		exit(EXIT_FAILURE);
+	} else {
+		// The parent.
+
+		// If the child terminates quickly, then there was probably a
+		// problem running the server (e.g., config file not found).
+		sleep(1);
+		int pid = waitpid(childpid, NULL, WNOHANG);
+		if (pid == childpid)
+			return -1; // Probably a problem starting the server.
+		else
+			return childpid; // Probably ok.
+	}
+}
+
+/**
+ * @brief Connect to servers and authenticate.
+ * @param hostname A server, or a list of them.
+ * @return A connection to the servers if successful.
+ */
+void* connect_auth(const char *hostname, int port)
+{
+	void *conn = storage_connect(hostname, port);
+	fail_unless(conn != NULL, "Couldn't connect to server.");
+
+	int status = storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn);
+	fail_unless(status == 0, "Authentication failed.");
+
+	return conn;
+}
+
+/**
+ * @brief Build the list of the first n servers, in the given order.
+ * @param order Server numbers from 0, or NULL for the natural order.
+ */
+void server_list(char *list, size_t len, int n, const int *order)
+{
+	size_t at = 0;
+	int i;
+	list[0] = '\0';
+	for (i = 0; i < n; i++)
+		at += snprintf(list + at, len - at, "%s%s:%d", (i == 0) ? "" : ",", SERVERHOST,
+				server_port + ((order == NULL) ? i : order[i]));
+}
+
+
+/// Sharded connection used by test fixture.
+void *test_conn = NULL;
+
+/// Servers started by test fixture, one more than NUMSERVERS to add one.
+int test_serverpids[NUMSERVERS + 1];
+
+/**
+ * @brief Text fixture setup.  Start the servers and store NUMKEYS keys over the first NUMSERVERS of them.
+ */
+void test_setup_shard()
+{
+	int i;
+	for (i = 0; i <= NUMSERVERS; i++) {
+		char conf[32], out[32];
+		snprintf(conf, sizeof conf, SHARD_CONF, i + 1);
+		snprintf(out, sizeof out, "shard%d.serverout", i + 1);
+		test_serverpids[i] = start_server(conf, out);
+		fail_unless(test_serverpids[i] > 0, "Server didn't run properly.");
+	}
+	char list[256];
+	server_list(list, sizeof list, NUMSERVERS, NULL);
+	test_conn = connect_auth(list, 0);
+
+	for (i = 0; i < NUMKEYS; i++) {
+		char key[MAX_KEY_LEN];
+		struct storage_record record;
+		memset(&record, 0, sizeof record);
+		snprintf(key, sizeof key, "key%d", i);
+		snprintf(record.value, sizeof record.value, "col1 %d,col2 0,col3 abc", i);
+		fail_unless(storage_set(THREECOLSTABLE, key, &record, test_conn) == 0, "Error setting a key/value pair.");
+	}
+}
+
+/**
+ * @brief Text fixture teardown.  Disconnect from the servers and stop them.
+ */
+void test_teardown()
+{
+	storage_disconnect(test_conn);
+	int i;
+	for (i = 0; i <= NUMSERVERS; i++) {
+		kill(test_serverpids[i], SIGKILL);
+		waitpid(test_serverpids[i], NULL, 0);
+	}
+}
+
+/**
+ * @brief Get key i and check its first column.
+ * @return Return 1 if it has the value stored by the fixture, 0 if the key is not found.
+ */
+int has_key(int i, void *conn)
+{
+	char key[MAX_KEY_LEN];
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	snprintf(key, sizeof key, "key%d", i);
+	if (storage_get(THREECOLSTABLE, key, &record, conn) != 0) {
+		fail_unless(errno == ERR_KEY_NOT_FOUND, "Error getting a key.");
+		return 0;
+	}
+	int col1 = -1;
+	fail_unless(sscanf(record.value, "col1 %d", &col1) == 1 && col1 == i, "Got wrong value.");
+	return 1;
+}
+
+
+/*
+ * Routing tests:
+ * 	get of every key stored (pass)
+ * 	each key stored on one server only (pass)
+ * 	servers listed in another order (pass, same owners)
+ */
+
+START_TEST (test_route_get)
+{
+	int i;
+	for (i = 0; i < NUMKEYS; i++)
+		fail_unless(has_key(i, test_conn), "Key stored through the sharded connection not found.");
+}
+END_TEST
+
+START_TEST (test_route_owner)
+{
+	void *servers[NUMSERVERS];
+	int i, j, used = 0;
+	for (j = 0; j < NUMSERVERS; j++)
+		servers[j] = connect_auth(SERVERHOST, server_port + j);
+	for (i = 0; i < NUMKEYS; i++) {
+		int owners = 0;
+		for (j = 0; j < NUMSERVERS; j++)
+			if (has_key(i, servers[j])) {
+				owners++;
+				used |= 1 << j;
+			}
+		fail_unless(owners == 1, "Key not stored on exactly one server.");
+	}
+	fail_unless(used == (1 << NUMSERVERS) - 1, "A server got no key.");
+	for (j = 0; j < NUMSERVERS; j++)
+		storage_disconnect(servers[j]);
+}
+END_TEST
+
+START_TEST (test_route_order)
+{
+	int reversed[NUMSERVERS];
+	int i;
+	for (i = 0; i < NUMSERVERS; i++)
+		reversed[i] = NUMSERVERS - 1 - i;
+	char list[256];
+	server_list(list, sizeof list, NUMSERVERS, reversed);
+	void *conn = connect_auth(list, 0);
+	for (i = 0; i < NUMKEYS; i++)
+		fail_unless(has_key(i, conn), "Key not found with the servers in another order.");
+	storage_disconnect(conn);
+}
+END_TEST
+
+
+/*
+ * Query tests:
+ * 	query matching keys on every server (pass, matches counted over all)
+ * 	query of an unknown table (fail)
+ */
+
+START_TEST (test_query_merge)
+{
+	char *keys[MAXQUERYKEYS];
+	int i;
+	for (i = 0; i < MAXQUERYKEYS; i++)
+		keys[i] = calloc(MAX_KEY_LEN, 1);
+	int matches = storage_query(THREECOLSTABLE, "col1 < 100", keys, MAXQUERYKEYS, test_conn);
+	fail_unless(matches == 100, "Matches of every server not counted.");
+	for (i = 0; i < MAXQUERYKEYS; i++) {
+		int n = -1;
+		fail_unless(sscanf(keys[i], "key%d", &n) == 1 && n >= 0 && n < 100, "Query returned a key that doesn't match.");
+		free(keys[i]);
+	}
+}
+END_TEST
+
+START_TEST (test_query_badtable)
+{
+	char *keys[1] = { NULL };
+	char key[MAX_KEY_LEN];
+	keys[0] = key;
+	int matches = storage_query("badtable", "col1 < 100", keys, 1, test_conn);
+	fail_unless(matches == -1, "storage_query of an unknown table should fail.");
+	fail_unless(errno == ERR_TABLE_NOT_FOUND, "storage_query of an unknown table not setting errno properly.");
+}
+END_TEST
+
+
+/*
+ * Rebalance tests:
+ * 	one server added to the list (pass, about one key in NUMSERVERS + 1 moves, only to it)
+ */
+
+START_TEST (test_rebalance_add)
+{
+	char list[256];
+	server_list(list, sizeof list, NUMSERVERS + 1, NULL);
+	void *conn = connect_auth(list, 0);
+	void *added = connect_auth(SERVERHOST, server_port + NUMSERVERS);
+
+	// The added server starts empty, so a moved key is not found, and any other key still is
+	int i, moved = 0;
+	for (i = 0; i < NUMKEYS; i++) {
+		if (has_key(i, conn))
+			continue;
+		moved++;
+		char key[MAX_KEY_LEN];
+		struct storage_record record;
+		snprintf(key, sizeof key, "key%d", i);
+		snprintf(record.value, sizeof record.value, "col1 %d,col2 0,col3 abc", i);
+		record.metadata[0] = 0;
+		fail_unless(storage_set(THREECOLSTABLE, key, &record, conn) == 0, "Error setting a key/value pair.");
+		fail_unless(has_key(i, added), "Key moved to a server other than the one added.");
+	}
+	int ideal = NUMKEYS / (NUMSERVERS + 1);
+	fail_unless(moved > ideal / 2 && moved < ideal * 3 / 2, "Far from one key in NUMSERVERS + 1 moved.");
+	storage_disconnect(added);
+	storage_disconnect(conn);
+}
+END_TEST
+
+
+int main(int argc, char *argv[])
+{
+	if(argc == 2)
+		server_port = atoi(argv[1]);
+	else
+		server_port = SERVERPORT;
+	printf("Using server ports: %d to %d.\n", server_port, server_port + NUMSERVERS);
+	Suite *s = suite_create("shard");
+	TCase *tc;
+
+	// Routing tests
+	tc = tcase_create("route");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_shard, test_teardown);
+	tcase_add_test(tc, test_route_get);
+	tcase_add_test(tc, test_route_owner);
+	tcase_add_test(tc, test_route_order);
+	suite_add_tcase(s, tc);
+
+	// Query tests
+	tc = tcase_create("query");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_shard, test_teardown);
+	tcase_add_test(tc, test_query_merge);
+	tcase_add_test(tc, test_query_badtable);
+	suite_add_tcase(s, tc);
+
+	// Rebalance tests
+	tc = tcase_create("rebalance");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_shard, test_teardown);
+	tcase_add_test(tc, test_rebalance_add);
+	suite_add_tcase(s, tc);
+
+	SRunner *sr = srunner_create(s);
+	srunner_set_log(sr, "results.log");
+	srunner_run_all(sr, CK_ENV);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
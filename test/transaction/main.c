@@ -0,0 +1,349 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <check.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include "storage.h"
+
+#define TESTTIMEOUT	10		// How long to wait for each test to run.
+#define SERVEREXEC	"./server"	// Server executable file.
+#define SERVEROUT	"default.serverout"	// File where the server's output is stored.
+#define SERVEROUT_MODE	0666		// Permissions of the server ouptut file.
+#define COMPLEXTABLES_CONF	"conf-complextables.conf"	// Server configuration file with a three column table.
+#define KEY1		"somekey1"	// A key used in the test cases.
+#define KEY2		"somekey2"	// A key used in the test cases.
+
+// These settings should correspond to what's in the config file.
+#define SERVERHOST	"localhost"	// The hostname where the server is running.
+#define SERVERPORT	4848		// The port where the server is running.
+#define SERVERUSERNAME	"admin"		// The server username
+#define SERVERPASSWORD	"dog4sale"	// The server password
+#define THREECOLSTABLE	"threecols"	// A table with three columns.
+
+/* Server port used by test */
+int server_port;
+
+/**
+ * @brief Start the storage server.
+ *
+ * @param config_file The configuration file the server should use.
+ * @param serverout_file File where server output is stored.
+ * @return Return server process id on success, or -1 otherwise.
+ */
+int start_server(char *config_file, const char *serverout_file)
+{
+	pid_t childpid = fork();
+	if (childpid < 0) {
+		// Failed to create child.
+		return -1;
+	} else if (childpid == 0) {
+		// The child.
+
+		// Redirect stdout and stderr to a file.
+		const char *outfile = serverout_file == NULL ? SERVEROUT : serverout_file;
+		int outfd = open(outfile, O_CREAT|O_WRONLY|O_TRUNC, SERVEROUT_MODE);
+		close(STDOUT_FILENO);
+		close(STDERR_FILENO);
+		if (dup2(outfd, STDOUT_FILENO) < 0 || dup2(outfd, STDERR_FILENO) < 0) {
+			perror("dup2 error");
+			return -1;
+		}
+
+		// Start the server
+		execl(SERVEREXEC, SERVEREXEC, config_file, NULL);
+
+		// Should never get here.
+		perror("Couldn't start server");
+		exit(EXIT_FAILURE);
+	} else {
+		// The parent.
+
+		// If the child terminates quickly, then there was probably a
+		// problem running the server (e.g., config file not found).
+		sleep(1);
+		int pid = waitpid(childpid, NULL, WNOHANG);
+		if (pid == childpid)
+			return -1; // Probably a problem starting the server.
+		else
+			return childpid; // Probably ok.
+	}
+}
+
+/**
+ * @brief Connect to the server and authenticate.
+ * @return A connection to the server if successful.
+ */
+void* connect_auth()
+{
+	void *conn = storage_connect(SERVERHOST, server_port);
+	fail_unless(conn != NULL, "Couldn't connect to server.");
+
+	int status = storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn);
+	fail_unless(status == 0, "Authentication failed.");
+
+	return conn;
+}
+
+
+/// Connection used by test fixture.
+void *test_conn = NULL;
+
+/// Server started by test fixture.
+int test_serverpid = -1;
+
+/**
+ * @brief Text fixture setup.  Start the server with a three column table and store two records.
+ */
+void test_setup_complex_populate()
+{
+	test_serverpid = start_server(COMPLEXTABLES_CONF, "complexdata.serverout");
+	fail_unless(test_serverpid > 0, "Server didn't run properly.");
+	test_conn = connect_auth();
+
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	strncpy(record.value, "col1 1,col2 2,col3 abc", sizeof record.value);
+	int status = storage_set(THREECOLSTABLE, KEY1, &record, test_conn);
+	fail_unless(status == 0, "Error setting a key/value pair.");
+	strncpy(record.value, "col1 3,col2 4,col3 def", sizeof record.value);
+	status = storage_set(THREECOLSTABLE, KEY2, &record, test_conn);
+	fail_unless(status == 0, "Error setting a key/value pair.");
+}
+
+/**
+ * @brief Text fixture teardown.  Disconnect from the server and stop it.
+ */
+void test_teardown()
+{
+	storage_disconnect(test_conn);
+	kill(test_serverpid, SIGKILL);
+	waitpid(test_serverpid, NULL, 0);
+}
+
+
+/**
+ * @brief Get a record and check its first column.
+ * @return The value of col1, or -1 if the get failed.
+ */
+int get_col1(const char *key, void *conn)
+{
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	int col1 = -1;
+	if (storage_get(THREECOLSTABLE, key, &record, conn) != 0)
+		return -1;
+	fail_unless(sscanf(record.value, "col1 %d", &col1) == 1, "Got wrong value.");
+	return col1;
+}
+
+
+/*
+ * Commit tests:
+ * 	get a key written earlier in the transaction (pass, buffered value)
+ * 	writes stay invisible to other connections until commit (pass)
+ * 	commit after another connection changed a key read (fail, abort)
+ */
+
+START_TEST (test_txncommit_readownwrite)
+{
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	void *other = connect_auth();
+
+	int status = storage_begin(test_conn);
+	fail_unless(status == 0, "Error starting a transaction.");
+	strncpy(record.value, "col1 5,col2 6,col3 xyz", sizeof record.value);
+	status = storage_set(THREECOLSTABLE, KEY1, &record, test_conn);
+	fail_unless(status == 0, "Error setting a key/value pair in a transaction.");
+
+	fail_unless(get_col1(KEY1, test_conn) == 5, "Transaction doesn't see its own write.");
+	fail_unless(get_col1(KEY1, other) == 1, "Write visible before commit.");
+
+	status = storage_commit(test_conn);
+	fail_unless(status == 0, "Error committing a transaction.");
+	fail_unless(get_col1(KEY1, other) == 5, "Write not visible after commit.");
+	storage_disconnect(other);
+}
+END_TEST
+
+START_TEST (test_txncommit_conflict)
+{
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	void *other = connect_auth();
+
+	int status = storage_begin(test_conn);
+	fail_unless(status == 0, "Error starting a transaction.");
+	fail_unless(get_col1(KEY1, test_conn) == 1, "Got wrong value.");
+
+	// Another connection changes the key read.
+	strncpy(record.value, "col1 9,col2 9,col3 zzz", sizeof record.value);
+	status = storage_set(THREECOLSTABLE, KEY1, &record, other);
+	fail_unless(status == 0, "Error setting a key/value pair.");
+
+	strncpy(record.value, "col1 7,col2 7,col3 yyy", sizeof record.value);
+	status = storage_set(THREECOLSTABLE, KEY2, &record, test_conn);
+	fail_unless(status == 0, "Error setting a key/value pair in a transaction.");
+
+	status = storage_commit(test_conn);
+	fail_unless(status == -1, "storage_commit after a conflicting write should fail.");
+	fail_unless(errno == ERR_TRANSACTION_ABORT, "storage_commit for aborted transaction not setting errno properly.");
+	fail_unless(get_col1(KEY2, test_conn) == 3, "Aborted transaction wrote a key.");
+	storage_disconnect(other);
+}
+END_TEST
+
+
+/*
+ * Abort tests:
+ * 	abort discards the writes of the transaction (pass)
+ */
+
+START_TEST (test_txnabort_discard)
+{
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+
+	int status = storage_begin(test_conn);
+	fail_unless(status == 0, "Error starting a transaction.");
+	strncpy(record.value, "col1 5,col2 6,col3 xyz", sizeof record.value);
+	status = storage_set(THREECOLSTABLE, KEY1, &record, test_conn);
+	fail_unless(status == 0, "Error setting a key/value pair in a transaction.");
+
+	status = storage_abort(test_conn);
+	fail_unless(status == 0, "Error aborting a transaction.");
+	fail_unless(get_col1(KEY1, test_conn) == 1, "Aborted transaction wrote a key.");
+}
+END_TEST
+
+
+/*
+ * Transaction tests with invalid use:
+ * 	begin inside a transaction (fail)
+ * 	commit or abort outside a transaction (fail)
+ */
+
+START_TEST (test_txninvalid_nested)
+{
+	int status = storage_begin(test_conn);
+	fail_unless(status == 0, "Error starting a transaction.");
+	status = storage_begin(test_conn);
+	fail_unless(status == -1, "Nested storage_begin should fail.");
+	fail_unless(errno == ERR_INVALID_PARAM, "Nested storage_begin not setting errno properly.");
+	status = storage_commit(test_conn);
+	fail_unless(status == 0, "Error committing a transaction.");
+}
+END_TEST
+
+START_TEST (test_txninvalid_notopen)
+{
+	int status = storage_commit(test_conn);
+	fail_unless(status == -1, "storage_commit without a transaction should fail.");
+	fail_unless(errno == ERR_INVALID_PARAM, "storage_commit without a transaction not setting errno properly.");
+	status = storage_abort(test_conn);
+	fail_unless(status == -1, "storage_abort without a transaction should fail.");
+	fail_unless(errno == ERR_INVALID_PARAM, "storage_abort without a transaction not setting errno properly.");
+}
+END_TEST
+
+
+/*
+ * Delete tests inside a transaction:
+ * 	get a key deleted earlier in the transaction (fail, key not found)
+ * 	commit the delete of a missing key (fail, abort)
+ */
+
+START_TEST (test_txndelete_getdeleted)
+{
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+
+	int status = storage_begin(test_conn);
+	fail_unless(status == 0, "Error starting a transaction.");
+
+	// The delete carries one value, the table has three columns.
+	status = storage_set(THREECOLSTABLE, KEY1, NULL, test_conn);
+	fail_unless(status == 0, "Error deleting a key in a transaction.");
+
+	status = storage_get(THREECOLSTABLE, KEY1, &record, test_conn);
+	fail_unless(status == -1, "storage_get of a key deleted in the transaction should fail.");
+	fail_unless(errno == ERR_KEY_NOT_FOUND, "storage_get of a deleted key not setting errno properly.");
+
+	status = storage_commit(test_conn);
+	fail_unless(status == 0, "Error committing a transaction.");
+
+	status = storage_get(THREECOLSTABLE, KEY1, &record, test_conn);
+	fail_unless(status == -1 && errno == ERR_KEY_NOT_FOUND, "Key deleted by the transaction is still there.");
+	status = storage_get(THREECOLSTABLE, KEY2, &record, test_conn);
+	fail_unless(status == 0, "The server stopped serving after the delete.");
+}
+END_TEST
+
+START_TEST (test_txndelete_missingkey)
+{
+	int status = storage_begin(test_conn);
+	fail_unless(status == 0, "Error starting a transaction.");
+	status = storage_set(THREECOLSTABLE, "missingkey", NULL, test_conn);
+	fail_unless(status == 0, "Error deleting a key in a transaction.");
+	status = storage_commit(test_conn);
+	fail_unless(status == -1, "Commit deleting a missing key should fail.");
+	fail_unless(errno == ERR_TRANSACTION_ABORT, "Commit deleting a missing key not setting errno properly.");
+}
+END_TEST
+
+
+int main(int argc, char *argv[])
+{
+	if(argc == 2)
+		server_port = atoi(argv[1]);
+	else
+		server_port = SERVERPORT;
+	printf("Using server port: %d.\n", server_port);
+	Suite *s = suite_create("transaction");
+	TCase *tc;
+
+	// Commit tests
+	tc = tcase_create("txncommit");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_complex_populate, test_teardown);
+	tcase_add_test(tc, test_txncommit_readownwrite);
+	tcase_add_test(tc, test_txncommit_conflict);
+	suite_add_tcase(s, tc);
+
+	// Abort tests
+	tc = tcase_create("txnabort");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_complex_populate, test_teardown);
+	tcase_add_test(tc, test_txnabort_discard);
+	suite_add_tcase(s, tc);
+
+	// Transaction tests with invalid use
+	tc = tcase_create("txninvalid");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_complex_populate, test_teardown);
+	tcase_add_test(tc, test_txninvalid_nested);
+	tcase_add_test(tc, test_txninvalid_notopen);
+	suite_add_tcase(s, tc);
+
+	// Delete tests inside a transaction
+	tc = tcase_create("txndelete");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_complex_populate, test_teardown);
+	tcase_add_test(tc, test_txndelete_getdeleted);
+	tcase_add_test(tc, test_txndelete_missingkey);
+	suite_add_tcase(s, tc);
+
+	SRunner *sr = srunner_create(s);
+	srunner_set_log(sr, "results.log");
+	srunner_run_all(sr, CK_ENV);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,428 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <check.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include "storage.h"
+#include "watch.h"
+
+#define TESTTIMEOUT	30		// How long to wait for each test to run.
+#define SERVEREXEC	"./server"	// Server executable file.
+#define SERVEROUT	"default.serverout"	// File where the server's output is stored.
+#define SERVEROUT_MODE	0666		// Permissions of the server ouptut file.
+#define WATCH_CONF	"conf-watch.conf"	// Server configuration file with a three column table.
+#define NOTETIMEOUT	500		// Milliseconds to wait for a change that should come.
+#define NONETIMEOUT	200		// Milliseconds to wait for a change that should not come.
+#define LOSSYWRITES	(2 * WATCH_QUEUE_LEN)	// Writes of one commit that overflow the queue of a watcher.
+#define CLIENTWRITES	(2 * WATCH_PENDING)	// Writes that overflow the changes a client connection keeps.
+#define KEY1		"somekey1"	// A key used in the test cases.
+#define KEY2		"somekey2"	// A key used in the test cases.
+#define OTHERKEY	"otherkey"	// A key no prefix of the test cases matches.
+
+// These settings should correspond to what's in the config file.
+#define SERVERHOST	"localhost"	// The hostname where the server is running.
+#define SERVERPORT	4848		// The port where the server is running.
+#define SERVERUSERNAME	"admin"		// The server username
+#define SERVERPASSWORD	"dog4sale"	// The server password
+#define THREECOLSTABLE	"threecols"	// A table with three columns.
+
+/* Server port used by test */
+int server_port;
+
+/**
+ * @brief Start the storage server.
+ *
+ * @param config_file The configuration file the server should use.
+ * @param serverout_file File where server output is stored.
+ * @return Return server process id on success, or -1 otherwise.
+ */
+int start_server(char *config_file, const char *serverout_file)
+{
+	pid_t childpid = fork();
+	if (childpid < 0) {
+		// Failed to create child.
+		return -1;
+	} else if (childpid == 0) {
+		// The child.
+
+		// Redirect stdout and stderr to a file.
+		const char *outfile = serverout_file == NULL ? SERVEROUT : serverout_file;
+		int outfd = open(outfile, O_CREAT|O_WRONLY|O_TRUNC, SERVEROUT_MODE);
+		close(STDOUT_FILENO);
+		close(STDERR_FILENO);
+		if (dup2(outfd, STDOUT_FILENO) < 0 || dup2(outfd, STDERR_FILENO) < 0) {
+			perror("dup2 error");
+			return -1;
+		}
+
+		// Start the server
+		execl(SERVEREXEC, SERVEREXEC, config_file, NULL);
+
+		// Should never get here.
+		perror("Couldn't start server");
+		exit(EXIT_FAILURE);
+	} else {
+		// The parent.
+
+		// If the child terminates quickly, then there was probably a
+		// problem running the server (e.g., config file not found).
+		sleep(1);
+		int pid = waitpid(childpid, NULL, WNOHANG);
+		if (pid == childpid)
+			return -1; // Probably a problem starting the server.
+		else
+			return childpid; // Probably ok.
+	}
+}
+
+/**
+ * @brief Connect to the server and authenticate.
+ * @return A connection to the server if successful.
+ */
+void* connect_auth()
+{
+	void *conn = storage_connect(SERVERHOST, server_port);
+	fail_unless(conn != NULL, "Couldn't connect to server.");
+
+	int status = storage_auth(SERVERUSERNAME, SERVERPASSWORD, conn);
+	fail_unless(status == 0, "Authentication failed.");
+
+	return conn;
+}
+
+
+/// Connections used by test fixture: one watches, the other writes.
+void *test_conn = NULL;
+void *writer_conn = NULL;
+
+/// Server started by test fixture.
+int test_serverpid = -1;
+
+/**
+ * @brief Text fixture setup.  Start the server with a three column table and open two connections.
+ */
+void test_setup_watch()
+{
+	test_serverpid = start_server(WATCH_CONF, "watch.serverout");
+	fail_unless(test_serverpid > 0, "Server didn't run properly.");
+	test_conn = connect_auth();
+	writer_conn = connect_auth();
+}
+
+/**
+ * @brief Text fixture teardown.  Disconnect from the server and stop it.
+ */
+void test_teardown()
+{
+	storage_disconnect(writer_conn);
+	storage_disconnect(test_conn);
+	kill(test_serverpid, SIGKILL);
+	waitpid(test_serverpid, NULL, 0);
+}
+
+
+/**
+ * @brief Set a key with the given first column.
+ * @return Return 0 on success, -1 otherwise.
+ */
+int set_col1(const char *key, int col1, void *conn)
+{
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	snprintf(record.value, sizeof record.value, "col1 %d,col2 0,col3 abc", col1);
+	return storage_set(THREECOLSTABLE, key, &record, conn);
+}
+
+/**
+ * @brief Get a record and check its first column.
+ * @return The value of col1, or -1 if the get failed.
+ */
+int get_col1(const char *key, void *conn)
+{
+	struct storage_record record;
+	memset(&record, 0, sizeof record);
+	int col1 = -1;
+	if (storage_get(THREECOLSTABLE, key, &record, conn) != 0)
+		return -1;
+	fail_unless(sscanf(record.value, "col1 %d", &col1) == 1, "Got wrong value.");
+	return col1;
+}
+
+/**
+ * @brief Take the next change on test_conn and check it is of key.
+ */
+void expect_note(const char *key)
+{
+	char table[MAX_TABLE_LEN], changed[MAX_KEY_LEN];
+	int status = storage_notification(table, changed, NOTETIMEOUT, test_conn);
+	fail_unless(status == 1, "Change of a watched key not delivered.");
+	fail_unless(strcmp(table, THREECOLSTABLE) == 0 && strcmp(changed, key) == 0, "Wrong change delivered.");
+}
+
+/**
+ * @brief Check no change comes on test_conn.
+ */
+void expect_none()
+{
+	char table[MAX_TABLE_LEN], changed[MAX_KEY_LEN];
+	int status = storage_notification(table, changed, NONETIMEOUT, test_conn);
+	fail_unless(status == 0, "Change of a key not watched delivered.");
+}
+
+
+/*
+ * Watch tests:
+ * 	set of a watched key (pass, pushed)
+ * 	set of a key not watched (no change)
+ * 	set after unwatch (no change)
+ * 	unknown table (fail)
+ */
+
+START_TEST (test_watch_key)
+{
+	int status = storage_watch(THREECOLSTABLE, KEY1, test_conn);
+	fail_unless(status == 0, "Error watching a key.");
+	fail_unless(set_col1(KEY2, 1, writer_conn) == 0, "Error setting a key/value pair.");
+	fail_unless(set_col1(KEY1, 1, writer_conn) == 0, "Error setting a key/value pair.");
+	expect_note(KEY1);
+	expect_none();
+}
+END_TEST
+
+START_TEST (test_watch_unwatch)
+{
+	int status = storage_watch(THREECOLSTABLE, KEY1, test_conn);
+	fail_unless(status == 0, "Error watching a key.");
+	status = storage_unwatch(THREECOLSTABLE, KEY1, test_conn);
+	fail_unless(status == 0, "Error unwatching a key.");
+	fail_unless(set_col1(KEY1, 1, writer_conn) == 0, "Error setting a key/value pair.");
+	expect_none();
+}
+END_TEST
+
+START_TEST (test_watch_badtable)
+{
+	int status = storage_watch("badtable", KEY1, test_conn);
+	fail_unless(status == -1, "storage_watch of an unknown table should fail.");
+	fail_unless(errno == ERR_TABLE_NOT_FOUND, "storage_watch of an unknown table not setting errno properly.");
+}
+END_TEST
+
+
+/*
+ * Prefix tests:
+ * 	set of a key starting with the prefix (pass, pushed)
+ * 	set of a key not starting with it (no change)
+ * 	'*' alone (pass, every key pushed)
+ */
+
+START_TEST (test_prefix_match)
+{
+	int status = storage_watch(THREECOLSTABLE, "somekey*", test_conn);
+	fail_unless(status == 0, "Error watching a prefix.");
+	fail_unless(set_col1(OTHERKEY, 1, writer_conn) == 0, "Error setting a key/value pair.");
+	fail_unless(set_col1(KEY2, 1, writer_conn) == 0, "Error setting a key/value pair.");
+	expect_note(KEY2);
+	expect_none();
+}
+END_TEST
+
+START_TEST (test_prefix_table)
+{
+	int status = storage_watch(THREECOLSTABLE, "*", test_conn);
+	fail_unless(status == 0, "Error watching a table.");
+	fail_unless(set_col1(OTHERKEY, 1, writer_conn) == 0, "Error setting a key/value pair.");
+	fail_unless(set_col1(KEY1, 1, writer_conn) == 0, "Error setting a key/value pair.");
+	expect_note(OTHERKEY);
+	expect_note(KEY1);
+}
+END_TEST
+
+
+/*
+ * Commit tests:
+ * 	commit writing watched keys (pass, each pushed)
+ * 	aborted transaction (no change)
+ */
+
+START_TEST (test_commit_notify)
+{
+	int status = storage_watch(THREECOLSTABLE, "somekey*", test_conn);
+	fail_unless(status == 0, "Error watching a prefix.");
+	status = storage_begin(writer_conn);
+	fail_unless(status == 0, "Error starting a transaction.");
+	fail_unless(set_col1(KEY1, 1, writer_conn) == 0, "Error setting a key/value pair in a transaction.");
+	fail_unless(set_col1(KEY2, 2, writer_conn) == 0, "Error setting a key/value pair in a transaction.");
+	expect_none();
+	status = storage_commit(writer_conn);
+	fail_unless(status == 0, "Error committing a transaction.");
+	expect_note(KEY1);
+	expect_note(KEY2);
+}
+END_TEST
+
+START_TEST (test_commit_abort)
+{
+	int status = storage_watch(THREECOLSTABLE, "somekey*", test_conn);
+	fail_unless(status == 0, "Error watching a prefix.");
+	status = storage_begin(writer_conn);
+	fail_unless(status == 0, "Error starting a transaction.");
+	fail_unless(set_col1(KEY1, 1, writer_conn) == 0, "Error setting a key/value pair in a transaction.");
+	status = storage_abort(writer_conn);
+	fail_unless(status == 0, "Error aborting a transaction.");
+	expect_none();
+}
+END_TEST
+
+
+/*
+ * Lossy tests:
+ * 	commit of more keys than the queue of the watcher holds (pass, "2,*,*" pushed)
+ * 	more changes than the client keeps during a call (pass, "*" taken first)
+ */
+
+START_TEST (test_lossy_server)
+{
+	int status = storage_watch(THREECOLSTABLE, "*", test_conn);
+	fail_unless(status == 0, "Error watching a table.");
+
+	// The commit runs on the thread of the watcher, which cannot send the changes meanwhile
+	status = storage_begin(test_conn);
+	fail_unless(status == 0, "Error starting a transaction.");
+	int i;
+	for (i = 0; i < LOSSYWRITES; i++) {
+		char key[MAX_KEY_LEN];
+		snprintf(key, sizeof key, "lossy%d", i);
+		fail_unless(set_col1(key, i, test_conn) == 0, "Error setting a key/value pair in a transaction.");
+	}
+	status = storage_commit(test_conn);
+	fail_unless(status == 0, "Error committing a transaction.");
+
+	char table[MAX_TABLE_LEN], key[MAX_KEY_LEN];
+	status = storage_notification(table, key, NOTETIMEOUT, test_conn);
+	fail_unless(status == 1, "Lost changes not reported.");
+	fail_unless(strcmp(table, "*") == 0 && strcmp(key, "*") == 0, "Overflow of the queue of a watcher not reported first.");
+	int changes = 0;
+	while (storage_notification(table, key, NONETIMEOUT, test_conn) == 1)
+		changes++;
+	fail_unless(changes <= WATCH_QUEUE_LEN, "More changes delivered than WATCH_QUEUE_LEN.");
+}
+END_TEST
+
+START_TEST (test_lossy_client)
+{
+	int status = storage_watch(THREECOLSTABLE, "*", test_conn);
+	fail_unless(status == 0, "Error watching a table.");
+	int i;
+	for (i = 0; i < CLIENTWRITES; i++)
+		fail_unless(set_col1(KEY1, i, writer_conn) == 0, "Error setting a key/value pair.");
+
+	// The changes come in before the reply of the get, and are kept
+	fail_unless(get_col1(KEY1, test_conn) == CLIENTWRITES - 1, "Got wrong value.");
+	char table[MAX_TABLE_LEN], key[MAX_KEY_LEN];
+	status = storage_notification(table, key, NOTETIMEOUT, test_conn);
+	fail_unless(status == 1, "Lost changes not reported.");
+	fail_unless(strcmp(table, "*") == 0 && strcmp(key, "*") == 0, "Overflow of the kept changes not reported first.");
+	int kept = 0;
+	while (storage_notification(table, key, NONETIMEOUT, test_conn) == 1)
+		kept++;
+	fail_unless(kept < WATCH_PENDING, "More changes kept than WATCH_PENDING.");
+}
+END_TEST
+
+
+/*
+ * Cache tests:
+ * 	change taken with storage_notification (pass, cached record dropped)
+ * 	change pushed during another call (pass, cached record dropped)
+ */
+
+START_TEST (test_cache_evict)
+{
+	int status = storage_cache_config(64, 60000);
+	fail_unless(status == 0, "Error turning the read cache on.");
+	fail_unless(set_col1(KEY1, 1, test_conn) == 0, "Error setting a key/value pair.");
+	fail_unless(set_col1(KEY2, 1, test_conn) == 0, "Error setting a key/value pair.");
+	status = storage_watch(THREECOLSTABLE, KEY1, test_conn);
+	fail_unless(status == 0, "Error watching a key.");
+	fail_unless(get_col1(KEY1, test_conn) == 1, "Got wrong value.");
+
+	fail_unless(set_col1(KEY1, 2, writer_conn) == 0, "Error setting a key/value pair.");
+	expect_note(KEY1);
+	fail_unless(get_col1(KEY1, test_conn) == 2, "Cached record not dropped by the change.");
+
+	// Taken in while the reply of another key is read
+	fail_unless(set_col1(KEY1, 3, writer_conn) == 0, "Error setting a key/value pair.");
+	char stats[4096];
+	status = storage_stats(stats, sizeof stats, test_conn);
+	fail_unless(status == 0, "Error getting statistics.");
+	fail_unless(get_col1(KEY1, test_conn) == 3, "Cached record not dropped by a change kept.");
+	expect_note(KEY1);
+}
+END_TEST
+
+
+int main(int argc, char *argv[])
+{
+	if(argc == 2)
+		server_port = atoi(argv[1]);
+	else
+		server_port = SERVERPORT;
+	printf("Using server port: %d.\n", server_port);
+	Suite *s = suite_create("watch");
+	TCase *tc;
+
+	// Watch tests
+	tc = tcase_create("watch");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_watch, test_teardown);
+	tcase_add_test(tc, test_watch_key);
+	tcase_add_test(tc, test_watch_unwatch);
+	tcase_add_test(tc, test_watch_badtable);
+	suite_add_tcase(s, tc);
+
+	// Prefix tests
+	tc = tcase_create("prefix");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_watch, test_teardown);
+	tcase_add_test(tc, test_prefix_match);
+	tcase_add_test(tc, test_prefix_table);
+	suite_add_tcase(s, tc);
+
+	// Commit tests
+	tc = tcase_create("commit");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_watch, test_teardown);
+	tcase_add_test(tc, test_commit_notify);
+	tcase_add_test(tc, test_commit_abort);
+	suite_add_tcase(s, tc);
+
+	// Lossy tests
+	tc = tcase_create("lossy");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_watch, test_teardown);
+	tcase_add_test(tc, test_lossy_server);
+	tcase_add_test(tc, test_lossy_client);
+	suite_add_tcase(s, tc);
+
+	// Cache tests
+	tc = tcase_create("cache");
+	tcase_set_timeout(tc, TESTTIMEOUT);
+	tcase_add_checked_fixture(tc, test_setup_watch, test_teardown);
+	tcase_add_test(tc, test_cache_evict);
+	suite_add_tcase(s, tc);
+
+	SRunner *sr = srunner_create(s);
+	srunner_set_log(sr, "results.log");
+	srunner_run_all(sr, CK_ENV);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}